@@ -24,6 +24,7 @@
 #include "Firestore/core/src/util/error_apple.h"
 
 using firebase::firestore::api::AggregateQuery;
+using firebase::firestore::api::AggregateSource;
 using firebase::firestore::model::AggregateField;
 using firebase::firestore::model::ObjectValue;
 using firebase::firestore::util::StatusOr;
@@ -76,14 +77,18 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)aggregationWithSource:(FIRAggregateSource)source
                    completion:(void (^)(FIRAggregateQuerySnapshot *_Nullable snapshot,
                                         NSError *_Nullable error))completion {
-  _aggregateQuery->GetAggregate([self, completion](const StatusOr<ObjectValue> &result) {
-    if (result.ok()) {
-      completion([[FIRAggregateQuerySnapshot alloc] initWithObject:result.ValueOrDie() query:self],
-                 nil);
-    } else {
-      completion(nil, MakeNSError(result.status()));
-    }
-  });
+  AggregateSource aggregateSource =
+      source == FIRAggregateSourceCache ? AggregateSource::Cache : AggregateSource::Server;
+  _aggregateQuery->GetAggregate(
+      aggregateSource, [self, completion](const StatusOr<ObjectValue> &result) {
+        if (result.ok()) {
+          completion([[FIRAggregateQuerySnapshot alloc] initWithObject:result.ValueOrDie()
+                                                                 query:self],
+                     nil);
+        } else {
+          completion(nil, MakeNSError(result.status()));
+        }
+      });
 }
 
 @end
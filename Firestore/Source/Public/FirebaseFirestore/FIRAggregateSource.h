@@ -37,6 +37,16 @@ typedef NS_ENUM(NSUInteger, FIRAggregateSource) {
    * offline.
    */
   FIRAggregateSourceServer,
+
+  /**
+   * Perform the aggregation over the documents in the local cache.
+   *
+   * The result takes local modifications that are not yet synchronized with the server into
+   * account, but not documents that are missing from the cache. When a client-side index fully
+   * covers the query, count aggregations are computed from the index entries without reading the
+   * documents.
+   */
+  FIRAggregateSourceCache,
 } NS_SWIFT_NAME(AggregateSource);
 
 NS_ASSUME_NONNULL_END
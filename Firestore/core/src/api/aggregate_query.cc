@@ -48,6 +48,16 @@ void AggregateQuery::GetAggregate(AggregateQueryCallback&& callback) {
                                                   std::move(callback));
 }
 
+void AggregateQuery::GetAggregate(AggregateSource source,
+                                  AggregateQueryCallback&& callback) {
+  if (source == AggregateSource::Cache) {
+    query_.firestore()->client()->RunAggregateQueryFromLocalCache(
+        query_.query(), aggregates_, std::move(callback));
+    return;
+  }
+  GetAggregate(std::move(callback));
+}
+
 // TODO(b/280805906) Remove this count specific API after the c++ SDK migrates
 // to the new Aggregate API
 void AggregateQuery::Get(CountQueryCallback&& callback) {
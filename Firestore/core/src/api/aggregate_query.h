@@ -18,6 +18,7 @@
 
 #include <vector>
 
+#include "Firestore/core/src/api/aggregate_source.h"
 #include "Firestore/core/src/api/query_core.h"
 
 using firebase::firestore::model::AggregateField;
@@ -53,6 +54,12 @@ class AggregateQuery {
   // when the tests and mocking are removed.
   virtual void GetAggregate(AggregateQueryCallback&& callback);
 
+  /**
+   * Computes the aggregations from the given source. `GetAggregate(callback)`
+   * computes them on the server.
+   */
+  void GetAggregate(AggregateSource source, AggregateQueryCallback&& callback);
+
   // TODO(b/280805906) Remove this count specific API after the c++ SDK migrates
   // to the new Aggregate API Backward-compatible getter for count result
   void Get(CountQueryCallback&& callback);
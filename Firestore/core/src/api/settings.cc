@@ -31,6 +31,11 @@ constexpr bool Settings::DefaultSslEnabled;
 constexpr bool Settings::DefaultPersistenceEnabled;
 constexpr int64_t Settings::DefaultCacheSizeBytes;
 constexpr int64_t Settings::MinimumCacheSizeBytes;
+constexpr int PersistentCacheTuning::LargeCacheBloomFilterBitsPerKey;
+constexpr int64_t PersistentCacheTuning::LargeCacheBlockCacheSizeBytes;
+constexpr int64_t PersistentCacheTuning::LargeCacheBlockSizeBytes;
+constexpr int64_t PersistentCacheTuning::LargeCacheWriteBufferSizeBytes;
+constexpr int PersistentCacheTuning::LargeCacheMaxOpenFiles;
 
 Settings::Settings(const Settings& other)
     : host_(other.host_),
@@ -184,7 +189,14 @@ size_t MemoryCacheSettings::Hash() const {
 }
 
 size_t PersistentCacheSettings::Hash() const {
-  return util::Hash(kind_, size_bytes_);
+  return util::Hash(kind_, size_bytes_, tuning_);
+}
+
+size_t PersistentCacheTuning::Hash() const {
+  return util::Hash(bloom_filter_bits_per_key_, block_cache_size_bytes_,
+                    block_size_bytes_, write_buffer_size_bytes_,
+                    max_open_files_, field_name_dictionary_enabled_,
+                    query_result_materialization_enabled_);
 }
 
 size_t MemoryEagerGcSettings::Hash() const {
@@ -205,9 +217,28 @@ bool operator!=(const MemoryCacheSettings& lhs,
   return !(lhs == rhs);
 }
 
+bool operator==(const PersistentCacheTuning& lhs,
+                const PersistentCacheTuning& rhs) {
+  return lhs.bloom_filter_bits_per_key() == rhs.bloom_filter_bits_per_key() &&
+         lhs.block_cache_size_bytes() == rhs.block_cache_size_bytes() &&
+         lhs.block_size_bytes() == rhs.block_size_bytes() &&
+         lhs.write_buffer_size_bytes() == rhs.write_buffer_size_bytes() &&
+         lhs.max_open_files() == rhs.max_open_files() &&
+         lhs.field_name_dictionary_enabled() ==
+             rhs.field_name_dictionary_enabled() &&
+         lhs.query_result_materialization_enabled() ==
+             rhs.query_result_materialization_enabled();
+}
+
+bool operator!=(const PersistentCacheTuning& lhs,
+                const PersistentCacheTuning& rhs) {
+  return !(lhs == rhs);
+}
+
 bool operator==(const PersistentCacheSettings& lhs,
                 const PersistentCacheSettings& rhs) {
-  return lhs.kind() == rhs.kind() && lhs.size_bytes() == rhs.size_bytes();
+  return lhs.kind() == rhs.kind() && lhs.size_bytes() == rhs.size_bytes() &&
+         lhs.tuning() == rhs.tuning();
 }
 
 bool operator!=(const PersistentCacheSettings& lhs,
@@ -280,6 +311,15 @@ int64_t Settings::cache_size_bytes() const {
   return cache_size_bytes_;
 }
 
+PersistentCacheTuning Settings::persistent_cache_tuning() const {
+  if (cache_settings_ &&
+      cache_settings_->kind() == LocalCacheSettings::Kind::kPersistent) {
+    return static_cast<const PersistentCacheSettings*>(cache_settings_.get())
+        ->tuning_;
+  }
+  return PersistentCacheTuning{};
+}
+
 bool Settings::gc_enabled() const {
   if (cache_settings_) {
     if (cache_settings_->kind_ == LocalCacheSettings::Kind::kPersistent) {
@@ -322,6 +362,71 @@ PersistentCacheSettings PersistentCacheSettings::WithSizeBytes(
   return new_settings;
 }
 
+PersistentCacheSettings PersistentCacheSettings::WithTuning(
+    const PersistentCacheTuning& tuning) const {
+  PersistentCacheSettings new_settings{*this};
+  new_settings.tuning_ = tuning;
+  return new_settings;
+}
+
+PersistentCacheTuning PersistentCacheTuning::ForLargeCache() {
+  return PersistentCacheTuning{}
+      .WithBloomFilterBitsPerKey(LargeCacheBloomFilterBitsPerKey)
+      .WithBlockCacheSizeBytes(LargeCacheBlockCacheSizeBytes)
+      .WithBlockSizeBytes(LargeCacheBlockSizeBytes)
+      .WithWriteBufferSizeBytes(LargeCacheWriteBufferSizeBytes)
+      .WithMaxOpenFiles(LargeCacheMaxOpenFiles);
+}
+
+PersistentCacheTuning PersistentCacheTuning::WithBloomFilterBitsPerKey(
+    int bits_per_key) const {
+  PersistentCacheTuning new_tuning{*this};
+  new_tuning.bloom_filter_bits_per_key_ = bits_per_key;
+  return new_tuning;
+}
+
+PersistentCacheTuning PersistentCacheTuning::WithBlockCacheSizeBytes(
+    int64_t size) const {
+  PersistentCacheTuning new_tuning{*this};
+  new_tuning.block_cache_size_bytes_ = size;
+  return new_tuning;
+}
+
+PersistentCacheTuning PersistentCacheTuning::WithBlockSizeBytes(
+    int64_t size) const {
+  PersistentCacheTuning new_tuning{*this};
+  new_tuning.block_size_bytes_ = size;
+  return new_tuning;
+}
+
+PersistentCacheTuning PersistentCacheTuning::WithWriteBufferSizeBytes(
+    int64_t size) const {
+  PersistentCacheTuning new_tuning{*this};
+  new_tuning.write_buffer_size_bytes_ = size;
+  return new_tuning;
+}
+
+PersistentCacheTuning PersistentCacheTuning::WithMaxOpenFiles(
+    int max_open_files) const {
+  PersistentCacheTuning new_tuning{*this};
+  new_tuning.max_open_files_ = max_open_files;
+  return new_tuning;
+}
+
+PersistentCacheTuning PersistentCacheTuning::WithFieldNameDictionary(
+    bool enabled) const {
+  PersistentCacheTuning new_tuning{*this};
+  new_tuning.field_name_dictionary_enabled_ = enabled;
+  return new_tuning;
+}
+
+PersistentCacheTuning PersistentCacheTuning::WithQueryResultMaterialization(
+    bool enabled) const {
+  PersistentCacheTuning new_tuning{*this};
+  new_tuning.query_result_materialization_enabled_ = enabled;
+  return new_tuning;
+}
+
 }  // namespace api
 }  // namespace firestore
 }  // namespace firebase
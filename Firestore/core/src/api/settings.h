@@ -30,6 +30,100 @@ namespace api {
 
 class LocalCacheSettings;
 
+/**
+ * Tuning parameters for the storage engine backing the persistent cache.
+ *
+ * Each parameter defaults to zero, which leaves the storage engine's own
+ * default in place. The defaults suit small caches; caches that grow to
+ * several gigabytes benefit from a bloom filter and a larger block cache.
+ */
+class PersistentCacheTuning {
+ public:
+  /** The number of bloom filter bits per key used by `ForLargeCache()`. */
+  static constexpr int LargeCacheBloomFilterBitsPerKey = 10;
+  static constexpr int64_t LargeCacheBlockCacheSizeBytes = 64 * 1024 * 1024;
+  static constexpr int64_t LargeCacheBlockSizeBytes = 16 * 1024;
+  static constexpr int64_t LargeCacheWriteBufferSizeBytes = 16 * 1024 * 1024;
+  static constexpr int LargeCacheMaxOpenFiles = 1000;
+
+  PersistentCacheTuning() = default;
+
+  /**
+   * Returns a profile intended for caches several gigabytes in size: a bloom
+   * filter to avoid disk reads for point lookups of absent keys, a larger
+   * block cache and block size, and a larger write buffer.
+   */
+  static PersistentCacheTuning ForLargeCache();
+
+  /**
+   * Returns a copy of this profile that adds a bloom filter using the given
+   * number of bits per key. Zero disables the bloom filter.
+   */
+  PersistentCacheTuning WithBloomFilterBitsPerKey(int bits_per_key) const;
+  PersistentCacheTuning WithBlockCacheSizeBytes(int64_t size) const;
+  PersistentCacheTuning WithBlockSizeBytes(int64_t size) const;
+  PersistentCacheTuning WithWriteBufferSizeBytes(int64_t size) const;
+  PersistentCacheTuning WithMaxOpenFiles(int max_open_files) const;
+
+  /**
+   * Returns a copy of this profile that stores the top-level field names of
+   * cached documents as small integer IDs from a dictionary kept per
+   * collection ID, which makes documents with many or long field names smaller
+   * and cheaper to decode. Documents already in the cache are rewritten when
+   * the cache is opened with a different setting. SDK versions that predate
+   * this setting cannot read documents stored with it, so turn it off and
+   * reopen the cache before downgrading.
+   */
+  PersistentCacheTuning WithFieldNameDictionary(bool enabled) const;
+
+  /**
+   * Returns a copy of this profile that stores the results of each target once
+   * its view is in sync with the backend, so that a query whose results did
+   * not change since then is answered without filtering and sorting its
+   * collection again, for example after a restart.
+   */
+  PersistentCacheTuning WithQueryResultMaterialization(bool enabled) const;
+
+  int bloom_filter_bits_per_key() const {
+    return bloom_filter_bits_per_key_;
+  }
+
+  int64_t block_cache_size_bytes() const {
+    return block_cache_size_bytes_;
+  }
+
+  int64_t block_size_bytes() const {
+    return block_size_bytes_;
+  }
+
+  int64_t write_buffer_size_bytes() const {
+    return write_buffer_size_bytes_;
+  }
+
+  int max_open_files() const {
+    return max_open_files_;
+  }
+
+  bool field_name_dictionary_enabled() const {
+    return field_name_dictionary_enabled_;
+  }
+
+  bool query_result_materialization_enabled() const {
+    return query_result_materialization_enabled_;
+  }
+
+  size_t Hash() const;
+
+ private:
+  int bloom_filter_bits_per_key_ = 0;
+  int64_t block_cache_size_bytes_ = 0;
+  int64_t block_size_bytes_ = 0;
+  int64_t write_buffer_size_bytes_ = 0;
+  int max_open_files_ = 0;
+  bool field_name_dictionary_enabled_ = false;
+  bool query_result_materialization_enabled_ = false;
+};
+
 /**
  * Represents settings associated with a FirestoreClient.
  *
@@ -75,6 +169,12 @@ class Settings {
   int64_t cache_size_bytes() const;
   bool gc_enabled() const;
 
+  /**
+   * Returns the storage engine tuning of the persistent cache settings, or the
+   * default tuning if the local cache is not configured as persistent.
+   */
+  PersistentCacheTuning persistent_cache_tuning() const;
+
   const LocalCacheSettings* local_cache_settings() const;
   void set_local_cache_settings(const LocalCacheSettings& settings);
 
@@ -122,15 +222,21 @@ class PersistentCacheSettings : public LocalCacheSettings {
         size_bytes_(Settings::DefaultCacheSizeBytes) {
   }
   PersistentCacheSettings WithSizeBytes(int64_t size) const;
+  PersistentCacheSettings WithTuning(const PersistentCacheTuning& tuning) const;
 
   int64_t size_bytes() const {
     return size_bytes_;
   }
 
+  const PersistentCacheTuning& tuning() const {
+    return tuning_;
+  }
+
   size_t Hash() const override;
 
  private:
   int64_t size_bytes_;
+  PersistentCacheTuning tuning_;
 };
 
 class MemoryGarbageCollectorSettings {
@@ -213,6 +319,12 @@ bool operator==(const MemoryCacheSettings& lhs, const MemoryCacheSettings& rhs);
 
 bool operator!=(const MemoryCacheSettings& lhs, const MemoryCacheSettings& rhs);
 
+bool operator==(const PersistentCacheTuning& lhs,
+                const PersistentCacheTuning& rhs);
+
+bool operator!=(const PersistentCacheTuning& lhs,
+                const PersistentCacheTuning& rhs);
+
 bool operator==(const PersistentCacheSettings& lhs,
                 const PersistentCacheSettings& rhs);
 
@@ -16,10 +16,11 @@
 #ifndef FIRESTORE_CORE_SRC_BUNDLE_BUNDLE_CALLBACK_H_
 #define FIRESTORE_CORE_SRC_BUNDLE_BUNDLE_CALLBACK_H_
 
-#include <string>
+#include <cstdint>
 
 #include "Firestore/core/src/bundle/bundle_metadata.h"
 #include "Firestore/core/src/bundle/named_query.h"
+#include "absl/types/optional.h"
 
 namespace firebase {
 namespace firestore {
@@ -34,15 +35,38 @@ class BundleCallback {
   virtual ~BundleCallback() = default;
 
   /**
-   * Applies the documents from a bundle to the "ground-state" (remote)
-   * documents.
+   * Starts loading the given bundle.
+   *
+   * @return The number of documents that an earlier, interrupted load of the
+   * same bundle has already staged, which can be skipped. Returns 0 if the
+   * load starts from the beginning.
+   */
+  virtual uint32_t StartBundleLoad(const BundleMetadata& metadata) = 0;
+
+  /**
+   * Stages a chunk of the documents from a bundle, and records that the first
+   * `documents_staged` documents of the bundle have been staged. Staged
+   * documents are only applied once the whole bundle has been read.
+   */
+  virtual void StageBundledDocuments(const model::MutableDocumentMap& documents,
+                                     const BundleMetadata& metadata,
+                                     uint32_t documents_staged) = 0;
+
+  /**
+   * Applies up to `max_documents` of the staged documents of a bundle to the
+   * "ground-state" (remote) documents.
    *
    * Local documents are re-calculated if there are remaining mutations in the
    * queue.
+   *
+   * @return The document view changes, or nullopt if no staged documents were
+   * left.
    */
-  virtual model::DocumentMap ApplyBundledDocuments(
-      const model::MutableDocumentMap& documents,
-      const std::string& bundle_id) = 0;
+  virtual absl::optional<model::DocumentMap> ApplyStagedDocuments(
+      const BundleMetadata& metadata, uint32_t max_documents) = 0;
+
+  /** Discards the documents staged by a load of the given bundle. */
+  virtual void AbortBundleLoad(const BundleMetadata& metadata) = 0;
 
   /** Saves the given NamedQuery to local persistence. */
   virtual void SaveNamedQuery(const NamedQuery& query,
@@ -17,11 +17,12 @@
 #include "Firestore/core/src/bundle/bundle_loader.h"
 
 #include <memory>
-#include <unordered_map>
+#include <utility>
 
 #include "Firestore/core/include/firebase/firestore/firestore_errors.h"
 #include "Firestore/core/src/api/load_bundle_task.h"
 #include "Firestore/core/src/bundle/bundle_document.h"
+#include "Firestore/core/src/bundle/bundled_document_metadata.h"
 #include "Firestore/core/src/model/document.h"
 #include "Firestore/core/src/model/document_key.h"
 #include "Firestore/core/src/model/document_key_set.h"
@@ -47,7 +48,9 @@ Status BundleLoader::AddElementInternal(const BundleElement& element) {
 
   switch (element.element_type()) {
     case BundleElement::Type::NamedQuery: {
-      queries_.push_back(static_cast<const NamedQuery&>(element));
+      const auto& named_query = static_cast<const NamedQuery&>(element);
+      queries_.push_back(named_query);
+      query_documents_.emplace(named_query.query_name(), DocumentKeySet{});
       break;
     }
 
@@ -55,13 +58,14 @@ Status BundleLoader::AddElementInternal(const BundleElement& element) {
       const auto& document_metadata =
           static_cast<const BundledDocumentMetadata&>(element);
       current_document_ = document_metadata.key();
-      documents_metadata_.emplace(document_metadata.key(), document_metadata);
+      for (const auto& query : document_metadata.queries()) {
+        DocumentKeySet& keys = query_documents_[query];
+        keys = keys.insert(document_metadata.key());
+      }
 
       if (!document_metadata.exists()) {
-        documents_ = documents_.insert(
-            document_metadata.key(),
-            MutableDocument::NoDocument(document_metadata.key(),
-                                        document_metadata.read_time()));
+        AddDocument(MutableDocument::NoDocument(document_metadata.key(),
+                                                document_metadata.read_time()));
         current_document_ = absl::nullopt;
       }
       break;
@@ -76,7 +80,7 @@ Status BundleLoader::AddElementInternal(const BundleElement& element) {
             "The document being added does not match the stored metadata.")};
       }
 
-      documents_ = documents_.insert(document.key(), document.document());
+      AddDocument(document.document());
       current_document_ = absl::nullopt;
       break;
     }
@@ -90,73 +94,94 @@ Status BundleLoader::AddElementInternal(const BundleElement& element) {
   return Status::OK();
 }
 
+void BundleLoader::AddDocument(const MutableDocument& document) {
+  ++documents_loaded_;
+  if (documents_loaded_ > documents_staged_.value()) {
+    documents_ = documents_.insert(document.key(), document);
+  }
+}
+
+void BundleLoader::StageChunk() {
+  callback_->StageBundledDocuments(documents_, metadata_, documents_loaded_);
+  documents_ = {};
+  documents_staged_ = documents_loaded_;
+}
+
+void BundleLoader::StartLoad() {
+  if (!documents_staged_) {
+    documents_staged_ = callback_->StartBundleLoad(metadata_);
+  }
+}
+
 StatusOr<absl::optional<LoadBundleTaskProgress>> BundleLoader::AddElement(
     std::unique_ptr<BundleElement> element_ptr, uint64_t byte_size) {
   HARD_ASSERT(element_ptr->element_type() != BundleElement::Type::Metadata,
               "Unexpected bundle metadata element.");
+  StartLoad();
 
-  auto before_count = documents_.size();
+  auto before_count = documents_loaded_;
 
   auto result = AddElementInternal(*element_ptr);
   if (!result.ok()) {
+    Abort();
     return result;
   }
 
   bytes_loaded_ += byte_size;
 
   // Document has only been partially loaded, no progress to report.
-  if (before_count == documents_.size()) {
+  if (before_count == documents_loaded_) {
     return {absl::nullopt};
   }
 
+  if (documents_.size() >= chunk_size_) {
+    StageChunk();
+  }
+
   LoadBundleTaskProgress progress{
-      documents_.size(), metadata_.total_documents(), bytes_loaded_,
+      documents_loaded_, metadata_.total_documents(), bytes_loaded_,
       metadata_.total_bytes(), LoadBundleTaskState::kInProgress};
   return {absl::make_optional(std::move(progress))};
 }
 
-StatusOr<DocumentMap> BundleLoader::ApplyChanges() {
+Status BundleLoader::ApplyChanges(
+    const ChunkAppliedCallback& on_chunk_applied) {
   if (current_document_ != absl::nullopt) {
-    return StatusOr<DocumentMap>(
-        Status(Error::kErrorInvalidArgument,
-               "Bundled documents end with a document metadata "
-               "element instead of a document."));
+    Abort();
+    return Status(Error::kErrorInvalidArgument,
+                  "Bundled documents end with a document metadata "
+                  "element instead of a document.");
   }
-  if (metadata_.total_documents() != documents_.size()) {
-    return StatusOr<DocumentMap>(
-        Status(Error::kErrorInvalidArgument,
-               "Loaded documents count is not the same as in metadata."));
+  if (metadata_.total_documents() != documents_loaded_) {
+    Abort();
+    return Status(Error::kErrorInvalidArgument,
+                  "Loaded documents count is not the same as in metadata.");
+  }
+
+  StartLoad();
+  if (!documents_.empty()) {
+    StageChunk();
+  }
+
+  while (absl::optional<DocumentMap> chunk_changes =
+             callback_->ApplyStagedDocuments(metadata_, chunk_size_)) {
+    on_chunk_applied(*chunk_changes);
   }
 
-  auto changes =
-      callback_->ApplyBundledDocuments(documents_, metadata_.bundle_id());
-  auto query_document_map = GetQueryDocumentMapping();
   for (const auto& named_query : queries_) {
-    const auto& matching_keys = query_document_map[named_query.query_name()];
+    const auto& matching_keys = query_documents_[named_query.query_name()];
     callback_->SaveNamedQuery(named_query, matching_keys);
   }
 
   callback_->SaveBundle(metadata_);
 
-  return changes;
+  return Status::OK();
 }
 
-std::unordered_map<std::string, DocumentKeySet>
-BundleLoader::GetQueryDocumentMapping() {
-  std::unordered_map<std::string, DocumentKeySet> result;
-  for (const auto& named_query : queries_) {
-    result.emplace(named_query.query_name(), DocumentKeySet{});
-  }
-
-  for (const auto& doc_metadata : documents_metadata_) {
-    const auto& metadata = doc_metadata.second;
-    for (const auto& query : doc_metadata.second.queries()) {
-      auto inserted = result[query].insert(metadata.key());
-      result[query] = std::move(inserted);
-    }
-  }
-
-  return result;
+void BundleLoader::Abort() {
+  callback_->AbortBundleLoad(metadata_);
+  documents_ = {};
+  documents_staged_ = absl::nullopt;
 }
 
 }  // namespace bundle
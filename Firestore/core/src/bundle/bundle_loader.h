@@ -17,6 +17,7 @@
 #define FIRESTORE_CORE_SRC_BUNDLE_BUNDLE_LOADER_H_
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -26,10 +27,12 @@
 #include "Firestore/core/src/api/load_bundle_task.h"
 #include "Firestore/core/src/bundle/bundle_callback.h"
 #include "Firestore/core/src/bundle/bundle_element.h"
-#include "Firestore/core/src/bundle/bundled_document_metadata.h"
+#include "Firestore/core/src/bundle/named_query.h"
 #include "Firestore/core/src/immutable/sorted_map.h"
 #include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/model/document_key_set.h"
 #include "Firestore/core/src/model/model_fwd.h"
+#include "Firestore/core/src/util/hard_assert.h"
 #include "Firestore/core/src/util/statusor.h"
 #include "absl/types/optional.h"
 
@@ -50,13 +53,37 @@ inline api::LoadBundleTaskProgress InitialProgress(
           api::LoadBundleTaskState::kInProgress};
 }
 
+/**
+ * The number of documents that a BundleLoader holds in memory before staging
+ * them in the local store, and applies from there at a time.
+ */
+constexpr uint32_t kDefaultBundleChunkSize = 1000;
+
+/**
+ * Applies the elements of a bundle to the local store.
+ *
+ * Documents are staged in the local store in chunks of `chunk_size` documents
+ * as they are read, each in its own transaction that also records how far the
+ * load got, so that memory use does not grow with the size of the bundle and a
+ * load that is interrupted resumes after the last staged chunk. Staged
+ * documents are only applied, again in chunks, once the whole bundle has been
+ * read and validated, and are discarded if it turns out to be invalid. The view
+ * changes of each applied chunk are handed out right away, so they are never
+ * held for the whole bundle either. Named queries and the bundle metadata are
+ * saved after every document is applied.
+ */
 class BundleLoader {
  public:
   using AddElementResult =
       util::StatusOr<absl::optional<api::LoadBundleTaskProgress>>;
 
-  BundleLoader(BundleCallback* callback, BundleMetadata metadata)
-      : callback_(callback), metadata_(std::move(metadata)) {
+  BundleLoader(BundleCallback* callback,
+               BundleMetadata metadata,
+               uint32_t chunk_size = kDefaultBundleChunkSize)
+      : callback_(callback),
+        metadata_(std::move(metadata)),
+        chunk_size_(chunk_size) {
+    HARD_ASSERT(chunk_size_ > 0, "Bundle chunk size must be positive.");
   }
 
   /**
@@ -64,40 +91,62 @@ class BundleLoader {
    *
    * @return a new progress if adding the element leads to a new progress,
    * otherwise returns `nullopt`. If an error occurred, returns a not `ok()`
-   * status.
+   * status and discards the staged documents.
    */
   AddElementResult AddElement(std::unique_ptr<BundleElement> element,
                               uint64_t byte_size);
 
-  /**
-   * Applies the loaded documents and queries to local store. Returns the
-   * document view changes. If an error occurred, returns a not `ok()` status.
-   */
-  util::StatusOr<model::DocumentMap> ApplyChanges();
+  /** Receives the document view changes of a chunk once it is applied. */
+  using ChunkAppliedCallback = std::function<void(const model::DocumentMap&)>;
 
- private:
   /**
-   * @return A map whose keys are the query names in the loading bundle, and
-   * values are matching document keys.
+   * Validates the bundle, then applies the staged documents and the queries to
+   * local store. The document view changes of each chunk are passed to
+   * `on_chunk_applied` as soon as its transaction commits, and are not kept
+   * afterwards. If an error occurred, returns a not `ok()` status and discards
+   * the staged documents.
    */
-  std::unordered_map<std::string, model::DocumentKeySet>
-  GetQueryDocumentMapping();
+  util::Status ApplyChanges(const ChunkAppliedCallback& on_chunk_applied);
 
+  /** Discards the documents staged so far. */
+  void Abort();
+
+ private:
   /**
    * Adds the given BundleElement to the internal containers, depending on the
    * element type.
    */
   util::Status AddElementInternal(const BundleElement& element);
 
+  /**
+   * Counts a document that was read completely, keeping it for the next chunk
+   * unless an earlier load already staged it.
+   */
+  void AddDocument(const model::MutableDocument& document);
+
+  /** Stages the documents held in memory in local store. */
+  void StageChunk();
+
+  /** Starts the load in local store, if it has not been started yet. */
+  void StartLoad();
+
   BundleCallback* callback_ = nullptr;
   BundleMetadata metadata_;
+  uint32_t chunk_size_ = kDefaultBundleChunkSize;
+
   std::vector<NamedQuery> queries_;
-  std::unordered_map<model::DocumentKey,
-                     BundledDocumentMetadata,
-                     model::DocumentKeyHash>
-      documents_metadata_;
+  // The keys of the documents that match each named query, by query name.
+  std::unordered_map<std::string, model::DocumentKeySet> query_documents_;
+
+  // The documents of the current chunk.
   model::MutableDocumentMap documents_;
 
+  // The number of documents read from the bundle.
+  uint32_t documents_loaded_ = 0;
+  // The number of documents staged in local store, including the ones staged
+  // by an earlier load. Unset until the load is started.
+  absl::optional<uint32_t> documents_staged_;
+
   uint64_t bytes_loaded_ = 0;
   absl::optional<model::DocumentKey> current_document_;
 };
@@ -39,6 +39,7 @@
 #include "Firestore/core/src/local/local_documents_view.h"
 #include "Firestore/core/src/local/local_serializer.h"
 #include "Firestore/core/src/local/local_store.h"
+#include "Firestore/core/src/local/lru_garbage_collector.h"
 #include "Firestore/core/src/local/memory_lru_reference_delegate.h"
 #include "Firestore/core/src/local/memory_persistence.h"
 #include "Firestore/core/src/local/proto_sizer.h"
@@ -50,6 +51,7 @@
 #include "Firestore/core/src/model/document_set.h"
 #include "Firestore/core/src/model/field_index.h"
 #include "Firestore/core/src/model/mutation.h"
+#include "Firestore/core/src/model/object_value.h"
 #include "Firestore/core/src/remote/connectivity_monitor.h"
 #include "Firestore/core/src/remote/datastore.h"
 #include "Firestore/core/src/remote/firebase_metadata_provider.h"
@@ -81,6 +83,7 @@ using credentials::User;
 using firestore::Error;
 using local::LevelDbOpener;
 using local::LocalStore;
+using local::LruCheckpoint;
 using local::LruParams;
 using local::MemoryPersistence;
 using local::QueryEngine;
@@ -119,6 +122,21 @@ static const auto kRegularGCDelay = std::chrono::minutes(5);
 static const auto kInitialBackfillDelay = std::chrono::seconds(15);
 /** Minimum amount of time between backfill checks, after the first one. */
 static const auto kRegularBackfillDelay = std::chrono::minutes(1);
+/** The longest that the slices of one backfill check may run for in total. */
+static const auto kBackfillBudget = std::chrono::seconds(15);
+/** How long each backfill slice should take while the worker queue is idle. */
+static const auto kIdleBackfillSliceDuration = std::chrono::milliseconds(50);
+/** How long each backfill slice should take while other work is queued. */
+static const auto kBusyBackfillSliceDuration = std::chrono::milliseconds(10);
+
+/**
+ * How long no bulk deletes must happen before the key ranges they emptied are
+ * compacted.
+ */
+static const auto kCompactionDelay = std::chrono::seconds(30);
+
+/** The number of cache-only queries that may execute concurrently. */
+static const int kMaxConcurrentCacheReads = 4;
 
 }  // namespace
 
@@ -208,7 +226,8 @@ void FirestoreClient::Initialize(const User& user, const Settings& settings) {
     LevelDbOpener opener(database_info_);
 
     auto created =
-        opener.Create(LruParams::WithCacheSize(settings.cache_size_bytes()));
+        opener.Create(LruParams::WithCacheSize(settings.cache_size_bytes()),
+                      settings.persistent_cache_tuning());
     // If leveldb fails to start then just throw up our hands: the error is
     // unrecoverable. There's nothing an end-user can do and nearly all
     // failures indicate the developer is doing something grossly wrong so we
@@ -218,6 +237,10 @@ void FirestoreClient::Initialize(const User& user, const Settings& settings) {
 
     auto ldb = std::move(created).ValueOrDie();
     lru_delegate_ = ldb->reference_delegate();
+    compactor_ = ldb->compactor();
+    leveldb_persistence_ = ldb.get();
+    compaction_executor_ =
+        Executor::CreateSerial("com.google.firebase.firestore.compaction");
 
     persistence_ = std::move(ldb);
     if (settings.gc_enabled()) {
@@ -241,9 +264,17 @@ void FirestoreClient::Initialize(const User& user, const Settings& settings) {
     persistence_ = MemoryPersistence::WithEagerGarbageCollector();
   }
 
+  if (persistence_->SupportsConcurrentReadOnlyTransactions()) {
+    reader_executor_ = Executor::CreateConcurrent(
+        "com.google.firebase.firestore.reader", kMaxConcurrentCacheReads);
+  }
+
   query_engine_ = absl::make_unique<QueryEngine>();
   local_store_ = absl::make_unique<LocalStore>(persistence_.get(),
                                                query_engine_.get(), user);
+  local_store_->SetQueryResultMaterializationEnabled(
+      settings.persistent_cache_tuning()
+          .query_result_materialization_enabled());
   connectivity_monitor_ = ConnectivityMonitor::Create(worker_queue_);
   auto datastore = std::make_shared<Datastore>(
       database_info_, worker_queue_, auth_credentials_provider_,
@@ -270,6 +301,13 @@ void FirestoreClient::Initialize(const User& user, const Settings& settings) {
   local_store_->Start();
   remote_store_->Start();
 
+  // Migrating the overlays of other users does not need to block startup, so
+  // it runs after the operations that are already queued.
+  overlay_migration_callback_ = worker_queue_->EnqueueAfterDelay(
+      std::chrono::milliseconds(0), TimerId::OverlayMigrationDelay,
+      [this] { local_store_->CompleteOverlayMigration(); });
+
+  ScheduleRemoteDocumentRewrite();
   ScheduleIndexBackfiller();
 }
 
@@ -333,7 +371,22 @@ void FirestoreClient::TerminateInternal() {
 
   backfiller_callback_.Cancel();
 
+  compaction_callback_.Cancel();
+
+  overlay_migration_callback_.Cancel();
+
+  remote_document_rewrite_callback_.Cancel();
+
   remote_store_->Shutdown();
+
+  // Wait for any read-only transactions to finish before closing the database
+  // they read from.
+  if (reader_executor_) {
+    reader_executor_->Dispose();
+  }
+  if (compaction_executor_) {
+    compaction_executor_->Dispose();
+  }
   persistence_->Shutdown();
 
   local_store_.reset();
@@ -350,9 +403,28 @@ void FirestoreClient::ScheduleLruGarbageCollection() {
 
   lru_callback_ = worker_queue_->EnqueueAfterDelay(
       delay, TimerId::GarbageCollectionDelay, [this] {
-        local_store_->CollectGarbage(lru_delegate_->garbage_collector());
+        auto checkpoint = std::make_shared<LruCheckpoint>(
+            local_store_->StartGarbageCollection(
+                lru_delegate_->garbage_collector()));
         gc_has_run_ = true;
-        ScheduleLruGarbageCollection();
+        ContinueLruGarbageCollection(std::move(checkpoint));
+      });
+}
+
+void FirestoreClient::ContinueLruGarbageCollection(
+    std::shared_ptr<LruCheckpoint> checkpoint) {
+  if (checkpoint->complete) {
+    ScheduleCompaction();
+    ScheduleLruGarbageCollection();
+    return;
+  }
+
+  lru_callback_ = worker_queue_->EnqueueAfterDelay(
+      std::chrono::milliseconds(0), TimerId::GarbageCollectionDelay,
+      [this, checkpoint] {
+        local_store_->CollectGarbageSlice(lru_delegate_->garbage_collector(),
+                                          checkpoint.get());
+        ContinueLruGarbageCollection(checkpoint);
       });
 }
 
@@ -362,9 +434,54 @@ void FirestoreClient::ScheduleIndexBackfiller() {
 
   backfiller_callback_ = worker_queue_->EnqueueAfterDelay(
       delay, TimerId::IndexBackfillDelay, [this] {
-        local_store_->Backfill();
         backfiller_has_run_ = true;
-        ScheduleIndexBackfiller();
+        ContinueIndexBackfill(std::chrono::steady_clock::now() +
+                              kBackfillBudget);
+      });
+}
+
+void FirestoreClient::ContinueIndexBackfill(
+    std::chrono::steady_clock::time_point deadline) {
+  auto slice_duration = worker_queue_->HasPendingOperations()
+                            ? kBusyBackfillSliceDuration
+                            : kIdleBackfillSliceDuration;
+  bool has_more = local_store_->BackfillSlice(slice_duration);
+  if (!has_more || std::chrono::steady_clock::now() >= deadline) {
+    ScheduleIndexBackfiller();
+    return;
+  }
+
+  backfiller_callback_ = worker_queue_->EnqueueAfterDelay(
+      std::chrono::milliseconds(0), TimerId::IndexBackfillDelay,
+      [this, deadline] { ContinueIndexBackfill(deadline); });
+}
+
+void FirestoreClient::ScheduleCompaction() {
+  if (!compactor_ || !compactor_->ShouldCompact()) return;
+
+  // Restarting the delay on every bulk delete keeps compaction from competing
+  // with a burst of them.
+  compaction_callback_.Cancel();
+  compaction_callback_ = worker_queue_->EnqueueAfterDelay(
+      kCompactionDelay, TimerId::CompactionDelay, [this] {
+        compaction_executor_->Execute(
+            [this] { compactor_->CompactPendingRanges(); });
+      });
+}
+
+void FirestoreClient::ScheduleRemoteDocumentRewrite() {
+  if (!leveldb_persistence_ ||
+      !leveldb_persistence_->has_pending_remote_document_rewrite()) {
+    return;
+  }
+
+  // Rewriting a chunk at a time lets the operations queued meanwhile run
+  // between chunks instead of waiting for the whole rewrite.
+  remote_document_rewrite_callback_ = worker_queue_->EnqueueAfterDelay(
+      std::chrono::milliseconds(0), TimerId::RemoteDocumentRewriteDelay,
+      [this] {
+        leveldb_persistence_->RewriteRemoteDocumentsSlice();
+        ScheduleRemoteDocumentRewrite();
       });
 }
 
@@ -487,31 +604,48 @@ void FirestoreClient::GetDocumentsFromLocalCache(
   // TODO(c++14): move `callback` into lambda.
   auto shared_callback = absl::ShareUniquePtr(std::move(callback));
   worker_queue_->Enqueue([this, query, shared_callback] {
-    QueryResult query_result = local_store_->ExecuteQuery(
-        query.query(), /* use_previous_results= */ true);
+    if (!reader_executor_) {
+      QueryResult query_result = local_store_->ExecuteQuery(
+          query.query(), /* use_previous_results= */ true);
+      RaiseLocalQuerySnapshot(query, query_result, shared_callback);
+      return;
+    }
 
-    View view(query.query(), query_result.remote_keys());
-    ViewDocumentChanges view_doc_changes =
-        view.ComputeDocumentChanges(query_result.documents());
-    ViewChange view_change = view.ApplyChanges(view_doc_changes);
-    HARD_ASSERT(
-        view_change.limbo_changes().empty(),
-        "View returned limbo documents during local-only query execution.");
+    // Hop through the worker queue so that the read observes every write
+    // enqueued before it, then execute the query off the worker queue so that
+    // it doesn't wait for remote events and index backfill.
+    reader_executor_->Execute([this, query, shared_callback] {
+      QueryResult query_result =
+          local_store_->ExecuteQueryReadOnly(query.query());
+      RaiseLocalQuerySnapshot(query, query_result, shared_callback);
+    });
+  });
+}
 
-    HARD_ASSERT(view_change.snapshot().has_value(), "Expected a snapshot");
+void FirestoreClient::RaiseLocalQuerySnapshot(
+    const api::Query& query,
+    const QueryResult& query_result,
+    const std::shared_ptr<EventListener<QuerySnapshot>>& callback) {
+  View view(query.query(), query_result.remote_keys());
+  ViewDocumentChanges view_doc_changes =
+      view.ComputeDocumentChanges(query_result.documents());
+  ViewChange view_change = view.ApplyChanges(view_doc_changes);
+  HARD_ASSERT(
+      view_change.limbo_changes().empty(),
+      "View returned limbo documents during local-only query execution.");
 
-    ViewSnapshot snapshot = std::move(view_change.snapshot()).value();
-    SnapshotMetadata metadata(snapshot.has_pending_writes(),
-                              snapshot.from_cache());
+  HARD_ASSERT(view_change.snapshot().has_value(), "Expected a snapshot");
 
-    QuerySnapshot result(query.firestore(), query.query(), std::move(snapshot),
-                         std::move(metadata));
+  ViewSnapshot snapshot = std::move(view_change.snapshot()).value();
+  SnapshotMetadata metadata(snapshot.has_pending_writes(),
+                            snapshot.from_cache());
 
-    if (shared_callback) {
-      user_executor_->Execute(
-          [=] { shared_callback->OnEvent(std::move(result)); });
-    }
-  });
+  QuerySnapshot result(query.firestore(), query.query(), std::move(snapshot),
+                       std::move(metadata));
+
+  if (callback) {
+    user_executor_->Execute([=] { callback->OnEvent(std::move(result)); });
+  }
 }
 
 void FirestoreClient::WriteMutations(std::vector<Mutation>&& mutations,
@@ -575,6 +709,24 @@ void FirestoreClient::RunAggregateQuery(
   });
 }
 
+void FirestoreClient::RunAggregateQueryFromLocalCache(
+    const Query& query,
+    const std::vector<AggregateField>& aggregates,
+    api::AggregateQueryCallback&& result_callback) {
+  VerifyNotTerminated();
+
+  auto async_callback = [this,
+                         result_callback](const StatusOr<ObjectValue>& status) {
+    if (result_callback) {
+      user_executor_->Execute([=] { result_callback(std::move(status)); });
+    }
+  };
+
+  worker_queue_->Enqueue([this, query, aggregates, async_callback] {
+    async_callback(local_store_->ExecuteAggregateQuery(query, aggregates));
+  });
+}
+
 void FirestoreClient::AddSnapshotsInSyncListener(
     const std::shared_ptr<EventListener<Empty>>& user_listener) {
   worker_queue_->Enqueue([this, user_listener] {
@@ -606,7 +758,10 @@ void FirestoreClient::SetIndexAutoCreationEnabled(bool is_enabled) const {
 
 void FirestoreClient::DeleteAllFieldIndexes() {
   VerifyNotTerminated();
-  worker_queue_->Enqueue([this] { local_store_->DeleteAllFieldIndexes(); });
+  worker_queue_->Enqueue([this] {
+    local_store_->DeleteAllFieldIndexes();
+    ScheduleCompaction();
+  });
 }
 
 void FirestoreClient::LoadBundle(
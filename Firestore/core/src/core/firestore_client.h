@@ -17,6 +17,7 @@
 #ifndef FIRESTORE_CORE_SRC_CORE_FIRESTORE_CLIENT_H_
 #define FIRESTORE_CORE_SRC_CORE_FIRESTORE_CLIENT_H_
 
+#include <chrono>  // NOLINT(build/c++11)
 #include <memory>
 #include <string>
 #include <vector>
@@ -40,10 +41,14 @@ namespace firebase {
 namespace firestore {
 
 namespace local {
+class LevelDbCompactor;
+class LevelDbPersistence;
 class LocalStore;
 class LruDelegate;
 class Persistence;
 class QueryEngine;
+class QueryResult;
+struct LruCheckpoint;
 }  // namespace local
 
 namespace model {
@@ -159,6 +164,15 @@ class FirestoreClient : public std::enable_shared_from_this<FirestoreClient> {
                          const std::vector<model::AggregateField>& aggregates,
                          api::AggregateQueryCallback&& result_callback);
 
+  /**
+   * Computes the given aggregations over the documents in the local cache that
+   * match the query, including local mutations.
+   */
+  void RunAggregateQueryFromLocalCache(
+      const Query& query,
+      const std::vector<model::AggregateField>& aggregates,
+      api::AggregateQueryCallback&& result_callback);
+
   /**
    * Adds a listener to be called when a snapshots-in-sync event fires.
    */
@@ -219,18 +233,56 @@ class FirestoreClient : public std::enable_shared_from_this<FirestoreClient> {
 
   void TerminateInternal();
 
+  /**
+   * Computes a snapshot of `query` from the result of executing it against the
+   * local store and delivers it to `callback` on the user executor.
+   */
+  void RaiseLocalQuerySnapshot(
+      const api::Query& query,
+      const local::QueryResult& query_result,
+      const std::shared_ptr<EventListener<api::QuerySnapshot>>& callback);
+
   /**
    * Schedules a callback to try running LRU garbage collection. Reschedules
    * itself after the GC has run.
    */
   void ScheduleLruGarbageCollection();
 
+  /**
+   * Schedules the next slice of a running garbage collection, yielding to any
+   * operations already queued on the worker queue. Once the collection is
+   * complete, schedules the next one.
+   */
+  void ContinueLruGarbageCollection(
+      std::shared_ptr<local::LruCheckpoint> checkpoint);
+
   /**
    * Schedules a callback to try running index backfiller. Reschedules
    * itself after the backfiller has run.
    */
   void ScheduleIndexBackfiller();
 
+  /**
+   * Runs a slice of index backfill and, while documents are left to index and
+   * `deadline` has not passed, schedules the next slice to run after the
+   * operations queued meanwhile.
+   */
+  void ContinueIndexBackfill(std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * Schedules compaction of the key ranges emptied by bulk deletes once no
+   * further bulk deletes have happened for a while. Does nothing if too few
+   * keys were deleted.
+   */
+  void ScheduleCompaction();
+
+  /**
+   * Schedules the next chunk of the rewrite of remote documents whose encoding
+   * does not match the field name dictionary setting, after the operations
+   * already queued. Does nothing once every document has been rewritten.
+   */
+  void ScheduleRemoteDocumentRewrite();
+
   DatabaseInfo database_info_;
   std::shared_ptr<credentials::AppCheckCredentialsProvider>
       app_check_credentials_provider_;
@@ -246,6 +298,19 @@ class FirestoreClient : public std::enable_shared_from_this<FirestoreClient> {
   std::shared_ptr<util::AsyncQueue> worker_queue_;
   std::shared_ptr<util::Executor> user_executor_;
 
+  /**
+   * Executes cache-only queries in read-only transactions, concurrently with
+   * the worker queue. Null if the persistence layer does not support
+   * concurrent read-only transactions.
+   */
+  std::unique_ptr<util::Executor> reader_executor_;
+
+  /**
+   * Compacts the key ranges emptied by bulk deletes, off the worker queue.
+   * Null if the persistence layer is not LevelDB.
+   */
+  std::unique_ptr<util::Executor> compaction_executor_;
+
   std::unique_ptr<remote::FirebaseMetadataProvider> firebase_metadata_provider_;
 
   std::unique_ptr<local::Persistence> persistence_;
@@ -262,6 +327,11 @@ class FirestoreClient : public std::enable_shared_from_this<FirestoreClient> {
   local::LruDelegate* _Nullable lru_delegate_;
   util::DelayedOperation lru_callback_;
   util::DelayedOperation backfiller_callback_;
+  local::LevelDbCompactor* _Nullable compactor_ = nullptr;
+  util::DelayedOperation compaction_callback_;
+  util::DelayedOperation overlay_migration_callback_;
+  local::LevelDbPersistence* _Nullable leveldb_persistence_ = nullptr;
+  util::DelayedOperation remote_document_rewrite_callback_;
 };
 
 }  // namespace core
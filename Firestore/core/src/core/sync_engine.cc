@@ -688,17 +688,19 @@ void SyncEngine::LoadBundle(std::shared_ptr<bundle::BundleReader> reader,
     return;
   }
 
-  util::StatusOr<DocumentMap> changes = maybe_loader.value().ApplyChanges();
-  if (!changes.ok()) {
+  // Raise each chunk's changes as soon as it is applied, so that the changes
+  // of the whole bundle are never held in memory at once.
+  util::Status status =
+      maybe_loader.value().ApplyChanges([&](const DocumentMap& changes) {
+        EmitNewSnapshotsAndNotifyLocalStore(changes, absl::nullopt);
+      });
+  if (!status.ok()) {
     LOG_WARN("Failed to ApplyChanges() for bundle elements with error %s",
-             changes.status().error_message());
-    result_task->SetError(changes.status());
+             status.error_message());
+    result_task->SetError(status);
     return;
   }
 
-  EmitNewSnapshotsAndNotifyLocalStore(changes.ConsumeValueOrDie(),
-                                      absl::nullopt);
-
   result_task->SetSuccess(SuccessProgress(bundle_metadata));
 }
 
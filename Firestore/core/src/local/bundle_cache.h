@@ -17,8 +17,11 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_BUNDLE_CACHE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_BUNDLE_CACHE_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+#include "Firestore/core/src/model/model_fwd.h"
 #include "absl/types/optional.h"
 
 namespace firebase {
@@ -68,6 +71,45 @@ class BundleCache {
    * Saves a `NamedQuery` from a bundle, using its name as the persistent key.
    */
   virtual void SaveNamedQuery(const bundle::NamedQuery& query) = 0;
+
+  /**
+   * Gets the number of documents that an unfinished load of the given bundle
+   * has staged.
+   *
+   * @return The number of documents staged, or nullopt if no load of a bundle
+   * with the same id and create time is in progress.
+   */
+  virtual absl::optional<uint32_t> GetBundleLoadProgress(
+      const bundle::BundleMetadata& metadata) const = 0;
+
+  /**
+   * Records that the first `documents_staged` documents of the given bundle
+   * have been staged, replacing the progress of any earlier load of a bundle
+   * with the same id.
+   */
+  virtual void SaveBundleLoadProgress(const bundle::BundleMetadata& metadata,
+                                      uint32_t documents_staged) = 0;
+
+  /**
+   * Stores a document of an unfinished load of the bundle with the given id
+   * until the load is applied. Staged documents are not part of the remote
+   * documents.
+   */
+  virtual void StageBundledDocument(const std::string& bundle_id,
+                                    const model::MutableDocument& document) = 0;
+
+  /**
+   * Removes up to `count` staged documents of the bundle with the given id and
+   * returns them.
+   */
+  virtual model::MutableDocumentMap TakeStagedDocuments(
+      const std::string& bundle_id, size_t count) = 0;
+
+  /**
+   * Removes the progress and the staged documents of the load of the bundle
+   * with the given id.
+   */
+  virtual void RemoveBundleLoad(const std::string& bundle_id) = 0;
 };
 
 }  // namespace local
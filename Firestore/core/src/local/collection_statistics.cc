@@ -0,0 +1,447 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/collection_statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "Firestore/core/src/core/field_filter.h"
+#include "Firestore/core/src/core/filter.h"
+#include "Firestore/core/src/core/target.h"
+#include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/model/field_path.h"
+#include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/src/nanopb/nanopb_util.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using core::FieldFilter;
+using model::DocumentKey;
+using model::FieldPath;
+using model::MutableDocument;
+using model::ResourcePath;
+
+/** The number of hashes that a distinct value sketch keeps. */
+const size_t kSketchSize = 64;
+
+/**
+ * The number of top-level fields whose values are tracked, and of filtered
+ * field combinations whose index scans are tracked, per collection group,
+ * which bounds the memory used for collections with dynamic field names.
+ */
+const size_t kMaxTrackedFields = 32;
+
+/**
+ * The number of collection groups, and of collections per collection group,
+ * whose statistics are kept, which bounds the memory used for apps with many
+ * dynamically named collections.
+ */
+const size_t kMaxTrackedCollectionGroups = 256;
+const size_t kMaxTrackedCollections = 256;
+
+/** Spreads `hash` uniformly over size_t, as distinct value sketches require. */
+size_t Mix(uint64_t hash) {
+  // The finalizer of SplitMix64.
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  return static_cast<size_t>(hash);
+}
+
+/** Hashes the given bytes with 64-bit FNV-1a. */
+uint64_t HashBytes(absl::string_view bytes) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : bytes) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+uint64_t DoubleBits(double value) {
+  uint64_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/**
+ * Hashes `value` without building its canonical ID, or returns nullopt for
+ * arrays and maps: hashing them costs as much as the values they contain, and
+ * equality filters rarely compare them.
+ */
+absl::optional<size_t> HashScalarValue(const google_firestore_v1_Value& value) {
+  uint64_t hash = 0;
+  switch (value.which_value_type) {
+    case google_firestore_v1_Value_null_value_tag:
+      break;
+    case google_firestore_v1_Value_boolean_value_tag:
+      hash = value.boolean_value ? 1 : 0;
+      break;
+    case google_firestore_v1_Value_integer_value_tag:
+      hash = static_cast<uint64_t>(value.integer_value);
+      break;
+    case google_firestore_v1_Value_double_value_tag:
+      hash = DoubleBits(value.double_value);
+      break;
+    case google_firestore_v1_Value_timestamp_value_tag:
+      hash = static_cast<uint64_t>(value.timestamp_value.seconds) * 1000000000 +
+             static_cast<uint64_t>(value.timestamp_value.nanos);
+      break;
+    case google_firestore_v1_Value_string_value_tag:
+      hash = HashBytes(nanopb::MakeStringView(value.string_value));
+      break;
+    case google_firestore_v1_Value_bytes_value_tag:
+      hash = HashBytes(nanopb::MakeStringView(value.bytes_value));
+      break;
+    case google_firestore_v1_Value_reference_value_tag:
+      hash = HashBytes(nanopb::MakeStringView(value.reference_value));
+      break;
+    case google_firestore_v1_Value_geo_point_value_tag:
+      hash = DoubleBits(value.geo_point_value.latitude) * 31 +
+             DoubleBits(value.geo_point_value.longitude);
+      break;
+    default:
+      return absl::nullopt;
+  }
+  // Values of different types never compare equal.
+  return Mix(hash * 31 + value.which_value_type);
+}
+
+/**
+ * Returns the canonical path and value hash of each top-level field of
+ * `document` that has a scalar value.
+ */
+std::vector<std::pair<std::string, size_t>> HashTopLevelValues(
+    const MutableDocument& document) {
+  std::vector<std::pair<std::string, size_t>> result;
+  if (!document.is_found_document()) return result;
+
+  google_firestore_v1_Value data = document.data().Get();
+  for (pb_size_t i = 0; i < data.map_value.fields_count; ++i) {
+    const google_firestore_v1_MapValue_FieldsEntry& field =
+        data.map_value.fields[i];
+    absl::optional<size_t> hash = HashScalarValue(field.value);
+    if (!hash) continue;
+
+    result.emplace_back(
+        FieldPath{nanopb::MakeString(field.key)}.CanonicalString(), *hash);
+  }
+  return result;
+}
+
+/** Returns the entry of `entries` that was used least recently. */
+template <typename Map>
+typename Map::iterator LeastRecentlyUsed(Map* entries) {
+  return std::min_element(entries->begin(), entries->end(),
+                          [](const typename Map::value_type& lhs,
+                             const typename Map::value_type& rhs) {
+                            return lhs.second.last_used < rhs.second.last_used;
+                          });
+}
+
+std::string CollectionGroup(const core::Target& target) {
+  return target.collection_group() != nullptr ? *target.collection_group()
+                                              : target.path().last_segment();
+}
+
+/** Returns the canonical paths of the fields that `target` filters on. */
+std::string FilteredFields(const core::Target& target) {
+  std::vector<std::string> fields;
+  for (const core::Filter& filter : target.filters()) {
+    for (const FieldFilter& field_filter : filter.GetFlattenedFilters()) {
+      fields.push_back(field_filter.field().CanonicalString());
+    }
+  }
+  std::sort(fields.begin(), fields.end());
+  fields.erase(std::unique(fields.begin(), fields.end()), fields.end());
+  return absl::StrJoin(fields, ",");
+}
+
+}  // namespace
+
+void CollectionStatistics::DistinctValueSketch::Add(size_t hash) {
+  if (smallest_hashes_.size() == kSketchSize &&
+      hash >= *smallest_hashes_.rbegin()) {
+    return;
+  }
+  smallest_hashes_.insert(hash);
+  if (smallest_hashes_.size() > kSketchSize) {
+    smallest_hashes_.erase(std::prev(smallest_hashes_.end()));
+  }
+}
+
+double CollectionStatistics::DistinctValueSketch::Estimate() const {
+  if (smallest_hashes_.size() < kSketchSize) {
+    // Every distinct value seen so far is in the sketch.
+    return static_cast<double>(smallest_hashes_.size());
+  }
+
+  // With k values hashed uniformly into [0, 1], the k-th smallest hash is
+  // about k / distinct_values.
+  double largest = static_cast<double>(*smallest_hashes_.rbegin()) /
+                   static_cast<double>(std::numeric_limits<size_t>::max());
+  return static_cast<double>(kSketchSize - 1) /
+         std::max(largest, std::numeric_limits<double>::min());
+}
+
+CollectionStatistics::CollectionGroupStatistics&
+CollectionStatistics::GroupLocked(const std::string& collection_group) {
+  auto group = groups_.find(collection_group);
+  if (group == groups_.end()) {
+    if (groups_.size() >= kMaxTrackedCollectionGroups) {
+      groups_.erase(LeastRecentlyUsed(&groups_));
+    }
+    group = groups_.insert({collection_group, {}}).first;
+  }
+  group->second.last_used = NextUseLocked();
+  return group->second;
+}
+
+const CollectionStatistics::CollectionGroupStatistics*
+CollectionStatistics::FindGroupLocked(
+    const std::string& collection_group) const {
+  auto group = groups_.find(collection_group);
+  if (group == groups_.end()) return nullptr;
+
+  group->second.last_used = NextUseLocked();
+  return &group->second;
+}
+
+void CollectionStatistics::RecordCollectionScan(
+    const ResourcePath& collection_path, size_t document_count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& counts = GroupLocked(collection_path.last_segment()).document_counts;
+  std::string canonical_path = collection_path.CanonicalString();
+  if (counts.size() >= kMaxTrackedCollections &&
+      counts.find(canonical_path) == counts.end()) {
+    counts.erase(LeastRecentlyUsed(&counts));
+  }
+  DocumentCount& count = counts[canonical_path];
+  count.count = static_cast<int64_t>(document_count);
+  count.last_used = NextUseLocked();
+}
+
+void CollectionStatistics::RecordDocumentChange(
+    const MutableDocument& existing_document,
+    const MutableDocument& new_document) {
+  // Hash before locking, since read-only queries wait for the lock.
+  auto value_hashes = HashTopLevelValues(new_document);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Deleted documents are stored as well, so only a document that was not in
+  // the cache before adds to the count. Removals are recorded separately.
+  if (!existing_document.is_valid_document() &&
+      new_document.is_valid_document()) {
+    // A count can only be kept up to date once the collection was scanned.
+    ResourcePath collection_path = new_document.key().path().PopLast();
+    auto group = groups_.find(collection_path.last_segment());
+    if (group != groups_.end()) {
+      auto& counts = group->second.document_counts;
+      auto count = counts.find(collection_path.CanonicalString());
+      if (count != counts.end()) ++count->second.count;
+    }
+  }
+  RecordValueHashesLocked(new_document.key(), value_hashes);
+}
+
+void CollectionStatistics::RecordDocumentRemoved(const DocumentKey& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ResourcePath collection_path = key.path().PopLast();
+  auto group = groups_.find(collection_path.last_segment());
+  if (group == groups_.end()) return;
+
+  auto& counts = group->second.document_counts;
+  auto count = counts.find(collection_path.CanonicalString());
+  if (count != counts.end()) {
+    count->second.count = std::max<int64_t>(count->second.count - 1, 0);
+  }
+}
+
+void CollectionStatistics::RecordDocumentValues(
+    const MutableDocument& document) {
+  auto value_hashes = HashTopLevelValues(document);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  RecordValueHashesLocked(document.key(), value_hashes);
+}
+
+void CollectionStatistics::RecordValueHashesLocked(
+    const model::DocumentKey& key,
+    const std::vector<std::pair<std::string, size_t>>& value_hashes) {
+  if (value_hashes.empty()) return;
+
+  auto& distinct_values =
+      GroupLocked(key.path().PopLast().last_segment()).distinct_values;
+  for (const auto& entry : value_hashes) {
+    auto sketch = distinct_values.find(entry.first);
+    if (sketch == distinct_values.end()) {
+      if (distinct_values.size() >= kMaxTrackedFields) continue;
+      sketch = distinct_values.insert({entry.first, {}}).first;
+    }
+    sketch->second.Add(entry.second);
+  }
+}
+
+void CollectionStatistics::RecordIndexScan(const core::Target& target,
+                                           size_t row_count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string collection_group = CollectionGroup(target);
+  absl::optional<size_t> document_count =
+      GetCollectionGroupDocumentCountLocked(collection_group);
+  if (!document_count || *document_count == 0) return;
+
+  // The group exists, since it has a document count.
+  auto& index_selectivity = groups_[collection_group].index_selectivity;
+  std::string filtered_fields = FilteredFields(target);
+  if (index_selectivity.size() >= kMaxTrackedFields &&
+      index_selectivity.find(filtered_fields) == index_selectivity.end()) {
+    return;
+  }
+  SelectivityHistogram& histogram = index_selectivity[filtered_fields];
+  size_t bucket = histogram.size() - 1;
+  if (row_count > 0) {
+    double fraction = std::min(
+        1.0, static_cast<double>(row_count) / *document_count);
+    bucket = std::min(bucket, static_cast<size_t>(-std::log2(fraction)));
+  }
+  ++histogram[bucket];
+}
+
+absl::optional<size_t> CollectionStatistics::GetDocumentCount(
+    const ResourcePath& collection_path) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const CollectionGroupStatistics* group =
+      FindGroupLocked(collection_path.last_segment());
+  if (!group) return absl::nullopt;
+
+  auto count = group->document_counts.find(collection_path.CanonicalString());
+  if (count == group->document_counts.end()) return absl::nullopt;
+  count->second.last_used = NextUseLocked();
+  return static_cast<size_t>(count->second.count);
+}
+
+absl::optional<size_t> CollectionStatistics::GetCollectionGroupDocumentCount(
+    const std::string& collection_group) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return GetCollectionGroupDocumentCountLocked(collection_group);
+}
+
+absl::optional<size_t>
+CollectionStatistics::GetCollectionGroupDocumentCountLocked(
+    const std::string& collection_group) const {
+  const CollectionGroupStatistics* group = FindGroupLocked(collection_group);
+  if (!group || group->document_counts.empty()) return absl::nullopt;
+
+  uint64_t use = NextUseLocked();
+  size_t total = 0;
+  for (const auto& count : group->document_counts) {
+    total += static_cast<size_t>(count.second.count);
+    count.second.last_used = use;
+  }
+  return total;
+}
+
+absl::optional<double> CollectionStatistics::EstimateDistinctValues(
+    const std::string& collection_group, const FieldPath& field_path) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return EstimateDistinctValuesLocked(collection_group, field_path);
+}
+
+absl::optional<double> CollectionStatistics::EstimateDistinctValuesLocked(
+    const std::string& collection_group, const FieldPath& field_path) const {
+  const CollectionGroupStatistics* group = FindGroupLocked(collection_group);
+  if (!group) return absl::nullopt;
+
+  auto sketch = group->distinct_values.find(field_path.CanonicalString());
+  if (sketch == group->distinct_values.end()) return absl::nullopt;
+  return sketch->second.Estimate();
+}
+
+absl::optional<double> CollectionStatistics::EstimateSelectivity(
+    const core::Target& target) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string collection_group = CollectionGroup(target);
+
+  // Filters of a conjunction are assumed to be independent. Filters that
+  // cannot be estimated are assumed to match every document.
+  absl::optional<double> selectivity;
+  for (const core::Filter& filter : target.filters()) {
+    if (!filter.IsAFieldFilter()) continue;
+
+    FieldFilter field_filter(filter);
+    absl::optional<double> distinct_values =
+        EstimateDistinctValuesLocked(collection_group, field_filter.field());
+    if (!distinct_values || *distinct_values < 1) continue;
+
+    double values = 1;
+    if (field_filter.op() == FieldFilter::Operator::In ||
+        field_filter.op() == FieldFilter::Operator::NotIn) {
+      values = field_filter.value().array_value.values_count;
+    }
+    double matching = std::min(1.0, values / *distinct_values);
+
+    switch (field_filter.op()) {
+      case FieldFilter::Operator::Equal:
+      case FieldFilter::Operator::In:
+        selectivity = selectivity.value_or(1) * matching;
+        break;
+      case FieldFilter::Operator::NotEqual:
+      case FieldFilter::Operator::NotIn:
+        selectivity = selectivity.value_or(1) * (1 - matching);
+        break;
+      default:
+        break;
+    }
+  }
+  if (selectivity) return selectivity;
+
+  const CollectionGroupStatistics* group = FindGroupLocked(collection_group);
+  if (!group) return absl::nullopt;
+  auto histogram = group->index_selectivity.find(FilteredFields(target));
+  if (histogram == group->index_selectivity.end()) {
+    return absl::nullopt;
+  }
+
+  int64_t total = 0;
+  for (int64_t count : histogram->second) total += count;
+  int64_t seen = 0;
+  for (size_t bucket = 0; bucket < histogram->second.size(); ++bucket) {
+    seen += histogram->second[bucket];
+    if (2 * seen >= total) {
+      // The geometric middle of the bucket's range.
+      return std::exp2(-(static_cast<double>(bucket) + 0.5));
+    }
+  }
+  return absl::nullopt;
+}
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIRESTORE_CORE_SRC_LOCAL_COLLECTION_STATISTICS_H_
+#define FIRESTORE_CORE_SRC_LOCAL_COLLECTION_STATISTICS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>  // NOLINT(build/c++11)
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Firestore/core/src/model/model_fwd.h"
+#include "Firestore/core/src/model/resource_path.h"
+#include "absl/types/optional.h"
+
+namespace firebase {
+namespace firestore {
+
+namespace core {
+class Target;
+}  // namespace core
+
+namespace local {
+
+/**
+ * Statistics about the documents in the local cache that the QueryEngine uses
+ * to estimate the cost of executing a query:
+ *
+ *   - The number of remote documents in each collection, including the
+ *     deleted documents that the cache remembers, since that is what a full
+ *     collection scan reads. Counts are taken from full collection scans, or
+ *     counted from the cache when a query first needs them, and kept up to
+ *     date as remote documents are added and removed, including by garbage
+ *     collection.
+ *   - An estimate of the number of distinct values of each top-level field in
+ *     a collection group, from the documents that are written and backfilled.
+ *     Fields with array or map values are not tracked.
+ *   - A histogram of the fraction of a collection group that index scans with
+ *     the same filtered fields returned.
+ *
+ * The statistics are estimates that are only kept in memory, so they are
+ * empty at startup and do not account for writes that are rolled back. The
+ * number of collections and collection groups they track is capped; when a
+ * cap is reached, the entry that was recorded or read least recently is
+ * evicted to make room. The class is thread-safe, since read-only queries run
+ * concurrently with writes.
+ */
+class CollectionStatistics {
+ public:
+  /**
+   * Records that a full scan of the collection at `collection_path` read
+   * `document_count` documents.
+   */
+  void RecordCollectionScan(const model::ResourcePath& collection_path,
+                            size_t document_count);
+
+  /**
+   * Records that the remote document `existing_document` was replaced by
+   * `new_document`.
+   */
+  void RecordDocumentChange(const model::MutableDocument& existing_document,
+                            const model::MutableDocument& new_document);
+
+  /**
+   * Records that the remote document at `key` was removed from the cache.
+   * Should only be called if the cache contained the document; otherwise the
+   * count of its collection ends up too low.
+   */
+  void RecordDocumentRemoved(const model::DocumentKey& key);
+
+  /** Records the field values of `document` without changing any counts. */
+  void RecordDocumentValues(const model::MutableDocument& document);
+
+  /**
+   * Records that an index scan for `target`, which must not have a limit,
+   * returned `row_count` documents.
+   */
+  void RecordIndexScan(const core::Target& target, size_t row_count);
+
+  /**
+   * Returns the number of documents in the collection at `collection_path`,
+   * or nullopt if it has not been scanned yet.
+   */
+  absl::optional<size_t> GetDocumentCount(
+      const model::ResourcePath& collection_path) const;
+
+  /**
+   * Returns the number of documents in the collections of `collection_group`
+   * that have been scanned, or nullopt if none has been scanned yet.
+   */
+  absl::optional<size_t> GetCollectionGroupDocumentCount(
+      const std::string& collection_group) const;
+
+  /**
+   * Returns an estimate of the number of distinct values of the top-level
+   * field at `field_path` in `collection_group`, or nullopt if no value has
+   * been recorded.
+   */
+  absl::optional<double> EstimateDistinctValues(
+      const std::string& collection_group,
+      const model::FieldPath& field_path) const;
+
+  /**
+   * Returns an estimate of the fraction of the documents in the target's
+   * collection group that match its filters, or nullopt if nothing is known
+   * about them.
+   *
+   * Equality, `in`, `!=` and `not-in` filters are estimated from the number of
+   * distinct values of their field. Otherwise, the median of the index scans
+   * recorded for the same filtered fields is used.
+   */
+  absl::optional<double> EstimateSelectivity(const core::Target& target) const;
+
+ private:
+  /**
+   * Estimates the number of distinct values from the smallest hashes of the
+   * values seen so far (a "k minimum values" sketch).
+   */
+  class DistinctValueSketch {
+   public:
+    void Add(size_t hash);
+    double Estimate() const;
+
+   private:
+    std::set<size_t> smallest_hashes_;
+  };
+
+  /**
+   * Counts index scans by the fraction of the collection group they returned,
+   * in buckets that halve in size: (1/2, 1], (1/4, 1/2] and so on.
+   */
+  using SelectivityHistogram = std::array<int64_t, 12>;
+
+  struct DocumentCount {
+    int64_t count = 0;
+
+    /** The value of `use_clock_` when the count was last recorded or read. */
+    mutable uint64_t last_used = 0;
+  };
+
+  struct CollectionGroupStatistics {
+    /** Document counts by canonical collection path. */
+    std::unordered_map<std::string, DocumentCount> document_counts;
+
+    /** Sketches by canonical field path. */
+    std::unordered_map<std::string, DistinctValueSketch> distinct_values;
+
+    /** Histograms by the canonical field paths of the scan's filters. */
+    std::unordered_map<std::string, SelectivityHistogram> index_selectivity;
+
+    /** The value of `use_clock_` when the group was last recorded or read. */
+    mutable uint64_t last_used = 0;
+  };
+
+  /** Advances `use_clock_` and returns its new value. */
+  uint64_t NextUseLocked() const {
+    return ++use_clock_;
+  }
+
+  /**
+   * Returns the statistics of `collection_group` and marks them as used, or
+   * nullptr if the group is not tracked.
+   */
+  const CollectionGroupStatistics* FindGroupLocked(
+      const std::string& collection_group) const;
+
+  /**
+   * Returns the statistics of `collection_group` and marks them as used,
+   * evicting the least recently used collection group first if the number of
+   * tracked groups has reached its cap.
+   */
+  CollectionGroupStatistics& GroupLocked(const std::string& collection_group);
+
+  /**
+   * Adds the hashed top-level values of the document at `key`, given as
+   * canonical field paths and hashes, to the sketches of its collection group.
+   */
+  void RecordValueHashesLocked(
+      const model::DocumentKey& key,
+      const std::vector<std::pair<std::string, size_t>>& value_hashes);
+
+  absl::optional<double> EstimateDistinctValuesLocked(
+      const std::string& collection_group,
+      const model::FieldPath& field_path) const;
+
+  absl::optional<size_t> GetCollectionGroupDocumentCountLocked(
+      const std::string& collection_group) const;
+
+  mutable std::mutex mutex_;
+
+  // Orders uses of the tracked statistics, so that the least recently used
+  // entry is evicted when a cap is reached.
+  mutable uint64_t use_clock_ = 0;
+
+  std::unordered_map<std::string, CollectionGroupStatistics> groups_;
+};
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
+
+#endif  // FIRESTORE_CORE_SRC_LOCAL_COLLECTION_STATISTICS_H_
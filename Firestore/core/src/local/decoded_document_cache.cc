@@ -0,0 +1,139 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/decoded_document_cache.h"
+
+#include <iterator>
+#include <utility>
+
+#include "Firestore/core/src/util/hard_assert.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+
+using model::DocumentKey;
+using model::MutableDocument;
+using model::SnapshotVersion;
+
+constexpr int64_t DecodedDocumentCache::DefaultMaxSizeBytes;
+
+DecodedDocumentCache::DecodedDocumentCache(int64_t max_size_bytes)
+    : max_size_bytes_(max_size_bytes) {
+  HARD_ASSERT(max_size_bytes >= 0, "Invalid byte budget %s", max_size_bytes);
+}
+
+absl::optional<MutableDocument> DecodedDocumentCache::Lookup(
+    const DocumentKey& key, const SnapshotVersion& read_time) {
+  MutableDocument document;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(key);
+    if (found == index_.end() ||
+        found->second->document.read_time() != read_time) {
+      ++miss_count_;
+      return absl::nullopt;
+    }
+
+    ++hit_count_;
+    entries_.splice(entries_.begin(), entries_, found->second);
+    document = found->second->document;
+  }
+
+  // Cached documents are never modified, so they can be cloned without holding
+  // the lock. Callers receive a deep copy because applying mutations modifies
+  // document contents in place.
+  return document.Clone();
+}
+
+void DecodedDocumentCache::Insert(const MutableDocument& document,
+                                  int64_t encoded_size) {
+  MutableDocument copy = document.Clone();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = index_.find(document.key());
+  if (found != index_.end()) {
+    RemoveLocked(found->second);
+  }
+
+  if (encoded_size > max_size_bytes_) {
+    return;
+  }
+
+  entries_.push_front(Entry{std::move(copy), encoded_size});
+  index_.emplace(document.key(), entries_.begin());
+  size_bytes_ += encoded_size;
+  EvictLocked();
+}
+
+void DecodedDocumentCache::Invalidate(const DocumentKey& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    RemoveLocked(found->second);
+  }
+}
+
+void DecodedDocumentCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_.clear();
+  entries_.clear();
+  size_bytes_ = 0;
+}
+
+void DecodedDocumentCache::SetMaxSizeBytes(int64_t max_size_bytes) {
+  HARD_ASSERT(max_size_bytes >= 0, "Invalid byte budget %s", max_size_bytes);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_size_bytes_ = max_size_bytes;
+  EvictLocked();
+}
+
+int64_t DecodedDocumentCache::size_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_bytes_;
+}
+
+size_t DecodedDocumentCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+int64_t DecodedDocumentCache::hit_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hit_count_;
+}
+
+int64_t DecodedDocumentCache::miss_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return miss_count_;
+}
+
+void DecodedDocumentCache::RemoveLocked(EntryList::iterator entry) {
+  size_bytes_ -= entry->size_bytes;
+  index_.erase(entry->document.key());
+  entries_.erase(entry);
+}
+
+void DecodedDocumentCache::EvictLocked() {
+  while (size_bytes_ > max_size_bytes_) {
+    RemoveLocked(std::prev(entries_.end()));
+  }
+}
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIRESTORE_CORE_SRC_LOCAL_DECODED_DOCUMENT_CACHE_H_
+#define FIRESTORE_CORE_SRC_LOCAL_DECODED_DOCUMENT_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <mutex>  // NOLINT(build/c++11)
+#include <unordered_map>
+
+#include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/src/model/snapshot_version.h"
+#include "absl/types/optional.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+
+/**
+ * A bounded, thread-safe cache of documents decoded from the remote documents
+ * table, keyed by document key and read time.
+ *
+ * A cached document is only returned for the read time it was decoded at. The
+ * cache does not know whether the document still exists: callers must confirm
+ * that the row is present before using a cached copy.
+ *
+ * The cache is bounded by the total encoded size of the cached documents. The
+ * least recently used documents are evicted first.
+ */
+class DecodedDocumentCache {
+ public:
+  /** The default byte budget. */
+  static constexpr int64_t DefaultMaxSizeBytes = 8 * 1024 * 1024;
+
+  /**
+   * Creates a cache that holds at most `max_size_bytes` of encoded documents.
+   * A budget of zero disables caching.
+   */
+  explicit DecodedDocumentCache(int64_t max_size_bytes = DefaultMaxSizeBytes);
+
+  /**
+   * Returns a copy of the document with the given key if it was cached at
+   * `read_time`. The copy may be modified freely.
+   */
+  absl::optional<model::MutableDocument> Lookup(
+      const model::DocumentKey& key, const model::SnapshotVersion& read_time);
+
+  /**
+   * Caches `document`, whose read time must be set, replacing any other
+   * version of it.
+   *
+   * @param encoded_size The size of the encoded document, charged against the
+   *     byte budget.
+   */
+  void Insert(const model::MutableDocument& document, int64_t encoded_size);
+
+  /** Removes every cached version of the document with the given key. */
+  void Invalidate(const model::DocumentKey& key);
+
+  /** Removes all cached documents. */
+  void Clear();
+
+  /** Changes the byte budget, evicting documents if necessary. */
+  void SetMaxSizeBytes(int64_t max_size_bytes);
+
+  /** Returns the total encoded size of the cached documents. */
+  int64_t size_bytes() const;
+
+  /** Returns the number of cached documents. */
+  size_t size() const;
+
+  /** Returns the number of lookups that returned a document. */
+  int64_t hit_count() const;
+
+  /** Returns the number of lookups that did not return a document. */
+  int64_t miss_count() const;
+
+ private:
+  struct Entry {
+    model::MutableDocument document;
+    int64_t size_bytes = 0;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  void RemoveLocked(EntryList::iterator entry);
+  void EvictLocked();
+
+  mutable std::mutex mutex_;
+
+  int64_t max_size_bytes_ = 0;
+  int64_t size_bytes_ = 0;
+  int64_t hit_count_ = 0;
+  int64_t miss_count_ = 0;
+
+  /** Cached entries, most recently used first. */
+  EntryList entries_;
+  std::unordered_map<model::DocumentKey,
+                     EntryList::iterator,
+                     model::DocumentKeyHash>
+      index_;
+};
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
+
+#endif  // FIRESTORE_CORE_SRC_LOCAL_DECODED_DOCUMENT_CACHE_H_
@@ -17,6 +17,7 @@
 #include <unordered_set>
 #include <utility>
 
+#include "Firestore/core/src/local/collection_statistics.h"
 #include "Firestore/core/src/local/index_backfiller.h"
 #include "Firestore/core/src/local/index_manager.h"
 #include "Firestore/core/src/local/local_documents_view.h"
@@ -35,10 +36,21 @@ namespace {
 using model::IndexOffset;
 
 /**
- * The maximum number of documents to process each time Backfill() is called.
+ * The maximum number of documents to process each time Backfill() is called,
+ * until the throughput of the backfiller has been measured. This is also the
+ * least that an adjusted cap allows.
  */
 static const size_t kMaxDocumentsToProcess = 50;
 
+/** The most documents that an adjusted cap allows. */
+static const size_t kMaxAdjustedDocumentsToProcess = 10000;
+
+/**
+ * How much larger than the largest measured run the cap can be, so that a
+ * single fast run does not produce a run that blocks the queue for long.
+ */
+static const size_t kMaxGrowthFactor = 2;
+
 }  // namespace
 
 IndexBackfiller::IndexBackfiller() {
@@ -65,10 +77,34 @@ size_t IndexBackfiller::WriteIndexEntries(const LocalStore* local_store) {
   return max_documents_to_process_ - documents_remaining;
 }
 
+void IndexBackfiller::SetTargetDuration(
+    std::chrono::milliseconds target_duration) {
+  if (documents_per_millisecond_ == 0) return;
+
+  auto documents = static_cast<size_t>(documents_per_millisecond_ *
+                                       target_duration.count());
+  documents = std::min(documents, largest_measured_run_ * kMaxGrowthFactor);
+  max_documents_to_process_ = std::max(
+      kMaxDocumentsToProcess,
+      std::min(documents, kMaxAdjustedDocumentsToProcess));
+}
+
+void IndexBackfiller::RecordThroughput(size_t documents_processed,
+                                       std::chrono::milliseconds elapsed) {
+  // A run that stopped short of the cap says nothing about how many documents
+  // fit in a given duration.
+  if (documents_processed < max_documents_to_process_) return;
+
+  auto measured = std::max(elapsed, std::chrono::milliseconds(1));
+  documents_per_millisecond_ =
+      static_cast<double>(documents_processed) / measured.count();
+  largest_measured_run_ = std::max(largest_measured_run_, documents_processed);
+}
+
 size_t IndexBackfiller::WriteEntriesForCollectionGroup(
     const LocalStore* local_store,
     const std::string& collection_group,
-    size_t documents_remaining_under_cap) const {
+    size_t documents_remaining_under_cap) {
   IndexManager* index_manager = local_store->index_manager();
   const auto* const local_documents_view = local_store->local_documents();
 
@@ -78,11 +114,24 @@ size_t IndexBackfiller::WriteEntriesForCollectionGroup(
       collection_group, existing_offset, documents_remaining_under_cap);
   index_manager->UpdateIndexEntries(next_batch.changes());
 
+  CollectionStatistics* statistics = local_store->statistics();
+  for (const auto& entry : next_batch.changes()) {
+    statistics->RecordDocumentValues(entry.second.get());
+  }
+
   const auto new_offset = GetNewOffset(existing_offset, next_batch);
   LOG_DEBUG("Updating offset: %s", new_offset.ToString());
   index_manager->UpdateCollectionGroup(collection_group, new_offset);
 
-  return next_batch.changes().size();
+  size_t documents_processed = next_batch.changes().size();
+  IndexBackfillProgress& progress = progress_[collection_group];
+  progress.documents_processed += documents_processed;
+  progress.up_to_date = documents_processed < documents_remaining_under_cap;
+  LOG_DEBUG("Backfilled %s documents in collection group %s (%s in total)%s",
+            documents_processed, collection_group, progress.documents_processed,
+            progress.up_to_date ? ", now up to date" : "");
+
+  return documents_processed;
 }
 
 model::IndexOffset IndexBackfiller::GetNewOffset(
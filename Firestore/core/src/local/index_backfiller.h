@@ -15,8 +15,10 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_INDEX_BACKFILLER_H_
 #define FIRESTORE_CORE_SRC_LOCAL_INDEX_BACKFILLER_H_
 
+#include <chrono>  // NOLINT(build/c++11)
 #include <cstddef>
 #include <string>
+#include <unordered_map>
 
 namespace firebase {
 namespace firestore {
@@ -35,6 +37,18 @@ class LocalStore;
 class LocalWriteResult;
 class IndexManager;
 
+/** The backfill progress of a single collection group. */
+struct IndexBackfillProgress {
+  /** The number of documents indexed since the backfiller was created. */
+  size_t documents_processed = 0;
+
+  /**
+   * True if the last backfill of the collection group indexed every document
+   * that was left.
+   */
+  bool up_to_date = false;
+};
+
 /** Implements the steps for backfilling indexes. */
 class IndexBackfiller {
  public:
@@ -46,6 +60,34 @@ class IndexBackfiller {
    */
   size_t WriteIndexEntries(const LocalStore* local_store);
 
+  /**
+   * Sets the cap on the number of documents that `WriteIndexEntries`
+   * processes so that the next call takes about `target_duration`, based on
+   * the throughput recorded so far.
+   */
+  void SetTargetDuration(std::chrono::milliseconds target_duration);
+
+  /**
+   * Records that the last call to `WriteIndexEntries` processed
+   * `documents_processed` documents in `elapsed`.
+   */
+  void RecordThroughput(size_t documents_processed,
+                        std::chrono::milliseconds elapsed);
+
+  size_t max_documents_to_process() const {
+    return max_documents_to_process_;
+  }
+
+  /**
+   * Returns the progress of each collection group that was backfilled by this
+   * instance. It is only kept in memory: a new instance resumes from the index
+   * offsets that the IndexManager saved.
+   */
+  const std::unordered_map<std::string, IndexBackfillProgress>& progress()
+      const {
+    return progress_;
+  }
+
  private:
   friend class IndexBackfillerTest;
   friend class LocalStoreTestBase;
@@ -57,7 +99,7 @@ class IndexBackfiller {
   size_t WriteEntriesForCollectionGroup(
       const LocalStore* local_store,
       const std::string& collection_group,
-      size_t documents_remaining_under_cap) const;
+      size_t documents_remaining_under_cap);
 
   /** Returns the next offset based on the provided documents. */
   model::IndexOffset GetNewOffset(const model::IndexOffset& existing_offset,
@@ -69,6 +111,13 @@ class IndexBackfiller {
   }
 
   size_t max_documents_to_process_;
+
+  // The measured throughput, or 0 before any call has reached the cap.
+  double documents_per_millisecond_ = 0;
+  // The most documents that a measured call has processed.
+  size_t largest_measured_run_ = 0;
+
+  std::unordered_map<std::string, IndexBackfillProgress> progress_;
 };
 
 }  // namespace local
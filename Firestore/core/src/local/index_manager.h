@@ -39,6 +39,8 @@ class ResourcePath;
 
 namespace local {
 
+class QueryContext;
+
 /**
  * Represents a set of indexes that are used to execute queries efficiently.
  *
@@ -136,10 +138,22 @@ class IndexManager {
   /**
    * Returns the documents that match the given target based on the provided
    * index, or `nullopt` if the query cannot be served from an index.
+   *
+   * If the target has a limit, each of its index scans stops after that many
+   * documents, which are returned in index order unless the target has an `in`
+   * filter.
    */
   virtual absl::optional<std::vector<model::DocumentKey>>
   GetDocumentsMatchingTarget(const core::Target& target) = 0;
 
+  /**
+   * Like `GetDocumentsMatchingTarget` above, but also records the index ranges
+   * that were scanned and the entries that were read in `context`.
+   */
+  virtual absl::optional<std::vector<model::DocumentKey>>
+  GetDocumentsMatchingTarget(const core::Target& target,
+                             absl::optional<QueryContext>& context) = 0;
+
   /**
    * Returns the next collection group to update. Returns `nullopt` if no
    * group exists.
@@ -16,14 +16,22 @@
 
 #include "Firestore/core/src/local/leveldb_bundle_cache.h"
 
+#include <string>
 #include <utility>
 
+#include "Firestore/Protos/nanopb/firestore/local/maybe_document.nanopb.h"
 #include "Firestore/core/src/bundle/bundle_metadata.h"
 #include "Firestore/core/src/bundle/named_query.h"
 #include "Firestore/core/src/local/leveldb_key.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_transaction.h"
+#include "Firestore/core/src/local/local_serializer.h"
+#include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/src/nanopb/message.h"
 #include "Firestore/core/src/nanopb/reader.h"
 #include "Firestore/core/src/util/hard_assert.h"
+#include "Firestore/core/src/util/ordered_code.h"
+#include "absl/strings/match.h"
 
 namespace firebase {
 namespace firestore {
@@ -31,8 +39,11 @@ namespace local {
 
 using bundle::BundleMetadata;
 using bundle::NamedQuery;
+using model::MutableDocument;
+using model::MutableDocumentMap;
 using nanopb::Message;
 using nanopb::StringReader;
+using util::OrderedCode;
 
 LevelDbBundleCache::LevelDbBundleCache(LevelDbPersistence* db,
                                        LocalSerializer* serializer)
@@ -99,6 +110,89 @@ void LevelDbBundleCache::SaveNamedQuery(const NamedQuery& query) {
   db_->current_transaction()->Put(key, serializer_->EncodeNamedQuery(query));
 }
 
+absl::optional<uint32_t> LevelDbBundleCache::GetBundleLoadProgress(
+    const BundleMetadata& metadata) const {
+  auto key = LevelDbBundleLoadKey::Key(metadata.bundle_id());
+  std::string encoded;
+  auto done = db_->current_transaction()->Get(key, &encoded);
+
+  if (!done.ok()) {
+    return absl::nullopt;
+  }
+
+  absl::string_view src = encoded;
+  int64_t seconds = 0;
+  int64_t nanos = 0;
+  uint64_t documents_staged = 0;
+  if (!OrderedCode::ReadSignedNumIncreasing(&src, &seconds) ||
+      !OrderedCode::ReadSignedNumIncreasing(&src, &nanos) ||
+      !OrderedCode::ReadNumIncreasing(&src, &documents_staged)) {
+    HARD_FAIL("Bundle load progress failed to decode for bundle %s",
+              metadata.bundle_id());
+  }
+
+  const Timestamp& create_time = metadata.create_time().timestamp();
+  if (seconds != create_time.seconds() ||
+      nanos != create_time.nanoseconds()) {
+    return absl::nullopt;
+  }
+  return static_cast<uint32_t>(documents_staged);
+}
+
+void LevelDbBundleCache::SaveBundleLoadProgress(const BundleMetadata& metadata,
+                                                uint32_t documents_staged) {
+  // Stored as the bundle's create time followed by the number of documents.
+  const Timestamp& create_time = metadata.create_time().timestamp();
+  std::string encoded;
+  OrderedCode::WriteSignedNumIncreasing(&encoded, create_time.seconds());
+  OrderedCode::WriteSignedNumIncreasing(&encoded, create_time.nanoseconds());
+  OrderedCode::WriteNumIncreasing(&encoded, documents_staged);
+
+  auto key = LevelDbBundleLoadKey::Key(metadata.bundle_id());
+  db_->current_transaction()->Put(key, encoded);
+}
+
+void LevelDbBundleCache::StageBundledDocument(const std::string& bundle_id,
+                                              const MutableDocument& document) {
+  auto key = LevelDbBundleDocumentKey::Key(bundle_id, document.key());
+  db_->current_transaction()->Put(
+      key, serializer_->EncodeMaybeDocument(document));
+}
+
+MutableDocumentMap LevelDbBundleCache::TakeStagedDocuments(
+    const std::string& bundle_id, size_t count) {
+  MutableDocumentMap result;
+  std::string prefix = LevelDbBundleDocumentKey::KeyPrefix(bundle_id);
+  auto it = db_->current_transaction()->NewIterator();
+  for (it->Seek(prefix); result.size() < count && it->Valid() &&
+                         absl::StartsWith(it->key(), prefix);
+       it->Next()) {
+    StringReader reader{it->value()};
+    auto message = Message<firestore_client_MaybeDocument>::TryParse(&reader);
+    MutableDocument document =
+        serializer_->DecodeMaybeDocument(&reader, *message);
+    if (!reader.ok()) {
+      HARD_FAIL("Staged bundle document failed to parse: %s",
+                reader.status().ToString());
+    }
+
+    result = result.insert(document.key(), document);
+    db_->current_transaction()->Delete(it->key());
+  }
+  return result;
+}
+
+void LevelDbBundleCache::RemoveBundleLoad(const std::string& bundle_id) {
+  db_->current_transaction()->Delete(LevelDbBundleLoadKey::Key(bundle_id));
+
+  std::string prefix = LevelDbBundleDocumentKey::KeyPrefix(bundle_id);
+  auto it = db_->current_transaction()->NewIterator();
+  for (it->Seek(prefix); it->Valid() && absl::StartsWith(it->key(), prefix);
+       it->Next()) {
+    db_->current_transaction()->Delete(it->key());
+  }
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
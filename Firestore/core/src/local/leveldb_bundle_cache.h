@@ -17,11 +17,14 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_BUNDLE_CACHE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_BUNDLE_CACHE_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 #include "Firestore/core/src/bundle/bundle_metadata.h"
 #include "Firestore/core/src/bundle/named_query.h"
 #include "Firestore/core/src/local/bundle_cache.h"
+#include "Firestore/core/src/model/model_fwd.h"
 #include "absl/types/optional.h"
 
 namespace firebase {
@@ -46,6 +49,20 @@ class LevelDbBundleCache : public BundleCache {
 
   void SaveNamedQuery(const bundle::NamedQuery& query) override;
 
+  absl::optional<uint32_t> GetBundleLoadProgress(
+      const bundle::BundleMetadata& metadata) const override;
+
+  void SaveBundleLoadProgress(const bundle::BundleMetadata& metadata,
+                              uint32_t documents_staged) override;
+
+  void StageBundledDocument(const std::string& bundle_id,
+                            const model::MutableDocument& document) override;
+
+  model::MutableDocumentMap TakeStagedDocuments(const std::string& bundle_id,
+                                                size_t count) override;
+
+  void RemoveBundleLoad(const std::string& bundle_id) override;
+
  private:
   // The LevelDbBundleCache is owned by LevelDbPersistence.
   LevelDbPersistence* db_ = nullptr;
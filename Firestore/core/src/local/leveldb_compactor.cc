@@ -0,0 +1,119 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/leveldb_compactor.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "Firestore/core/src/util/hard_assert.h"
+#include "Firestore/core/src/util/log.h"
+#include "Firestore/core/src/util/string_util.h"
+#include "leveldb/db.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+
+constexpr int64_t LevelDbCompactor::kMinDeletedKeysToCompact;
+
+LevelDbCompactor::LevelDbCompactor(leveldb::DB* db) : db_(db) {
+  HARD_ASSERT(db_ != nullptr, "LevelDbCompactor requires a database");
+}
+
+void LevelDbCompactor::AddRange(std::string begin,
+                                std::string end,
+                                int64_t deleted_keys) {
+  HARD_ASSERT(begin <= end, "Invalid compaction range");
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_ranges_.push_back(Range{std::move(begin), std::move(end)});
+  pending_deleted_keys_ += deleted_keys;
+  ++stats_.ranges_recorded;
+}
+
+void LevelDbCompactor::AddPrefix(const std::string& prefix,
+                                 int64_t deleted_keys) {
+  AddRange(prefix, util::PrefixSuccessor(prefix), deleted_keys);
+}
+
+bool LevelDbCompactor::ShouldCompact() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_deleted_keys_ >= kMinDeletedKeysToCompact;
+}
+
+void LevelDbCompactor::CompactPendingRanges() {
+  std::vector<Range> ranges;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ranges.swap(pending_ranges_);
+    pending_deleted_keys_ = 0;
+  }
+  if (ranges.empty()) return;
+
+  std::sort(ranges.begin(), ranges.end(),
+            [](const Range& lhs, const Range& rhs) {
+              return lhs.begin < rhs.begin;
+            });
+  std::vector<Range> merged;
+  for (Range& range : ranges) {
+    if (!merged.empty() && range.begin <= merged.back().end) {
+      merged.back().end = std::max(merged.back().end, range.end);
+    } else {
+      merged.push_back(std::move(range));
+    }
+  }
+
+  // Compaction runs without holding the lock so that ranges can be recorded
+  // meanwhile. LevelDB allows compaction concurrently with reads and writes.
+  auto start = std::chrono::steady_clock::now();
+  int64_t bytes_before = 0;
+  int64_t bytes_after = 0;
+  for (const Range& range : merged) {
+    leveldb::Slice begin(range.begin);
+    leveldb::Slice end(range.end);
+    leveldb::Range size_range(begin, end);
+
+    uint64_t size = 0;
+    db_->GetApproximateSizes(&size_range, 1, &size);
+    bytes_before += static_cast<int64_t>(size);
+
+    db_->CompactRange(&begin, &end);
+
+    db_->GetApproximateSizes(&size_range, 1, &size);
+    bytes_after += static_cast<int64_t>(size);
+  }
+  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  LOG_DEBUG("Compacted %s key ranges in %s ms, approximately %s to %s bytes",
+            merged.size(), duration.count(), bytes_before, bytes_after);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.ranges_compacted += static_cast<int64_t>(merged.size());
+  stats_.approximate_bytes_before += bytes_before;
+  stats_.approximate_bytes_after += bytes_after;
+  stats_.duration += duration;
+}
+
+LevelDbCompactionStats LevelDbCompactor::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
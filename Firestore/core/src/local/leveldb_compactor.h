@@ -0,0 +1,117 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_COMPACTOR_H_
+#define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_COMPACTOR_H_
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+
+namespace leveldb {
+class DB;
+}  // namespace leveldb
+
+namespace firebase {
+namespace firestore {
+namespace local {
+
+/** Counters describing the work done by a `LevelDbCompactor`. */
+struct LevelDbCompactionStats {
+  /** The number of key ranges recorded by bulk deletes. */
+  int64_t ranges_recorded = 0;
+
+  /** The number of `CompactRange` calls, after merging overlapping ranges. */
+  int64_t ranges_compacted = 0;
+
+  /** The approximate on-disk size of the compacted ranges before compaction. */
+  int64_t approximate_bytes_before = 0;
+
+  /** The approximate on-disk size of the compacted ranges after compaction. */
+  int64_t approximate_bytes_after = 0;
+
+  /** The total time spent compacting. */
+  std::chrono::milliseconds duration{0};
+};
+
+/**
+ * Tracks the key ranges emptied by bulk deletes and compacts them on demand.
+ *
+ * LevelDB keeps deletion markers until background compaction reaches them, so
+ * until then scans over a range that was mostly deleted still step over every
+ * deleted key. Compacting the range drops the markers.
+ *
+ * Ranges can be recorded from the thread that runs transactions while
+ * `CompactPendingRanges` runs on another thread.
+ */
+class LevelDbCompactor {
+ public:
+  /**
+   * The number of deleted keys that makes compacting the recorded ranges
+   * worthwhile.
+   */
+  static constexpr int64_t kMinDeletedKeysToCompact = 1000;
+
+  /** Creates a compactor for `db`, which must outlive it. */
+  explicit LevelDbCompactor(leveldb::DB* db);
+
+  /**
+   * Records that about `deleted_keys` keys were deleted between `begin` and
+   * `end`, inclusive.
+   */
+  void AddRange(std::string begin, std::string end, int64_t deleted_keys);
+
+  /**
+   * Records that about `deleted_keys` keys were deleted from the keys that
+   * start with `prefix`.
+   */
+  void AddPrefix(const std::string& prefix, int64_t deleted_keys);
+
+  /**
+   * Returns true if enough keys were deleted in the recorded ranges for
+   * `CompactPendingRanges` to be worthwhile.
+   */
+  bool ShouldCompact() const;
+
+  /**
+   * Compacts the recorded ranges, merging overlapping ones first, and forgets
+   * them. Blocks until compaction finishes.
+   */
+  void CompactPendingRanges();
+
+  LevelDbCompactionStats stats() const;
+
+ private:
+  struct Range {
+    std::string begin;
+    std::string end;
+  };
+
+  leveldb::DB* db_;
+
+  mutable std::mutex mutex_;
+  std::vector<Range> pending_ranges_;
+  int64_t pending_deleted_keys_ = 0;
+  LevelDbCompactionStats stats_;
+};
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
+
+#endif  // FIRESTORE_CORE_SRC_LOCAL_LEVELDB_COMPACTOR_H_
@@ -89,8 +89,13 @@ OverlayByDocumentKeyMap LevelDbDocumentOverlayCache::GetOverlays(
     const ResourcePath& collection, int since_batch_id) const {
   OverlayByDocumentKeyMap result;
   ForEachKeyInCollection(
-      collection, since_batch_id, [&](LevelDbDocumentOverlayKey&& key) {
-        absl::optional<Overlay> overlay = GetOverlay(key);
+      collection, since_batch_id,
+      [&](LevelDbDocumentOverlayKey&& key, absl::string_view encoded_mutation) {
+        // Index entries written by older versions do not hold the mutation.
+        absl::optional<Overlay> overlay =
+            encoded_mutation.empty()
+                ? GetOverlay(key)
+                : absl::make_optional(ParseOverlay(key, encoded_mutation));
         HARD_ASSERT(overlay.has_value());
         result[std::move(key).document_key()] = std::move(overlay).value();
       });
@@ -174,11 +179,16 @@ void LevelDbDocumentOverlayCache::SaveOverlay(int largest_batch_id,
 
   const LevelDbDocumentOverlayKey key(user_id_, document_key, largest_batch_id);
 
-  // Add the overlay to the database and index entries pointing to it.
+  // Add the overlay to the database and index entries pointing to it. The
+  // collection index holds a copy of the mutation so that collection queries
+  // can avoid looking up each overlay.
   auto* transaction = db_->current_transaction();
-  transaction->Put(key.Encode(), serializer_->EncodeMutation(mutation));
+  std::string encoded_mutation =
+      nanopb::MakeStdString(serializer_->EncodeMutation(mutation));
+  transaction->Put(key.Encode(), encoded_mutation);
   transaction->Put(LevelDbDocumentOverlayLargestBatchIdIndexKey::Key(key), "");
-  transaction->Put(LevelDbDocumentOverlayCollectionIndexKey::Key(key), "");
+  transaction->Put(LevelDbDocumentOverlayCollectionIndexKey::Key(key),
+                   std::move(encoded_mutation));
 
   absl::optional<std::string> collection_group_index_key =
       LevelDbDocumentOverlayCollectionGroupIndexKey::Key(key);
@@ -237,7 +247,8 @@ void LevelDbDocumentOverlayCache::ForEachKeyWithLargestBatchId(
 void LevelDbDocumentOverlayCache::ForEachKeyInCollection(
     const ResourcePath& collection,
     int since_batch_id,
-    std::function<void(LevelDbDocumentOverlayKey&&)> callback) const {
+    std::function<void(LevelDbDocumentOverlayKey&&, absl::string_view)>
+        callback) const {
   const std::string index_start_key =
       LevelDbDocumentOverlayCollectionIndexKey::KeyPrefix(user_id_, collection,
                                                           since_batch_id + 1);
@@ -253,7 +264,7 @@ void LevelDbDocumentOverlayCache::ForEachKeyInCollection(
     if (key.collection() != collection) {
       break;
     }
-    callback(std::move(key).ToLevelDbDocumentOverlayKey());
+    callback(std::move(key).ToLevelDbDocumentOverlayKey(), it->value());
   }
 }
 
@@ -99,10 +99,15 @@ class LevelDbDocumentOverlayCache final : public DocumentOverlayCache {
       int largest_batch_id,
       std::function<void(LevelDbDocumentOverlayKey&&)>) const;
 
+  /**
+   * Invokes the callback with each overlay key in the collection index and
+   * the encoded mutation stored alongside it, which may be empty.
+   */
   void ForEachKeyInCollection(
       const model::ResourcePath& collection,
       int since_batch_id,
-      std::function<void(LevelDbDocumentOverlayKey&&)>) const;
+      std::function<void(LevelDbDocumentOverlayKey&&, absl::string_view)>)
+      const;
 
   void ForEachKeyInCollectionGroup(
       absl::string_view collection_group,
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/leveldb_field_name_dictionary.h"
+
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Firestore/core/src/local/leveldb_key.h"
+#include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_util.h"
+#include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/nanopb/nanopb_util.h"
+#include "Firestore/core/src/util/hard_assert.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "leveldb/db.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using model::DocumentKey;
+using nanopb::MakeBytesArray;
+
+const std::string& CollectionId(const DocumentKey& key) {
+  const model::ResourcePath& path = key.path();
+  return path[path.size() - 2];
+}
+
+/**
+ * Replaces the name of every top-level field of `document` with the result of
+ * `rename`, which returns an empty string if the name cannot be renamed.
+ */
+template <typename Rename>
+bool RenameFields(google_firestore_v1_Document* document,
+                  const Rename& rename) {
+  for (pb_size_t i = 0; i < document->fields_count; ++i) {
+    google_firestore_v1_Document_FieldsEntry& entry = document->fields[i];
+    std::string renamed = rename(nanopb::MakeStringView(entry.key));
+    if (renamed.empty()) {
+      return false;
+    }
+    std::free(entry.key);
+    entry.key = MakeBytesArray(renamed);
+  }
+  return true;
+}
+
+}  // namespace
+
+LevelDbFieldNameDictionary::LevelDbFieldNameDictionary(LevelDbPersistence* db)
+    : db_(NOT_NULL(db)), dictionaries_(std::make_shared<Dictionaries>()) {
+}
+
+constexpr size_t LevelDbFieldNameDictionary::kMaxFieldNames;
+
+bool LevelDbFieldNameDictionary::Encode(
+    const DocumentKey& key, google_firestore_v1_Document* document) {
+  const std::string& collection_id = CollectionId(key);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::shared_ptr<const Dictionary> dictionary = LoadLocked(collection_id);
+
+  std::vector<std::string> new_names;
+  for (pb_size_t i = 0; i < document->fields_count; ++i) {
+    std::string name = nanopb::MakeString(document->fields[i].key);
+    if (dictionary->ids.find(name) == dictionary->ids.end()) {
+      new_names.push_back(std::move(name));
+    }
+  }
+  if (dictionary->names.size() + new_names.size() > kMaxFieldNames) {
+    return false;
+  }
+
+  if (!new_names.empty()) {
+    // Extend a copy, so that concurrent readers keep using the published
+    // dictionary.
+    auto extended = std::make_shared<Dictionary>(*dictionary);
+    for (std::string& name : new_names) {
+      auto id = static_cast<int32_t>(extended->names.size());
+      db_->current_transaction()->Put(
+          LevelDbFieldNameKey::Key(collection_id, id), name);
+      extended->ids.emplace(name, id);
+      extended->names.push_back(std::move(name));
+    }
+    PublishLocked(collection_id, extended);
+    dictionary = std::move(extended);
+  }
+
+  return RenameFields(document, [&](absl::string_view name) {
+    return absl::StrCat(dictionary->ids.at(std::string(name)));
+  });
+}
+
+bool LevelDbFieldNameDictionary::Decode(
+    const DocumentKey& key, google_firestore_v1_Document* document) {
+  const std::string& collection_id = CollectionId(key);
+
+  std::shared_ptr<const Dictionary> dictionary = Find(collection_id);
+  if (!dictionary) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dictionary = LoadLocked(collection_id);
+  }
+  return RenameFields(document, [&](absl::string_view encoded) {
+    int32_t id = 0;
+    if (!absl::SimpleAtoi(encoded, &id) || id < 0 ||
+        static_cast<size_t>(id) >= dictionary->names.size()) {
+      return std::string();
+    }
+    return dictionary->names[id];
+  });
+}
+
+std::shared_ptr<const LevelDbFieldNameDictionary::Dictionary>
+LevelDbFieldNameDictionary::Find(const std::string& collection_id) const {
+  std::shared_ptr<const Dictionaries> dictionaries =
+      std::atomic_load(&dictionaries_);
+  auto found = dictionaries->find(collection_id);
+  return found != dictionaries->end() ? found->second : nullptr;
+}
+
+std::shared_ptr<const LevelDbFieldNameDictionary::Dictionary>
+LevelDbFieldNameDictionary::LoadLocked(const std::string& collection_id) {
+  // Another thread may have loaded the dictionary while this one waited for
+  // the lock.
+  std::shared_ptr<const Dictionary> loaded = Find(collection_id);
+  if (loaded) {
+    return loaded;
+  }
+
+  auto dictionary = std::make_shared<Dictionary>();
+  std::string prefix = LevelDbFieldNameKey::KeyPrefix(collection_id);
+  std::unique_ptr<leveldb::Iterator> it(
+      db_->ptr()->NewIterator(leveldb::ReadOptions()));
+  LevelDbFieldNameKey row_key;
+  for (it->Seek(prefix);
+       it->Valid() && absl::StartsWith(MakeStringView(it->key()), prefix);
+       it->Next()) {
+    bool decoded = row_key.Decode(MakeStringView(it->key()));
+    HARD_ASSERT(decoded, "Invalid field name key");
+    HARD_ASSERT(row_key.field_id() ==
+                    static_cast<int32_t>(dictionary->names.size()),
+                "Field name IDs for collection %s are not contiguous",
+                collection_id);
+
+    std::string name = it->value().ToString();
+    dictionary->ids.emplace(name, row_key.field_id());
+    dictionary->names.push_back(std::move(name));
+  }
+
+  PublishLocked(collection_id, dictionary);
+  return dictionary;
+}
+
+void LevelDbFieldNameDictionary::PublishLocked(
+    const std::string& collection_id,
+    std::shared_ptr<const Dictionary> dictionary) {
+  auto updated = std::make_shared<Dictionaries>(*dictionaries_);
+  (*updated)[collection_id] = std::move(dictionary);
+  std::atomic_store(&dictionaries_,
+                    std::shared_ptr<const Dictionaries>(std::move(updated)));
+}
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_FIELD_NAME_DICTIONARY_H_
+#define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_FIELD_NAME_DICTIONARY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Firestore/Protos/nanopb/google/firestore/v1/document.nanopb.h"
+
+namespace firebase {
+namespace firestore {
+
+namespace model {
+class DocumentKey;
+}  // namespace model
+
+namespace local {
+
+class LevelDbPersistence;
+
+/**
+ * Replaces the top-level field names of stored documents with small integer
+ * IDs, and back.
+ *
+ * Each collection ID has its own dictionary, stored in the field names table,
+ * so collections that share an ID (for example, every user's "posts"
+ * subcollection) share field name IDs. IDs are assigned when a document that
+ * uses a new field name is encoded and are never reassigned. Names of nested
+ * map fields are user data rather than schema, so they are left as they are.
+ *
+ * Encoding must happen within a read-write transaction, which stores newly
+ * assigned IDs. Decoding may happen on any thread, and does not block on other
+ * threads once the dictionary of the collection has been loaded.
+ */
+class LevelDbFieldNameDictionary {
+ public:
+  /**
+   * The largest number of field names in the dictionary of one collection ID.
+   * Documents that would add names beyond it are not encoded.
+   */
+  static constexpr size_t kMaxFieldNames = 1000;
+
+  /** Creates a dictionary for the given database. */
+  explicit LevelDbFieldNameDictionary(LevelDbPersistence* db);
+
+  /**
+   * Replaces every top-level field name in `document` with its ID in the
+   * dictionary of the collection containing `key`.
+   *
+   * Returns false, leaving `document` unchanged, if that would grow the
+   * dictionary beyond `kMaxFieldNames`.
+   */
+  bool Encode(const model::DocumentKey& key,
+              google_firestore_v1_Document* document);
+
+  /**
+   * Reverses `Encode`. Returns false if `document` refers to an ID that is not
+   * in the dictionary, in which case the document is partially decoded.
+   */
+  bool Decode(const model::DocumentKey& key,
+              google_firestore_v1_Document* document);
+
+ private:
+  /**
+   * The field names of one collection ID. A published dictionary is never
+   * modified; adding names publishes a modified copy.
+   */
+  struct Dictionary {
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int32_t> ids;
+  };
+
+  using Dictionaries =
+      std::unordered_map<std::string, std::shared_ptr<const Dictionary>>;
+
+  /**
+   * Returns the published dictionary for the given collection ID, or null if
+   * it has not been loaded.
+   */
+  std::shared_ptr<const Dictionary> Find(
+      const std::string& collection_id) const;
+
+  /**
+   * Returns the dictionary for the given collection ID, loading it from the
+   * database and publishing it if necessary.
+   */
+  std::shared_ptr<const Dictionary> LoadLocked(
+      const std::string& collection_id);
+
+  /** Replaces the published dictionary of the given collection ID. */
+  void PublishLocked(const std::string& collection_id,
+                     std::shared_ptr<const Dictionary> dictionary);
+
+  // The LevelDbFieldNameDictionary is owned by LevelDbRemoteDocumentCache.
+  LevelDbPersistence* db_;
+
+  // Dictionaries are loaded from the committed state of the database, which
+  // includes every ID that an uncommitted transaction could reference: IDs are
+  // only assigned after the dictionary has been loaded.
+  //
+  // Readers load `dictionaries_` atomically and never lock. Writers hold
+  // `mutex_` while they load or extend a dictionary, then publish a copy of
+  // the map.
+  std::mutex mutex_;
+  std::shared_ptr<const Dictionaries> dictionaries_;
+};
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
+
+#endif  // FIRESTORE_CORE_SRC_LOCAL_LEVELDB_FIELD_NAME_DICTIONARY_H_
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <functional>
 #include <memory>
+#include <queue>
 #include <set>
 #include <string>
 #include <unordered_set>
@@ -35,6 +36,7 @@
 #include "Firestore/core/src/local/leveldb_persistence.h"
 #include "Firestore/core/src/local/leveldb_util.h"
 #include "Firestore/core/src/local/local_serializer.h"
+#include "Firestore/core/src/local/query_context.h"
 #include "Firestore/core/src/model/document_set.h"
 #include "Firestore/core/src/model/field_index.h"
 #include "Firestore/core/src/model/model_fwd.h"
@@ -89,7 +91,7 @@ void from_json(const json& j, DbIndexState& s) {
   j.at("largest_batch").get_to(s.largest_batch_id);
 }
 
-IndexState DecodeIndexState(const std::string& encoded) {
+IndexState DecodeIndexState(absl::string_view encoded) {
   auto j = json::parse(encoded.begin(), encoded.end(), /*callback=*/nullptr,
                        /*allow_exceptions=*/false);
   auto db_state = j.get<DbIndexState>();
@@ -560,6 +562,13 @@ IndexManager::IndexType LevelDbIndexManager::GetIndexType(
 
 absl::optional<std::vector<model::DocumentKey>>
 LevelDbIndexManager::GetDocumentsMatchingTarget(const core::Target& target) {
+  absl::optional<QueryContext> null_context;
+  return GetDocumentsMatchingTarget(target, null_context);
+}
+
+absl::optional<std::vector<model::DocumentKey>>
+LevelDbIndexManager::GetDocumentsMatchingTarget(
+    const core::Target& target, absl::optional<QueryContext>& context) {
   std::vector<std::pair<core::Target, model::FieldIndex>> indexes;
   for (const auto& sub_target : GetSubTargets(target)) {
     auto index_opt = GetFieldIndex(sub_target);
@@ -591,31 +600,97 @@ LevelDbIndexManager::GetDocumentsMatchingTarget(const core::Target& target) {
         index.index_id(), array_values, encoded_lower, lower_bound.inclusive,
         encoded_upper, upper_bound.inclusive, encoded_not_in);
 
-    auto iter = db_->current_transaction()->NewIterator();
-    for (const auto& range : index_ranges) {
-      int32_t count = 0;
-      for (iter->Seek(range.lower); iter->Valid() && count < target.limit() &&
-                                    iter->key() <= range.upper;
-           iter->Next()) {
-        LevelDbIndexEntryKey entry_key;
-        if (!entry_key.Decode(iter->key())) {
-          break;
-        }
-
-        ++count;
-        if (existing_keys.find(entry_key.document_key()) ==
-            existing_keys.end()) {
-          result.push_back(
-              DocumentKey::FromPathString(entry_key.document_key()));
-          existing_keys.insert(entry_key.document_key());
-        }
+    // Ranges that differ in the values of an `in` filter differ before the
+    // segments that a query can order by, so merging them would not yield
+    // query order. Each of those ranges is scanned up to the limit instead.
+    size_t entries_read = 0;
+    if (encoded_lower.size() <= 1 && encoded_upper.size() <= 1) {
+      entries_read = ScanIndexRanges(index_ranges, target.limit(),
+                                     &existing_keys, &result);
+    } else {
+      for (const auto& range : index_ranges) {
+        entries_read +=
+            ScanIndexRanges({range}, target.limit(), &existing_keys, &result);
       }
     }
+
+    if (context.has_value()) {
+      context.value().IncrementIndexRangeCount(index_ranges.size());
+      context.value().IncrementIndexEntryReadCount(entries_read);
+    }
   }
 
   return result;
 }
 
+size_t LevelDbIndexManager::ScanIndexRanges(
+    const std::vector<IndexRange>& ranges,
+    int32_t limit,
+    std::unordered_set<std::string>* existing_keys,
+    std::vector<DocumentKey>* result) {
+  struct Cursor {
+    std::unique_ptr<LevelDbTransaction::Iterator> iter;
+    const IndexRange* range;
+    LevelDbIndexEntryKey entry_key;
+
+    /** Decodes the current entry, or returns false if the range is done. */
+    bool Load() {
+      return iter->Valid() && iter->key() <= range->upper &&
+             entry_key.Decode(iter->key());
+    }
+  };
+
+  // Entries in different ranges differ in their array value, if at all, so
+  // they are merged by their directional value and then by document key, which
+  // is the order of the entries within each range.
+  std::vector<Cursor> cursors;
+  for (const auto& range : ranges) {
+    Cursor cursor{db_->current_transaction()->NewIterator(), &range, {}};
+    cursor.iter->Seek(range.lower);
+    if (cursor.Load()) {
+      cursors.push_back(std::move(cursor));
+    }
+  }
+  auto comes_after = [&](size_t lhs, size_t rhs) {
+    const LevelDbIndexEntryKey& left = cursors[lhs].entry_key;
+    const LevelDbIndexEntryKey& right = cursors[rhs].entry_key;
+    int cmp = left.directional_value().compare(right.directional_value());
+    return cmp != 0 ? cmp > 0 : left.document_key() > right.document_key();
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(comes_after)> heap(
+      comes_after);
+  for (size_t i = 0; i < cursors.size(); ++i) {
+    heap.push(i);
+  }
+
+  int32_t count = 0;
+  size_t entries_read = 0;
+  std::string last_key;
+  while (!heap.empty() && count < limit) {
+    size_t next = heap.top();
+    heap.pop();
+    Cursor& cursor = cursors[next];
+    ++entries_read;
+
+    // A document that matches several array values is adjacent to itself in
+    // the merged order.
+    const std::string& document_key = cursor.entry_key.document_key();
+    if (document_key != last_key) {
+      ++count;
+      last_key = document_key;
+      if (existing_keys->insert(document_key).second) {
+        result->push_back(DocumentKey::FromPathString(document_key));
+      }
+    }
+
+    cursor.iter->Next();
+    if (cursor.Load()) {
+      heap.push(next);
+    }
+  }
+  return entries_read;
+}
+
 std::vector<std::string> LevelDbIndexManager::EncodeBound(
     const FieldIndex& index,
     const Target& target,
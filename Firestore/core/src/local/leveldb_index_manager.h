@@ -21,6 +21,7 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "Firestore/core/src/core/target.h"
@@ -83,6 +84,10 @@ class LevelDbIndexManager : public IndexManager {
   absl::optional<std::vector<model::DocumentKey>> GetDocumentsMatchingTarget(
       const core::Target& target) override;
 
+  absl::optional<std::vector<model::DocumentKey>> GetDocumentsMatchingTarget(
+      const core::Target& target,
+      absl::optional<QueryContext>& context) override;
+
   absl::optional<std::string> GetNextCollectionGroupToUpdate() const override;
 
   void UpdateCollectionGroup(const std::string& collection_group,
@@ -202,6 +207,17 @@ class LevelDbIndexManager : public IndexManager {
       const index::IndexEntry& upper_bound,
       std::vector<index::IndexEntry> not_in_bounds) const;
 
+  /**
+   * Scans the index entries in `ranges` in index order, merging the ranges, and
+   * stops after `limit` distinct documents. Appends the documents that are not
+   * in `existing_keys` yet to `result` and to `existing_keys`. Returns the
+   * number of index entries that were read.
+   */
+  size_t ScanIndexRanges(const std::vector<IndexRange>& ranges,
+                       int32_t limit,
+                       std::unordered_set<std::string>* existing_keys,
+                       std::vector<model::DocumentKey>* result);
+
   /**
    * Returns an index that can be used to serve the provided target. Returns
    * `nullopt` if no index is configured.
@@ -25,6 +25,7 @@
 #include "Firestore/core/src/util/ordered_code.h"
 #include "absl/base/attributes.h"
 #include "absl/strings/escaping.h"
+#include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/types/optional.h"
 
@@ -42,16 +43,22 @@ const char* kVersionGlobalTable = "version";
 const char* kGlobalsTable = "globals";
 const char* kMutationsTable = "mutation";
 const char* kDocumentMutationsTable = "document_mutation";
+const char* kCollectionMutationsTable = "collection_mutation";
 const char* kMutationQueuesTable = "mutation_queue";
 const char* kTargetGlobalTable = "target_global";
 const char* kTargetsTable = "target";
 const char* kQueryTargetsTable = "query_target";
 const char* kTargetDocumentsTable = "target_document";
 const char* kDocumentTargetsTable = "document_target";
+const char* kQueryResultsTable = "query_results";
+const char* kOrphanedDocumentsTable = "orphaned_document";
 const char* kRemoteDocumentsTable = "remote_document";
 const char* kCollectionParentsTable = "collection_parent";
 const char* kRemoteDocumentReadTimeTable = "remote_document_read_time";
+const char* kFieldNamesTable = "field_name";
 const char* kBundlesTable = "bundles";
+const char* kBundleLoadsTable = "bundle_loads";
+const char* kBundleDocumentsTable = "bundle_documents";
 const char* kNamedQueriesTable = "named_queries";
 const char* kIndexConfigurationTable = "index_configuration";
 const char* kIndexStateTable = "index_state";
@@ -67,6 +74,9 @@ const char* kDocumentOverlaysCollectionGroupIndexTable =
     "document_overlays_collection_group_index";
 const char* kDataMigrationTable = "data_migration";
 
+/** The name of the migration that creates overlays from local mutations. */
+const char* kOverlayMigrationName = "overlay_migration";
+
 /**
  * Labels for the components of keys. These serve to make keys self-describing.
  *
@@ -165,6 +175,9 @@ enum ComponentLabel {
    */
   GlobalName = 26,
 
+  /** A component containing the ID of a dictionary-encoded field name. */
+  FieldNameId = 27,
+
   /**
    * A path segment describes just a single segment in a resource path. Path
    * segments that occur sequentially in a key represent successive segments in
@@ -212,6 +225,10 @@ class Reader {
    */
   std::string Describe();
 
+  std::string ReadTableName() {
+    return ReadLabeledString(ComponentLabel::TableName);
+  }
+
   void ReadTableNameMatching(const char* expected_table_name) {
     if (!ReadLabeledStringMatching(ComponentLabel::TableName,
                                    expected_table_name)) {
@@ -283,6 +300,10 @@ class Reader {
     return ReadLabeledString(ComponentLabel::DataMigrationName);
   }
 
+  int32_t ReadFieldNameId() {
+    return ReadLabeledInt32(ComponentLabel::FieldNameId);
+  }
+
   /**
    * Reads a snapshot version, encoded as a component label and a pair of
    * seconds (int64) and nanoseconds (int32).
@@ -691,12 +712,22 @@ std::string Reader::Describe() {
       if (ok_) {
         absl::StrAppend(&description, " directional_value=", std::move(value));
       }
+    } else if (label == ComponentLabel::SequenceNumber) {
+      int64_t sequence_number = ReadSequenceNumber();
+      if (ok_) {
+        absl::StrAppend(&description, " sequence_number=", sequence_number);
+      }
     } else if (label == ComponentLabel::DataMigrationName) {
       std::string value = ReadDataMigrationName();
       if (ok_) {
         absl::StrAppend(&description,
                         " data_migration_name=", std::move(value));
       }
+    } else if (label == ComponentLabel::FieldNameId) {
+      int32_t field_id = ReadFieldNameId();
+      if (ok_) {
+        absl::StrAppend(&description, " field_id=", field_id);
+      }
     } else {
       absl::StrAppend(&description, " unknown label=", static_cast<int>(label));
       Fail();
@@ -812,6 +843,10 @@ class Writer {
     WriteLabeledString(ComponentLabel::DataMigrationName, name);
   }
 
+  void WriteFieldNameId(int32_t id) {
+    WriteLabeledInt32(ComponentLabel::FieldNameId, id);
+  }
+
  private:
   /** Writes a component label to the given key destination. */
   void WriteComponentLabel(ComponentLabel label) {
@@ -865,6 +900,42 @@ std::string DescribeKey(const char* key) {
   return DescribeKey(leveldb::Slice{key});
 }
 
+LevelDbStore LevelDbStoreForKey(absl::string_view key) {
+  Reader reader{key};
+  std::string table = reader.ReadTableName();
+  if (!reader.ok()) {
+    return LevelDbStore::kOther;
+  }
+
+  if (table == kRemoteDocumentsTable ||
+      table == kRemoteDocumentReadTimeTable ||
+      table == kCollectionParentsTable || table == kFieldNamesTable) {
+    return LevelDbStore::kDocuments;
+  }
+  if (table == kTargetGlobalTable || table == kTargetsTable ||
+      table == kQueryTargetsTable || table == kTargetDocumentsTable ||
+      table == kDocumentTargetsTable || table == kOrphanedDocumentsTable ||
+      table == kQueryResultsTable) {
+    return LevelDbStore::kTargets;
+  }
+  if (table == kMutationsTable || table == kDocumentMutationsTable ||
+      table == kCollectionMutationsTable || table == kMutationQueuesTable) {
+    return LevelDbStore::kMutations;
+  }
+  if (table == kDocumentOverlaysTable ||
+      table == kDocumentOverlaysLargestBatchIdIndexTable ||
+      table == kDocumentOverlaysCollectionIndexTable ||
+      table == kDocumentOverlaysCollectionGroupIndexTable) {
+    return LevelDbStore::kOverlays;
+  }
+  if (table == kIndexConfigurationTable || table == kIndexStateTable ||
+      table == kIndexEntriesTable ||
+      table == kIndexEntriesDocumentKeyIndexTable) {
+    return LevelDbStore::kIndexes;
+  }
+  return LevelDbStore::kOther;
+}
+
 std::string LevelDbVersionKey::Key() {
   Writer writer;
   writer.WriteTableName(kVersionGlobalTable);
@@ -948,6 +1019,52 @@ bool LevelDbDocumentMutationKey::Decode(absl::string_view key) {
   return reader.ok();
 }
 
+std::string LevelDbCollectionMutationKey::KeyPrefix() {
+  Writer writer;
+  writer.WriteTableName(kCollectionMutationsTable);
+  return writer.result();
+}
+
+std::string LevelDbCollectionMutationKey::KeyPrefix(absl::string_view user_id) {
+  Writer writer;
+  writer.WriteTableName(kCollectionMutationsTable);
+  writer.WriteUserId(user_id);
+  return writer.result();
+}
+
+std::string LevelDbCollectionMutationKey::KeyPrefix(
+    absl::string_view user_id, const ResourcePath& collection) {
+  Writer writer;
+  writer.WriteTableName(kCollectionMutationsTable);
+  writer.WriteUserId(user_id);
+  writer.WriteResourcePath(collection);
+  return writer.result();
+}
+
+std::string LevelDbCollectionMutationKey::Key(absl::string_view user_id,
+                                              const DocumentKey& document_key,
+                                              model::BatchId batch_id) {
+  Writer writer;
+  writer.WriteTableName(kCollectionMutationsTable);
+  writer.WriteUserId(user_id);
+  writer.WriteResourcePath(document_key.path().PopLast());
+  writer.WriteDocumentId(document_key.path().last_segment());
+  writer.WriteBatchId(batch_id);
+  writer.WriteTerminator();
+  return writer.result();
+}
+
+bool LevelDbCollectionMutationKey::Decode(absl::string_view key) {
+  Reader reader{key};
+  reader.ReadTableNameMatching(kCollectionMutationsTable);
+  user_id_ = reader.ReadUserId();
+  collection_ = reader.ReadResourcePath();
+  document_id_ = reader.ReadDocumentId();
+  batch_id_ = reader.ReadBatchId();
+  reader.ReadTerminator();
+  return reader.ok();
+}
+
 std::string LevelDbMutationQueueKey::KeyPrefix() {
   Writer writer;
   writer.WriteTableName(kMutationQueuesTable);
@@ -1124,6 +1241,54 @@ bool LevelDbDocumentTargetKey::Decode(absl::string_view key) {
   return reader.ok();
 }
 
+std::string LevelDbQueryResultsKey::KeyPrefix() {
+  Writer writer;
+  writer.WriteTableName(kQueryResultsTable);
+  return writer.result();
+}
+
+std::string LevelDbQueryResultsKey::Key(model::TargetId target_id) {
+  Writer writer;
+  writer.WriteTableName(kQueryResultsTable);
+  writer.WriteTargetId(target_id);
+  writer.WriteTerminator();
+  return writer.result();
+}
+
+bool LevelDbQueryResultsKey::Decode(absl::string_view key) {
+  Reader reader{key};
+  reader.ReadTableNameMatching(kQueryResultsTable);
+  target_id_ = reader.ReadTargetId();
+  reader.ReadTerminator();
+  return reader.ok();
+}
+
+std::string LevelDbOrphanedDocumentKey::KeyPrefix() {
+  Writer writer;
+  writer.WriteTableName(kOrphanedDocumentsTable);
+  return writer.result();
+}
+
+std::string LevelDbOrphanedDocumentKey::Key(
+    model::ListenSequenceNumber sequence_number,
+    const DocumentKey& document_key) {
+  Writer writer;
+  writer.WriteTableName(kOrphanedDocumentsTable);
+  writer.WriteSequenceNumber(sequence_number);
+  writer.WriteResourcePath(document_key.path());
+  writer.WriteTerminator();
+  return writer.result();
+}
+
+bool LevelDbOrphanedDocumentKey::Decode(absl::string_view key) {
+  Reader reader{key};
+  reader.ReadTableNameMatching(kOrphanedDocumentsTable);
+  sequence_number_ = reader.ReadSequenceNumber();
+  document_key_ = reader.ReadDocumentKey();
+  reader.ReadTerminator();
+  return reader.ok();
+}
+
 std::string LevelDbRemoteDocumentKey::KeyPrefix() {
   Writer writer;
   writer.WriteTableName(kRemoteDocumentsTable);
@@ -1220,6 +1385,38 @@ bool LevelDbRemoteDocumentReadTimeKey::Decode(absl::string_view key) {
   return reader.ok();
 }
 
+std::string LevelDbFieldNameKey::KeyPrefix() {
+  Writer writer;
+  writer.WriteTableName(kFieldNamesTable);
+  return writer.result();
+}
+
+std::string LevelDbFieldNameKey::KeyPrefix(absl::string_view collection_id) {
+  Writer writer;
+  writer.WriteTableName(kFieldNamesTable);
+  writer.WriteCollectionId(collection_id);
+  return writer.result();
+}
+
+std::string LevelDbFieldNameKey::Key(absl::string_view collection_id,
+                                     int32_t field_id) {
+  Writer writer;
+  writer.WriteTableName(kFieldNamesTable);
+  writer.WriteCollectionId(collection_id);
+  writer.WriteFieldNameId(field_id);
+  writer.WriteTerminator();
+  return writer.result();
+}
+
+bool LevelDbFieldNameKey::Decode(absl::string_view key) {
+  Reader reader{key};
+  reader.ReadTableNameMatching(kFieldNamesTable);
+  collection_id_ = reader.ReadCollectionId();
+  field_id_ = reader.ReadFieldNameId();
+  reader.ReadTerminator();
+  return reader.ok();
+}
+
 std::string LevelDbGlobalKey::KeyPrefix() {
   Writer writer;
   writer.WriteTableName(kGlobalsTable);
@@ -1264,6 +1461,54 @@ bool LevelDbBundleKey::Decode(absl::string_view key) {
   return reader.ok();
 }
 
+std::string LevelDbBundleLoadKey::KeyPrefix() {
+  Writer writer;
+  writer.WriteTableName(kBundleLoadsTable);
+  return writer.result();
+}
+
+std::string LevelDbBundleLoadKey::Key(absl::string_view bundle_id) {
+  Writer writer;
+  writer.WriteTableName(kBundleLoadsTable);
+  writer.WriteBundleId(bundle_id);
+  writer.WriteTerminator();
+  return writer.result();
+}
+
+bool LevelDbBundleLoadKey::Decode(absl::string_view key) {
+  Reader reader{key};
+  reader.ReadTableNameMatching(kBundleLoadsTable);
+  bundle_id_ = reader.ReadBundleId();
+  reader.ReadTerminator();
+  return reader.ok();
+}
+
+std::string LevelDbBundleDocumentKey::KeyPrefix(absl::string_view bundle_id) {
+  Writer writer;
+  writer.WriteTableName(kBundleDocumentsTable);
+  writer.WriteBundleId(bundle_id);
+  return writer.result();
+}
+
+std::string LevelDbBundleDocumentKey::Key(absl::string_view bundle_id,
+                                          const DocumentKey& document_key) {
+  Writer writer;
+  writer.WriteTableName(kBundleDocumentsTable);
+  writer.WriteBundleId(bundle_id);
+  writer.WriteResourcePath(document_key.path());
+  writer.WriteTerminator();
+  return writer.result();
+}
+
+bool LevelDbBundleDocumentKey::Decode(absl::string_view key) {
+  Reader reader{key};
+  reader.ReadTableNameMatching(kBundleDocumentsTable);
+  bundle_id_ = reader.ReadBundleId();
+  document_key_ = reader.ReadDocumentKey();
+  reader.ReadTerminator();
+  return reader.ok();
+}
+
 std::string LevelDbNamedQueryKey::KeyPrefix() {
   Writer writer;
   writer.WriteTableName(kNamedQueriesTable);
@@ -1435,6 +1680,12 @@ bool LevelDbIndexEntryDocumentKeyIndexKey::Decode(absl::string_view key) {
   return reader.ok();
 }
 
+std::string LevelDbDocumentOverlayKey::KeyPrefix() {
+  Writer writer;
+  writer.WriteTableName(kDocumentOverlaysTable);
+  return writer.result();
+}
+
 std::string LevelDbDocumentOverlayKey::KeyPrefix(absl::string_view user_id) {
   Writer writer;
   writer.WriteTableName(kDocumentOverlaysTable);
@@ -1638,6 +1889,12 @@ bool LevelDbDocumentOverlayCollectionGroupIndexKey::Decode(
   return reader.ok();
 }
 
+std::string LevelDbDataMigrationKey::KeyPrefix() {
+  Writer writer;
+  writer.WriteTableName(kDataMigrationTable);
+  return writer.result();
+}
+
 std::string LevelDbDataMigrationKey::Key(absl::string_view migration_name) {
   Writer writer;
   writer.WriteTableName(kDataMigrationTable);
@@ -1646,6 +1903,15 @@ std::string LevelDbDataMigrationKey::Key(absl::string_view migration_name) {
   return writer.result();
 }
 
+std::string LevelDbDataMigrationKey::OverlayMigrationKey() {
+  return Key(kOverlayMigrationName);
+}
+
+std::string LevelDbDataMigrationKey::UserOverlayMigrationKey(
+    absl::string_view user_id) {
+  return Key(absl::StrCat(kOverlayMigrationName, "/", user_id));
+}
+
 bool LevelDbDataMigrationKey::Decode(absl::string_view key) {
   Reader reader{key};
   reader.ReadTableNameMatching(kDataMigrationTable);
@@ -1654,6 +1920,12 @@ bool LevelDbDataMigrationKey::Decode(absl::string_view key) {
   return reader.ok();
 }
 
+bool LevelDbDataMigrationKey::IsOverlayMigration() const {
+  return migration_name_ == kOverlayMigrationName ||
+         absl::StartsWith(migration_name_,
+                          absl::StrCat(kOverlayMigrationName, "/"));
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
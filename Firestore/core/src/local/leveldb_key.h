@@ -17,6 +17,7 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_KEY_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_KEY_H_
 
+#include <cstddef>
 #include <string>
 #include <utility>
 
@@ -76,6 +77,10 @@ namespace local {
 //   - path: ResourcePath
 //   - target_id: model::TargetId
 //
+// query_results:
+//   - table_name: string = "query_results"
+//   - target_id: model::TargetId
+//
 // remote_documents:
 //   - table_name: string = "remote_document"
 //   - path: ResourcePath
@@ -95,6 +100,15 @@ namespace local {
 //   - table_name: string = "bundles"
 //   - bundle_id: string
 //
+// bundle_loads:
+//   - table_name: string = "bundle_loads"
+//   - bundle_id: string
+//
+// bundle_documents:
+//   - table_name: string = "bundle_documents"
+//   - bundle_id: string
+//   - path: ResourcePath
+//
 // named_queries:
 //   - table_name: string = "named_queries"
 //   - name: string
@@ -162,6 +176,34 @@ std::string DescribeKey(absl::string_view key);
 std::string DescribeKey(const std::string& key);
 std::string DescribeKey(const char* key);
 
+/**
+ * The logical stores that LevelDB tables belong to, for the purposes of
+ * tracking the size of the cache.
+ */
+enum class LevelDbStore {
+  /**
+   * Remote documents, their read time and collection parent indexes, and
+   * their field name dictionaries.
+   */
+  kDocuments,
+  /** Targets, their metadata, and target-document associations. */
+  kTargets,
+  /** Mutation queues, mutation batches, and their document index. */
+  kMutations,
+  /** Document overlays and their indexes. */
+  kOverlays,
+  /** Client-side index configuration, state, and entries. */
+  kIndexes,
+  /** Everything else: schema version, globals, bundles, and migrations. */
+  kOther,
+};
+
+/** The number of values in LevelDbStore. */
+constexpr size_t kLevelDbStoreCount = 6;
+
+/** Returns the store that the table of the given key belongs to. */
+LevelDbStore LevelDbStoreForKey(absl::string_view key);
+
 /** A key to a singleton row storing the version of the schema. */
 class LevelDbVersionKey {
  public:
@@ -283,6 +325,84 @@ class LevelDbDocumentMutationKey {
   model::BatchId batch_id_ = model::kBatchIdUnknown;
 };
 
+/**
+ * A key in the collection mutations index, which stores the batches in which
+ * documents are mutated, grouped by the collection that directly contains each
+ * document.
+ *
+ * Unlike the document mutations index, a prefix scan over a collection visits
+ * the immediate children of that collection before any of its subcollections,
+ * so a collection scan can stop at the first row for a nested document.
+ */
+class LevelDbCollectionMutationKey {
+ public:
+  /**
+   * Creates a key prefix that points just before the first key in the table.
+   */
+  static std::string KeyPrefix();
+
+  /**
+   * Creates a key prefix that points just before the first key for the given
+   * user_id.
+   */
+  static std::string KeyPrefix(absl::string_view user_id);
+
+  /**
+   * Creates a key prefix that points just before the first key for the user_id
+   * and collection.
+   *
+   * Rows for documents in subcollections of the collection also match this
+   * prefix, but sort after all of the collection's immediate children.
+   */
+  static std::string KeyPrefix(absl::string_view user_id,
+                               const model::ResourcePath& collection);
+
+  /**
+   * Creates a complete key that points to a specific user_id, document key,
+   * and batch_id.
+   */
+  static std::string Key(absl::string_view user_id,
+                         const model::DocumentKey& document_key,
+                         model::BatchId batch_id);
+
+  /**
+   * Decodes the given complete key, storing the decoded values in this
+   * instance.
+   *
+   * @return true if the key successfully decoded, false otherwise. If false is
+   * returned, this instance is in an undefined state until the next call to
+   * `Decode()`.
+   */
+  ABSL_MUST_USE_RESULT
+  bool Decode(absl::string_view key);
+
+  /** The user that owns the mutation batches. */
+  const std::string& user_id() const {
+    return user_id_;
+  }
+
+  /** The path to the collection containing the document. */
+  const model::ResourcePath& collection() const {
+    return collection_;
+  }
+
+  /** The path to the document, as encoded in the key. */
+  model::DocumentKey document_key() const {
+    return model::DocumentKey{collection_.Append(document_id_)};
+  }
+
+  /** The batch_id in which the document participates. */
+  model::BatchId batch_id() const {
+    return batch_id_;
+  }
+
+ private:
+  std::string user_id_;
+  model::ResourcePath collection_;
+  std::string document_id_;
+  model::BatchId batch_id_ = model::kBatchIdUnknown;
+};
+
 /**
  * A key in the mutation_queues table.
  *
@@ -547,6 +667,86 @@ class LevelDbDocumentTargetKey {
   model::DocumentKey document_key_;
 };
 
+/**
+ * A key in the query results table, which stores the materialized results of
+ * a target's query as a single row per target.
+ */
+class LevelDbQueryResultsKey {
+ public:
+  /**
+   * Creates a key prefix that points just before the first key in the table.
+   */
+  static std::string KeyPrefix();
+
+  /** Creates a key that points to the results of the given target. */
+  static std::string Key(model::TargetId target_id);
+
+  /**
+   * Decodes the contents of a query results key, storing the decoded values
+   * in this instance.
+   *
+   * @return true if the key successfully decoded, false otherwise. If false is
+   * returned, this instance is in an undefined state until the next call to
+   * `Decode()`.
+   */
+  ABSL_MUST_USE_RESULT
+  bool Decode(absl::string_view key);
+
+  model::TargetId target_id() const {
+    return target_id_;
+  }
+
+ private:
+  model::TargetId target_id_ = 0;
+};
+
+/**
+ * A key in the orphaned documents table, an index of the documents that have a
+ * sentinel row but belong to no target, ordered by the sequence number stored
+ * in the sentinel row.
+ *
+ * This allows the LRU garbage collector to visit the least recently used
+ * orphaned documents first, without scanning the document targets table.
+ */
+class LevelDbOrphanedDocumentKey {
+ public:
+  /**
+   * Creates a key that contains just the orphaned documents table prefix and
+   * points just before the first key.
+   */
+  static std::string KeyPrefix();
+
+  /** Creates a key that points to a specific orphaned document. */
+  static std::string Key(model::ListenSequenceNumber sequence_number,
+                         const model::DocumentKey& document_key);
+
+  /**
+   * Decodes the contents of an orphaned document key, storing the decoded
+   * values in this instance.
+   *
+   * @return true if the key successfully decoded, false otherwise. If false is
+   * returned, this instance is in an undefined state until the next call to
+   * `Decode()`.
+   */
+  ABSL_MUST_USE_RESULT
+  bool Decode(absl::string_view key);
+
+  /** The sequence number stored in the document's sentinel row. */
+  model::ListenSequenceNumber sequence_number() const {
+    return sequence_number_;
+  }
+
+  /** The path to the document, as encoded in the key. */
+  const model::DocumentKey& document_key() const {
+    return document_key_;
+  }
+
+ private:
+  // Deliberately uninitialized: will be assigned in Decode
+  model::ListenSequenceNumber sequence_number_;
+  model::DocumentKey document_key_;
+};
+
 /** A key in the remote documents table. */
 class LevelDbRemoteDocumentKey {
  public:
@@ -698,6 +898,58 @@ class LevelDbRemoteDocumentReadTimeKey {
   model::SnapshotVersion read_time_;
 };
 
+/**
+ * A key in the field names table, which maps the field name IDs used by
+ * dictionary-encoded remote documents back to field names. Field name IDs are
+ * assigned per collection ID, so that all collections with the same ID share
+ * a dictionary.
+ */
+class LevelDbFieldNameKey {
+ public:
+  /**
+   * Creates a key prefix that points just before the first key in the table.
+   */
+  static std::string KeyPrefix();
+
+  /**
+   * Creates a key prefix that points just before the first key for the given
+   * collection_id.
+   */
+  static std::string KeyPrefix(absl::string_view collection_id);
+
+  /**
+   * Creates a complete key that points to a specific collection_id and field
+   * name ID.
+   */
+  static std::string Key(absl::string_view collection_id, int32_t field_id);
+
+  /**
+   * Decodes the given complete key, storing the decoded values in this
+   * instance.
+   *
+   * @return true if the key successfully decoded, false otherwise. If false is
+   * returned, this instance is in an undefined state until the next call to
+   * `Decode()`.
+   */
+  ABSL_MUST_USE_RESULT
+  bool Decode(absl::string_view key);
+
+  /** The collection_id, as encoded in the key. */
+  const std::string& collection_id() const {
+    return collection_id_;
+  }
+
+  /** The field name ID, as encoded in the key. */
+  int32_t field_id() const {
+    return field_id_;
+  }
+
+ private:
+  // Deliberately uninitialized: will be assigned in Decode
+  std::string collection_id_;
+  int32_t field_id_;
+};
+
 /**
  * A key in the bundles table, storing the bundle Id for each entry.
  */
@@ -733,6 +985,87 @@ class LevelDbBundleKey {
   std::string bundle_id_;
 };
 
+/**
+ * A key in the bundle loads table, storing the progress of each load of a
+ * bundle that has not finished yet.
+ */
+class LevelDbBundleLoadKey {
+ public:
+  /**
+   * Creates a key prefix that points just before the first key of the table.
+   */
+  static std::string KeyPrefix();
+
+  /**
+   * Creates a key that points to the load of the given bundle id.
+   */
+  static std::string Key(absl::string_view bundle_id);
+
+  /**
+   * Decodes the given complete key, storing the decoded values in this
+   * instance.
+   *
+   * @return true if the key successfully decoded, false otherwise. If false is
+   * returned, this instance is in an undefined state until the next call to
+   * `Decode()`.
+   */
+  ABSL_MUST_USE_RESULT
+  bool Decode(absl::string_view key);
+
+  /** The bundle ID for this entry. */
+  const std::string& bundle_id() const {
+    return bundle_id_;
+  }
+
+ private:
+  std::string bundle_id_;
+};
+
+/**
+ * A key in the bundle documents table, storing the documents of an unfinished
+ * bundle load until the whole bundle has been read and validated.
+ */
+class LevelDbBundleDocumentKey {
+ public:
+  /**
+   * Creates a key prefix that points just before the first staged document of
+   * the given bundle id.
+   */
+  static std::string KeyPrefix(absl::string_view bundle_id);
+
+  /**
+   * Creates a key that points to the given document staged by a load of the
+   * given bundle id.
+   */
+  static std::string Key(absl::string_view bundle_id,
+                         const model::DocumentKey& document_key);
+
+  /**
+   * Decodes the given complete key, storing the decoded values in this
+   * instance.
+   *
+   * @return true if the key successfully decoded, false otherwise. If false is
+   * returned, this instance is in an undefined state until the next call to
+   * `Decode()`.
+   */
+  ABSL_MUST_USE_RESULT
+  bool Decode(absl::string_view key);
+
+  /** The bundle ID for this entry. */
+  const std::string& bundle_id() const {
+    return bundle_id_;
+  }
+
+  /** The path to the staged document, as encoded in the key. */
+  const model::DocumentKey& document_key() const {
+    return document_key_;
+  }
+
+ private:
+  std::string bundle_id_;
+  model::DocumentKey document_key_;
+};
+
 /**
  * A key in the named_queries table, storing the query name for each entry.
  */
@@ -1055,6 +1388,11 @@ class LevelDbDocumentOverlayKey {
         largest_batch_id_(largest_batch_id) {
   }
 
+  /**
+   * Creates a key prefix that points just before the first key in the table.
+   */
+  static std::string KeyPrefix();
+
   /**
    * Creates a key prefix that points just before the first key for the given
    * user_id.
@@ -1216,7 +1554,14 @@ class LevelDbDocumentOverlayLargestBatchIdIndexKey
   bool Decode(absl::string_view key);
 };
 
-/** A key in the "collection" index of the document_overlays table. */
+/**
+ * A key in the "collection" index of the document_overlays table.
+ *
+ * The value of each entry is a copy of the encoded mutation stored in the
+ * overlay it points to, so that the overlays of a collection can be read in a
+ * single scan of the index. Entries written before schema version 11 have an
+ * empty value.
+ */
 class LevelDbDocumentOverlayCollectionIndexKey
     : public LevelDbDocumentOverlayIndexKey {
  public:
@@ -1340,15 +1685,24 @@ class LevelDbDataMigrationKey {
  public:
   LevelDbDataMigrationKey() = default;
 
+  /**
+   * Creates a key prefix that points just before the first key of the table.
+   */
+  static std::string KeyPrefix();
+
   /**
    * Creates a complete key that points to a specific migration_name.
    */
   static std::string Key(absl::string_view migration_name);
 
   /** Migration to create overlays from local mutations. */
-  static std::string OverlayMigrationKey() {
-    return Key("overlay_migration");
-  }
+  static std::string OverlayMigrationKey();
+
+  /**
+   * Migration to create overlays from the local mutations of a single user,
+   * which replaces `OverlayMigrationKey` once the migration has started.
+   */
+  static std::string UserOverlayMigrationKey(absl::string_view user_id);
 
   /**
    * Decodes the given complete key, storing the decoded values in this
@@ -1371,6 +1725,12 @@ class LevelDbDataMigrationKey {
     return migration_name_;
   }
 
+  /**
+   * Returns true if this is an `OverlayMigrationKey` or a
+   * `UserOverlayMigrationKey`.
+   */
+  bool IsOverlayMigration() const;
+
  private:
   std::string migration_name_;
 };
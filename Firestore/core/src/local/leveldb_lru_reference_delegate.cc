@@ -16,9 +16,12 @@
 
 #include "Firestore/core/src/local/leveldb_lru_reference_delegate.h"
 
+#include <algorithm>
+#include <iterator>
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "Firestore/core/src/local/leveldb_key.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
@@ -40,6 +43,8 @@ using model::ListenSequenceNumber;
 using model::ResourcePath;
 using util::StatusOr;
 
+using MembershipChange = LevelDbTargetCache::MembershipChange;
+
 LevelDbLruReferenceDelegate::LevelDbLruReferenceDelegate(
     LevelDbPersistence* persistence, LruParams lru_params)
     : db_(persistence) {
@@ -63,16 +68,16 @@ void LevelDbLruReferenceDelegate::AddInMemoryPins(ReferenceSet* set) {
 }
 
 void LevelDbLruReferenceDelegate::AddReference(const DocumentKey& key) {
-  WriteSentinel(key);
+  WriteSentinel(key, MembershipChange::kAdded);
 }
 
 void LevelDbLruReferenceDelegate::RemoveReference(const DocumentKey& key) {
-  WriteSentinel(key);
+  WriteSentinel(key, MembershipChange::kRemoved);
 }
 
 void LevelDbLruReferenceDelegate::RemoveMutationReference(
     const DocumentKey& key) {
-  WriteSentinel(key);
+  WriteSentinel(key, MembershipChange::kUnchanged);
 }
 
 void LevelDbLruReferenceDelegate::RemoveTarget(const TargetData& target_data) {
@@ -82,7 +87,7 @@ void LevelDbLruReferenceDelegate::RemoveTarget(const TargetData& target_data) {
 }
 
 void LevelDbLruReferenceDelegate::UpdateLimboDocument(const DocumentKey& key) {
-  WriteSentinel(key);
+  WriteSentinel(key, MembershipChange::kUnchanged);
 }
 
 ListenSequenceNumber LevelDbLruReferenceDelegate::current_sequence_number()
@@ -111,12 +116,8 @@ StatusOr<int64_t> LevelDbLruReferenceDelegate::CalculateByteSize() {
 }
 
 size_t LevelDbLruReferenceDelegate::GetSequenceNumberCount() {
-  size_t total_count = db_->target_cache()->size();
-  EnumerateOrphanedDocuments(
-      [&total_count](const DocumentKey&, ListenSequenceNumber) {
-        total_count++;
-      });
-  return total_count;
+  return db_->target_cache()->size() +
+         db_->target_cache()->CountOrphanedDocuments();
 }
 
 void LevelDbLruReferenceDelegate::EnumerateTargetSequenceNumbers(
@@ -126,23 +127,132 @@ void LevelDbLruReferenceDelegate::EnumerateTargetSequenceNumbers(
 
 void LevelDbLruReferenceDelegate::EnumerateOrphanedDocuments(
     const OrphanedDocumentCallback& callback) {
+  db_->target_cache()->EnumerateOrphanedDocuments(
+      [&](const DocumentKey& key, ListenSequenceNumber sequence_number) {
+        callback(key, sequence_number);
+        return true;
+      });
+}
+
+void LevelDbLruReferenceDelegate::EnumerateOrphanedDocumentsInOrder(
+    const OrderedOrphanedDocumentCallback& callback) {
   db_->target_cache()->EnumerateOrphanedDocuments(callback);
 }
 
 int LevelDbLruReferenceDelegate::RemoveOrphanedDocuments(
     ListenSequenceNumber upper_bound) {
-  int count = 0;
+  // Collect the documents first: removing them modifies the index that is
+  // being enumerated.
+  std::vector<DocumentKey> removable;
+  std::vector<ListenSequenceNumber> sequence_numbers;
+  std::string orphaned_index_end;
   db_->target_cache()->EnumerateOrphanedDocuments(
       [&](const DocumentKey& key, ListenSequenceNumber sequence_number) {
-        if (sequence_number <= upper_bound) {
-          if (!IsPinned(key)) {
-            count++;
-            db_->remote_document_cache()->Remove(key);
-            RemoveSentinel(key);
-          }
+        if (sequence_number > upper_bound) {
+          return false;
         }
+        if (!IsPinned(key)) {
+          removable.push_back(key);
+          sequence_numbers.push_back(sequence_number);
+          orphaned_index_end =
+              LevelDbOrphanedDocumentKey::Key(sequence_number, key);
+        }
+        return true;
       });
-  return count;
+
+  RemoveDocuments(removable, sequence_numbers);
+  RecordRemovedDocuments(removable, orphaned_index_end);
+  return static_cast<int>(removable.size());
+}
+
+int LevelDbLruReferenceDelegate::RemoveOrphanedDocuments(
+    LruCheckpoint* checkpoint,
+    int max_documents,
+    std::chrono::steady_clock::time_point deadline) {
+  int visited = 0;
+  bool exhausted = true;
+  std::vector<DocumentKey> removable;
+  std::vector<ListenSequenceNumber> sequence_numbers;
+  auto visit = [&](const DocumentKey& key,
+                   ListenSequenceNumber sequence_number) {
+    if (sequence_number > checkpoint->upper_bound) {
+      return false;
+    }
+    // Always visit at least one document so that every slice makes progress.
+    if (visited > 0 && (visited >= max_documents ||
+                        std::chrono::steady_clock::now() >= deadline)) {
+      exhausted = false;
+      return false;
+    }
+
+    visited++;
+    checkpoint->last_sequence_number = sequence_number;
+    checkpoint->last_document_key = key;
+    if (!IsPinned(key)) {
+      removable.push_back(key);
+      sequence_numbers.push_back(sequence_number);
+    }
+    return true;
+  };
+
+  if (checkpoint->last_document_key) {
+    db_->target_cache()->EnumerateOrphanedDocumentsAfter(
+        checkpoint->last_sequence_number, *checkpoint->last_document_key,
+        visit);
+  } else {
+    db_->target_cache()->EnumerateOrphanedDocuments(visit);
+  }
+
+  RemoveDocuments(removable, sequence_numbers);
+  if (!removable.empty()) {
+    RecordRemovedDocuments(
+        removable, LevelDbOrphanedDocumentKey::Key(
+                       checkpoint->last_sequence_number,
+                       *checkpoint->last_document_key));
+  }
+  checkpoint->complete = exhausted;
+  return static_cast<int>(removable.size());
+}
+
+void LevelDbLruReferenceDelegate::RemoveDocuments(
+    const std::vector<DocumentKey>& removable,
+    const std::vector<ListenSequenceNumber>& sequence_numbers) {
+  db_->remote_document_cache()->RemoveAll(removable);
+  for (size_t i = 0; i < removable.size(); ++i) {
+    db_->target_cache()->RemoveSentinel(removable[i], sequence_numbers[i]);
+  }
+}
+
+void LevelDbLruReferenceDelegate::RecordRemovedDocuments(
+    const std::vector<DocumentKey>& removed,
+    const std::string& orphaned_index_end) {
+  if (removed.empty()) return;
+
+  // Orphaned documents are removed in sequence number order, so the removed
+  // remote documents are scattered across the key space but their index
+  // entries form a prefix of the orphaned documents index. A single range
+  // spanning all the removed documents would compact much of the table that
+  // was not touched, so a range is recorded per collection instead.
+  std::vector<DocumentKey> sorted = removed;
+  std::sort(sorted.begin(), sorted.end());
+  LevelDbCompactor* compactor = db_->compactor();
+  auto first = sorted.begin();
+  while (first != sorted.end()) {
+    ResourcePath collection = first->path().PopLast();
+    auto last = first;
+    auto next = std::next(first);
+    while (next != sorted.end() && next->path().PopLast() == collection) {
+      last = next++;
+    }
+    compactor->AddRange(LevelDbRemoteDocumentKey::Key(*first),
+                        LevelDbRemoteDocumentKey::Key(*last),
+                        static_cast<int64_t>(std::distance(first, next)));
+    first = next;
+  }
+
+  auto deleted_keys = static_cast<int64_t>(removed.size());
+  compactor->AddRange(LevelDbOrphanedDocumentKey::KeyPrefix(),
+                      orphaned_index_end, deleted_keys);
 }
 
 int LevelDbLruReferenceDelegate::RemoveTargets(
@@ -151,6 +261,16 @@ int LevelDbLruReferenceDelegate::RemoveTargets(
       db_->target_cache()->RemoveTargets(sequence_number, live_queries));
 }
 
+int LevelDbLruReferenceDelegate::RemoveTargets(
+    LruCheckpoint* checkpoint,
+    const LiveQueryMap& live_queries,
+    int max_documents,
+    std::chrono::steady_clock::time_point deadline) {
+  return static_cast<int>(db_->target_cache()->RemoveTargets(
+      checkpoint->upper_bound, live_queries, static_cast<size_t>(max_documents),
+      deadline, &checkpoint->next_target_id, &checkpoint->targets_complete));
+}
+
 bool LevelDbLruReferenceDelegate::IsPinned(const DocumentKey& key) {
   if (additional_references_->ContainsKey(key)) {
     return true;
@@ -177,16 +297,9 @@ bool LevelDbLruReferenceDelegate::MutationQueuesContainKey(
   return false;
 }
 
-void LevelDbLruReferenceDelegate::RemoveSentinel(const DocumentKey& key) {
-  db_->current_transaction()->Delete(
-      LevelDbDocumentTargetKey::SentinelKey(key));
-}
-
-void LevelDbLruReferenceDelegate::WriteSentinel(const DocumentKey& key) {
-  std::string sentinel_key = LevelDbDocumentTargetKey::SentinelKey(key);
-  std::string encoded_sequence_number =
-      LevelDbDocumentTargetKey::EncodeSentinelValue(current_sequence_number());
-  db_->current_transaction()->Put(sentinel_key, encoded_sequence_number);
+void LevelDbLruReferenceDelegate::WriteSentinel(const DocumentKey& key,
+                                                MembershipChange change) {
+  db_->target_cache()->WriteSentinel(key, current_sequence_number(), change);
 }
 
 }  // namespace local
@@ -17,8 +17,12 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_LRU_REFERENCE_DELEGATE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_LRU_REFERENCE_DELEGATE_H_
 
+#include <chrono>  // NOLINT(build/c++11)
 #include <memory>
+#include <string>
+#include <vector>
 
+#include "Firestore/core/src/local/leveldb_target_cache.h"
 #include "Firestore/core/src/local/lru_garbage_collector.h"
 
 namespace firebase {
@@ -65,17 +69,46 @@ class LevelDbLruReferenceDelegate : public LruDelegate {
   void EnumerateOrphanedDocuments(
       const OrphanedDocumentCallback& callback) override;
 
+  void EnumerateOrphanedDocumentsInOrder(
+      const OrderedOrphanedDocumentCallback& callback) override;
+
   int RemoveOrphanedDocuments(model::ListenSequenceNumber upper_bound) override;
+
+  int RemoveOrphanedDocuments(
+      LruCheckpoint* checkpoint,
+      int max_documents,
+      std::chrono::steady_clock::time_point deadline) override;
   int RemoveTargets(model::ListenSequenceNumber sequence_number,
                     const LiveQueryMap& live_queries) override;
 
+  int RemoveTargets(LruCheckpoint* checkpoint,
+                    const LiveQueryMap& live_queries,
+                    int max_documents,
+                    std::chrono::steady_clock::time_point deadline) override;
+
  private:
   bool IsPinned(const model::DocumentKey& key);
 
   bool MutationQueuesContainKey(const model::DocumentKey& key);
 
-  void RemoveSentinel(const model::DocumentKey& key);
-  void WriteSentinel(const model::DocumentKey& key);
+  void WriteSentinel(const model::DocumentKey& key,
+                     LevelDbTargetCache::MembershipChange change);
+
+  /**
+   * Removes the given orphaned documents, whose entries in the orphaned
+   * documents index are at the matching `sequence_numbers`.
+   */
+  void RemoveDocuments(
+      const std::vector<model::DocumentKey>& removable,
+      const std::vector<model::ListenSequenceNumber>& sequence_numbers);
+
+  /**
+   * Records the key ranges emptied by removing `removed` for compaction.
+   * `orphaned_index_end` is the orphaned documents index key of the last
+   * document visited, which bounds the index entries that were deleted.
+   */
+  void RecordRemovedDocuments(const std::vector<model::DocumentKey>& removed,
+                              const std::string& orphaned_index_end);
 
   std::unique_ptr<LruGarbageCollector> gc_;
 
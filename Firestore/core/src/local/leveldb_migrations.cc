@@ -22,6 +22,8 @@
 #include "Firestore/Protos/nanopb/firestore/local/mutation.nanopb.h"
 #include "Firestore/Protos/nanopb/firestore/local/target.nanopb.h"
 #include "Firestore/core/src/local/leveldb_key.h"
+#include "Firestore/core/src/local/leveldb_size_tracker.h"
+#include "Firestore/core/src/local/leveldb_target_cache.h"
 #include "Firestore/core/src/local/memory_index_manager.h"
 #include "Firestore/core/src/local/target_data.h"
 #include "Firestore/core/src/model/document_key.h"
@@ -30,6 +32,7 @@
 #include "Firestore/core/src/nanopb/reader.h"
 #include "Firestore/core/src/nanopb/writer.h"
 #include "Firestore/core/src/util/log.h"
+#include "Firestore/core/src/util/ordered_code.h"
 #include "Firestore/core/src/util/statusor.h"
 #include "absl/strings/match.h"
 
@@ -40,9 +43,17 @@ namespace {
 
 using leveldb::Status;
 using model::DocumentKey;
+using model::ListenSequenceNumber;
 using model::ResourcePath;
 using nanopb::Message;
 using nanopb::StringReader;
+using util::OrderedCode;
+
+using SchemaVersion = LevelDbMigrations::SchemaVersion;
+
+/** The name of the globals row that stores the cursor of a migration. */
+const char* kMigrationCursor = "migration_cursor";
+const char* kMinimumSchemaVersion = "minimum_schema_version";
 
 /**
  * Save the given version number as the current version of the schema of the
@@ -57,6 +68,127 @@ void SaveVersion(LevelDbMigrations::SchemaVersion version,
   transaction->Put(key, version_string);
 }
 
+/**
+ * Runs the passes of a schema migration over tables that may be arbitrarily
+ * large.
+ *
+ * Each pass commits after every `chunk_size` rows, together with a cursor
+ * pointing at the next row, so memory stays bounded and a migration that is
+ * interrupted resumes from its last committed chunk. Passes must be run in the
+ * same order on every attempt.
+ */
+class ChunkedMigration {
+ public:
+  ChunkedMigration(leveldb::DB* db, SchemaVersion version, size_t chunk_size)
+      : db_(db), version_(version), chunk_size_(chunk_size) {
+    HARD_ASSERT(chunk_size_ > 0, "Migration chunk size must be positive");
+
+    // A cursor saved by a different migration is stale: it can only be left
+    // behind if the schema was downgraded in the meantime.
+    absl::optional<LevelDbMigrations::Cursor> cursor =
+        LevelDbMigrations::ReadMigrationCursor(db_);
+    if (cursor && cursor->version == version_) {
+      LOG_DEBUG("Resuming migration to schema version %s at pass %s",
+                version_, cursor->pass);
+      resume_ = std::move(cursor);
+    }
+  }
+
+  /**
+   * Calls `process` with a transaction and an iterator positioned at each row
+   * whose key starts with `prefix`, skipping the rows that an earlier attempt
+   * committed.
+   */
+  template <typename Process>
+  void ForEachRow(const char* label,
+                  const std::string& prefix,
+                  const Process& process) {
+    // Every row is a group of its own.
+    size_t row = 0;
+    ForEachGroup(
+        label, prefix, [&row](absl::string_view) { return row++; }, process,
+        [](LevelDbTransaction*) {});
+  }
+
+  /**
+   * Like `ForEachRow`, but never splits the consecutive rows that `group_of`
+   * maps to equal values between two chunks, so that `process` can carry
+   * state from one row of a group to the next. `group_of` is called on each
+   * row before `process`, and `end_group` is called with the transaction
+   * after the last row of each group has been processed.
+   */
+  template <typename GroupOf, typename Process, typename EndGroup>
+  void ForEachGroup(const char* label,
+                    const std::string& prefix,
+                    const GroupOf& group_of,
+                    const Process& process,
+                    const EndGroup& end_group) {
+    int32_t pass = next_pass_++;
+    std::string next_key = prefix;
+    if (resume_) {
+      if (pass < resume_->pass) return;
+      if (pass == resume_->pass && !resume_->next_key.empty()) {
+        next_key = resume_->next_key;
+      }
+    }
+
+    using Group = decltype(group_of(absl::string_view()));
+    bool more = true;
+    while (more) {
+      LevelDbTransaction transaction(db_, label);
+      auto it = transaction.NewIterator();
+
+      more = false;
+      size_t rows = 0;
+      absl::optional<Group> group;
+      for (it->Seek(next_key);
+           it->Valid() && absl::StartsWith(it->key(), prefix); it->Next()) {
+        Group row_group = group_of(it->key());
+        if (group && *group != row_group) {
+          end_group(&transaction);
+          group.reset();
+        }
+        if (rows >= chunk_size_ && !group) {
+          more = true;
+          next_key = std::string(it->key());
+          break;
+        }
+        process(&transaction, it.get());
+        group = std::move(row_group);
+        ++rows;
+      }
+      if (group) end_group(&transaction);
+
+      LevelDbMigrations::Cursor cursor;
+      cursor.version = version_;
+      if (more) {
+        cursor.pass = pass;
+        cursor.next_key = next_key;
+      } else {
+        cursor.pass = pass + 1;
+      }
+      LevelDbMigrations::SaveMigrationCursor(cursor, &transaction);
+      transaction.Commit();
+    }
+  }
+
+  /** Saves the schema version and removes the cursor. */
+  void Finish() {
+    LevelDbTransaction transaction(db_, "Finish migration");
+    LevelDbMigrations::DeleteMigrationCursor(&transaction);
+    SaveVersion(version_, &transaction);
+    transaction.Commit();
+  }
+
+ private:
+  leveldb::DB* db_;
+  SchemaVersion version_;
+  size_t chunk_size_;
+
+  absl::optional<LevelDbMigrations::Cursor> resume_;
+  int32_t next_pass_ = 0;
+};
+
 void DeleteEverythingWithPrefix(const std::string& prefix, leveldb::DB* db) {
   bool more_deletes = true;
   while (more_deletes) {
@@ -196,28 +328,26 @@ void EnsureSentinelRow(LevelDbTransaction* transaction,
  * Ensure each document in the remote document table has a corresponding
  * sentinel row in the document target index.
  */
-void EnsureSentinelRows(leveldb::DB* db) {
-  LevelDbTransaction transaction(db, "Ensure sentinel rows");
-
+void EnsureSentinelRows(leveldb::DB* db, size_t chunk_size) {
   // Get the value we'll use for anything that's missing a row.
-  model::ListenSequenceNumber sequence_number =
-      GetHighestSequenceNumber(&transaction);
-  std::string sentinel_value =
-      LevelDbDocumentTargetKey::EncodeSentinelValue(sequence_number);
+  std::string sentinel_value;
+  {
+    LevelDbTransaction transaction(db, "Read highest sequence number");
+    sentinel_value = LevelDbDocumentTargetKey::EncodeSentinelValue(
+        GetHighestSequenceNumber(&transaction));
+  }
 
-  std::string documents_prefix = LevelDbRemoteDocumentKey::KeyPrefix();
-  auto it = transaction.NewIterator();
-  it->Seek(documents_prefix);
+  ChunkedMigration migration(db, 4, chunk_size);
   LevelDbRemoteDocumentKey document_key;
-  for (; it->Valid() && absl::StartsWith(it->key(), documents_prefix);
-       it->Next()) {
-    HARD_ASSERT(document_key.Decode(it->key()),
-                "Failed to decode document key");
-    EnsureSentinelRow(&transaction, document_key.document_key(),
-                      sentinel_value);
-  }
-  SaveVersion(4, &transaction);
-  transaction.Commit();
+  migration.ForEachRow(
+      "Ensure sentinel rows", LevelDbRemoteDocumentKey::KeyPrefix(),
+      [&](LevelDbTransaction* transaction, LevelDbTransaction::Iterator* it) {
+        HARD_ASSERT(document_key.Decode(it->key()),
+                    "Failed to decode document key");
+        EnsureSentinelRow(transaction, document_key.document_key(),
+                          sentinel_value);
+      });
+  migration.Finish();
 }
 
 // Helper to add an index entry iff we haven't already written it (as determined
@@ -243,40 +373,33 @@ void EnsureCollectionParentRow(LevelDbTransaction* transaction,
  * Creates appropriate LevelDbCollectionParentKey rows for all collections
  * of documents in the remote document cache and mutation queue.
  */
-void EnsureCollectionParentsIndex(leveldb::DB* db) {
-  LevelDbTransaction transaction(db, "Ensure Collection Parents Index");
-
+void EnsureCollectionParentsIndex(leveldb::DB* db, size_t chunk_size) {
+  ChunkedMigration migration(db, 6, chunk_size);
   MemoryCollectionParentIndex cache;
 
   // Index existing remote documents.
-  std::string documents_prefix = LevelDbRemoteDocumentKey::KeyPrefix();
-  auto it = transaction.NewIterator();
-  it->Seek(documents_prefix);
   LevelDbRemoteDocumentKey document_key;
-  for (; it->Valid() && absl::StartsWith(it->key(), documents_prefix);
-       it->Next()) {
-    HARD_ASSERT(document_key.Decode(it->key()),
-                "Failed to decode document key");
-
-    EnsureCollectionParentRow(&transaction, &cache,
-                              document_key.document_key());
-  }
+  migration.ForEachRow(
+      "Ensure Collection Parents Index", LevelDbRemoteDocumentKey::KeyPrefix(),
+      [&](LevelDbTransaction* transaction, LevelDbTransaction::Iterator* it) {
+        HARD_ASSERT(document_key.Decode(it->key()),
+                    "Failed to decode document key");
+        EnsureCollectionParentRow(transaction, &cache,
+                                  document_key.document_key());
+      });
 
   // Index existing mutations.
-  std::string mutations_prefix = LevelDbDocumentMutationKey::KeyPrefix();
-  it = transaction.NewIterator();
-  it->Seek(mutations_prefix);
   LevelDbDocumentMutationKey key;
-  for (; it->Valid() && absl::StartsWith(it->key(), mutations_prefix);
-       it->Next()) {
-    HARD_ASSERT(key.Decode(it->key()),
-                "Failed to decode document-mutation key");
-
-    EnsureCollectionParentRow(&transaction, &cache, key.document_key());
-  }
-
-  SaveVersion(6, &transaction);
-  transaction.Commit();
+  migration.ForEachRow(
+      "Ensure Collection Parents Index",
+      LevelDbDocumentMutationKey::KeyPrefix(),
+      [&](LevelDbTransaction* transaction, LevelDbTransaction::Iterator* it) {
+        HARD_ASSERT(key.Decode(it->key()),
+                    "Failed to decode document-mutation key");
+        EnsureCollectionParentRow(transaction, &cache, key.document_key());
+      });
+
+  migration.Finish();
 }
 
 /**
@@ -370,8 +493,145 @@ void EnsureOverlayDataMigrationIsRequired(leveldb::DB* db) {
   transaction.Commit();
 }
 
+/**
+ * Migration 9.
+ *
+ * Starts tracking the logical size of each store in the globals table. The
+ * totals are discarded after any migration runs and are recomputed by
+ * LevelDbSizeTracker when the database is next opened. Bumping the version
+ * ensures that this also happens after a downgrade to a version that does not
+ * maintain them.
+ */
+void EnsureByteSizesAreRecomputed(leveldb::DB* db) {
+  LevelDbTransaction transaction(db, "Ensure byte sizes are recomputed");
+  SaveVersion(9, &transaction);
+  transaction.Commit();
+}
+
+/**
+ * Migration 10.
+ *
+ * Rebuilds the orphaned documents index from the document targets table. Any
+ * existing entries are deleted first, since they may be stale after a
+ * downgrade to a version that did not maintain the index.
+ */
+void EnsureOrphanedDocumentsIndex(leveldb::DB* db, size_t chunk_size) {
+  ChunkedMigration migration(db, 10, chunk_size);
+  migration.ForEachRow(
+      "Delete orphaned documents index",
+      LevelDbOrphanedDocumentKey::KeyPrefix(),
+      [](LevelDbTransaction* transaction, LevelDbTransaction::Iterator* it) {
+        transaction->Delete(it->key());
+      });
+
+  // Each document's sentinel row sorts before its target rows, so a document
+  // is orphaned if its sentinel row is not followed by any of its target rows.
+  // The rows of a document are never split between chunks, so whether it is
+  // targeted can be tracked while scanning them.
+  std::string empty_buffer;
+  LevelDbDocumentTargetKey key;
+  absl::optional<ListenSequenceNumber> sequence_number;
+  DocumentKey sentinel_document_key;
+  bool targeted = false;
+  migration.ForEachGroup(
+      "Ensure orphaned documents index", LevelDbDocumentTargetKey::KeyPrefix(),
+      [&](absl::string_view row_key) {
+        HARD_ASSERT(key.Decode(row_key),
+                    "Failed to decode DocumentTarget key");
+        return key.document_key();
+      },
+      [&](LevelDbTransaction*, LevelDbTransaction::Iterator* it) {
+        // `key` holds the row decoded by the group function above.
+        if (key.IsSentinel()) {
+          sequence_number =
+              LevelDbDocumentTargetKey::DecodeSentinelValue(it->value());
+          sentinel_document_key = key.document_key();
+        } else {
+          targeted = true;
+        }
+      },
+      [&](LevelDbTransaction* transaction) {
+        if (sequence_number && !targeted) {
+          transaction->Put(LevelDbOrphanedDocumentKey::Key(
+                               *sequence_number, sentinel_document_key),
+                           empty_buffer);
+        }
+        sequence_number.reset();
+        targeted = false;
+      });
+
+  migration.Finish();
+}
+
+/**
+ * Migration 11.
+ *
+ * Copies the encoded mutation of every overlay into its entry in the
+ * collection index, so that collection scans do not need to look up each
+ * overlay.
+ */
+void CopyOverlaysIntoCollectionIndex(leveldb::DB* db, size_t chunk_size) {
+  ChunkedMigration migration(db, 11, chunk_size);
+  LevelDbDocumentOverlayKey key;
+  migration.ForEachRow(
+      "Copy overlays into collection index",
+      LevelDbDocumentOverlayKey::KeyPrefix(),
+      [&](LevelDbTransaction* transaction, LevelDbTransaction::Iterator* it) {
+        HARD_ASSERT(key.Decode(it->key()), "Failed to decode overlay key");
+        transaction->Put(LevelDbDocumentOverlayCollectionIndexKey::Key(key),
+                         std::string(it->value()));
+      });
+  migration.Finish();
+}
+
+/**
+ * Migration 12.
+ *
+ * Builds the collection mutations index from the document mutations index.
+ * Any existing rows are dropped first, since a version that predates the index
+ * may have added or removed mutation batches without maintaining it.
+ */
+void EnsureCollectionMutationsIndex(leveldb::DB* db, size_t chunk_size) {
+  ChunkedMigration migration(db, 12, chunk_size);
+  migration.ForEachRow(
+      "Delete collection mutations index",
+      LevelDbCollectionMutationKey::KeyPrefix(),
+      [](LevelDbTransaction* transaction, LevelDbTransaction::Iterator* it) {
+        transaction->Delete(it->key());
+      });
+
+  std::string empty_buffer;
+  LevelDbDocumentMutationKey key;
+  migration.ForEachRow(
+      "Ensure collection mutations index",
+      LevelDbDocumentMutationKey::KeyPrefix(),
+      [&](LevelDbTransaction* transaction, LevelDbTransaction::Iterator* it) {
+        HARD_ASSERT(key.Decode(it->key()),
+                    "Failed to decode document mutation key");
+        transaction->Put(LevelDbCollectionMutationKey::Key(
+                             key.user_id(), key.document_key(), key.batch_id()),
+                         empty_buffer);
+      });
+
+  migration.Finish();
+}
+
+/**
+ * Migration 13.
+ *
+ * Changes no rows. Saving the version marks the database as opened by an SDK
+ * that checks the minimum schema version before reading remote documents.
+ */
+void EnsureMinimumSchemaVersionIsChecked(leveldb::DB* db) {
+  LevelDbTransaction transaction(db, "Ensure minimum schema version");
+  SaveVersion(13, &transaction);
+  transaction.Commit();
+}
+
 }  // namespace
 
+constexpr size_t LevelDbMigrations::kMigrationChunkSize;
+
 LevelDbMigrations::SchemaVersion LevelDbMigrations::ReadSchemaVersion(
     leveldb::DB* db) {
   LevelDbTransaction transaction(db, "Read schema version");
@@ -388,6 +648,71 @@ LevelDbMigrations::SchemaVersion LevelDbMigrations::ReadSchemaVersion(
   }
 }
 
+LevelDbMigrations::SchemaVersion LevelDbMigrations::ReadMinimumSchemaVersion(
+    leveldb::DB* db) {
+  LevelDbTransaction transaction(db, "Read minimum schema version");
+  std::string value;
+  Status status =
+      transaction.Get(LevelDbGlobalKey::Key(kMinimumSchemaVersion), &value);
+  if (status.IsNotFound()) {
+    return 0;
+  }
+  HARD_ASSERT(status.ok(),
+              "Failed to read minimum schema version, error: '%s'",
+              status.ToString());
+  return stoi(value);
+}
+
+void LevelDbMigrations::SaveMinimumSchemaVersion(
+    SchemaVersion version, LevelDbTransaction* transaction) {
+  std::string key = LevelDbGlobalKey::Key(kMinimumSchemaVersion);
+  if (version == 0) {
+    transaction->Delete(key);
+  } else {
+    transaction->Put(key, std::to_string(version));
+  }
+}
+
+absl::optional<LevelDbMigrations::Cursor>
+LevelDbMigrations::ReadMigrationCursor(leveldb::DB* db) {
+  LevelDbTransaction transaction(db, "Read migration cursor");
+  std::string value;
+  Status status =
+      transaction.Get(LevelDbGlobalKey::Key(kMigrationCursor), &value);
+  if (status.IsNotFound()) {
+    return absl::nullopt;
+  }
+  HARD_ASSERT(status.ok(), "Failed to read migration cursor, error: '%s'",
+              status.ToString());
+
+  absl::string_view src = value;
+  int64_t version = 0;
+  int64_t pass = 0;
+  Cursor cursor;
+  if (!OrderedCode::ReadSignedNumIncreasing(&src, &version) ||
+      !OrderedCode::ReadSignedNumIncreasing(&src, &pass) ||
+      !OrderedCode::ReadString(&src, &cursor.next_key)) {
+    LOG_WARN("Ignoring unreadable migration cursor");
+    return absl::nullopt;
+  }
+  cursor.version = static_cast<SchemaVersion>(version);
+  cursor.pass = static_cast<int32_t>(pass);
+  return cursor;
+}
+
+void LevelDbMigrations::SaveMigrationCursor(const Cursor& cursor,
+                                            LevelDbTransaction* transaction) {
+  std::string value;
+  OrderedCode::WriteSignedNumIncreasing(&value, cursor.version);
+  OrderedCode::WriteSignedNumIncreasing(&value, cursor.pass);
+  OrderedCode::WriteString(&value, cursor.next_key);
+  transaction->Put(LevelDbGlobalKey::Key(kMigrationCursor), value);
+}
+
+void LevelDbMigrations::DeleteMigrationCursor(LevelDbTransaction* transaction) {
+  transaction->Delete(LevelDbGlobalKey::Key(kMigrationCursor));
+}
+
 void LevelDbMigrations::RunMigrations(leveldb::DB* db,
                                       const LocalSerializer& serializer) {
   RunMigrations(db, kSchemaVersion, serializer);
@@ -395,13 +720,16 @@ void LevelDbMigrations::RunMigrations(leveldb::DB* db,
 
 void LevelDbMigrations::RunMigrations(leveldb::DB* db,
                                       SchemaVersion to_version,
-                                      const LocalSerializer& serializer) {
+                                      const LocalSerializer& serializer,
+                                      size_t chunk_size) {
   SchemaVersion from_version = ReadSchemaVersion(db);
   // If this is a downgrade, just save the downgrade version so we can
   // detect it when we go to upgrade again, allowing us to rerun the
   // data migrations.
   if (from_version > to_version) {
     LevelDbTransaction transaction(db, "Save downgrade version");
+    LevelDbSizeTracker::Discard(&transaction);
+    DeleteMigrationCursor(&transaction);
     SaveVersion(to_version, &transaction);
     transaction.Commit();
     return;
@@ -415,7 +743,7 @@ void LevelDbMigrations::RunMigrations(leveldb::DB* db,
   }
 
   if (from_version < 4 && to_version >= 4) {
-    EnsureSentinelRows(db);
+    EnsureSentinelRows(db, chunk_size);
   }
 
   if (from_version < 5 && to_version >= 5) {
@@ -423,7 +751,7 @@ void LevelDbMigrations::RunMigrations(leveldb::DB* db,
   }
 
   if (from_version < 6 && to_version >= 6) {
-    EnsureCollectionParentsIndex(db);
+    EnsureCollectionParentsIndex(db, chunk_size);
   }
 
   if (from_version < 7 && to_version >= 7) {
@@ -433,6 +761,36 @@ void LevelDbMigrations::RunMigrations(leveldb::DB* db,
   if (from_version < 8 && to_version >= 8) {
     EnsureOverlayDataMigrationIsRequired(db);
   }
+
+  if (from_version < 9 && to_version >= 9) {
+    EnsureByteSizesAreRecomputed(db);
+  }
+
+  if (from_version < 10 && to_version >= 10) {
+    EnsureOrphanedDocumentsIndex(db, chunk_size);
+  }
+
+  if (from_version < 11 && to_version >= 11) {
+    CopyOverlaysIntoCollectionIndex(db, chunk_size);
+  }
+
+  if (from_version < 12 && to_version >= 12) {
+    EnsureCollectionMutationsIndex(db, chunk_size);
+  }
+
+  if (from_version < 13 && to_version >= 13) {
+    EnsureMinimumSchemaVersionIsChecked(db);
+  }
+
+  if (from_version < to_version) {
+    // Migrations write without a size tracker attached, and may rebuild the
+    // orphaned documents index, so the persisted totals no longer match the
+    // contents of the database.
+    LevelDbTransaction transaction(db, "Discard persisted totals");
+    LevelDbSizeTracker::Discard(&transaction);
+    LevelDbTargetCache::DiscardOrphanedDocumentCount(&transaction);
+    transaction.Commit();
+  }
 }
 
 }  // namespace local
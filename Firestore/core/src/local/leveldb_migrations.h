@@ -17,10 +17,13 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_MIGRATIONS_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_MIGRATIONS_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <string>
 
 #include "Firestore/core/src/local/leveldb_transaction.h"
 #include "Firestore/core/src/local/local_serializer.h"
+#include "absl/types/optional.h"
 #include "leveldb/db.h"
 
 namespace firebase {
@@ -31,11 +34,61 @@ class LevelDbMigrations {
  public:
   using SchemaVersion = int32_t;
 
+  /**
+   * The number of rows that a migration scanning a table processes in each
+   * transaction.
+   */
+  static constexpr size_t kMigrationChunkSize = 1000;
+
+  /**
+   * The progress of a migration that has committed some, but not all, of its
+   * chunks.
+   */
+  struct Cursor {
+    /** The schema version that the migration upgrades to. */
+    SchemaVersion version = 0;
+
+    /** The index of the first pass of the migration that is not complete. */
+    int32_t pass = 0;
+
+    /**
+     * The key of the first row that the pass has yet to process, or empty if
+     * the pass has not started.
+     */
+    std::string next_key;
+  };
+
   /**
    * Returns the current version of the schema for the given database
    */
   static SchemaVersion ReadSchemaVersion(leveldb::DB* db);
 
+  /**
+   * Returns the oldest schema version that can read the given database, or 0
+   * if every version can.
+   */
+  static SchemaVersion ReadMinimumSchemaVersion(leveldb::DB* db);
+
+  /**
+   * Records in the given transaction that only SDKs at `version` or newer can
+   * read the database. A version of 0 removes the restriction.
+   */
+  static void SaveMinimumSchemaVersion(SchemaVersion version,
+                                       LevelDbTransaction* transaction);
+
+  /**
+   * Returns the progress of the migration that was interrupted before it
+   * completed, if any.
+   */
+  static absl::optional<Cursor> ReadMigrationCursor(leveldb::DB* db);
+
+  /** Saves the progress of a migration in the given transaction. */
+  static void SaveMigrationCursor(const Cursor& cursor,
+                                  LevelDbTransaction* transaction);
+
+  /** Removes the progress of a migration in the given transaction. */
+  static void DeleteMigrationCursor(LevelDbTransaction* transaction);
+
   /**
    * Runs any migrations needed to bring the given database up to the current
    * schema version
@@ -48,7 +101,8 @@ class LevelDbMigrations {
    */
   static void RunMigrations(leveldb::DB* db,
                             SchemaVersion version,
-                            const LocalSerializer& serializer);
+                            const LocalSerializer& serializer,
+                            size_t chunk_size = kMigrationChunkSize);
 };
 
 /**
@@ -73,8 +127,28 @@ class LevelDbMigrations {
  *   * Migration 6 populates the collection_parents index.
  *   * Migration 7 rewrites query_targets canonical ids in new format.
  *   * Migration 8 kicks off overlay data migration.
+ *   * Migration 9 recomputes the byte sizes tracked by LevelDbSizeTracker.
+ *     Every later migration also discards them, since migrations do not
+ *     update them.
+ *   * Migration 10 builds the orphaned documents index used by LRU garbage
+ *     collection.
+ *   * Migration 11 copies overlay mutations into the overlay collection index.
+ *   * Migration 12 builds the collection_mutation index.
+ *   * Migration 13 changes no rows. SDKs at this version refuse to open a
+ *     database whose minimum schema version is newer than theirs.
+ *
+ * Migrations that scan tables proportional to the size of the cache (4, 6, 10,
+ * 11 and 12) commit in chunks and save a cursor with each chunk, so an
+ * interrupted migration resumes from its last committed chunk. The schema
+ * version is only saved once every chunk is committed.
+ */
+const LevelDbMigrations::SchemaVersion kSchemaVersion = 13;
+
+/**
+ * The minimum schema version recorded by databases holding remote documents
+ * encoded with a field name dictionary, which older SDKs cannot parse.
  */
-const LevelDbMigrations::SchemaVersion kSchemaVersion = 8;
+const LevelDbMigrations::SchemaVersion kFieldNameDictionarySchemaVersion = 13;
 
 }  // namespace local
 }  // namespace firestore
@@ -166,8 +166,11 @@ MutationBatch LevelDbMutationQueue::AddMutationBatch(
 
   MutationBatch batch(batch_id, local_write_time, std::move(base_mutations),
                       std::move(mutations));
+  // No rows exist yet for a batch id that is not in the queue.
+  LevelDbTransaction* transaction = db_->current_transaction();
   std::string key = mutation_batch_key(batch_id);
-  db_->current_transaction()->Put(key, serializer_->EncodeMutationBatch(batch));
+  transaction->RecordAbsent(key);
+  transaction->Put(key, serializer_->EncodeMutationBatch(batch));
 
   // Store an empty value in the index which is equivalent to serializing a
   // GPBEmpty message. In the future if we wanted to store some other kind of
@@ -177,7 +180,11 @@ MutationBatch LevelDbMutationQueue::AddMutationBatch(
 
   for (const Mutation& mutation : batch.mutations()) {
     key = LevelDbDocumentMutationKey::Key(user_id_, mutation.key(), batch_id);
-    db_->current_transaction()->Put(key, empty_buffer);
+    transaction->RecordAbsent(key);
+    transaction->Put(key, empty_buffer);
+    key = LevelDbCollectionMutationKey::Key(user_id_, mutation.key(), batch_id);
+    transaction->RecordAbsent(key);
+    transaction->Put(key, empty_buffer);
 
     index_manager_->AddToCollectionParentIndex(mutation.key().path().PopLast());
   }
@@ -201,11 +208,17 @@ void LevelDbMutationQueue::RemoveMutationBatch(const MutationBatch& batch) {
               "Mutation batch %s not found; found %s", DescribeKey(key),
               DescribeKey(check_iterator->key()));
 
-  db_->current_transaction()->Delete(key);
+  LevelDbTransaction* transaction = db_->current_transaction();
+  transaction->Delete(key);
 
+  // The index rows were written with empty values by AddMutationBatch.
   for (const Mutation& mutation : batch.mutations()) {
     key = LevelDbDocumentMutationKey::Key(user_id_, mutation.key(), batch_id);
-    db_->current_transaction()->Delete(key);
+    transaction->RecordPreviousSize(key, 0);
+    transaction->Delete(key);
+    key = LevelDbCollectionMutationKey::Key(user_id_, mutation.key(), batch_id);
+    transaction->RecordPreviousSize(key, 0);
+    transaction->Delete(key);
     db_->reference_delegate()->RemoveMutationReference(mutation.key());
   }
 }
@@ -276,30 +289,26 @@ LevelDbMutationQueue::AllMutationBatchesAffectingQuery(const Query& query) {
       "CollectionGroup queries should be handled in LocalDocumentsView");
 
   const ResourcePath& query_path = query.path();
-  size_t immediate_children_path_length = query_path.size() + 1;
 
-  // TODO(mcg): Actually implement a single-collection query
-  //
-  // This is actually executing an ancestor query, traversing the whole subtree
-  // below the collection which can be horrifically inefficient for some
-  // structures. The right way to solve this is to implement the full value
-  // index, but that's not in the cards in the near future so this is the best
-  // we can do for the moment.
-  //
   // Since we don't yet index the actual properties in the mutations, our
   // current approach is to just return all mutation batches that affect
   // documents in the collection being queried.
   //
+  // The collection-mutation index groups rows by the collection directly
+  // containing each document. Rows for the immediate children of the query
+  // path sort before rows for documents in any of its subcollections, so the
+  // scan ends at the first row for a nested document.
+  //
   // Unlike AllMutationBatchesAffectingDocumentKey, this iteration will scan the
-  // document-mutation index for more than a single document so the associated
-  // batch_ids will be neither necessarily unique nor in order. This means an
-  // efficient simultaneous scan isn't possible.
+  // index for more than a single document so the associated batch_ids will be
+  // neither necessarily unique nor in order. This means an efficient
+  // simultaneous scan isn't possible.
   std::string index_prefix =
-      LevelDbDocumentMutationKey::KeyPrefix(user_id_, query_path);
+      LevelDbCollectionMutationKey::KeyPrefix(user_id_, query_path);
   auto index_iterator = db_->current_transaction()->NewIterator();
   index_iterator->Seek(index_prefix);
 
-  LevelDbDocumentMutationKey row_key;
+  LevelDbCollectionMutationKey row_key;
 
   // Collect up unique batch_ids encountered during a scan of the index. Use a
   // set<BatchId> to accumulate the IDs so they can be traversed in order in a
@@ -312,20 +321,11 @@ LevelDbMutationQueue::AllMutationBatchesAffectingQuery(const Query& query) {
   std::set<BatchId> unique_batch_ids;
   for (; index_iterator->Valid(); index_iterator->Next()) {
     if (!absl::StartsWith(index_iterator->key(), index_prefix) ||
-        !row_key.Decode(index_iterator->key())) {
+        !row_key.Decode(index_iterator->key()) ||
+        row_key.collection() != query_path) {
       break;
     }
 
-    // Rows with document keys more than one segment longer than the query path
-    // can't be matches. For example, a query on 'rooms' can't match the
-    // document /rooms/abc/messages/xyx.
-    // TODO(mcg): we'll need a different scanner when we implement ancestor
-    // queries.
-    if (row_key.document_key().path().size() !=
-        immediate_children_path_length) {
-      continue;
-    }
-
     unique_batch_ids.insert(row_key.batch_id());
   }
 
@@ -397,21 +397,24 @@ void LevelDbMutationQueue::PerformConsistencyCheck() {
     return;
   }
 
-  // Verify that there are no entries in the document-mutation index if the
-  // queue is empty.
-  std::string index_prefix = LevelDbDocumentMutationKey::KeyPrefix(user_id_);
-  auto index_iterator = db_->current_transaction()->NewIterator();
-  index_iterator->Seek(index_prefix);
-
+  // Verify that there are no entries in the document-mutation or
+  // collection-mutation indexes if the queue is empty.
   std::vector<std::string> dangling_mutation_references;
 
-  for (; index_iterator->Valid(); index_iterator->Next()) {
-    // Only consider rows matching this index prefix for the current user.
-    if (!absl::StartsWith(index_iterator->key(), index_prefix)) {
-      break;
-    }
+  for (const std::string& index_prefix :
+       {LevelDbDocumentMutationKey::KeyPrefix(user_id_),
+        LevelDbCollectionMutationKey::KeyPrefix(user_id_)}) {
+    auto index_iterator = db_->current_transaction()->NewIterator();
+    index_iterator->Seek(index_prefix);
 
-    dangling_mutation_references.push_back(DescribeKey(index_iterator));
+    for (; index_iterator->Valid(); index_iterator->Next()) {
+      // Only consider rows matching this index prefix for the current user.
+      if (!absl::StartsWith(index_iterator->key(), index_prefix)) {
+        break;
+      }
+
+      dangling_mutation_references.push_back(DescribeKey(index_iterator));
+    }
   }
 
   HARD_ASSERT(dangling_mutation_references.empty(),
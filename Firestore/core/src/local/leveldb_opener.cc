@@ -66,7 +66,7 @@ LevelDbOpener::LevelDbOpener(DatabaseInfo database_info,
 }
 
 util::StatusOr<std::unique_ptr<LevelDbPersistence>> LevelDbOpener::Create(
-    const LruParams& lru_params) {
+    const LruParams& lru_params, const api::PersistentCacheTuning& tuning) {
   auto maybe_dir = PrepareDataDir();
   if (!maybe_dir.ok()) return maybe_dir.status();
   Path db_data_dir = maybe_dir.ValueOrDie();
@@ -77,7 +77,7 @@ util::StatusOr<std::unique_ptr<LevelDbPersistence>> LevelDbOpener::Create(
   LocalSerializer local_serializer(std::move(remote_serializer));
 
   return LevelDbPersistence::Create(db_data_dir, std::move(local_serializer),
-                                    lru_params);
+                                    lru_params, tuning);
 }
 
 StatusOr<Path> LevelDbOpener::LevelDbDataDir() {
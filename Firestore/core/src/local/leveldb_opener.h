@@ -19,6 +19,7 @@
 
 #include <memory>
 
+#include "Firestore/core/src/api/settings.h"
 #include "Firestore/core/src/core/database_info.h"
 #include "Firestore/core/src/util/path.h"
 #include "absl/types/optional.h"
@@ -73,10 +74,12 @@ class LevelDbOpener {
    *   * Actually opening the LevelDB database.
    *
    * @param lru_params The LRU GC configuration to use for the instance.
+   * @param tuning The storage engine tuning to open the database with.
    * @return A pointer to the created instance or Status indicating what failed.
    */
   util::StatusOr<std::unique_ptr<LevelDbPersistence>> Create(
-      const LruParams& lru_params);
+      const LruParams& lru_params,
+      const api::PersistentCacheTuning& tuning = {});
 
   /**
    * Finds a suitable directory to serve as the root of all Firestore local
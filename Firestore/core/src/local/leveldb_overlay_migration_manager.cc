@@ -16,16 +16,30 @@
 
 #include "Firestore/core/src/local/leveldb_overlay_migration_manager.h"
 
+#include <algorithm>
+#include <iterator>
+#include <map>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "Firestore/core/src/credentials/user.h"
+#include "Firestore/core/src/local/document_overlay_cache.h"
 #include "Firestore/core/src/local/leveldb_key.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
-#include "Firestore/core/src/local/local_documents_view.h"
+#include "Firestore/core/src/local/mutation_queue.h"
+#include "Firestore/core/src/local/remote_document_cache.h"
+#include "Firestore/core/src/model/document_key_set.h"
 #include "Firestore/core/src/model/model_fwd.h"
+#include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/src/model/mutation.h"
+#include "Firestore/core/src/model/mutation_batch.h"
+#include "Firestore/core/src/util/background_queue.h"
+#include "Firestore/core/src/util/executor.h"
 #include "absl/strings/match.h"
+#include "absl/types/optional.h"
 
 namespace firebase {
 namespace firestore {
@@ -33,6 +47,19 @@ namespace local {
 namespace {
 
 using credentials::User;
+using model::BatchId;
+using model::DocumentKey;
+using model::DocumentKeySet;
+using model::FieldMask;
+using model::MutableDocument;
+using model::Mutation;
+using model::MutationBatch;
+using model::MutationByDocumentKeyMap;
+using util::BackgroundQueue;
+using util::Executor;
+
+/** The number of documents whose overlay is calculated by each task. */
+const size_t kDocumentsPerTask = 100;
 
 std::unordered_set<std::string> GetAllUserIds(LevelDbPersistence* db) {
   std::unordered_set<std::string> uids;
@@ -49,51 +76,202 @@ std::unordered_set<std::string> GetAllUserIds(LevelDbPersistence* db) {
   return uids;
 }
 
-void RemovePendingOverlayMigrations(LevelDbPersistence* db) {
-  auto key = LevelDbDataMigrationKey::OverlayMigrationKey();
-  db->current_transaction()->Delete(key);
+std::vector<std::string> GetPendingUserIds(LevelDbPersistence* db) {
+  std::vector<std::string> uids;
+  for (const auto& uid : GetAllUserIds(db)) {
+    std::string to_discard;
+    auto key = LevelDbDataMigrationKey::UserOverlayMigrationKey(uid);
+    if (db->current_transaction()->Get(key, &to_discard).ok()) {
+      uids.push_back(uid);
+    }
+  }
+  return uids;
+}
+
+User ToUser(const std::string& uid) {
+  return uid.empty() ? User::Unauthenticated() : User(uid);
+}
+
+/** A document whose overlay needs to be calculated. */
+struct PendingDocument {
+  MutableDocument document;
+
+  /** The batches that mutate the document, in order of batch ID. */
+  std::vector<const MutationBatch*> batches;
+};
+
+/** An overlay to save, and the ID of the batch that it was calculated at. */
+struct CalculatedOverlay {
+  BatchId largest_batch_id;
+  Mutation mutation;
+};
+
+/**
+ * Applies all of the batches that mutate the pending document and appends the
+ * resulting overlay, if any, to `results`. This only reads shared state, so it
+ * can run on any thread.
+ */
+void CalculateOverlay(PendingDocument* pending,
+                      std::vector<CalculatedOverlay>* results) {
+  absl::optional<FieldMask> mask = FieldMask();
+  for (const MutationBatch* batch : pending->batches) {
+    mask = batch->ApplyToLocalView(pending->document, std::move(mask));
+  }
+
+  absl::optional<Mutation> mutation =
+      Mutation::CalculateOverlayMutation(pending->document, mask);
+  if (mutation.has_value()) {
+    results->push_back(CalculatedOverlay{pending->batches.back()->batch_id(),
+                                         std::move(mutation).value()});
+  }
+}
+
+/**
+ * Calculates the overlays of all documents mutated by `batches`.
+ *
+ * Each document's overlay only depends on the batches that mutate it, so
+ * documents are split into groups whose overlays are calculated in parallel.
+ */
+std::vector<CalculatedOverlay> CalculateOverlays(
+    RemoteDocumentCache* remote_document_cache,
+    const std::vector<MutationBatch>& batches) {
+  std::map<DocumentKey, std::vector<const MutationBatch*>> batches_by_key;
+  DocumentKeySet keys;
+  for (const MutationBatch& batch : batches) {
+    for (const DocumentKey& key : batch.keys()) {
+      batches_by_key[key].push_back(&batch);
+      keys = keys.insert(key);
+    }
+  }
+
+  std::vector<PendingDocument> pending;
+  pending.reserve(batches_by_key.size());
+  for (const auto& entry : remote_document_cache->GetAll(keys)) {
+    pending.push_back(PendingDocument{
+        entry.second, std::move(batches_by_key[entry.first])});
+  }
+
+  size_t task_count = (pending.size() + kDocumentsPerTask - 1) /
+                      kDocumentsPerTask;
+  std::vector<std::vector<CalculatedOverlay>> results(task_count);
+  auto run_task = [&pending, &results](size_t task) {
+    size_t end = std::min(pending.size(), (task + 1) * kDocumentsPerTask);
+    for (size_t i = task * kDocumentsPerTask; i < end; ++i) {
+      CalculateOverlay(&pending[i], &results[task]);
+    }
+  };
+
+  if (task_count == 1) {
+    run_task(0);
+  } else if (task_count > 1) {
+    auto hw_concurrency = std::thread::hardware_concurrency();
+    if (hw_concurrency == 0) {
+      // If the standard library doesn't know, guess something reasonable.
+      hw_concurrency = 4;
+    }
+    auto executor =
+        Executor::CreateConcurrent("com.google.firebase.firestore.overlays",
+                                   static_cast<int>(hw_concurrency));
+    BackgroundQueue tasks(executor.get());
+    for (size_t task = 0; task < task_count; ++task) {
+      tasks.Execute([&run_task, task] { run_task(task); });
+    }
+    tasks.AwaitAll();
+  }
+
+  std::vector<CalculatedOverlay> overlays;
+  for (auto& task_results : results) {
+    std::move(task_results.begin(), task_results.end(),
+              std::back_inserter(overlays));
+  }
+  return overlays;
 }
 
 }  // namespace
 
 bool LevelDbOverlayMigrationManager::HasPendingOverlayMigration() {
+  auto prefix = LevelDbDataMigrationKey::KeyPrefix();
+  LevelDbDataMigrationKey key;
+  auto iter = db_->current_transaction()->NewIterator();
+  for (iter->Seek(prefix);
+       iter->Valid() && absl::StartsWith(iter->key(), prefix); iter->Next()) {
+    if (key.Decode(iter->key()) && key.IsOverlayMigration()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LevelDbOverlayMigrationManager::SplitPendingOverlayMigration() {
   auto key = LevelDbDataMigrationKey::OverlayMigrationKey();
   std::string to_discard;
-  return db_->current_transaction()->Get(key, &to_discard).ok();
+  if (!db_->current_transaction()->Get(key, &to_discard).ok()) {
+    return;
+  }
+
+  for (const auto& uid : GetAllUserIds(db_)) {
+    db_->current_transaction()->Put(
+        LevelDbDataMigrationKey::UserOverlayMigrationKey(uid), "");
+  }
+  db_->current_transaction()->Delete(key);
+}
+
+void LevelDbOverlayMigrationManager::MigrateUser(const std::string& uid) {
+  auto key = LevelDbDataMigrationKey::UserOverlayMigrationKey(uid);
+  std::string to_discard;
+  if (!db_->current_transaction()->Get(key, &to_discard).ok()) {
+    return;
+  }
+
+  User user = ToUser(uid);
+  auto* index_manager = db_->GetIndexManager(user);
+  auto* mutation_queue = db_->GetMutationQueue(user, index_manager);
+  std::vector<MutationBatch> batches = mutation_queue->AllMutationBatches();
+
+  // Overlays are calculated in parallel, but saved serially in the current
+  // transaction.
+  std::map<BatchId, MutationByDocumentKeyMap> overlays_by_batch_id;
+  for (CalculatedOverlay& overlay :
+       CalculateOverlays(db_->remote_document_cache(), batches)) {
+    DocumentKey document_key = overlay.mutation.key();
+    overlays_by_batch_id[overlay.largest_batch_id].emplace(
+        std::move(document_key), std::move(overlay.mutation));
+  }
+
+  auto* document_overlay_cache = db_->GetDocumentOverlayCache(user);
+  for (const auto& entry : overlays_by_batch_id) {
+    document_overlay_cache->SaveOverlays(entry.first, entry.second);
+  }
+
+  db_->current_transaction()->Delete(key);
 }
 
 void LevelDbOverlayMigrationManager::Run() {
   db_->Run("migrate overlays", [this] {
-    if (!HasPendingOverlayMigration()) {
-      return;
-    }
+    SplitPendingOverlayMigration();
+    MigrateUser(uid_);
+  });
+}
 
-    std::unordered_set<std::string> user_ids = GetAllUserIds(db_);
-    auto* remote_document_cache = db_->remote_document_cache();
-    for (const auto& uid : user_ids) {
-      User user = User::Unauthenticated();
-      if (!uid.empty()) {
-        user = User(uid);
-      }
-      auto* index_manager = db_->GetIndexManager(user);
-      auto* mutation_queue = db_->GetMutationQueue(user, index_manager);
-
-      // Get all document keys that have local mutations
-      model::DocumentKeySet all_document_keys;
-      for (const auto& batch : mutation_queue->AllMutationBatches()) {
-        all_document_keys = all_document_keys.union_with(batch.keys());
-      }
-
-      // Recalculate and save overlays
-      auto* document_overlay_cache = db_->GetDocumentOverlayCache(user);
-      LocalDocumentsView local_view(remote_document_cache, mutation_queue,
-                                    document_overlay_cache, index_manager);
-      local_view.RecalculateAndSaveOverlays(std::move(all_document_keys));
-    }
+void LevelDbOverlayMigrationManager::RunForOtherUsers() {
+  std::vector<std::string> uids =
+      db_->Run("Read pending overlay migrations", [this] {
+        SplitPendingOverlayMigration();
+        return GetPendingUserIds(db_);
+      });
 
+  // Each user is migrated in its own transaction, so that a large migration
+  // does not hold every user's overlays in memory at once.
+  bool migrated = false;
+  for (const auto& uid : uids) {
+    if (uid == uid_) continue;
+    db_->Run("migrate overlays", [&] { MigrateUser(uid); });
+    migrated = true;
+  }
+
+  if (migrated) {
     db_->ReleaseOtherUserSpecificComponents(uid_);
-    RemovePendingOverlayMigrations(db_);
-  });
+  }
 }
 
 }  // namespace local
@@ -41,13 +41,34 @@ class LevelDbOverlayMigrationManager : public OverlayMigrationManager {
       : db_(db), uid_(uid) {
   }
 
+  /**
+   * Migrates the overlays of the manager's user. The first run after the
+   * migration became required splits it into one migration per user with
+   * pending mutations, so that users whose queue is empty, and users other
+   * than the current one, do not delay startup.
+   */
   void Run() override;
 
+  void RunForOtherUsers() override;
+
  private:
   friend class LevelDbOverlayMigrationManagerTest;
 
+  /** Returns true if the overlays of any user still need to be migrated. */
   bool HasPendingOverlayMigration();
 
+  /**
+   * Replaces the migration for all users, if present, with one migration per
+   * user that has mutations.
+   */
+  void SplitPendingOverlayMigration();
+
+  /**
+   * Recalculates and saves the overlays of the given user, if that user has a
+   * pending migration.
+   */
+  void MigrateUser(const std::string& uid);
+
   // The LevelDbOverlayMigrationManager is owned by LevelDbPersistence.
   LevelDbPersistence* db_;
 
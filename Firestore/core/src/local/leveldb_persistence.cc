@@ -16,7 +16,6 @@
 
 #include "Firestore/core/src/local/leveldb_persistence.h"
 
-#include <limits>
 #include <utility>
 
 #include "Firestore/core/src/core/database_info.h"
@@ -51,6 +50,34 @@ using util::Status;
 using util::StatusOr;
 using util::StringFormat;
 
+/**
+ * The global recording how found documents are encoded in the remote documents
+ * table, and its values.
+ */
+const char* kRemoteDocumentEncoding = "remote_document_encoding";
+const char* kPlainEncoding = "plain";
+const char* kFieldNameDictionaryEncoding = "field_name_dictionary";
+
+/**
+ * The passes recorded in the migration cursor while remote documents are
+ * rewritten, which tell an interrupted rewrite which encoding it was writing.
+ * The cursor's version is kFieldNameDictionarySchemaVersion.
+ */
+const int32_t kEncodeWithDictionaryPass = 0;
+const int32_t kEncodePlainPass = 1;
+
+/**
+ * The read-only transaction running on the current thread, if any, along with
+ * the persistence that started it.
+ */
+struct ReadOnlyTransactionSlot {
+  const LevelDbPersistence* persistence;
+  LevelDbTransaction* transaction;
+};
+
+thread_local ReadOnlyTransactionSlot current_read_only_transaction = {
+    nullptr, nullptr};
+
 /**
  * Finds all user ids in the database based on the existence of a mutation
  * queue.
@@ -80,7 +107,8 @@ StatusOr<std::unique_ptr<LevelDbPersistence>> LevelDbPersistence::Create(
     util::Path dir,
     LevelDbMigrations::SchemaVersion version,
     LocalSerializer serializer,
-    const LruParams& lru_params) {
+    const LruParams& lru_params,
+    const api::PersistentCacheTuning& tuning) {
   auto* fs = Filesystem::Default();
   Status status = EnsureDirectory(dir);
   if (!status.ok()) return status;
@@ -88,35 +116,61 @@ StatusOr<std::unique_ptr<LevelDbPersistence>> LevelDbPersistence::Create(
   status = fs->ExcludeFromBackups(dir);
   if (!status.ok()) return status;
 
-  StatusOr<std::unique_ptr<DB>> created = OpenDb(dir);
+  std::unique_ptr<const leveldb::FilterPolicy> filter_policy;
+  std::unique_ptr<leveldb::Cache> block_cache;
+  StatusOr<std::unique_ptr<DB>> created =
+      OpenDb(dir, tuning, &filter_policy, &block_cache);
   if (!created.ok()) return created.status();
 
   std::unique_ptr<DB> db = std::move(created).ValueOrDie();
+  LevelDbMigrations::SchemaVersion minimum_version =
+      LevelDbMigrations::ReadMinimumSchemaVersion(db.get());
+  if (minimum_version > version) {
+    return Status{Error::kErrorFailedPrecondition,
+                  StringFormat("The persistence directory requires schema "
+                               "version %s, but this SDK only supports %s",
+                               minimum_version, version)};
+  }
   LevelDbMigrations::RunMigrations(db.get(), version, serializer);
+  auto size_tracker = absl::make_unique<LevelDbSizeTracker>(db.get());
 
   LevelDbTransaction transaction(db.get(), "Start LevelDB");
   std::set<std::string> users = CollectUserSet(&transaction);
   transaction.Commit();
 
   // Explicit conversion is required to allow the StatusOr to be created.
-  std::unique_ptr<LevelDbPersistence> result(
-      new LevelDbPersistence(std::move(db), std::move(dir), std::move(users),
-                             std::move(serializer), lru_params));
+  std::unique_ptr<LevelDbPersistence> result(new LevelDbPersistence(
+      std::move(db), std::move(filter_policy), std::move(block_cache),
+      std::move(size_tracker), std::move(dir), std::move(users),
+      std::move(serializer), lru_params, tuning));
+  result->EnsureRemoteDocumentEncoding();
   return {std::move(result)};
 }
 
 StatusOr<std::unique_ptr<LevelDbPersistence>> LevelDbPersistence::Create(
-    util::Path dir, LocalSerializer serializer, const LruParams& lru_params) {
+    util::Path dir,
+    LocalSerializer serializer,
+    const LruParams& lru_params,
+    const api::PersistentCacheTuning& tuning) {
   return Create(std::move(dir), kSchemaVersion, std::move(serializer),
-                lru_params);
+                lru_params, tuning);
 }
 
-LevelDbPersistence::LevelDbPersistence(std::unique_ptr<leveldb::DB> db,
-                                       util::Path directory,
-                                       std::set<std::string> users,
-                                       LocalSerializer serializer,
-                                       const LruParams& lru_params)
-    : db_(std::move(db)),
+LevelDbPersistence::LevelDbPersistence(
+    std::unique_ptr<leveldb::DB> db,
+    std::unique_ptr<const leveldb::FilterPolicy> filter_policy,
+    std::unique_ptr<leveldb::Cache> block_cache,
+    std::unique_ptr<LevelDbSizeTracker> size_tracker,
+    util::Path directory,
+    std::set<std::string> users,
+    LocalSerializer serializer,
+    const LruParams& lru_params,
+    const api::PersistentCacheTuning& tuning)
+    : filter_policy_(std::move(filter_policy)),
+      block_cache_(std::move(block_cache)),
+      db_(std::move(db)),
+      compactor_(absl::make_unique<LevelDbCompactor>(db_.get())),
+      size_tracker_(std::move(size_tracker)),
       directory_(std::move(directory)),
       users_(std::move(users)),
       serializer_(std::move(serializer)) {
@@ -132,6 +186,9 @@ LevelDbPersistence::LevelDbPersistence(std::unique_ptr<leveldb::DB> db,
   target_cache_->Start();
   reference_delegate_->Start();
   started_ = true;
+
+  document_cache_->set_field_name_dictionary_enabled(
+      tuning.field_name_dictionary_enabled());
 }
 
 // Handle unique_ptrs to forward declarations
@@ -151,10 +208,38 @@ Status LevelDbPersistence::EnsureDirectory(const Path& dir) {
   return Status::OK();
 }
 
-StatusOr<std::unique_ptr<DB>> LevelDbPersistence::OpenDb(const Path& dir) {
+StatusOr<std::unique_ptr<DB>> LevelDbPersistence::OpenDb(
+    const Path& dir,
+    const api::PersistentCacheTuning& tuning,
+    std::unique_ptr<const leveldb::FilterPolicy>* filter_policy,
+    std::unique_ptr<leveldb::Cache>* block_cache) {
   leveldb::Options options;
   options.create_if_missing = true;
 
+  // Parameters left at zero keep LevelDB's defaults. Changing any of them on
+  // an existing database is safe: they only affect how new tables are written
+  // and how the database is accessed while open.
+  if (tuning.bloom_filter_bits_per_key() > 0) {
+    filter_policy->reset(
+        leveldb::NewBloomFilterPolicy(tuning.bloom_filter_bits_per_key()));
+    options.filter_policy = filter_policy->get();
+  }
+  if (tuning.block_cache_size_bytes() > 0) {
+    block_cache->reset(leveldb::NewLRUCache(
+        static_cast<size_t>(tuning.block_cache_size_bytes())));
+    options.block_cache = block_cache->get();
+  }
+  if (tuning.block_size_bytes() > 0) {
+    options.block_size = static_cast<size_t>(tuning.block_size_bytes());
+  }
+  if (tuning.write_buffer_size_bytes() > 0) {
+    options.write_buffer_size =
+        static_cast<size_t>(tuning.write_buffer_size_bytes());
+  }
+  if (tuning.max_open_files() > 0) {
+    options.max_open_files = tuning.max_open_files();
+  }
+
   DB* database = nullptr;
   leveldb::Status status = DB::Open(options, dir.ToUtf8String(), &database);
   if (!status.ok()) {
@@ -170,11 +255,19 @@ StatusOr<std::unique_ptr<DB>> LevelDbPersistence::OpenDb(const Path& dir) {
 // MARK: - LevelDB utilities
 
 LevelDbTransaction* LevelDbPersistence::current_transaction() {
+  if (current_read_only_transaction.persistence == this) {
+    return current_read_only_transaction.transaction;
+  }
+
   HARD_ASSERT(transaction_ != nullptr,
               "Attempting to access transaction before one has started");
   return transaction_.get();
 }
 
+bool LevelDbPersistence::in_read_only_transaction() const {
+  return current_read_only_transaction.persistence == this;
+}
+
 util::Status LevelDbPersistence::ClearPersistence(
     const core::DatabaseInfo& database_info) {
   LevelDbOpener opener(database_info);
@@ -189,36 +282,10 @@ util::Status LevelDbPersistence::ClearPersistence(
 }
 
 StatusOr<int64_t> LevelDbPersistence::CalculateByteSize() {
-  auto* fs = Filesystem::Default();
-
-  // Accumulate the total size in an unsigned integer to avoid undefined
-  // behavior on overflow.
-  uint64_t count = 0;
-  auto iter = util::DirectoryIterator::Create(directory_);
-  for (; iter->Valid(); iter->Next()) {
-    StatusOr<int64_t> maybe_size = fs->FileSize(iter->file());
-    if (!maybe_size.ok()) {
-      return Status::FromCause("Failed to size LevelDB directory",
-                               maybe_size.status());
-    }
-
-    uint64_t old_count = count;
-    int64_t file_size = maybe_size.ValueOrDie();
-    count += file_size;
-
-    auto max_signed_value =
-        static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
-    if (count < old_count || count > max_signed_value) {
-      return Status(Error::kErrorOutOfRange,
-                    "Failed to size LevelDB: count overflowed");
-    }
-  }
-
-  if (!iter->status().ok()) {
-    return Status::FromCause("Failed to iterate over LevelDB files",
-                             iter->status());
-  }
-  return static_cast<int64_t>(count);
+  // Garbage collection checks the size periodically, which is when totals that
+  // have drifted through blind writes are brought back in line.
+  size_tracker_->ResyncIfNeeded();
+  return size_tracker_->total_byte_size();
 }
 
 // MARK: - Persistence
@@ -329,15 +396,46 @@ void LevelDbPersistence::RunInternal(absl::string_view label,
               "Starting a transaction while one is already in progress");
 
   transaction_ = absl::make_unique<LevelDbTransaction>(db_.get(), label);
+  transaction_->set_size_tracker(size_tracker_.get());
   reference_delegate_->OnTransactionStarted(label);
 
   block();
 
+  target_cache_->SaveOrphanedDocumentCount();
   reference_delegate_->OnTransactionCommitted();
   transaction_->Commit();
   transaction_.reset();
 }
 
+bool LevelDbPersistence::SupportsConcurrentReadOnlyTransactions() const {
+  return true;
+}
+
+void LevelDbPersistence::RunReadOnlyInternal(absl::string_view label,
+                                             std::function<void()> block) {
+  HARD_ASSERT(current_read_only_transaction.transaction == nullptr,
+              "Starting a read-only transaction while one is already in "
+              "progress on this thread");
+  HARD_ASSERT(db_ != nullptr, "Read-only transaction after shutdown");
+
+  const leveldb::Snapshot* snapshot = db_->GetSnapshot();
+  leveldb::ReadOptions read_options = StandardReadOptions();
+  read_options.snapshot = snapshot;
+
+  {
+    LevelDbTransaction transaction(db_.get(), label, read_options);
+    current_read_only_transaction = {this, &transaction};
+
+    block();
+
+    current_read_only_transaction = {nullptr, nullptr};
+    HARD_ASSERT(transaction.changed_keys() == 0,
+                "Read-only transaction %s attempted to write", label);
+  }
+
+  db_->ReleaseSnapshot(snapshot);
+}
+
 leveldb::ReadOptions StandardReadOptions() {
   // For now this is paranoid, but perhaps disable that in production builds.
   leveldb::ReadOptions options;
@@ -345,9 +443,85 @@ leveldb::ReadOptions StandardReadOptions() {
   return options;
 }
 
+void LevelDbPersistence::EnsureRemoteDocumentEncoding() {
+  bool enabled = document_cache_->field_name_dictionary_enabled();
+  std::string wanted = enabled ? kFieldNameDictionaryEncoding : kPlainEncoding;
+  int32_t pass = enabled ? kEncodeWithDictionaryPass : kEncodePlainPass;
+
+  // Databases that never recorded an encoding only hold plain documents.
+  std::string recorded = Run("Read remote document encoding", [&] {
+    std::string value;
+    leveldb::Status status = transaction_->Get(
+        LevelDbGlobalKey::Key(kRemoteDocumentEncoding), &value);
+    return status.ok() ? value : std::string(kPlainEncoding);
+  });
+
+  // The recorded encoding is only updated once a rewrite completes, so a
+  // rewrite that was interrupted is found through its migration cursor.
+  absl::optional<LevelDbMigrations::Cursor> cursor =
+      LevelDbMigrations::ReadMigrationCursor(db_.get());
+  bool interrupted =
+      cursor && cursor->version == kFieldNameDictionarySchemaVersion;
+  if (recorded == wanted && !interrupted) return;
+
+  std::string next_key;
+  if (interrupted && cursor->pass == pass) {
+    LOG_DEBUG("Resuming the rewrite of remote documents");
+    next_key = cursor->next_key;
+  }
+
+  // From now on, new rows are written in the wanted encoding, so the cursor is
+  // saved before the first of them. The minimum schema version is saved
+  // before any row is dictionary encoded, so SDKs that cannot parse such rows
+  // refuse to open the database instead. SDKs that predate it fail to parse
+  // the rows themselves.
+  Run("Start rewriting remote documents", [&] {
+    if (enabled && recorded != wanted) {
+      LevelDbMigrations::SaveMinimumSchemaVersion(
+          kFieldNameDictionarySchemaVersion, transaction_.get());
+    }
+    LevelDbMigrations::Cursor progress;
+    progress.version = kFieldNameDictionarySchemaVersion;
+    progress.pass = pass;
+    progress.next_key = next_key;
+    LevelDbMigrations::SaveMigrationCursor(progress, transaction_.get());
+  });
+  remote_document_rewrite_key_ = std::move(next_key);
+}
+
+bool LevelDbPersistence::RewriteRemoteDocumentsSlice() {
+  if (!remote_document_rewrite_key_) return false;
+
+  bool enabled = document_cache_->field_name_dictionary_enabled();
+  std::string wanted = enabled ? kFieldNameDictionaryEncoding : kPlainEncoding;
+  std::string* next_key = &remote_document_rewrite_key_.value();
+  bool done = false;
+  Run("Rewrite remote documents", [&] {
+    done = document_cache_->ReencodeDocuments(
+        next_key, LevelDbMigrations::kMigrationChunkSize);
+    if (done) {
+      LevelDbMigrations::DeleteMigrationCursor(transaction_.get());
+      transaction_->Put(LevelDbGlobalKey::Key(kRemoteDocumentEncoding), wanted);
+      if (!enabled) {
+        LevelDbMigrations::SaveMinimumSchemaVersion(0, transaction_.get());
+      }
+    } else {
+      LevelDbMigrations::Cursor progress;
+      progress.version = kFieldNameDictionarySchemaVersion;
+      progress.pass = enabled ? kEncodeWithDictionaryPass : kEncodePlainPass;
+      progress.next_key = *next_key;
+      LevelDbMigrations::SaveMigrationCursor(progress, transaction_.get());
+    }
+  });
+
+  if (done) remote_document_rewrite_key_ = absl::nullopt;
+  return !done;
+}
+
 void LevelDbPersistence::DeleteEverythingWithPrefix(absl::string_view label,
                                                     const std::string& prefix) {
   bool more_deletes = true;
+  int64_t deleted_keys = 0;
 
   auto fun = [&]() {
     more_deletes = false;
@@ -360,12 +534,17 @@ void LevelDbPersistence::DeleteEverythingWithPrefix(absl::string_view label,
         break;
       }
       transaction_->Delete(it->key());
+      ++deleted_keys;
     }
   };
 
   while (more_deletes) {
     RunInternal(label, fun);
   }
+
+  if (deleted_keys > 0) {
+    compactor_->AddPrefix(prefix, deleted_keys);
+  }
 }
 
 }  // namespace local
@@ -17,13 +17,16 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_PERSISTENCE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_PERSISTENCE_H_
 
+#include <functional>
 #include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
 
+#include "Firestore/core/src/api/settings.h"
 #include "Firestore/core/src/credentials/user.h"
 #include "Firestore/core/src/local/leveldb_bundle_cache.h"
+#include "Firestore/core/src/local/leveldb_compactor.h"
 #include "Firestore/core/src/local/leveldb_document_overlay_cache.h"
 #include "Firestore/core/src/local/leveldb_globals_cache.h"
 #include "Firestore/core/src/local/leveldb_index_manager.h"
@@ -32,12 +35,16 @@
 #include "Firestore/core/src/local/leveldb_mutation_queue.h"
 #include "Firestore/core/src/local/leveldb_overlay_migration_manager.h"
 #include "Firestore/core/src/local/leveldb_remote_document_cache.h"
+#include "Firestore/core/src/local/leveldb_size_tracker.h"
 #include "Firestore/core/src/local/leveldb_target_cache.h"
 #include "Firestore/core/src/local/leveldb_transaction.h"
 #include "Firestore/core/src/local/local_serializer.h"
 #include "Firestore/core/src/local/persistence.h"
 #include "Firestore/core/src/util/path.h"
 #include "Firestore/core/src/util/statusor.h"
+#include "absl/types/optional.h"
+#include "leveldb/cache.h"
+#include "leveldb/filter_policy.h"
 
 namespace firebase {
 namespace firestore {
@@ -57,14 +64,25 @@ class LevelDbPersistence : public Persistence {
   /**
    * Creates a LevelDB in the given directory and returns it or a Status object
    * containing details of the failure.
+   *
+   * @param tuning Storage engine parameters used to open the database.
    */
   static util::StatusOr<std::unique_ptr<LevelDbPersistence>> Create(
-      util::Path dir, LocalSerializer serializer, const LruParams& lru_params);
+      util::Path dir,
+      LocalSerializer serializer,
+      const LruParams& lru_params,
+      const api::PersistentCacheTuning& tuning = {});
 
   ~LevelDbPersistence();
 
   LevelDbTransaction* current_transaction();
 
+  /**
+   * Returns true if `current_transaction()` is a read-only transaction started
+   * by `RunReadOnly` on the calling thread.
+   */
+  bool in_read_only_transaction() const;
+
   leveldb::DB* ptr() {
     return db_.get();
   }
@@ -75,8 +93,46 @@ class LevelDbPersistence : public Persistence {
 
   static util::Status ClearPersistence(const core::DatabaseInfo& database_info);
 
+  /**
+   * Returns the logical size of the cache: the total size of the keys and
+   * values of all rows, maintained incrementally as transactions commit. If
+   * enough commits have estimated the sizes of rows they changed, the total is
+   * first recomputed by scanning the database.
+   */
   util::StatusOr<int64_t> CalculateByteSize();
 
+  const LevelDbSizeTracker& size_tracker() const {
+    return *size_tracker_;
+  }
+
+  /**
+   * Returns the compactor that tracks key ranges emptied by bulk deletes. It
+   * must not be used after `Shutdown`.
+   */
+  LevelDbCompactor* compactor() {
+    return compactor_.get();
+  }
+
+  /**
+   * Returns true if some remote documents may still be encoded differently
+   * from what the field name dictionary setting asks for. Both encodings can
+   * be read, so these rows are rewritten by `RewriteRemoteDocumentsSlice`
+   * after the database is open.
+   */
+  bool has_pending_remote_document_rewrite() const {
+    return remote_document_rewrite_key_.has_value();
+  }
+
+  /**
+   * Rewrites the next chunk of remote documents whose encoding does not match
+   * the field name dictionary setting, in a transaction that also saves a
+   * migration cursor. A rewrite interrupted by a restart resumes from its
+   * last chunk. Must be called from the same thread as `Run`.
+   *
+   * @return true if more remote documents remain to be checked.
+   */
+  bool RewriteRemoteDocumentsSlice();
+
   // MARK: Persistence overrides
 
   model::ListenSequenceNumber current_sequence_number() const override;
@@ -105,20 +161,35 @@ class LevelDbPersistence : public Persistence {
 
   void ReleaseOtherUserSpecificComponents(const std::string& uid) override;
 
+  bool SupportsConcurrentReadOnlyTransactions() const override;
+
  protected:
   void RunInternal(absl::string_view label,
                    std::function<void()> block) override;
 
+  /**
+   * Runs `block` in a transaction that reads from a `leveldb::Snapshot`. The
+   * transaction is only visible through `current_transaction()` on the calling
+   * thread, so any number of read-only transactions may run concurrently with
+   * each other and with a read-write transaction on another thread.
+   */
+  void RunReadOnlyInternal(absl::string_view label,
+                           std::function<void()> block) override;
+
  private:
   friend class LevelDbOverlayMigrationManagerTest;
   friend class LevelDbLocalStoreTest;
   friend class LevelDbIndexManager;
 
   LevelDbPersistence(std::unique_ptr<leveldb::DB> db,
+                     std::unique_ptr<const leveldb::FilterPolicy> filter_policy,
+                     std::unique_ptr<leveldb::Cache> block_cache,
+                     std::unique_ptr<LevelDbSizeTracker> size_tracker,
                      util::Path directory,
                      std::set<std::string> users,
                      LocalSerializer serializer,
-                     const LruParams& lru_params);
+                     const LruParams& lru_params,
+                     const api::PersistentCacheTuning& tuning);
 
   /**
    * The maximum number of operation per transaction.
@@ -130,15 +201,24 @@ class LevelDbPersistence : public Persistence {
    */
   static util::Status EnsureDirectory(const util::Path& dir);
 
-  /** Opens the database within the given directory. */
+  /**
+   * Opens the database within the given directory, configured according to
+   * `tuning`. Any filter policy or block cache created for the database is
+   * returned through `filter_policy` and `block_cache`; these must outlive the
+   * database.
+   */
   static util::StatusOr<std::unique_ptr<leveldb::DB>> OpenDb(
-      const util::Path& dir);
+      const util::Path& dir,
+      const api::PersistentCacheTuning& tuning,
+      std::unique_ptr<const leveldb::FilterPolicy>* filter_policy,
+      std::unique_ptr<leveldb::Cache>* block_cache);
 
   static util::StatusOr<std::unique_ptr<LevelDbPersistence>> Create(
       util::Path dir,
       LevelDbMigrations::SchemaVersion schema_version,
       LocalSerializer serializer,
-      const LruParams& lru_params);
+      const LruParams& lru_params,
+      const api::PersistentCacheTuning& tuning = {});
 
   void DeleteAllFieldIndexes() override;
 
@@ -149,7 +229,19 @@ class LevelDbPersistence : public Persistence {
   void DeleteEverythingWithPrefix(absl::string_view label,
                                   const std::string& prefix);
 
+  /**
+   * Determines whether the remote documents have to be rewritten to match the
+   * field name dictionary setting and, if so, where the rewrite starts. Called
+   * by `Create` once the database is open.
+   */
+  void EnsureRemoteDocumentEncoding();
+
+  // Declared before db_ so that they are destroyed after it.
+  std::unique_ptr<const leveldb::FilterPolicy> filter_policy_;
+  std::unique_ptr<leveldb::Cache> block_cache_;
   std::unique_ptr<leveldb::DB> db_;
+  std::unique_ptr<LevelDbCompactor> compactor_;
+  std::unique_ptr<LevelDbSizeTracker> size_tracker_;
 
   util::Path directory_;
   std::set<std::string> users_;
@@ -172,6 +264,10 @@ class LevelDbPersistence : public Persistence {
   std::unique_ptr<LevelDbLruReferenceDelegate> reference_delegate_;
 
   std::unique_ptr<LevelDbTransaction> transaction_;
+
+  // The key from which the remote documents are rewritten next, or nullopt if
+  // all of them match the field name dictionary setting.
+  absl::optional<std::string> remote_document_rewrite_key_;
 };
 
 /** Returns a standard set of read options. */
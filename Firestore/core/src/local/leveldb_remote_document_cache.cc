@@ -16,12 +16,15 @@
 
 #include "Firestore/core/src/local/leveldb_remote_document_cache.h"
 
+#include <algorithm>
 #include <string>
 #include <thread>  // NOLINT(build/c++11)
 #include <utility>
+#include <vector>
 
 #include "Firestore/Protos/nanopb/firestore/local/maybe_document.nanopb.h"
 #include "Firestore/core/src/core/query.h"
+#include "Firestore/core/src/local/collection_statistics.h"
 #include "Firestore/core/src/local/leveldb_key.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
 #include "Firestore/core/src/local/local_serializer.h"
@@ -34,8 +37,10 @@
 #include "Firestore/core/src/nanopb/reader.h"
 #include "Firestore/core/src/util/background_queue.h"
 #include "Firestore/core/src/util/executor.h"
+#include "Firestore/core/src/util/hard_assert.h"
 #include "Firestore/core/src/util/status.h"
 #include "Firestore/core/src/util/string_util.h"
+#include "absl/strings/match.h"
 #include "leveldb/db.h"
 
 namespace firebase {
@@ -89,11 +94,47 @@ class AsyncResults {
   std::mutex mutex_;
 };
 
+/**
+ * The number of rows an ordered scan steps over before it gives up and seeks
+ * directly to the next requested key.
+ */
+const int kMaxSeekAheadSteps = 8;
+
+/**
+ * The number of documents that ForEachDocumentMatchingQuery decodes in
+ * parallel before handing them to its callback.
+ */
+const size_t kStreamedBatchSize = 256;
+
+/**
+ * The first byte of rows holding dictionary-encoded documents. As a protobuf
+ * tag it names field zero with wire type 7, which does not exist, so any
+ * protobuf parser fails on such rows. A serialized MaybeDocument never starts
+ * with it, and SDKs that predate the dictionary reject the row instead of
+ * reading the IDs as field names.
+ */
+const char kFieldNameDictionaryMarker = '\x07';
+
+/**
+ * Advances `it` to the first row at or after `target`, which must not sort
+ * before the iterator's current position. Nearby rows are reached by stepping,
+ * which is cheaper than a seek when the requested keys are dense.
+ */
+void SeekForward(LevelDbTransaction::Iterator* it, const std::string& target) {
+  for (int steps = 0; it->Valid() && it->key() < target; ++steps) {
+    if (steps == kMaxSeekAheadSteps) {
+      it->Seek(target);
+      return;
+    }
+    it->Next();
+  }
+}
+
 }  // namespace
 
 LevelDbRemoteDocumentCache::LevelDbRemoteDocumentCache(
     LevelDbPersistence* db, LocalSerializer* serializer)
-    : db_(db), serializer_(NOT_NULL(serializer)) {
+    : db_(db), serializer_(NOT_NULL(serializer)), field_names_(db) {
   auto hw_concurrency = std::thread::hardware_concurrency();
   if (hw_concurrency == 0) {
     // If the standard library doesn't know, guess something reasonable.
@@ -110,22 +151,52 @@ void LevelDbRemoteDocumentCache::Add(const MutableDocument& document,
                                      const SnapshotVersion& read_time) {
   const DocumentKey& key = document.key();
   const ResourcePath& path = key.path();
+  LevelDbTransaction* transaction = db_->current_transaction();
 
   std::string ldb_document_key = LevelDbRemoteDocumentKey::Key(key);
-  db_->current_transaction()->Put(ldb_document_key,
-                                  serializer_->EncodeMaybeDocument(document));
+  transaction->Put(ldb_document_key, EncodeMaybeDocument(document));
 
+  // Read times only increase, so a document's row in the read time index is
+  // new unless the document is rewritten at the read time it already has.
   std::string ldb_read_time_key = LevelDbRemoteDocumentReadTimeKey::Key(
       path.PopLast(), read_time, path.last_segment());
-  db_->current_transaction()->Put(ldb_read_time_key, "");
+  transaction->RecordAbsent(ldb_read_time_key);
+  transaction->Put(ldb_read_time_key, "");
 
   NOT_NULL(index_manager_);
   index_manager_->AddToCollectionParentIndex(document.key().path().PopLast());
+
+  decoded_documents_.Invalidate(key);
 }
 
 void LevelDbRemoteDocumentCache::Remove(const DocumentKey& key) {
-  std::string ldb_key = LevelDbRemoteDocumentKey::Key(key);
-  db_->current_transaction()->Delete(ldb_key);
+  db_->current_transaction()->Delete(LevelDbRemoteDocumentKey::Key(key));
+  if (statistics_) {
+    statistics_->RecordDocumentRemoved(key);
+  }
+
+  decoded_documents_.Invalidate(key);
+}
+
+void LevelDbRemoteDocumentCache::RemoveAll(std::vector<DocumentKey> keys) {
+  std::sort(keys.begin(), keys.end());
+  LevelDbTransaction* transaction = db_->current_transaction();
+  LevelDbRemoteDocumentKey current_key;
+  auto it = transaction->NewIterator();
+
+  // Deleting each row while the iterator points at it records its size, so
+  // the removed bytes are subtracted from the size of the cache.
+  for (const DocumentKey& key : keys) {
+    it->Seek(LevelDbRemoteDocumentKey::Key(key));
+    if (it->Valid() && current_key.Decode(it->key()) &&
+        current_key.document_key() == key) {
+      transaction->Delete(it->key());
+      if (statistics_) {
+        statistics_->RecordDocumentRemoved(key);
+      }
+    }
+    decoded_documents_.Invalidate(key);
+  }
 }
 
 MutableDocument LevelDbRemoteDocumentCache::Get(const DocumentKey& key) const {
@@ -142,22 +213,45 @@ MutableDocument LevelDbRemoteDocumentCache::Get(const DocumentKey& key) const {
   }
 }
 
+MutableDocument LevelDbRemoteDocumentCache::GetAtReadTime(
+    const LevelDbTransaction& transaction,
+    const DocumentKey& key,
+    const SnapshotVersion& read_time) const {
+  std::string ldb_key = LevelDbRemoteDocumentKey::Key(key);
+  std::string value;
+  Status status = transaction.ConcurrentGet(ldb_key, &value);
+  if (status.IsNotFound()) {
+    return MutableDocument::InvalidDocument(key);
+  } else if (status.ok()) {
+    return DecodeAtReadTime(value, key, read_time);
+  } else {
+    HARD_FAIL("Fetch document for key (%s) failed with status: %s",
+              key.ToString(), status.ToString());
+  }
+}
+
 MutableDocumentMap LevelDbRemoteDocumentCache::GetAll(
     const DocumentKeySet& keys) const {
   BackgroundQueue tasks(executor_.get());
   AsyncResults<std::pair<DocumentKey, MutableDocument>> results;
 
+  LevelDbTransaction* transaction = db_->current_transaction();
   LevelDbRemoteDocumentKey current_key;
-  auto it = db_->current_transaction()->NewIterator();
+  auto it = transaction->NewIterator();
 
+  // Callers usually read documents before rewriting them, so the transaction
+  // is told the size of each row and need not look it up when committing.
   for (const DocumentKey& key : keys) {
-    it->Seek(LevelDbRemoteDocumentKey::Key(key));
+    std::string ldb_key = LevelDbRemoteDocumentKey::Key(key);
+    it->Seek(ldb_key);
     if (!it->Valid() || !current_key.Decode(it->key()) ||
         current_key.document_key() != key) {
+      transaction->RecordAbsent(ldb_key);
       results.Insert(
           std::make_pair(key, MutableDocument::InvalidDocument(key)));
     } else {
-      const std::string& contents = it->value();
+      transaction->RecordPreviousSize(ldb_key, it->value().size());
+      std::string contents(it->value());
       tasks.Execute([this, &results, &key, contents] {
         results.Insert(std::make_pair(key, DecodeMaybeDocument(contents, key)));
       });
@@ -173,15 +267,115 @@ MutableDocumentMap LevelDbRemoteDocumentCache::GetAll(
   return map;
 }
 
+size_t LevelDbRemoteDocumentCache::CountEntries(
+    const DocumentKeySet& keys) const {
+  // The keys are visited in table order, so a single iterator walks forward
+  // through the rows and no row is decoded.
+  size_t count = 0;
+  auto it = db_->current_transaction()->NewIterator();
+  bool positioned = false;
+  for (const DocumentKey& key : keys) {
+    std::string ldb_key = LevelDbRemoteDocumentKey::Key(key);
+    if (positioned) {
+      SeekForward(it.get(), ldb_key);
+    } else {
+      it->Seek(ldb_key);
+      positioned = true;
+    }
+
+    if (!it->Valid()) break;
+    if (it->key() == ldb_key) ++count;
+  }
+  return count;
+}
+
+size_t LevelDbRemoteDocumentCache::CountDocuments(
+    const ResourcePath& collection_path) const {
+  // A full scan reads the documents listed in the read time index, whose rows
+  // hold no values.
+  return ScanReadTimeIndex(collection_path, model::IndexOffset::None(),
+                           absl::nullopt)
+      .size();
+}
+
 MutableDocumentMap LevelDbRemoteDocumentCache::GetAllExisting(
     DocumentVersionMap&& remote_map,
     const core::Query& query,
     const model::OverlayByDocumentKeyMap& mutated_docs) const {
+  switch (read_mode_) {
+    case ReadMode::kPointLookup:
+      return GetAllExistingByPointLookup(remote_map, query, mutated_docs);
+    case ReadMode::kOrderedScan:
+      return GetAllExistingByOrderedScan(remote_map, query, mutated_docs);
+  }
+  UNREACHABLE();
+}
+
+MutableDocumentMap LevelDbRemoteDocumentCache::GetAllExistingByPointLookup(
+    const DocumentVersionMap& remote_map,
+    const core::Query& query,
+    const model::OverlayByDocumentKeyMap& mutated_docs) const {
+  // The current transaction is only known to this thread.
+  const LevelDbTransaction* transaction = db_->current_transaction();
+  BackgroundQueue tasks(executor_.get());
+  AsyncResults<std::pair<DocumentKey, MutableDocument>> results;
+  for (const auto& key_version : remote_map) {
+    tasks.Execute([this, transaction, &results, &key_version, query,
+                   &mutated_docs] {
+      auto document =
+          GetAtReadTime(*transaction, key_version.first, key_version.second);
+      if (document.is_found_document() &&
+          // Either the document matches the given query, or it is mutated.
+          (query.Matches(document) ||
+           mutated_docs.find(key_version.first) != mutated_docs.end())) {
+        results.Insert(std::make_pair(key_version.first, std::move(document)));
+      }
+    });
+  }
+  tasks.AwaitAll();
+
+  MutableDocumentMap map;
+  for (const auto& entry : results.Result()) {
+    map = map.insert(entry.first, entry.second);
+  }
+  return map;
+}
+
+MutableDocumentMap LevelDbRemoteDocumentCache::GetAllExistingByOrderedScan(
+    const DocumentVersionMap& remote_map,
+    const core::Query& query,
+    const model::OverlayByDocumentKeyMap& mutated_docs) const {
+  // DocumentVersionMap is ordered by DocumentKey, which is also the order of
+  // the remote documents table, so a single iterator can walk forward through
+  // the table instead of starting a fresh lookup for every document.
   BackgroundQueue tasks(executor_.get());
   AsyncResults<std::pair<DocumentKey, MutableDocument>> results;
+
+  auto it = db_->current_transaction()->NewIterator();
+  bool positioned = false;
+
   for (const auto& key_version : remote_map) {
-    tasks.Execute([this, &results, &key_version, query, &mutated_docs] {
-      auto document = Get(key_version.first).WithReadTime(key_version.second);
+    std::string ldb_key = LevelDbRemoteDocumentKey::Key(key_version.first);
+    if (positioned) {
+      SeekForward(it.get(), ldb_key);
+    } else {
+      it->Seek(ldb_key);
+      positioned = true;
+    }
+
+    if (!it->Valid()) {
+      // The iterator only moves forward, so none of the remaining keys exist.
+      break;
+    }
+    if (it->key() != ldb_key) {
+      continue;
+    }
+
+    std::string contents(it->value());
+    tasks.Execute([this, &results, &key_version, &query, &mutated_docs,
+                   contents] {
+      auto document =
+          DecodeAtReadTime(contents, key_version.first, key_version.second);
       if (document.is_found_document() &&
           // Either the document matches the given query, or it is mutated.
           (query.Matches(document) ||
@@ -238,13 +432,85 @@ MutableDocumentMap LevelDbRemoteDocumentCache::GetDocumentsMatchingQuery(
     absl::optional<QueryContext>& context,
     absl::optional<size_t> limit,
     const model::OverlayByDocumentKeyMap& mutated_docs) const {
-  // Use the query path as a prefix for testing if a document matches the query.
+  DocumentVersionMap remote_map =
+      ScanReadTimeIndex(query.path(), offset, limit);
+
+  if (context.has_value()) {
+    // The next step is going to check every document in remote_map, so it will
+    // go through total of remote_map.size() documents.
+    context.value().IncrementDocumentReadCount(remote_map.size());
+  }
+
+  return LevelDbRemoteDocumentCache::GetAllExisting(std::move(remote_map),
+                                                    query, mutated_docs);
+}
+
+void LevelDbRemoteDocumentCache::ForEachDocumentMatchingQuery(
+    const core::Query& query,
+    const model::OverlayByDocumentKeyMap& mutated_docs,
+    const std::function<void(MutableDocument&&)>& callback) const {
+  // The read time index is not ordered by document key, so the keys are
+  // collected first. The documents are then fetched as in an ordered scan, but
+  // decoded and handed to `callback` one batch at a time, so that only a batch
+  // of documents is held in memory however large the collection is.
+  DocumentVersionMap remote_map = ScanReadTimeIndex(
+      query.path(), model::IndexOffset::None(), absl::nullopt);
+
+  auto it = db_->current_transaction()->NewIterator();
+  bool positioned = false;
+  auto key_version = remote_map.cbegin();
+  while (key_version != remote_map.cend()) {
+    BackgroundQueue tasks(executor_.get());
+    AsyncResults<MutableDocument> results;
+    for (size_t batch_size = 0;
+         key_version != remote_map.cend() && batch_size < kStreamedBatchSize;
+         ++key_version) {
+      std::string ldb_key = LevelDbRemoteDocumentKey::Key(key_version->first);
+      if (positioned) {
+        SeekForward(it.get(), ldb_key);
+      } else {
+        it->Seek(ldb_key);
+        positioned = true;
+      }
+
+      if (!it->Valid()) {
+        // The iterator only moves forward, so none of the remaining keys exist.
+        key_version = remote_map.cend();
+        break;
+      }
+      if (it->key() != ldb_key) {
+        continue;
+      }
+
+      const auto* entry = &*key_version;
+      std::string contents(it->value());
+      tasks.Execute([this, &results, entry, &query, &mutated_docs, contents] {
+        auto document = DecodeAtReadTime(contents, entry->first, entry->second);
+        if (document.is_found_document() &&
+            // Either the document matches the given query, or it is mutated.
+            (query.Matches(document) ||
+             mutated_docs.find(entry->first) != mutated_docs.end())) {
+          results.Insert(std::move(document));
+        }
+      });
+      ++batch_size;
+    }
+    tasks.AwaitAll();
 
+    for (MutableDocument& document : results.Result()) {
+      callback(std::move(document));
+    }
+  }
+}
+
+DocumentVersionMap LevelDbRemoteDocumentCache::ScanReadTimeIndex(
+    const ResourcePath& path,
+    const model::IndexOffset& offset,
+    absl::optional<size_t> limit) const {
   // Execute an index-free query and filter by read time. This is safe since
   // all document changes to queries that have a
   // last_limbo_free_snapshot_version (`since_read_time`) have a read time
   // set.
-  auto path = query.path();
   std::string start_key =
       LevelDbRemoteDocumentReadTimeKey::KeyPrefix(path, offset.read_time());
   auto it = db_->current_transaction()->NewIterator();
@@ -272,22 +538,106 @@ MutableDocumentMap LevelDbRemoteDocumentCache::GetDocumentsMatchingQuery(
       }
     }
   }
+  return remote_map;
+}
 
-  if (context.has_value()) {
-    // The next step is going to check every document in remote_map, so it will
-    // go through total of remote_map.size() documents.
-    context.value().IncrementDocumentReadCount(remote_map.size());
+MutableDocument LevelDbRemoteDocumentCache::DecodeAtReadTime(
+    absl::string_view encoded,
+    const DocumentKey& key,
+    const SnapshotVersion& read_time) const {
+  // The caller has read the document's row, so the document still exists and
+  // a copy decoded at the same read time has the same contents.
+  absl::optional<MutableDocument> cached =
+      decoded_documents_.Lookup(key, read_time);
+  if (cached) {
+    return std::move(cached).value();
   }
 
-  return LevelDbRemoteDocumentCache::GetAllExisting(std::move(remote_map),
-                                                    query, mutated_docs);
+  MutableDocument document =
+      DecodeMaybeDocument(encoded, key).WithReadTime(read_time);
+  decoded_documents_.Insert(document, static_cast<int64_t>(encoded.size()));
+  return document;
+}
+
+bool LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+    absl::string_view contents) {
+  return !contents.empty() && contents[0] == kFieldNameDictionaryMarker;
+}
+
+bool LevelDbRemoteDocumentCache::ReencodeDocuments(std::string* next_key,
+                                                   size_t max_documents) {
+  std::string prefix = LevelDbRemoteDocumentKey::KeyPrefix();
+  auto it = db_->current_transaction()->NewIterator();
+  it->Seek(next_key->empty() ? prefix : *next_key);
+
+  // Rewrite rows after the scan, rather than while the iterator visits them.
+  std::vector<MutableDocument> rewritten;
+  LevelDbRemoteDocumentKey row_key;
+  bool done = true;
+  size_t visited = 0;
+  for (; it->Valid() && absl::StartsWith(it->key(), prefix); it->Next()) {
+    if (visited == max_documents) {
+      done = false;
+      *next_key = std::string(it->key());
+      break;
+    }
+    ++visited;
+
+    absl::string_view contents = it->value();
+    if (IsDictionaryEncoded(contents) == field_name_dictionary_enabled_) {
+      continue;
+    }
+    bool decoded = row_key.Decode(it->key());
+    HARD_ASSERT(decoded, "Invalid remote document key");
+    MutableDocument document =
+        DecodeMaybeDocument(contents, row_key.document_key());
+    // Only found documents have field names to encode.
+    if (document.is_found_document()) {
+      rewritten.push_back(std::move(document));
+    }
+  }
+
+  for (const MutableDocument& document : rewritten) {
+    db_->current_transaction()->Put(
+        LevelDbRemoteDocumentKey::Key(document.key()),
+        EncodeMaybeDocument(document));
+  }
+  return done;
+}
+
+std::string LevelDbRemoteDocumentCache::EncodeMaybeDocument(
+    const MutableDocument& document) {
+  auto message = serializer_->EncodeMaybeDocument(document);
+  if (!field_name_dictionary_enabled_ ||
+      message->which_document_type !=
+          firestore_client_MaybeDocument_document_tag) {
+    return MakeStdString(message);
+  }
+
+  if (!field_names_.Encode(document.key(), &message->document)) {
+    // The collection has too many distinct field names to encode them all.
+    return MakeStdString(message);
+  }
+  std::string encoded(1, kFieldNameDictionaryMarker);
+  encoded += MakeStdString(message);
+  return encoded;
 }
 
 MutableDocument LevelDbRemoteDocumentCache::DecodeMaybeDocument(
     absl::string_view encoded, const DocumentKey& key) const {
+  bool dictionary_encoded = IsDictionaryEncoded(encoded);
+  if (dictionary_encoded) {
+    encoded.remove_prefix(1);
+  }
   StringReader reader{encoded};
 
   auto message = Message<firestore_client_MaybeDocument>::TryParse(&reader);
+  if (dictionary_encoded && reader.ok() &&
+      message->which_document_type ==
+          firestore_client_MaybeDocument_document_tag &&
+      !field_names_.Decode(key, &message->document)) {
+    reader.Fail("Document refers to an unknown field name ID");
+  }
   MutableDocument maybe_document =
       serializer_->DecodeMaybeDocument(&reader, *message);
 
@@ -306,6 +656,11 @@ void LevelDbRemoteDocumentCache::SetIndexManager(IndexManager* manager) {
   index_manager_ = NOT_NULL(manager);
 }
 
+void LevelDbRemoteDocumentCache::SetCollectionStatistics(
+    CollectionStatistics* statistics) {
+  statistics_ = NOT_NULL(statistics);
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
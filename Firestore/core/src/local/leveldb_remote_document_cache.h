@@ -17,16 +17,20 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_REMOTE_DOCUMENT_CACHE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_REMOTE_DOCUMENT_CACHE_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT(build/c++11)
 #include <vector>
 
 #include "Firestore/core/src/core/query.h"
+#include "Firestore/core/src/local/decoded_document_cache.h"
+#include "Firestore/core/src/local/leveldb_field_name_dictionary.h"
 #include "Firestore/core/src/local/leveldb_index_manager.h"
 #include "Firestore/core/src/local/remote_document_cache.h"
 #include "Firestore/core/src/model/model_fwd.h"
 #include "Firestore/core/src/model/overlay.h"
+#include "Firestore/core/src/model/resource_path.h"
 #include "Firestore/core/src/model/types.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
@@ -46,22 +50,56 @@ class SnapshotVersion;
 namespace local {
 
 class LevelDbPersistence;
+class LevelDbTransaction;
 class LocalSerializer;
 
 /** Cached Remote Documents backed by leveldb. */
 class LevelDbRemoteDocumentCache : public RemoteDocumentCache {
  public:
+  /**
+   * Determines how documents found by a collection scan of the read time index
+   * are fetched from the remote documents table.
+   */
+  enum class ReadMode {
+    /**
+     * Fetches each document with an independent point lookup, issued in
+     * parallel on the query executor.
+     */
+    kPointLookup,
+
+    /**
+     * Sorts the document keys and fetches them with a single forward iterator
+     * over the remote documents table, stepping rather than seeking when the
+     * next key is close by. Decoding still happens on the query executor.
+     */
+    kOrderedScan,
+  };
+
   LevelDbRemoteDocumentCache(LevelDbPersistence* db,
                              LocalSerializer* serializer);
   ~LevelDbRemoteDocumentCache();
 
   void Add(const model::MutableDocument& document,
            const model::SnapshotVersion& read_time) override;
+  /**
+   * Removes the cached entry for the given key without reading it first, so
+   * the document is counted as removed in the collection statistics whether
+   * or not it existed.
+   */
   void Remove(const model::DocumentKey& key) override;
 
+  /**
+   * Removes the documents with the given keys, for garbage collection. Unlike
+   * `Remove`, only documents that exist are removed and counted as removed.
+   */
+  void RemoveAll(std::vector<model::DocumentKey> keys);
+
   model::MutableDocument Get(const model::DocumentKey& key) const override;
   model::MutableDocumentMap GetAll(
       const model::DocumentKeySet& keys) const override;
+  size_t CountEntries(const model::DocumentKeySet& keys) const override;
+  size_t CountDocuments(
+      const model::ResourcePath& collection_path) const override;
   model::MutableDocumentMap GetAll(const std::string& collection_group,
                                    const model::IndexOffset& offset,
                                    size_t limit) const override;
@@ -76,8 +114,59 @@ class LevelDbRemoteDocumentCache : public RemoteDocumentCache {
       absl::optional<QueryContext>& context,
       absl::optional<size_t> limit = absl::nullopt,
       const model::OverlayByDocumentKeyMap& mutated_docs = {}) const override;
+  void ForEachDocumentMatchingQuery(
+      const core::Query& query,
+      const model::OverlayByDocumentKeyMap& mutated_docs,
+      const std::function<void(model::MutableDocument&&)>& callback)
+      const override;
 
   void SetIndexManager(IndexManager* manager) override;
+  void SetCollectionStatistics(CollectionStatistics* statistics) override;
+
+  ReadMode read_mode() const {
+    return read_mode_;
+  }
+
+  void set_read_mode(ReadMode read_mode) {
+    read_mode_ = read_mode;
+  }
+
+  /**
+   * The cache of decoded documents consulted by collection scans, which know
+   * the read time of every document they fetch.
+   */
+  DecodedDocumentCache& decoded_document_cache() {
+    return decoded_documents_;
+  }
+
+  /**
+   * Returns true if found documents are written with their field names
+   * replaced by IDs from a `LevelDbFieldNameDictionary`. Documents are read
+   * correctly regardless of how they were written.
+   */
+  bool field_name_dictionary_enabled() const {
+    return field_name_dictionary_enabled_;
+  }
+
+  void set_field_name_dictionary_enabled(bool enabled) {
+    field_name_dictionary_enabled_ = enabled;
+  }
+
+  /**
+   * Returns true if `contents`, the value of a remote documents row, holds a
+   * document encoded with a field name dictionary.
+   */
+  static bool IsDictionaryEncoded(absl::string_view contents);
+
+  /**
+   * Rewrites the stored documents whose encoding does not match
+   * `field_name_dictionary_enabled()`, visiting at most `max_documents` rows
+   * starting at `*next_key`. An empty `*next_key` starts at the first
+   * document. If rows remain, `*next_key` is updated to the first of them.
+   *
+   * @return true once every row has been visited.
+   */
+  bool ReencodeDocuments(std::string* next_key, size_t max_documents);
 
  private:
   /**
@@ -89,6 +178,53 @@ class LevelDbRemoteDocumentCache : public RemoteDocumentCache {
       const core::Query& query,
       const model::OverlayByDocumentKeyMap& mutated_docs = {}) const;
 
+  /**
+   * Returns the key and read time of each document in the collection at
+   * `path` after `offset`, from the read time index, stopping after `limit`
+   * documents.
+   */
+  model::DocumentVersionMap ScanReadTimeIndex(
+      const model::ResourcePath& path,
+      const model::IndexOffset& offset,
+      absl::optional<size_t> limit) const;
+
+  /** Implements GetAllExisting() for ReadMode::kPointLookup. */
+  model::MutableDocumentMap GetAllExistingByPointLookup(
+      const model::DocumentVersionMap& remote_map,
+      const core::Query& query,
+      const model::OverlayByDocumentKeyMap& mutated_docs) const;
+
+  /** Implements GetAllExisting() for ReadMode::kOrderedScan. */
+  model::MutableDocumentMap GetAllExistingByOrderedScan(
+      const model::DocumentVersionMap& remote_map,
+      const core::Query& query,
+      const model::OverlayByDocumentKeyMap& mutated_docs) const;
+
+  /**
+   * Fetches the document with the given key, whose read time index entry says
+   * it was last written at `read_time`, using the decoded document cache.
+   *
+   * Runs on query executor threads, which cannot look up the current
+   * transaction themselves, so the caller passes it in as `transaction`.
+   */
+  model::MutableDocument GetAtReadTime(
+      const LevelDbTransaction& transaction,
+      const model::DocumentKey& key,
+      const model::SnapshotVersion& read_time) const;
+
+  /**
+   * Returns the cached copy of the document with the given key and read time,
+   * or decodes `encoded` and caches the result. `encoded` must be the current
+   * contents of the document's row.
+   */
+  model::MutableDocument DecodeAtReadTime(
+      absl::string_view encoded,
+      const model::DocumentKey& key,
+      const model::SnapshotVersion& read_time) const;
+
+  /** Encodes `document` as the contents of its remote documents row. */
+  std::string EncodeMaybeDocument(const model::MutableDocument& document);
+
   model::MutableDocument DecodeMaybeDocument(
       absl::string_view encoded, const model::DocumentKey& key) const;
 
@@ -96,10 +232,19 @@ class LevelDbRemoteDocumentCache : public RemoteDocumentCache {
   LevelDbPersistence* db_;
   // The LevelDbIndexManager instance is owned by LevelDbPersistence.
   IndexManager* index_manager_ = nullptr;
+  // The CollectionStatistics instance is owned by the QueryEngine.
+  CollectionStatistics* statistics_ = nullptr;
   // Owned by LevelDbPersistence.
   LocalSerializer* serializer_ = nullptr;
 
   std::unique_ptr<util::Executor> executor_;
+
+  ReadMode read_mode_ = ReadMode::kOrderedScan;
+
+  mutable DecodedDocumentCache decoded_documents_;
+
+  mutable LevelDbFieldNameDictionary field_names_;
+  bool field_name_dictionary_enabled_ = false;
 };
 
 }  // namespace local
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/leveldb_size_tracker.h"
+
+#include <memory>
+
+#include "Firestore/core/src/local/leveldb_transaction.h"
+#include "Firestore/core/src/local/leveldb_util.h"
+#include "Firestore/core/src/util/hard_assert.h"
+#include "Firestore/core/src/util/log.h"
+#include "Firestore/core/src/util/ordered_code.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using util::OrderedCode;
+
+const char* kByteSizes = "byte_sizes";
+
+}  // namespace
+
+constexpr int64_t LevelDbSizeTracker::kDefaultMaxEstimatedChanges;
+
+LevelDbSizeTracker::LevelDbSizeTracker(leveldb::DB* db,
+                                       int64_t max_estimated_changes)
+    : db_(NOT_NULL(db)), max_estimated_changes_(max_estimated_changes) {
+  std::string key = Key();
+  std::string encoded;
+  leveldb::Status status =
+      db->Get(LevelDbTransaction::DefaultReadOptions(), key, &encoded);
+  HARD_ASSERT(status.ok() || status.IsNotFound(),
+              "Failed to read cache size: %s", status.ToString());
+
+  absl::optional<Persisted> persisted;
+  if (status.ok()) {
+    persisted = Decode(encoded);
+  }
+
+  if (persisted) {
+    sizes_ = persisted->sizes;
+    estimated_changes_ = persisted->estimated_changes;
+    ResyncIfNeeded();
+    return;
+  }
+
+  Recompute();
+}
+
+std::string LevelDbSizeTracker::Key() {
+  return LevelDbGlobalKey::Key(kByteSizes);
+}
+
+void LevelDbSizeTracker::Discard(LevelDbTransaction* transaction) {
+  transaction->Delete(Key());
+}
+
+int64_t LevelDbSizeTracker::total_byte_size() const {
+  int64_t total = 0;
+  for (int64_t size : sizes_) {
+    total += size;
+  }
+  return total;
+}
+
+void LevelDbSizeTracker::RecordChange(absl::string_view key,
+                                      int64_t old_size,
+                                      int64_t new_size,
+                                      Sizes* delta) {
+  if (old_size == new_size) return;
+  (*delta)[static_cast<size_t>(LevelDbStoreForKey(key))] += new_size - old_size;
+}
+
+std::string LevelDbSizeTracker::EncodeWithDelta(
+    const Sizes& delta, int64_t estimated_changes) const {
+  std::string result;
+  OrderedCode::WriteSignedNumIncreasing(&result, kLevelDbStoreCount);
+  for (size_t i = 0; i < kLevelDbStoreCount; ++i) {
+    OrderedCode::WriteSignedNumIncreasing(&result, sizes_[i] + delta[i]);
+  }
+  OrderedCode::WriteSignedNumIncreasing(
+      &result, estimated_changes_ + estimated_changes);
+  return result;
+}
+
+void LevelDbSizeTracker::Apply(const Sizes& delta, int64_t estimated_changes) {
+  for (size_t i = 0; i < kLevelDbStoreCount; ++i) {
+    sizes_[i] += delta[i];
+  }
+  estimated_changes_ += estimated_changes;
+}
+
+void LevelDbSizeTracker::ResyncIfNeeded() {
+  if (estimated_changes_ >= max_estimated_changes_) {
+    Recompute();
+  }
+}
+
+void LevelDbSizeTracker::Recompute() {
+  LOG_DEBUG("Computing the size of the cache");
+  sizes_ = Scan(db_);
+  estimated_changes_ = 0;
+
+  LevelDbTransaction transaction(db_, "Save cache size");
+  transaction.Put(Key(), EncodeWithDelta(Sizes{}, 0));
+  transaction.Commit();
+}
+
+absl::optional<LevelDbSizeTracker::Persisted> LevelDbSizeTracker::Decode(
+    absl::string_view encoded) {
+  int64_t count = 0;
+  if (!OrderedCode::ReadSignedNumIncreasing(&encoded, &count) ||
+      count != static_cast<int64_t>(kLevelDbStoreCount)) {
+    // Written with a different set of stores; recompute.
+    return absl::nullopt;
+  }
+
+  Persisted persisted;
+  for (size_t i = 0; i < kLevelDbStoreCount; ++i) {
+    if (!OrderedCode::ReadSignedNumIncreasing(&encoded, &persisted.sizes[i])) {
+      return absl::nullopt;
+    }
+  }
+  // Totals written by commits that looked up every row have no count of
+  // estimated changes.
+  if (!encoded.empty() && !OrderedCode::ReadSignedNumIncreasing(
+                              &encoded, &persisted.estimated_changes)) {
+    return absl::nullopt;
+  }
+  return persisted;
+}
+
+LevelDbSizeTracker::Sizes LevelDbSizeTracker::Scan(leveldb::DB* db) {
+  Sizes sizes{};
+  std::string own_key = Key();
+
+  std::unique_ptr<leveldb::Iterator> it(
+      db->NewIterator(LevelDbTransaction::DefaultReadOptions()));
+  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+    absl::string_view key = MakeStringView(it->key());
+    if (key == own_key) continue;
+
+    auto size = static_cast<int64_t>(it->key().size() + it->value().size());
+    RecordChange(key, 0, size, &sizes);
+  }
+  HARD_ASSERT(it->status().ok(), "Failed to compute cache size: %s",
+              it->status().ToString());
+  return sizes;
+}
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
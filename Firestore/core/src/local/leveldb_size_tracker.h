@@ -0,0 +1,140 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_SIZE_TRACKER_H_
+#define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_SIZE_TRACKER_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "Firestore/core/src/local/leveldb_key.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "leveldb/db.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+
+class LevelDbTransaction;
+
+/**
+ * Maintains a running total of the logical size of each LevelDbStore, which is
+ * the sum of the sizes of the keys and values of its rows.
+ *
+ * The totals are persisted in the globals table and are updated by every
+ * LevelDbTransaction that the tracker is attached to, in the same write as the
+ * changes they account for. Unlike the size of the LevelDB directory, they do
+ * not include deleted rows that are still waiting to be compacted away.
+ *
+ * Commits account for the previous size of a changed row only if it is known:
+ * if the transaction read the row, or the writer recorded the size it already
+ * had. Other rows are assumed not to exist, so the totals are an estimate: a
+ * blind overwrite counts the row twice, and a blind delete does not subtract
+ * it. To keep the error bounded, such changes are counted, and the totals are
+ * recomputed by scanning the database once enough of them have accumulated.
+ */
+class LevelDbSizeTracker {
+ public:
+  using Sizes = std::array<int64_t, kLevelDbStoreCount>;
+
+  /**
+   * The default number of changes to rows of unknown size after which the
+   * totals are recomputed.
+   */
+  static constexpr int64_t kDefaultMaxEstimatedChanges = 100000;
+
+  /**
+   * Loads the persisted totals from `db`. If there are none, or they have
+   * accumulated `max_estimated_changes` estimated changes, computes them by
+   * scanning the entire database and persists the result.
+   */
+  explicit LevelDbSizeTracker(
+      leveldb::DB* db,
+      int64_t max_estimated_changes = kDefaultMaxEstimatedChanges);
+
+  /** The key of the globals row that holds the persisted totals. */
+  static std::string Key();
+
+  /**
+   * Deletes the persisted totals, so that they are recomputed the next time
+   * the database is opened. Migrations call this because they write without a
+   * tracker attached.
+   */
+  static void Discard(LevelDbTransaction* transaction);
+
+  /** Returns the logical size of the given store, in bytes. */
+  int64_t byte_size(LevelDbStore store) const {
+    return sizes_[static_cast<size_t>(store)];
+  }
+
+  /** Returns the logical size of all stores, in bytes. */
+  int64_t total_byte_size() const;
+
+  /**
+   * Adds to `delta` the change in the size of the store of the row at `key`
+   * when the row's size changes from `old_size` to `new_size` bytes. A size of
+   * zero means that the row does not exist.
+   */
+  static void RecordChange(absl::string_view key,
+                           int64_t old_size,
+                           int64_t new_size,
+                           Sizes* delta);
+
+  /**
+   * Encodes the totals that result from applying `delta`, which includes
+   * `estimated_changes` changes to rows whose previous size was not known.
+   */
+  std::string EncodeWithDelta(const Sizes& delta,
+                              int64_t estimated_changes) const;
+
+  /** Applies `delta` once the write that persisted it has succeeded. */
+  void Apply(const Sizes& delta, int64_t estimated_changes);
+
+  /**
+   * Recomputes and persists the totals if enough estimated changes have been
+   * applied since they were last computed. Must not be called while a tracked
+   * transaction is being committed.
+   */
+  void ResyncIfNeeded();
+
+ private:
+  struct Persisted {
+    Sizes sizes{};
+    int64_t estimated_changes = 0;
+  };
+
+  static absl::optional<Persisted> Decode(absl::string_view encoded);
+  static Sizes Scan(leveldb::DB* db);
+
+  /** Scans the database and persists the resulting totals. */
+  void Recompute();
+
+  leveldb::DB* db_ = nullptr;
+  int64_t max_estimated_changes_ = 0;
+  Sizes sizes_{};
+
+  // The number of changes to rows of unknown size since the totals were last
+  // computed by a scan.
+  int64_t estimated_changes_ = 0;
+};
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
+
+#endif  // FIRESTORE_CORE_SRC_LOCAL_LEVELDB_SIZE_TRACKER_H_
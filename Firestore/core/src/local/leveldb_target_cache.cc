@@ -16,14 +16,20 @@
 
 #include "Firestore/core/src/local/leveldb_target_cache.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "Firestore/core/src/local/leveldb_key.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_transaction.h"
 #include "Firestore/core/src/local/leveldb_util.h"
 #include "Firestore/core/src/local/local_serializer.h"
+#include "Firestore/core/src/local/materialized_query_results.h"
 #include "Firestore/core/src/local/reference_delegate.h"
 #include "Firestore/core/src/local/target_data.h"
 #include "Firestore/core/src/model/document_key.h"
@@ -31,6 +37,7 @@
 #include "Firestore/core/src/nanopb/byte_string.h"
 #include "Firestore/core/src/nanopb/reader.h"
 #include "Firestore/core/src/util/log.h"
+#include "Firestore/core/src/util/ordered_code.h"
 #include "Firestore/core/src/util/string_apple.h"
 #include "absl/strings/match.h"
 
@@ -43,10 +50,99 @@ using leveldb::Status;
 using model::DocumentKey;
 using model::DocumentKeySet;
 using model::ListenSequenceNumber;
+using model::ResourcePath;
 using model::SnapshotVersion;
 using model::TargetId;
 using nanopb::Message;
 using nanopb::StringReader;
+using util::OrderedCode;
+
+namespace {
+
+/**
+ * The number of decoded targets kept in memory. Applications rarely listen to
+ * more than a few dozen targets at a time, so this covers the working set of
+ * listen/unlisten churn while keeping memory use small.
+ */
+const size_t kMaxDecodedTargets = 100;
+
+const char* kOrphanedDocumentCount = "orphaned_document_count";
+
+std::string OrphanedDocumentCountKey() {
+  return LevelDbGlobalKey::Key(kOrphanedDocumentCount);
+}
+
+std::string EncodeOrphanedDocumentCount(size_t count) {
+  std::string result;
+  OrderedCode::WriteSignedNumIncreasing(&result, static_cast<int64_t>(count));
+  return result;
+}
+
+void WriteVersion(std::string* dest, const SnapshotVersion& version) {
+  OrderedCode::WriteSignedNumIncreasing(dest, version.timestamp().seconds());
+  OrderedCode::WriteSignedNumIncreasing(dest,
+                                        version.timestamp().nanoseconds());
+}
+
+bool ReadVersion(absl::string_view* src, SnapshotVersion* version) {
+  int64_t seconds;
+  int64_t nanos;
+  if (!OrderedCode::ReadSignedNumIncreasing(src, &seconds) ||
+      !OrderedCode::ReadSignedNumIncreasing(src, &nanos)) {
+    return false;
+  }
+  *version = SnapshotVersion(Timestamp(seconds, static_cast<int32_t>(nanos)));
+  return true;
+}
+
+/**
+ * Encodes materialized results as their snapshot version followed by the
+ * path segments and version of each document, in query order.
+ */
+std::string EncodeQueryResults(const MaterializedQueryResults& results) {
+  std::string dest;
+  WriteVersion(&dest, results.snapshot_version());
+  for (const auto& entry : results.documents()) {
+    const ResourcePath& path = entry.first.path();
+    OrderedCode::WriteNumIncreasing(&dest, path.size());
+    for (const std::string& segment : path) {
+      OrderedCode::WriteString(&dest, segment);
+    }
+    WriteVersion(&dest, entry.second);
+  }
+  return dest;
+}
+
+MaterializedQueryResults DecodeQueryResults(absl::string_view src) {
+  SnapshotVersion snapshot_version;
+  bool ok = ReadVersion(&src, &snapshot_version);
+
+  std::vector<MaterializedQueryResults::Entry> documents;
+  while (ok && !src.empty()) {
+    uint64_t segment_count = 0;
+    ok = OrderedCode::ReadNumIncreasing(&src, &segment_count);
+
+    std::vector<std::string> segments;
+    for (uint64_t i = 0; ok && i < segment_count; ++i) {
+      std::string segment;
+      ok = OrderedCode::ReadString(&src, &segment);
+      segments.push_back(std::move(segment));
+    }
+
+    SnapshotVersion version;
+    ok = ok && ReadVersion(&src, &version);
+    ResourcePath path{std::move(segments)};
+    ok = ok && DocumentKey::IsDocumentKey(path);
+    if (ok) {
+      documents.emplace_back(DocumentKey{std::move(path)}, version);
+    }
+  }
+  HARD_ASSERT(ok, "Failed to decode materialized query results");
+
+  return MaterializedQueryResults(snapshot_version, std::move(documents));
+}
+
+}  // namespace
 
 absl::optional<Message<firestore_client_TargetGlobal>>
 LevelDbTargetCache::TryReadMetadata(leveldb::DB* db) {
@@ -81,6 +177,11 @@ Message<firestore_client_TargetGlobal> LevelDbTargetCache::ReadMetadata(
   return std::move(maybe_metadata).value();
 }
 
+void LevelDbTargetCache::DiscardOrphanedDocumentCount(
+    LevelDbTransaction* transaction) {
+  transaction->Delete(OrphanedDocumentCountKey());
+}
+
 LevelDbTargetCache::LevelDbTargetCache(LevelDbPersistence* db,
                                        LocalSerializer* serializer)
     : db_(NOT_NULL(db)), serializer_(NOT_NULL(serializer)) {
@@ -97,6 +198,8 @@ void LevelDbTargetCache::Start() {
     HARD_FAIL("Failed to decode last remote snapshot version, reason: '%s'",
               reader.status().ToString());
   }
+
+  LoadOrphanedDocumentCount();
 }
 
 void LevelDbTargetCache::AddTarget(const TargetData& target_data) {
@@ -108,6 +211,14 @@ void LevelDbTargetCache::AddTarget(const TargetData& target_data) {
   std::string empty_buffer;
   db_->current_transaction()->Put(index_key, empty_buffer);
 
+  // Re-adding an existing target replaces it, so drop any decoded copy and
+  // avoid recording its ID twice.
+  ForgetTarget(canonical_id, target_data.target_id());
+  if (canonical_ids_loaded_) {
+    target_ids_by_canonical_id_[canonical_id].push_back(
+        target_data.target_id());
+  }
+
   metadata_->target_count++;
   UpdateMetadata(target_data);
   SaveMetadata();
@@ -115,6 +226,7 @@ void LevelDbTargetCache::AddTarget(const TargetData& target_data) {
 
 void LevelDbTargetCache::UpdateTarget(const TargetData& target_data) {
   Save(target_data);
+  CacheDecodedTarget(target_data);
 
   if (UpdateMetadata(target_data)) {
     SaveMetadata();
@@ -125,6 +237,7 @@ void LevelDbTargetCache::RemoveTarget(const TargetData& target_data) {
   TargetId target_id = target_data.target_id();
 
   RemoveMatchingKeysForTarget(target_id);
+  RemoveQueryResults(target_id);
 
   std::string key = LevelDbTargetKey::Key(target_id);
   db_->current_transaction()->Delete(key);
@@ -132,12 +245,50 @@ void LevelDbTargetCache::RemoveTarget(const TargetData& target_data) {
   std::string index_key =
       LevelDbQueryTargetKey::Key(target_data.target().CanonicalId(), target_id);
   db_->current_transaction()->Delete(index_key);
+  ForgetTarget(target_data.target().CanonicalId(), target_id);
 
   metadata_->target_count--;
   SaveMetadata();
 }
 
 absl::optional<TargetData> LevelDbTargetCache::GetTarget(const Target& target) {
+  // Read-only transactions may run on other threads and read from an older
+  // snapshot, so they cannot use the in-memory copies, which track the latest
+  // read-write transaction.
+  if (db_->in_read_only_transaction()) {
+    return ScanForTarget(target);
+  }
+
+  // Canonical IDs are not required to be unique per target, so each target
+  // sharing the canonical ID has to be compared with the requested target.
+  EnsureCanonicalIdsLoaded();
+  auto found = target_ids_by_canonical_id_.find(target.CanonicalId());
+  if (found == target_ids_by_canonical_id_.end()) {
+    return absl::nullopt;
+  }
+
+  for (TargetId target_id : found->second) {
+    absl::optional<TargetData> target_data = LookupTarget(target_id);
+    if (!target_data) {
+      LOG_WARN("Dangling query-target reference found: %s points to %s",
+               DescribeKey(LevelDbQueryTargetKey::Key(target.CanonicalId(),
+                                                      target_id)),
+               DescribeKey(LevelDbTargetKey::Key(target_id)));
+      continue;
+    }
+
+    // Finally after finding a potential match, check that the target is
+    // actually equal to the requested target.
+    if (target_data->target() == target) {
+      return target_data;
+    }
+  }
+
+  return absl::nullopt;
+}
+
+absl::optional<TargetData> LevelDbTargetCache::ScanForTarget(
+    const Target& target) {
   // Scan the query-target index starting with a prefix starting with the given
   // target's canonical_id. Note that this is a scan rather than a get because
   // canonical_ids are not required to be unique per target.
@@ -150,7 +301,6 @@ absl::optional<TargetData> LevelDbTargetCache::GetTarget(const Target& target) {
   // (canonical_id, target_id) pair is unique and ordered, so when scanning a
   // table prefixed by exactly one canonical_id, all the target_ids will be
   // unique and in order.
-  std::string target_prefix = LevelDbTargetKey::KeyPrefix();
   auto target_iterator = db_->current_transaction()->NewIterator();
 
   LevelDbQueryTargetKey row_key;
@@ -225,6 +375,7 @@ size_t LevelDbTargetCache::RemoveTargets(
 
       // Remove the DocumentKey to TargetId mapping
       RemoveMatchingKeysForTarget(target_id);
+      RemoveQueryResults(target_id);
       // Remove the TargetId to Target mapping
       db_->current_transaction()->Delete(it->key());
 
@@ -241,6 +392,69 @@ size_t LevelDbTargetCache::RemoveTargets(
   return removed_targets.size();
 }
 
+size_t LevelDbTargetCache::RemoveTargets(
+    ListenSequenceNumber upper_bound,
+    const std::unordered_map<model::TargetId, TargetData>& live_targets,
+    size_t max_keys,
+    std::chrono::steady_clock::time_point deadline,
+    TargetId* next_target_id,
+    bool* complete) {
+  std::string target_prefix = LevelDbTargetKey::KeyPrefix();
+  auto it = db_->current_transaction()->NewIterator();
+  it->Seek(LevelDbTargetKey::Key(*next_target_id));
+
+  std::unordered_set<TargetId> removed_targets;
+  size_t removed_keys = 0;
+  *complete = true;
+  for (; it->Valid() && absl::StartsWith(it->key(), target_prefix);
+       it->Next()) {
+    StringReader reader{it->value()};
+    auto target_proto = DecodeTargetProto(&reader);
+    TargetId target_id = target_proto->target_id;
+    if (target_proto->last_listen_sequence_number > upper_bound ||
+        live_targets.find(target_id) != live_targets.end()) {
+      continue;
+    }
+
+    if (removed_keys > 0 && (removed_keys >= max_keys ||
+                             std::chrono::steady_clock::now() >= deadline)) {
+      *next_target_id = target_id;
+      *complete = false;
+      break;
+    }
+
+    size_t remaining = removed_keys < max_keys ? max_keys - removed_keys : 1;
+    if (!RemoveMatchingKeysForTarget(target_id, remaining, &removed_keys)) {
+      // The remaining keys no longer match the results the server would
+      // resume from, so the target cannot be resumed if it is listened to
+      // before it is removed.
+      TargetData target_data = DecodeTarget(it->value());
+      UpdateTarget(
+          target_data
+              .WithResumeToken(nanopb::ByteString(), SnapshotVersion::None())
+              .WithLastLimboFreeSnapshotVersion(SnapshotVersion::None()));
+      *next_target_id = target_id;
+      *complete = false;
+      break;
+    }
+
+    RemoveQueryResults(target_id);
+    db_->current_transaction()->Delete(it->key());
+    removed_targets.insert(target_id);
+  }
+
+  if (removed_targets.empty()) {
+    return 0;
+  }
+
+  RemoveQueryTargetKeyForTargets(removed_targets);
+
+  metadata_->target_count -= removed_targets.size();
+  SaveMetadata();
+
+  return removed_targets.size();
+}
+
 void LevelDbTargetCache::AddMatchingKeys(const DocumentKeySet& keys,
                                          TargetId target_id) {
   // Store an empty value in the index which is equivalent to serializing a
@@ -270,10 +484,18 @@ void LevelDbTargetCache::RemoveMatchingKeys(const DocumentKeySet& keys,
 }
 
 void LevelDbTargetCache::RemoveMatchingKeysForTarget(TargetId target_id) {
+  size_t removed_keys = 0;
+  RemoveMatchingKeysForTarget(target_id, SIZE_MAX, &removed_keys);
+}
+
+bool LevelDbTargetCache::RemoveMatchingKeysForTarget(TargetId target_id,
+                                                     size_t max_keys,
+                                                     size_t* removed_keys) {
   std::string index_prefix = LevelDbTargetDocumentKey::KeyPrefix(target_id);
   auto index_iterator = db_->current_transaction()->NewIterator();
   index_iterator->Seek(index_prefix);
 
+  size_t removed = 0;
   LevelDbTargetDocumentKey row_key;
   for (; index_iterator->Valid(); index_iterator->Next()) {
     absl::string_view index_key = index_iterator->key();
@@ -282,13 +504,24 @@ void LevelDbTargetCache::RemoveMatchingKeysForTarget(TargetId target_id) {
     if (!row_key.Decode(index_key) || row_key.target_id() != target_id) {
       break;
     }
+    if (removed == max_keys) {
+      return false;
+    }
     const DocumentKey& document_key = row_key.document_key();
 
     // Delete both index rows
     db_->current_transaction()->Delete(index_key);
     db_->current_transaction()->Delete(
         LevelDbDocumentTargetKey::Key(document_key, target_id));
+
+    // No reference delegate callback is made for these documents, so they may
+    // have just become orphaned.
+    UpdateOrphanedDocument(document_key);
+    removed++;
   }
+
+  *removed_keys += removed;
+  return true;
 }
 
 void LevelDbTargetCache::RemoveQueryTargetKeyForTargets(
@@ -305,6 +538,7 @@ void LevelDbTargetCache::RemoveQueryTargetKeyForTargets(
 
     if (target_ids.find(row_key.target_id()) != target_ids.end()) {
       db_->current_transaction()->Delete(index_iterator->key());
+      ForgetTarget(row_key.canonical_id(), row_key.target_id());
     }
   }
 }
@@ -330,6 +564,38 @@ DocumentKeySet LevelDbTargetCache::GetMatchingKeys(TargetId target_id) {
   return result;
 }
 
+void LevelDbTargetCache::SetQueryResults(
+    TargetId target_id, const MaterializedQueryResults& results) {
+  db_->current_transaction()->Put(LevelDbQueryResultsKey::Key(target_id),
+                                  EncodeQueryResults(results));
+}
+
+absl::optional<MaterializedQueryResults> LevelDbTargetCache::GetQueryResults(
+    TargetId target_id) {
+  std::string value;
+  Status status = db_->current_transaction()->Get(
+      LevelDbQueryResultsKey::Key(target_id), &value);
+  if (status.IsNotFound()) {
+    return absl::nullopt;
+  }
+  HARD_ASSERT(status.ok(), "Failed to read query results of target %s: %s",
+              target_id, status.ToString());
+  return DecodeQueryResults(value);
+}
+
+bool LevelDbTargetCache::HasQueryResults(TargetId target_id) {
+  // Seeking only compares keys, so the encoded results are never copied or
+  // decoded.
+  std::string key = LevelDbQueryResultsKey::Key(target_id);
+  auto it = db_->current_transaction()->NewIterator();
+  it->Seek(key);
+  return it->Valid() && it->key() == key;
+}
+
+void LevelDbTargetCache::RemoveQueryResults(TargetId target_id) {
+  db_->current_transaction()->Delete(LevelDbQueryResultsKey::Key(target_id));
+}
+
 bool LevelDbTargetCache::Contains(const DocumentKey& key) {
   // ignore sentinel rows when determining if a key belongs to a target.
   // Sentinel row just says the document exists, not that it's a member of any
@@ -363,39 +629,280 @@ void LevelDbTargetCache::SetLastRemoteSnapshotVersion(SnapshotVersion version) {
   SaveMetadata();
 }
 
+SnapshotVersion LevelDbTargetCache::ReadLastRemoteSnapshotVersion() {
+  // Read the metadata row through the current transaction rather than using
+  // the cached copy, which may be ahead of a read-only transaction's snapshot.
+  std::string key = LevelDbTargetGlobalKey::Key();
+  std::string value;
+  Status status = db_->current_transaction()->Get(key, &value);
+
+  StringReader reader{value};
+  reader.set_status(ConvertStatus(status));
+  auto metadata = Message<firestore_client_TargetGlobal>::TryParse(&reader);
+  SnapshotVersion result = serializer_->DecodeVersion(
+      &reader, metadata->last_remote_snapshot_version);
+  if (!reader.ok()) {
+    HARD_FAIL("Failed to read last remote snapshot version, reason: '%s'",
+              reader.status().ToString());
+  }
+  return result;
+}
+
+void LevelDbTargetCache::WriteSentinel(const DocumentKey& key,
+                                       ListenSequenceNumber sequence_number,
+                                       MembershipChange change) {
+  absl::optional<ListenSequenceNumber> previous = ReadSentinel(key);
+  bool was_orphaned = previous && IsOrphanedDocument(*previous, key);
+
+  bool orphaned = false;
+  switch (change) {
+    case MembershipChange::kAdded:
+      orphaned = false;
+      break;
+    case MembershipChange::kRemoved:
+      // The document may still belong to other targets.
+      orphaned = !Contains(key);
+      break;
+    case MembershipChange::kUnchanged:
+      // A document with a sentinel is in the index exactly when it is
+      // orphaned, so only a document without one has to be looked up.
+      orphaned = previous ? was_orphaned : !Contains(key);
+      break;
+  }
+
+  if (previous == sequence_number && was_orphaned == orphaned) {
+    return;
+  }
+
+  if (was_orphaned) {
+    RemoveOrphanedDocument(*previous, key);
+  }
+
+  db_->current_transaction()->Put(
+      LevelDbDocumentTargetKey::SentinelKey(key),
+      LevelDbDocumentTargetKey::EncodeSentinelValue(sequence_number));
+
+  if (orphaned) {
+    AddOrphanedDocument(sequence_number, key);
+  }
+}
+
+void LevelDbTargetCache::RemoveSentinel(const DocumentKey& key,
+                                        ListenSequenceNumber sequence_number) {
+  RemoveOrphanedDocument(sequence_number, key);
+  db_->current_transaction()->Delete(
+      LevelDbDocumentTargetKey::SentinelKey(key));
+}
+
 void LevelDbTargetCache::EnumerateOrphanedDocuments(
-    const OrphanedDocumentCallback& callback) {
-  std::string document_target_prefix = LevelDbDocumentTargetKey::KeyPrefix();
+    const std::function<bool(const DocumentKey&, ListenSequenceNumber)>&
+        callback) {
+  EnumerateOrphanedDocumentsFrom(LevelDbOrphanedDocumentKey::KeyPrefix(),
+                                 callback);
+}
+
+void LevelDbTargetCache::EnumerateOrphanedDocumentsAfter(
+    ListenSequenceNumber sequence_number,
+    const DocumentKey& key,
+    const std::function<bool(const DocumentKey&, ListenSequenceNumber)>&
+        callback) {
+  // The smallest key that sorts after the given document's key is that key
+  // followed by a zero byte.
+  std::string start_key =
+      LevelDbOrphanedDocumentKey::Key(sequence_number, key) + '\0';
+  EnumerateOrphanedDocumentsFrom(start_key, callback);
+}
+
+void LevelDbTargetCache::EnumerateOrphanedDocumentsFrom(
+    const std::string& start_key,
+    const std::function<bool(const DocumentKey&, ListenSequenceNumber)>&
+        callback) {
+  std::string index_prefix = LevelDbOrphanedDocumentKey::KeyPrefix();
   auto it = db_->current_transaction()->NewIterator();
-  it->Seek(document_target_prefix);
-  ListenSequenceNumber next_to_report = 0;
-  DocumentKey key_to_report;
-  LevelDbDocumentTargetKey key;
+  it->Seek(start_key);
 
-  for (; it->Valid() && absl::StartsWith(it->key(), document_target_prefix);
+  LevelDbOrphanedDocumentKey row_key;
+  for (; it->Valid() && absl::StartsWith(it->key(), index_prefix);
        it->Next()) {
-    HARD_ASSERT(key.Decode(it->key()), "Failed to decode DocumentTarget key");
-    if (key.IsSentinel()) {
-      // if next_to_report is non-zero, report it, this is a new key so the last
-      // one must be not be a member of any targets.
-      if (next_to_report != 0) {
-        callback(key_to_report, next_to_report);
-      }
-      // set next_to_report to be this sequence number. It's the next one we
-      // might report, if we don't find any targets for this document.
-      next_to_report =
-          LevelDbDocumentTargetKey::DecodeSentinelValue(it->value());
-      key_to_report = key.document_key();
-    } else {
-      // set next_to_report to be 0, we know we don't need to report this one
-      // since we found a target for it.
-      next_to_report = 0;
+    HARD_ASSERT(row_key.Decode(it->key()),
+                "Failed to decode OrphanedDocument key");
+    if (!callback(row_key.document_key(), row_key.sequence_number())) {
+      break;
     }
   }
-  // if next_to_report is non-zero, report it. We didn't find any targets for
-  // that document, and we weren't asked to stop.
-  if (next_to_report != 0) {
-    callback(key_to_report, next_to_report);
+}
+
+absl::optional<ListenSequenceNumber> LevelDbTargetCache::ReadSentinel(
+    const DocumentKey& key) {
+  std::string value;
+  Status status = db_->current_transaction()->Get(
+      LevelDbDocumentTargetKey::SentinelKey(key), &value);
+  if (status.IsNotFound()) {
+    return absl::nullopt;
+  }
+  HARD_ASSERT(status.ok(), "Failed to read sentinel row: %s",
+              status.ToString());
+  return LevelDbDocumentTargetKey::DecodeSentinelValue(value);
+}
+
+void LevelDbTargetCache::UpdateOrphanedDocument(const DocumentKey& key) {
+  absl::optional<ListenSequenceNumber> sequence_number = ReadSentinel(key);
+  if (!sequence_number) {
+    return;
+  }
+
+  bool was_orphaned = IsOrphanedDocument(*sequence_number, key);
+  bool orphaned = !Contains(key);
+  if (was_orphaned && !orphaned) {
+    RemoveOrphanedDocument(*sequence_number, key);
+  } else if (!was_orphaned && orphaned) {
+    AddOrphanedDocument(*sequence_number, key);
+  }
+}
+
+bool LevelDbTargetCache::IsOrphanedDocument(
+    ListenSequenceNumber sequence_number, const DocumentKey& key) {
+  std::string value;
+  Status status = db_->current_transaction()->Get(
+      LevelDbOrphanedDocumentKey::Key(sequence_number, key), &value);
+  HARD_ASSERT(status.ok() || status.IsNotFound(),
+              "Failed to read orphaned document: %s", status.ToString());
+  return status.ok();
+}
+
+void LevelDbTargetCache::AddOrphanedDocument(
+    ListenSequenceNumber sequence_number, const DocumentKey& key) {
+  std::string empty_buffer;
+  db_->current_transaction()->Put(
+      LevelDbOrphanedDocumentKey::Key(sequence_number, key), empty_buffer);
+  orphaned_document_count_++;
+  orphaned_document_count_changed_ = true;
+}
+
+void LevelDbTargetCache::RemoveOrphanedDocument(
+    ListenSequenceNumber sequence_number, const DocumentKey& key) {
+  db_->current_transaction()->Delete(
+      LevelDbOrphanedDocumentKey::Key(sequence_number, key));
+  orphaned_document_count_--;
+  orphaned_document_count_changed_ = true;
+}
+
+void LevelDbTargetCache::LoadOrphanedDocumentCount() {
+  leveldb::DB* db = db_->ptr();
+  std::string key = OrphanedDocumentCountKey();
+  std::string encoded;
+  Status status = db->Get(StandardReadOptions(), key, &encoded);
+  HARD_ASSERT(status.ok() || status.IsNotFound(),
+              "Failed to read orphaned document count: %s", status.ToString());
+
+  absl::string_view reader = encoded;
+  int64_t count = 0;
+  if (status.ok() && OrderedCode::ReadSignedNumIncreasing(&reader, &count)) {
+    orphaned_document_count_ = static_cast<size_t>(count);
+    return;
+  }
+
+  // The count is missing in a new database and after migrations, which may
+  // rebuild the index.
+  LOG_DEBUG("Counting orphaned documents");
+  std::string index_prefix = LevelDbOrphanedDocumentKey::KeyPrefix();
+  std::unique_ptr<leveldb::Iterator> it(db->NewIterator(StandardReadOptions()));
+  orphaned_document_count_ = 0;
+  for (it->Seek(index_prefix);
+       it->Valid() && absl::StartsWith(MakeStringView(it->key()), index_prefix);
+       it->Next()) {
+    orphaned_document_count_++;
+  }
+  HARD_ASSERT(it->status().ok(), "Failed to count orphaned documents: %s",
+              it->status().ToString());
+
+  LevelDbTransaction transaction(db, "Save orphaned document count");
+  transaction.Put(key, EncodeOrphanedDocumentCount(orphaned_document_count_));
+  transaction.Commit();
+}
+
+void LevelDbTargetCache::SaveOrphanedDocumentCount() {
+  if (!orphaned_document_count_changed_) {
+    return;
+  }
+  db_->current_transaction()->Put(
+      OrphanedDocumentCountKey(),
+      EncodeOrphanedDocumentCount(orphaned_document_count_));
+  orphaned_document_count_changed_ = false;
+}
+
+void LevelDbTargetCache::EnsureCanonicalIdsLoaded() {
+  if (canonical_ids_loaded_) {
+    return;
+  }
+
+  std::string index_prefix = LevelDbQueryTargetKey::KeyPrefix();
+  auto it = db_->current_transaction()->NewIterator();
+  LevelDbQueryTargetKey row_key;
+  for (it->Seek(index_prefix);
+       it->Valid() && absl::StartsWith(it->key(), index_prefix) &&
+       row_key.Decode(it->key());
+       it->Next()) {
+    target_ids_by_canonical_id_[row_key.canonical_id()].push_back(
+        row_key.target_id());
+  }
+  canonical_ids_loaded_ = true;
+}
+
+absl::optional<TargetData> LevelDbTargetCache::LookupTarget(
+    TargetId target_id) {
+  auto found = decoded_targets_.find(target_id);
+  if (found != decoded_targets_.end()) {
+    return found->second;
+  }
+
+  std::string value;
+  Status status =
+      db_->current_transaction()->Get(LevelDbTargetKey::Key(target_id), &value);
+  if (status.IsNotFound()) {
+    return absl::nullopt;
+  }
+  HARD_ASSERT(status.ok(), "Failed to read target %s: %s", target_id,
+              status.ToString());
+
+  TargetData target_data = DecodeTarget(value);
+  CacheDecodedTarget(target_data);
+  return target_data;
+}
+
+void LevelDbTargetCache::CacheDecodedTarget(const TargetData& target_data) {
+  // The expected count is not persisted, so drop it to match what decoding the
+  // stored proto would return.
+  TargetData stored = target_data.WithExpectedCount(absl::nullopt);
+  TargetId target_id = stored.target_id();
+  auto found = decoded_targets_.find(target_id);
+  if (found != decoded_targets_.end()) {
+    found->second = std::move(stored);
+    return;
+  }
+
+  // Evicting an arbitrary entry is enough here: a target that is still in use
+  // is reloaded with a single point read.
+  if (decoded_targets_.size() >= kMaxDecodedTargets) {
+    decoded_targets_.erase(decoded_targets_.begin());
+  }
+  decoded_targets_.emplace(target_id, std::move(stored));
+}
+
+void LevelDbTargetCache::ForgetTarget(const std::string& canonical_id,
+                                      TargetId target_id) {
+  decoded_targets_.erase(target_id);
+
+  auto found = target_ids_by_canonical_id_.find(canonical_id);
+  if (found == target_ids_by_canonical_id_.end()) {
+    return;
+  }
+  std::vector<TargetId>& target_ids = found->second;
+  target_ids.erase(
+      std::remove(target_ids.begin(), target_ids.end(), target_id),
+      target_ids.end());
+  if (target_ids.empty()) {
+    target_ids_by_canonical_id_.erase(found);
   }
 }
 
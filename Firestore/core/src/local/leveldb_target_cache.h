@@ -17,11 +17,16 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LEVELDB_TARGET_CACHE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_TARGET_CACHE_H_
 
+#include <chrono>  // NOLINT(build/c++11)
+#include <functional>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "Firestore/Protos/nanopb/firestore/local/target.nanopb.h"
 #include "Firestore/core/src/local/target_cache.h"
+#include "Firestore/core/src/local/target_data.h"
 #include "Firestore/core/src/model/model_fwd.h"
 #include "Firestore/core/src/model/snapshot_version.h"
 #include "Firestore/core/src/nanopb/message.h"
@@ -34,8 +39,8 @@ namespace firestore {
 namespace local {
 
 class LevelDbPersistence;
+class LevelDbTransaction;
 class LocalSerializer;
-class TargetData;
 
 /** Cached Queries backed by LevelDB. */
 class LevelDbTargetCache : public TargetCache {
@@ -56,6 +61,12 @@ class LevelDbTargetCache : public TargetCache {
   static absl::optional<nanopb::Message<firestore_client_TargetGlobal>>
   TryReadMetadata(leveldb::DB* db);
 
+  /**
+   * Deletes the persisted count of orphaned documents, so that it is
+   * recomputed the next time a target cache is started.
+   */
+  static void DiscardOrphanedDocumentCount(LevelDbTransaction* transaction);
+
   /**
    * Creates a new target cache in the given LevelDB.
    *
@@ -103,6 +114,17 @@ class LevelDbTargetCache : public TargetCache {
    */
   bool Contains(const model::DocumentKey& key) override;
 
+  // Materialized result methods
+  void SetQueryResults(model::TargetId target_id,
+                       const MaterializedQueryResults& results) override;
+
+  absl::optional<MaterializedQueryResults> GetQueryResults(
+      model::TargetId target_id) override;
+
+  bool HasQueryResults(model::TargetId target_id) override;
+
+  void RemoveQueryResults(model::TargetId target_id) override;
+
   // Other methods and accessors
   size_t size() const override {
     return metadata_->target_count;
@@ -120,10 +142,91 @@ class LevelDbTargetCache : public TargetCache {
 
   void SetLastRemoteSnapshotVersion(model::SnapshotVersion version) override;
 
+  model::SnapshotVersion ReadLastRemoteSnapshotVersion() override;
+
   // Non-interface methods
   void Start();
 
-  void EnumerateOrphanedDocuments(const OrphanedDocumentCallback& callback);
+  /** How a change to a document's sentinel affects its target membership. */
+  enum class MembershipChange {
+    /** The document was just added to a target. */
+    kAdded,
+    /** The document was just removed from a target, but may be in others. */
+    kRemoved,
+    /** The document's targets did not change. */
+    kUnchanged,
+  };
+
+  /**
+   * Writes the sentinel row for the given document, recording the sequence
+   * number at which it was last used, and updates the orphaned documents index
+   * to match. Whether the document is orphaned is derived from `change`
+   * where possible, rather than by looking up its targets.
+   */
+  void WriteSentinel(const model::DocumentKey& key,
+                     model::ListenSequenceNumber sequence_number,
+                     MembershipChange change);
+
+  /**
+   * Removes the sentinel row of the given orphaned document along with its
+   * entry in the orphaned documents index, which is at `sequence_number`.
+   */
+  void RemoveSentinel(const model::DocumentKey& key,
+                      model::ListenSequenceNumber sequence_number);
+
+  /**
+   * Enumerates the orphaned documents in ascending order of sequence number,
+   * stopping once `callback` returns false.
+   */
+  void EnumerateOrphanedDocuments(
+      const std::function<bool(const model::DocumentKey&,
+                               model::ListenSequenceNumber)>& callback);
+
+  /**
+   * Enumerates the orphaned documents that follow the given sequence number
+   * and document key, in the same order as `EnumerateOrphanedDocuments`.
+   */
+  void EnumerateOrphanedDocumentsAfter(
+      model::ListenSequenceNumber sequence_number,
+      const model::DocumentKey& key,
+      const std::function<bool(const model::DocumentKey&,
+                               model::ListenSequenceNumber)>& callback);
+
+  /**
+   * Removes targets as `RemoveTargets` does, in ascending order of target ID
+   * starting with `*next_target_id`. Stops once `max_keys` document keys have
+   * been removed or `deadline` has passed, always removing at least one key,
+   * and records the target to resume with in `*next_target_id`. Sets
+   * `*complete` once every target has been visited.
+   *
+   * A target whose keys are only partially removed is kept until a later call
+   * removes the rest, but its resume token is cleared so that listening to it
+   * again fetches its results from scratch.
+   *
+   * @return The number of targets removed.
+   */
+  size_t RemoveTargets(
+      model::ListenSequenceNumber upper_bound,
+      const std::unordered_map<model::TargetId, TargetData>& live_targets,
+      size_t max_keys,
+      std::chrono::steady_clock::time_point deadline,
+      model::TargetId* next_target_id,
+      bool* complete);
+
+  /**
+   * Returns the number of orphaned documents, which is kept up to date as
+   * documents are added to and removed from the orphaned documents index.
+   */
+  size_t CountOrphanedDocuments() const {
+    return orphaned_document_count_;
+  }
+
+  /**
+   * Writes the orphaned document count to the current transaction if it
+   * changed since it was last written. Called once before each transaction
+   * commits, rather than for every document that changes the count.
+   */
+  void SaveOrphanedDocumentCount();
 
  private:
   void Save(const TargetData& target_data);
@@ -140,10 +243,88 @@ class LevelDbTargetCache : public TargetCache {
    */
   TargetData DecodeTarget(absl::string_view encoded);
 
+  void EnumerateOrphanedDocumentsFrom(
+      const std::string& start_key,
+      const std::function<bool(const model::DocumentKey&,
+                               model::ListenSequenceNumber)>& callback);
+
+  /**
+   * Returns the sequence number stored in the sentinel row of the given
+   * document, if it has one.
+   */
+  absl::optional<model::ListenSequenceNumber> ReadSentinel(
+      const model::DocumentKey& key);
+
+  /**
+   * Adds the given document to the orphaned documents index or removes it,
+   * depending on whether it still belongs to any target.
+   */
+  void UpdateOrphanedDocument(const model::DocumentKey& key);
+
+  /**
+   * Removes at most `max_keys` document keys in the query results of the given
+   * target ID, adding the number removed to `*removed_keys`. Returns true if
+   * none are left.
+   */
+  bool RemoveMatchingKeysForTarget(model::TargetId target_id,
+                                   size_t max_keys,
+                                   size_t* removed_keys);
+
+  /**
+   * Returns true if the orphaned documents index has an entry for the given
+   * document at the given sequence number.
+   */
+  bool IsOrphanedDocument(model::ListenSequenceNumber sequence_number,
+                          const model::DocumentKey& key);
+
+  /**
+   * Adds the given document, which must not be in the orphaned documents
+   * index yet, and updates the orphaned document count.
+   */
+  void AddOrphanedDocument(model::ListenSequenceNumber sequence_number,
+                           const model::DocumentKey& key);
+
+  /**
+   * Removes the given document, which must be in the orphaned documents index,
+   * and updates the orphaned document count.
+   */
+  void RemoveOrphanedDocument(model::ListenSequenceNumber sequence_number,
+                              const model::DocumentKey& key);
+
+  /**
+   * Loads the persisted orphaned document count, or computes and persists it
+   * by scanning the orphaned documents index if there is none.
+   */
+  void LoadOrphanedDocumentCount();
+
   /** Removes the given targets from the query to target mapping. */
   void RemoveQueryTargetKeyForTargets(
       const std::unordered_set<model::TargetId>& target_id);
 
+  /**
+   * Finds the given target by scanning the query-target index, without
+   * consulting or updating any in-memory state.
+   */
+  absl::optional<TargetData> ScanForTarget(const core::Target& target);
+
+  /**
+   * Populates `target_ids_by_canonical_id_` from the query-target index, if it
+   * has not been loaded yet.
+   */
+  void EnsureCanonicalIdsLoaded();
+
+  /**
+   * Returns the target data stored for the given target ID, consulting
+   * `decoded_targets_` before reading and decoding the stored proto.
+   */
+  absl::optional<TargetData> LookupTarget(model::TargetId target_id);
+
+  /** Adds the given target data to `decoded_targets_`, replacing any entry. */
+  void CacheDecodedTarget(const TargetData& target_data);
+
+  /** Removes all in-memory state for the given target. */
+  void ForgetTarget(const std::string& canonical_id, model::TargetId target_id);
+
   // The LevelDbTargetCache is owned by LevelDbPersistence.
   LevelDbPersistence* db_;
   // Owned by LevelDbPersistence.
@@ -153,6 +334,28 @@ class LevelDbTargetCache : public TargetCache {
   nanopb::Message<firestore_client_TargetGlobal> metadata_;
 
   model::SnapshotVersion last_remote_snapshot_version_;
+
+  /**
+   * The orphaned document count, which is written to the current transaction
+   * by `SaveOrphanedDocumentCount` if `orphaned_document_count_changed_`.
+   */
+  size_t orphaned_document_count_ = 0;
+  bool orphaned_document_count_changed_ = false;
+
+  /**
+   * A write-through copy of the query-target index, mapping each canonical ID
+   * to the IDs of the targets that share it. Loaded on first use.
+   */
+  std::unordered_map<std::string, std::vector<model::TargetId>>
+      target_ids_by_canonical_id_;
+  bool canonical_ids_loaded_ = false;
+
+  /**
+   * Decoded copies of recently updated or retrieved targets, bounded by
+   * `kMaxDecodedTargets`. Newly added targets are read back from LevelDB on
+   * first lookup.
+   */
+  std::unordered_map<model::TargetId, TargetData> decoded_targets_;
 };
 
 }  // namespace local
@@ -14,11 +14,15 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <type_traits>
+#include <utility>
 
 #include "Firestore/core/src/local/leveldb_transaction.h"
 
 #include "Firestore/core/src/local/leveldb_key.h"
+#include "Firestore/core/src/local/leveldb_size_tracker.h"
+#include "Firestore/core/src/local/leveldb_util.h"
 #include "Firestore/core/src/util/hard_assert.h"
 #include "Firestore/core/src/util/log.h"
 #include "absl/memory/memory.h"
@@ -42,16 +46,24 @@ LevelDbTransaction::Iterator::Iterator(LevelDbTransaction* txn)
       last_version_(txn->version_),
       txn_(txn),
       mutations_iter_(txn->mutations_.begin()),
-      current_(),
+      deletions_iter_(txn->deletions_.begin()),
+      is_materialized_(false),
       is_mutation_(false),
       // Iterator doesn't really point to anything yet, so is
       // invalid
       is_valid_(false) {
+  txn_->iterators_.push_back(this);
+}
+
+LevelDbTransaction::Iterator::~Iterator() {
+  auto& iterators = txn_->iterators_;
+  iterators.erase(std::find(iterators.begin(), iterators.end(), this));
 }
 
 void LevelDbTransaction::Iterator::UpdateCurrent() {
   bool mutation_is_valid = mutations_iter_ != txn_->mutations_.end();
   is_valid_ = mutation_is_valid || db_iter_->Valid();
+  is_materialized_ = false;
 
   if (is_valid_) {
     if (!mutation_is_valid) {
@@ -66,17 +78,33 @@ void LevelDbTransaction::Iterator::UpdateCurrent() {
       is_mutation_ = db_iter_->key().compare(mutations_iter_->first) >= 0;
     }
     if (is_mutation_) {
-      current_ = *mutations_iter_;
+      key_ = mutations_iter_->first;
+      value_ = mutations_iter_->second;
     } else {
-      current_ = {db_iter_->key().ToString(), db_iter_->value().ToString()};
+      key_ = MakeStringView(db_iter_->key());
+      value_ = MakeStringView(db_iter_->value());
     }
   }
 }
 
+void LevelDbTransaction::Iterator::OnTransactionChanging() {
+  if (!is_valid_ || !is_mutation_ || is_materialized_) {
+    // Views into db_iter_ stay valid until it moves, which only happens in
+    // Seek() or Next().
+    return;
+  }
+  materialized_key_.assign(key_.data(), key_.size());
+  materialized_value_.assign(value_.data(), value_.size());
+  key_ = materialized_key_;
+  value_ = materialized_value_;
+  is_materialized_ = true;
+}
+
 void LevelDbTransaction::Iterator::Seek(const std::string& key) {
   db_iter_->Seek(key);
   HARD_ASSERT(db_iter_->status().ok(), "leveldb iterator reported an error: %s",
               db_iter_->status().ToString());
+  deletions_iter_ = txn_->deletions_.lower_bound(key);
   for (; db_iter_->Valid() && IsDeleted(db_iter_->key()); db_iter_->Next()) {
   }
   HARD_ASSERT(db_iter_->status().ok(), "leveldb iterator reported an error: %s",
@@ -86,28 +114,33 @@ void LevelDbTransaction::Iterator::Seek(const std::string& key) {
   last_version_ = txn_->version_;
 }
 
-const std::string& LevelDbTransaction::Iterator::key() const {
+absl::string_view LevelDbTransaction::Iterator::key() const {
   HARD_ASSERT(Valid(), "key() called on invalid iterator");
-  return current_.first;
+  return key_;
 }
 
-const std::string& LevelDbTransaction::Iterator::value() const {
+absl::string_view LevelDbTransaction::Iterator::value() const {
   HARD_ASSERT(Valid(), "value() called on invalid iterator");
-  return current_.second;
+  return value_;
 }
 
 bool LevelDbTransaction::Iterator::IsDeleted(leveldb::Slice slice) {
-  return txn_->deletions_.find(slice.ToString()) != txn_->deletions_.end();
+  absl::string_view key = MakeStringView(slice);
+  const Deletions& deletions = txn_->deletions_;
+  while (deletions_iter_ != deletions.end() && *deletions_iter_ < key) {
+    ++deletions_iter_;
+  }
+  return deletions_iter_ != deletions.end() && *deletions_iter_ == key;
 }
 
 bool LevelDbTransaction::Iterator::SyncToTransaction() {
   if (last_version_ < txn_->version_) {
-    // Intentionally copying here since Seek() may update current_. We need the
+    // Intentionally copying here since Seek() may update key_. We need the
     // copy to do the comparison below.
-    const std::string current_key = current_.first;
+    const std::string current_key(key_);
     Seek(current_key);
     // If we advanced, we don't need to advance again.
-    return is_valid_ && current_.first > current_key;
+    return is_valid_ && key_ > current_key;
   } else {
     return false;
   }
@@ -168,7 +201,44 @@ const WriteOptions& LevelDbTransaction::DefaultWriteOptions() {
   return options;
 }
 
+void LevelDbTransaction::NotifyIteratorsChanging() {
+  for (Iterator* iterator : iterators_) {
+    iterator->OnTransactionChanging();
+  }
+}
+
+void LevelDbTransaction::RecordPreviousSize(absl::string_view key,
+                                            size_t value_size) {
+  if (!size_tracker_ || HasPendingChange(key)) return;
+  auto size = static_cast<int64_t>(key.size() + value_size);
+  previous_sizes_.emplace(std::string(key), size);
+}
+
+void LevelDbTransaction::RecordAbsent(absl::string_view key) {
+  if (!size_tracker_ || HasPendingChange(key)) return;
+  previous_sizes_.emplace(std::string(key), 0);
+}
+
+bool LevelDbTransaction::HasPendingChange(absl::string_view key) const {
+  return mutations_.find(key) != mutations_.end() ||
+         deletions_.find(key) != deletions_.end();
+}
+
+void LevelDbTransaction::RecordPreviousSizeFromIterators(
+    absl::string_view key) {
+  if (!size_tracker_) return;
+  for (const Iterator* iterator : iterators_) {
+    if (iterator->is_valid_ && !iterator->is_mutation_ &&
+        iterator->key_ == key) {
+      RecordPreviousSize(key, iterator->value_.size());
+      return;
+    }
+  }
+}
+
 void LevelDbTransaction::Put(std::string key, std::string value) {
+  RecordPreviousSizeFromIterators(key);
+  NotifyIteratorsChanging();
   deletions_.erase(key);
   mutations_[std::move(key)] = std::move(value);
   version_++;
@@ -180,24 +250,48 @@ LevelDbTransaction::NewIterator() {
 }
 
 Status LevelDbTransaction::Get(absl::string_view key, std::string* value) {
-  std::string key_string(key);
-  if (deletions_.find(key_string) != deletions_.end()) {
-    return Status::NotFound(key_string + " is not present in the transaction");
+  if (deletions_.find(key) != deletions_.end()) {
+    return Status::NotFound(
+        absl::StrCat(key, " is not present in the transaction"));
   } else {
-    Mutations::iterator iter{mutations_.find(key_string)};
+    Mutations::iterator iter{mutations_.find(key)};
     if (iter != mutations_.end()) {
       *value = iter->second;
       return Status::OK();
     } else {
-      return db_->Get(read_options_, key_string, value);
+      Status status = db_->Get(read_options_, MakeSlice(key), value);
+      if (status.ok()) {
+        RecordPreviousSize(key, value->size());
+      } else if (status.IsNotFound()) {
+        RecordAbsent(key);
+      }
+      return status;
     }
   }
 }
 
+Status LevelDbTransaction::ConcurrentGet(absl::string_view key,
+                                         std::string* value) const {
+  if (deletions_.find(key) != deletions_.end()) {
+    return Status::NotFound(
+        absl::StrCat(key, " is not present in the transaction"));
+  }
+  auto iter = mutations_.find(key);
+  if (iter != mutations_.end()) {
+    *value = iter->second;
+    return Status::OK();
+  }
+  return db_->Get(read_options_, MakeSlice(key), value);
+}
+
 void LevelDbTransaction::Delete(absl::string_view key) {
+  // Copy the key before notifying iterators, since it may be a view of an
+  // iterator's current entry.
   std::string to_delete(key);
-  deletions_.insert(to_delete);
+  RecordPreviousSizeFromIterators(to_delete);
+  NotifyIteratorsChanging();
   mutations_.erase(to_delete);
+  deletions_.insert(std::move(to_delete));
   version_++;
 }
 
@@ -211,11 +305,47 @@ void LevelDbTransaction::Commit() {
     batch.Put(entry.first, entry.second);
   }
 
+  LevelDbSizeTracker::Sizes size_delta{};
+  int64_t estimated_changes = 0;
+  std::string size_key = LevelDbSizeTracker::Key();
+  if (size_tracker_ && changed_keys() > 0) {
+    // Rows whose previous size was not read or recorded are assumed not to
+    // exist. The tracker counts these changes and eventually recomputes.
+    auto previous_size = [&](const std::string& key) -> int64_t {
+      auto known = previous_sizes_.find(key);
+      if (known != previous_sizes_.end()) return known->second;
+      estimated_changes++;
+      return 0;
+    };
+
+    for (const auto& deletion : deletions_) {
+      if (deletion == size_key) continue;
+      LevelDbSizeTracker::RecordChange(deletion, previous_size(deletion), 0,
+                                       &size_delta);
+    }
+    for (const auto& entry : mutations_) {
+      if (entry.first == size_key) continue;
+      auto new_size =
+          static_cast<int64_t>(entry.first.size() + entry.second.size());
+      LevelDbSizeTracker::RecordChange(entry.first, previous_size(entry.first),
+                                       new_size, &size_delta);
+    }
+
+    if (size_delta != LevelDbSizeTracker::Sizes{} || estimated_changes > 0) {
+      batch.Put(size_key,
+                size_tracker_->EncodeWithDelta(size_delta, estimated_changes));
+    }
+  }
+
   LOG_DEBUG("Committing transaction: %s", ToString());
 
   Status status = db_->Write(write_options_, &batch);
   HARD_ASSERT(status.ok(), "Failed to commit transaction:\n%s\n Failed: %s",
               ToString(), status.ToString());
+
+  if (size_tracker_) {
+    size_tracker_->Apply(size_delta, estimated_changes);
+  }
 }
 
 std::string LevelDbTransaction::ToString() {
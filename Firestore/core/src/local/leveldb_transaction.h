@@ -18,11 +18,14 @@
 #define FIRESTORE_CORE_SRC_LOCAL_LEVELDB_TRANSACTION_H_
 
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "Firestore/core/src/nanopb/byte_string.h"
 #include "Firestore/core/src/nanopb/message.h"
@@ -34,24 +37,40 @@ namespace firebase {
 namespace firestore {
 namespace local {
 
+class LevelDbSizeTracker;
+
 /**
  * LevelDBTransaction tracks pending changes to entries in leveldb, including
  * deletions. It also provides an Iterator to traverse a merged view of pending
  * changes and committed values.
  */
 class LevelDbTransaction {
-  using Deletions = std::set<std::string>;
-  using Mutations = std::map<std::string, std::string>;
+  // Both containers use a transparent comparator so that keys can be looked up
+  // by `absl::string_view` without copying them into a `std::string`.
+  using Deletions = std::set<std::string, std::less<>>;
+  using Mutations = std::map<std::string, std::string, std::less<>>;
 
  public:
   /**
    * Iterator iterates over a merged view of pending changes from the
    * transaction and any unchanged values in the underlying leveldb instance.
+   *
+   * The key and value of the current entry are exposed as views into either
+   * the underlying leveldb iterator or the transaction's pending mutations, so
+   * stepping through rows does not copy them. If the transaction is modified
+   * while the iterator points at a pending mutation, the current entry is
+   * copied first so that it remains readable.
    */
   class Iterator {
    public:
     explicit Iterator(LevelDbTransaction* txn);
 
+    ~Iterator();
+
+    Iterator(const Iterator& other) = delete;
+
+    Iterator& operator=(const Iterator& other) = delete;
+
     /**
      * Returns true if this iterator points to an entry
      */
@@ -71,16 +90,20 @@ class LevelDbTransaction {
     void Next();
 
     /**
-     * Returns the key of the current entry
+     * Returns the key of the current entry. The returned view remains valid
+     * until the next call to Seek() or Next().
      */
-    const std::string& key() const;
+    absl::string_view key() const;
 
     /**
-     * Returns the value of the current entry
+     * Returns the value of the current entry. The returned view remains valid
+     * until the next call to Seek() or Next().
      */
-    const std::string& value() const;
+    absl::string_view value() const;
 
    private:
+    friend class LevelDbTransaction;
+
     /**
      * Advances to the next non-deleted key in leveldb.
      */
@@ -88,7 +111,9 @@ class LevelDbTransaction {
 
     /**
      * Returns true if the given slice matches a key present in the deletions_
-     * set.
+     * set. Keys must be passed in ascending order between calls to Seek(),
+     * which lets this advance through deletions_ alongside db_iter_ instead of
+     * searching it for every row.
      */
     bool IsDeleted(leveldb::Slice slice);
 
@@ -96,16 +121,23 @@ class LevelDbTransaction {
      * Syncs with the underlying transaction. If the transaction has been
      * updated, the mutation iterator may need to be reset. Returns true if this
      * resulted in moving to a new underlying entry (i.e. the entry represented
-     * by current_ was deleted).
+     * by the current key was deleted).
      */
     bool SyncToTransaction();
 
     /**
      * Given the current state of the internal iterators, set is_valid_,
-     * is_mutation_, and current_.
+     * is_mutation_, key_ and value_.
      */
     void UpdateCurrent();
 
+    /**
+     * Called by the transaction before it changes its pending mutations. If
+     * the current entry is backed by a pending mutation, copies it into
+     * storage owned by this iterator so that key() and value() remain valid.
+     */
+    void OnTransactionChanging();
+
     std::unique_ptr<leveldb::Iterator> db_iter_;
 
     // The last observed version of the underlying transaction
@@ -113,12 +145,24 @@ class LevelDbTransaction {
     // The underlying transaction.
     LevelDbTransaction* txn_;
     Mutations::iterator mutations_iter_;
-    // We save the current key and value so that once an iterator is Valid(), it
-    // remains so at least until the next call to Seek() or Next(), even if the
-    // underlying data is deleted.
-    std::pair<std::string, std::string> current_;
-    // True if current_ represents an entry in the mutations_ map, rather than
-    // committed data.
+    // The first pending deletion that is not less than the last key checked by
+    // IsDeleted().
+    Deletions::iterator deletions_iter_;
+    // Views of the current key and value. These point into db_iter_, into the
+    // mutations_ map, or into materialized_key_ and materialized_value_ once
+    // the current entry has been copied. Either way, once an iterator is
+    // Valid(), it remains so at least until the next call to Seek() or Next(),
+    // even if the underlying data is deleted.
+    absl::string_view key_;
+    absl::string_view value_;
+    // Owned copies of the current entry, populated only when the transaction
+    // changes while the iterator points at a pending mutation.
+    std::string materialized_key_;
+    std::string materialized_value_;
+    // True if key_ and value_ point into the materialized copies.
+    bool is_materialized_;
+    // True if the current entry represents an entry in the mutations_ map,
+    // rather than committed data.
     bool is_mutation_;
     // True if the iterator pointed to a valid entry the last time Next() or
     // Seek() was called.
@@ -178,12 +222,47 @@ class LevelDbTransaction {
    */
   leveldb::Status Get(absl::string_view key, std::string* value);
 
+  /**
+   * Like `Get`, but does not record the size of the row for the size tracker,
+   * so it may be called from several threads at once as long as no thread
+   * changes the transaction in the meantime.
+   */
+  leveldb::Status ConcurrentGet(absl::string_view key,
+                                std::string* value) const;
+
   /**
    * Returns a new Iterator over the pending changes in this transaction, merged
    * with the existing values already in leveldb.
    */
   std::unique_ptr<Iterator> NewIterator();
 
+  /**
+   * Attaches a tracker that is updated with the change in the logical size of
+   * the database when this transaction commits. The previous size of a changed
+   * row is taken from this transaction's reads of it, or from
+   * `RecordPreviousSize` and `RecordAbsent`. Otherwise the row is assumed not
+   * to exist, and the change is counted as an estimate.
+   */
+  void set_size_tracker(LevelDbSizeTracker* size_tracker) {
+    size_tracker_ = size_tracker;
+  }
+
+  /**
+   * Records that the committed row at `key` has a value of `value_size`
+   * bytes, for writers that know the size of a row they are about to change
+   * without reading it through this transaction. Only the first size recorded
+   * for a key counts, and only if this transaction has not changed the row
+   * yet.
+   */
+  void RecordPreviousSize(absl::string_view key, size_t value_size);
+
+  /**
+   * Records that there is no committed row at `key`, for writers that know
+   * they are adding a new row. Like `RecordPreviousSize`, this has no effect
+   * once this transaction has changed the row.
+   */
+  void RecordAbsent(absl::string_view key);
+
   /**
    * Commits the transaction. All pending changes are written. The transaction
    * should not be used after calling this method.
@@ -193,6 +272,23 @@ class LevelDbTransaction {
   std::string ToString();
 
  private:
+  /**
+   * Informs open iterators that pending mutations are about to change.
+   */
+  void NotifyIteratorsChanging();
+
+  /**
+   * Returns true if this transaction has already changed the row at `key`, in
+   * which case a size read from it is not the committed size.
+   */
+  bool HasPendingChange(absl::string_view key) const;
+
+  /**
+   * Records the size of the committed row at `key` if an open iterator points
+   * at it, which is how rows are usually deleted while scanning.
+   */
+  void RecordPreviousSizeFromIterators(absl::string_view key);
+
   leveldb::DB* db_ = nullptr;
   Mutations mutations_;
   Deletions deletions_;
@@ -200,6 +296,14 @@ class LevelDbTransaction {
   leveldb::WriteOptions write_options_;
   int32_t version_ = 0;
   std::string label_;
+  LevelDbSizeTracker* size_tracker_ = nullptr;
+  // The sizes of committed rows that this transaction read or was told about,
+  // by key, which Commit() uses as their previous size. Only kept with a size
+  // tracker.
+  std::unordered_map<std::string, int64_t> previous_sizes_;
+  // The iterators currently open over this transaction, which need to be told
+  // before pending mutations change.
+  std::vector<Iterator*> iterators_;
 };
 
 /**
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/local_aggregator.h"
+
+#include <limits>
+#include <utility>
+
+#include "Firestore/core/src/model/document.h"
+#include "Firestore/core/src/model/field_path.h"
+#include "Firestore/core/src/model/value_util.h"
+#include "Firestore/core/src/nanopb/message.h"
+#include "Firestore/core/src/util/hard_assert.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using model::AggregateField;
+using nanopb::Message;
+
+bool AddOverflows(int64_t lhs, int64_t rhs) {
+  return rhs > 0 ? lhs > std::numeric_limits<int64_t>::max() - rhs
+                 : lhs < std::numeric_limits<int64_t>::min() - rhs;
+}
+
+Message<google_firestore_v1_Value> IntegerValue(int64_t value) {
+  Message<google_firestore_v1_Value> result;
+  result->which_value_type = google_firestore_v1_Value_integer_value_tag;
+  result->integer_value = value;
+  return result;
+}
+
+Message<google_firestore_v1_Value> DoubleValue(double value) {
+  Message<google_firestore_v1_Value> result;
+  result->which_value_type = google_firestore_v1_Value_double_value_tag;
+  result->double_value = value;
+  return result;
+}
+
+}  // namespace
+
+LocalAggregator::LocalAggregator(std::vector<AggregateField> aggregates)
+    : aggregates_(std::move(aggregates)), sums_(aggregates_.size()) {
+}
+
+bool LocalAggregator::needs_documents() const {
+  for (const AggregateField& aggregate : aggregates_) {
+    if (aggregate.op != AggregateField::OpKind::Count) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LocalAggregator::Add(const model::Document& document) {
+  ++count_;
+
+  for (size_t i = 0; i < aggregates_.size(); ++i) {
+    const AggregateField& aggregate = aggregates_[i];
+    if (aggregate.op == AggregateField::OpKind::Count) continue;
+
+    absl::optional<google_firestore_v1_Value> value =
+        document->field(aggregate.fieldPath);
+    if (!model::IsNumber(value)) continue;
+
+    Sum& sum = sums_[i];
+    ++sum.value_count;
+    if (model::IsInteger(value)) {
+      int64_t integer = value->integer_value;
+      sum.double_sum += static_cast<double>(integer);
+      if (sum.is_double) continue;
+      if (AddOverflows(sum.integer_sum, integer)) {
+        sum.is_double = true;
+      } else {
+        sum.integer_sum += integer;
+      }
+    } else {
+      sum.double_sum += value->double_value;
+      sum.is_double = true;
+    }
+  }
+}
+
+void LocalAggregator::AddCount(int64_t count) {
+  HARD_ASSERT(!needs_documents(),
+              "Documents must be added for SUM and AVG aggregations");
+  count_ += count;
+}
+
+model::ObjectValue LocalAggregator::Result() const {
+  model::ObjectValue result;
+  for (size_t i = 0; i < aggregates_.size(); ++i) {
+    const AggregateField& aggregate = aggregates_[i];
+    const Sum& sum = sums_[i];
+
+    Message<google_firestore_v1_Value> value;
+    switch (aggregate.op) {
+      case AggregateField::OpKind::Count:
+        value = IntegerValue(count_);
+        break;
+      case AggregateField::OpKind::Sum:
+        value = sum.is_double ? DoubleValue(sum.double_sum)
+                              : IntegerValue(sum.integer_sum);
+        break;
+      case AggregateField::OpKind::Avg:
+        value = sum.value_count == 0
+                    ? Message<google_firestore_v1_Value>(model::NullValue())
+                    : DoubleValue(sum.double_sum /
+                                  static_cast<double>(sum.value_count));
+        break;
+    }
+    result.Set(model::FieldPath{aggregate.alias.StringValue()},
+               std::move(value));
+  }
+  return result;
+}
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIRESTORE_CORE_SRC_LOCAL_LOCAL_AGGREGATOR_H_
+#define FIRESTORE_CORE_SRC_LOCAL_LOCAL_AGGREGATOR_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "Firestore/core/src/model/aggregate_field.h"
+#include "Firestore/core/src/model/model_fwd.h"
+#include "Firestore/core/src/model/object_value.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+
+/**
+ * Computes COUNT, SUM and AVG aggregations over documents that are added one
+ * at a time, with the same results as the backend:
+ *
+ *   - SUM and AVG only consider fields with numeric values.
+ *   - SUM is an integer as long as every value is an integer and the sum does
+ *     not overflow, and a double otherwise.
+ *   - AVG is a double, or null if no document has a numeric value.
+ */
+class LocalAggregator {
+ public:
+  explicit LocalAggregator(std::vector<model::AggregateField> aggregates);
+
+  /**
+   * Returns true if some aggregation depends on document contents. Otherwise,
+   * matching documents only need to be counted with `AddCount`.
+   */
+  bool needs_documents() const;
+
+  /** Adds a document that matches the aggregated query. */
+  void Add(const model::Document& document);
+
+  /**
+   * Adds `count` matching documents. May only be called if `needs_documents()`
+   * is false.
+   */
+  void AddCount(int64_t count);
+
+  /** Returns the number of documents added so far. */
+  int64_t count() const {
+    return count_;
+  }
+
+  /** Returns the result of each aggregation, keyed by its alias. */
+  model::ObjectValue Result() const;
+
+ private:
+  struct Sum {
+    int64_t integer_sum = 0;
+    double double_sum = 0;
+    bool is_double = false;
+    int64_t value_count = 0;
+  };
+
+  std::vector<model::AggregateField> aggregates_;
+
+  // One entry per aggregation, unused for COUNT.
+  std::vector<Sum> sums_;
+  int64_t count_ = 0;
+};
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
+
+#endif  // FIRESTORE_CORE_SRC_LOCAL_LOCAL_AGGREGATOR_H_
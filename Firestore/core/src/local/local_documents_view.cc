@@ -29,6 +29,7 @@
 #include "Firestore/core/src/immutable/sorted_set.h"
 #include "Firestore/core/src/local/local_write_result.h"
 #include "Firestore/core/src/local/mutation_queue.h"
+#include "Firestore/core/src/local/query_context.h"
 #include "Firestore/core/src/local/remote_document_cache.h"
 #include "Firestore/core/src/model/document.h"
 #include "Firestore/core/src/model/document_key.h"
@@ -172,6 +173,9 @@ DocumentMap LocalDocumentsView::GetDocumentsMatchingCollectionQuery(
   MutableDocumentMap remote_documents =
       remote_document_cache_->GetDocumentsMatchingQuery(
           query, offset, context, absl::nullopt, overlays);
+  if (context.has_value()) {
+    context.value().IncrementOverlayCount(overlays.size());
+  }
 
   // As documents might match the query because of their overlay we need to
   // include documents for all overlays in the initial document set.
@@ -203,6 +207,58 @@ DocumentMap LocalDocumentsView::GetDocumentsMatchingCollectionQuery(
   return results;
 }
 
+void LocalDocumentsView::ForEachDocumentMatchingQuery(
+    const Query& query, const std::function<void(const Document&)>& callback) {
+  if (query.IsDocumentQuery()) {
+    for (const auto& entry : GetDocumentsMatchingDocumentQuery(query.path())) {
+      callback(entry.second);
+    }
+  } else if (query.IsCollectionGroupQuery()) {
+    HARD_ASSERT(
+        query.path().empty(),
+        "Currently we only support collection group queries at the root.");
+
+    const std::string& collection_id = *query.collection_group();
+    for (const ResourcePath& parent :
+         index_manager_->GetCollectionParents(collection_id)) {
+      ForEachDocumentMatchingCollectionQuery(
+          query.AsCollectionQueryAtPath(parent.Append(collection_id)),
+          callback);
+    }
+  } else {
+    ForEachDocumentMatchingCollectionQuery(query, callback);
+  }
+}
+
+void LocalDocumentsView::ForEachDocumentMatchingCollectionQuery(
+    const Query& query, const std::function<void(const Document&)>& callback) {
+  OverlayByDocumentKeyMap overlays = document_overlay_cache_->GetOverlays(
+      query.path(), IndexOffset::None().largest_batch_id());
+
+  DocumentKeySet visited_overlays;
+  auto apply_overlay_and_match = [&](MutableDocument&& doc) {
+    auto overlay_it = overlays.find(doc.key());
+    if (overlay_it != overlays.end()) {
+      overlay_it->second.mutation().ApplyToLocalView(doc, FieldMask(),
+                                                     Timestamp::Now());
+      visited_overlays = visited_overlays.insert(doc.key());
+    }
+    if (query.Matches(doc)) {
+      callback(Document(std::move(doc)));
+    }
+  };
+  remote_document_cache_->ForEachDocumentMatchingQuery(
+      query, overlays, apply_overlay_and_match);
+
+  // As documents might match the query because of their overlay, the
+  // documents that only have an overlay are matched as well.
+  for (const auto& entry : overlays) {
+    if (!visited_overlays.contains(entry.first)) {
+      apply_overlay_and_match(MutableDocument::InvalidDocument(entry.first));
+    }
+  }
+}
+
 Document LocalDocumentsView::GetDocument(const DocumentKey& key) {
   absl::optional<Overlay> overlay = document_overlay_cache_->GetOverlay(key);
   MutableDocument document = GetBaseDocument(key, overlay);
@@ -218,6 +274,24 @@ DocumentMap LocalDocumentsView::GetDocuments(const DocumentKeySet& keys) {
   return GetLocalViewOfDocuments(docs, DocumentKeySet{});
 }
 
+DocumentMap LocalDocumentsView::GetDocuments(
+    const DocumentKeySet& keys, absl::optional<QueryContext>& context) {
+  if (!context.has_value()) return GetDocuments(keys);
+
+  MutableDocumentMap docs = remote_document_cache_->GetAll(keys);
+  OverlayByDocumentKeyMap overlays;
+  PopulateOverlays(overlays, keys);
+  context.value().IncrementDocumentReadCount(docs.size());
+  context.value().IncrementOverlayCount(overlays.size());
+
+  DocumentMap result;
+  for (auto& entry :
+       ComputeViews(docs, std::move(overlays), DocumentKeySet{})) {
+    result = result.insert(entry.first, std::move(entry.second).document());
+  }
+  return result;
+}
+
 DocumentMap LocalDocumentsView::GetLocalViewOfDocuments(
     const MutableDocumentMap& base_docs,
     const DocumentKeySet& existence_state_changed) {
@@ -18,6 +18,7 @@
 #define FIRESTORE_CORE_SRC_LOCAL_LOCAL_DOCUMENTS_VIEW_H_
 
 #include <cstddef>
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -81,6 +82,13 @@ class LocalDocumentsView {
    */
   model::DocumentMap GetDocuments(const model::DocumentKeySet& keys);
 
+  /**
+   * Like `GetDocuments` above, but also records the documents and overlays
+   * that were read in `context`.
+   */
+  model::DocumentMap GetDocuments(const model::DocumentKeySet& keys,
+                                  absl::optional<QueryContext>& context);
+
   /**
    * Given a collection group, returns the next documents that follow the
    * provided offset, along with an updated batch ID.
@@ -156,6 +164,16 @@ class LocalDocumentsView {
       const model::IndexOffset& offset,
       absl::optional<QueryContext>& context);
 
+  /**
+   * Calls `callback` with each document in the local view that matches
+   * `query`, as `GetDocumentsMatchingQuery` with no offset would return them,
+   * but without collecting them first. Documents are visited in an unspecified
+   * order.
+   */
+  void ForEachDocumentMatchingQuery(
+      const core::Query& query,
+      const std::function<void(const model::Document&)>& callback);
+
  private:
   friend class QueryEngine;
 
@@ -180,6 +198,14 @@ class LocalDocumentsView {
       const model::IndexOffset& offset,
       absl::optional<QueryContext>& context);
 
+  /**
+   * Implements ForEachDocumentMatchingQuery() for queries of a single
+   * collection.
+   */
+  void ForEachDocumentMatchingCollectionQuery(
+      const core::Query& query,
+      const std::function<void(const model::Document&)>& callback);
+
   RemoteDocumentCache* remote_document_cache() {
     return remote_document_cache_;
   }
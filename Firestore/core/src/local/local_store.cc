@@ -16,10 +16,12 @@
 
 #include "Firestore/core/src/local/local_store.h"
 
+#include <chrono>  // NOLINT(build/c++11)
 #include <set>
 #include <string>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "Firestore/core/src/credentials/user.h"
 #include "Firestore/core/src/local/bundle_cache.h"
@@ -28,16 +30,21 @@
 #include "Firestore/core/src/local/local_view_changes.h"
 #include "Firestore/core/src/local/local_write_result.h"
 #include "Firestore/core/src/local/lru_garbage_collector.h"
+#include "Firestore/core/src/local/materialized_query_results.h"
 #include "Firestore/core/src/local/overlay_migration_manager.h"
 #include "Firestore/core/src/local/persistence.h"
 #include "Firestore/core/src/local/query_engine.h"
+#include "Firestore/core/src/local/query_profile.h"
 #include "Firestore/core/src/local/query_result.h"
 #include "Firestore/core/src/local/reference_delegate.h"
 #include "Firestore/core/src/local/target_cache.h"
+#include "Firestore/core/src/model/aggregate_field.h"
 #include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/model/document_set.h"
 #include "Firestore/core/src/model/mutable_document.h"
 #include "Firestore/core/src/model/mutation_batch.h"
 #include "Firestore/core/src/model/mutation_batch_result.h"
+#include "Firestore/core/src/model/object_value.h"
 #include "Firestore/core/src/model/patch_mutation.h"
 #include "Firestore/core/src/remote/remote_event.h"
 #include "Firestore/core/src/util/log.h"
@@ -117,6 +124,7 @@ LocalStore::LocalStore(Persistence* persistence,
       remote_document_cache_, mutation_queue_, document_overlay_cache_,
       index_manager_);
   remote_document_cache_->SetIndexManager(index_manager_);
+  remote_document_cache_->SetCollectionStatistics(query_engine_->statistics());
   overlay_migration_manager_ =
       persistence_->GetOverlayMigrationManager(initial_user);
 
@@ -128,6 +136,10 @@ LocalStore::LocalStore(Persistence* persistence,
 
 LocalStore::~LocalStore() = default;
 
+CollectionStatistics* LocalStore::statistics() const {
+  return query_engine_->statistics();
+}
+
 void LocalStore::Start() {
   StartMutationQueue();
   StartIndexManager();
@@ -137,6 +149,10 @@ void LocalStore::Start() {
       TargetIdGenerator::TargetCacheTargetIdGenerator(target_id);
 }
 
+void LocalStore::CompleteOverlayMigration() {
+  overlay_migration_manager_->RunForOtherUsers();
+}
+
 void LocalStore::StartMutationQueue() {
   persistence_->Run("Start MutationQueue", [&] { mutation_queue_->Start(); });
 }
@@ -146,6 +162,8 @@ void LocalStore::StartIndexManager() {
 }
 
 DocumentMap LocalStore::HandleUserChange(const User& user) {
+  std::unique_lock<std::shared_timed_mutex> lock(user_components_mutex_);
+
   // Swap out the mutation queue, grabbing the pending mutation batches before
   // and after.
   std::vector<MutationBatch> old_batches = persistence_->Run(
@@ -161,6 +179,10 @@ DocumentMap LocalStore::HandleUserChange(const User& user) {
   StartMutationQueue();
   StartIndexManager();
 
+  // The new user's overlays may not have been migrated yet.
+  overlay_migration_manager_ = persistence_->GetOverlayMigrationManager(user);
+  overlay_migration_manager_->Run();
+
   persistence_->ReleaseOtherUserSpecificComponents(user.uid());
 
   return persistence_->Run("NewBatches", [&] {
@@ -197,6 +219,8 @@ LocalWriteResult LocalStore::WriteLocally(std::vector<Mutation>&& mutations) {
     keys = keys.insert(mutation.key());
   }
 
+  // Local writes are never deferred: once this returns, the write may be sent
+  // to the backend, and it must not be lost if the process exits.
   return persistence_->Run("Locally write mutations", [&] {
     // Figure out which keys do not have a remote version in the cache, this is
     // needed to create the right overlay mutation: if no remote version
@@ -347,6 +371,17 @@ model::DocumentMap LocalStore::ApplyRemoteEvent(
       target_cache_->RemoveMatchingKeys(change.removed_documents(), target_id);
       target_cache_->AddMatchingKeys(change.added_documents(), target_id);
 
+      // The materialized results are written again once the view is back in
+      // sync.
+      if (query_result_materialization_enabled_ &&
+          (!change.added_documents().empty() ||
+           !change.modified_documents().empty() ||
+           !change.removed_documents().empty() ||
+           remote_event.target_mismatches().find(target_id) !=
+               remote_event.target_mismatches().end())) {
+        target_cache_->RemoveQueryResults(target_id);
+      }
+
       TargetData new_target_data =
           old_target_data.WithSequenceNumber(sequence_number);
       if (remote_event.target_mismatches().find(target_id) !=
@@ -479,6 +514,18 @@ void LocalStore::NotifyLocalViewChanges(
         if (ShouldPersistTargetData(updated_target_data, target_data, {})) {
           target_cache_->UpdateTarget(updated_target_data);
         }
+
+        // The results are only rewritten when their keys change. Reads check
+        // every document's version, so results left with older versions make
+        // the query run as usual instead of returning stale documents.
+        bool keys_changed = !view_change.added_keys().empty() ||
+                            !view_change.removed_keys().empty();
+        if (query_result_materialization_enabled_ &&
+            view_change.documents().has_value() &&
+            (keys_changed || !target_cache_->HasQueryResults(target_id))) {
+          MaterializeQueryResults(target_id, last_limbo_free_snapshot_version,
+                                  view_change.documents().value());
+        }
       }
     }
   });
@@ -564,12 +611,88 @@ QueryResult LocalStore::ExecuteQuery(const Query& query,
       remote_keys = target_cache_->GetMatchingKeys(target_data->target_id());
     }
 
+    if (query_result_materialization_enabled_ && use_previous_results &&
+        target_data) {
+      absl::optional<MaterializedQueryResults> results =
+          target_cache_->GetQueryResults(target_data->target_id());
+      absl::optional<model::DocumentMap> documents =
+          results ? query_engine_->GetDocumentsFromMaterializedResults(
+                        query, results.value())
+                  : absl::nullopt;
+      if (documents) {
+        return QueryResult(std::move(documents).value(),
+                           std::move(remote_keys));
+      }
+    }
+
+    absl::optional<QueryProfile> profile;
+    if (util::LogIsDebugEnabled()) {
+      profile = QueryProfile();
+    }
+
     model::DocumentMap documents = query_engine_->GetDocumentsMatchingQuery(
         query,
         use_previous_results ? last_limbo_free_snapshot_version
                              : SnapshotVersion::None(),
-        use_previous_results ? remote_keys : DocumentKeySet{});
-    return QueryResult(std::move(documents), std::move(remote_keys));
+        use_previous_results ? remote_keys : DocumentKeySet{},
+        profile ? &profile.value() : nullptr);
+    QueryResult result(std::move(documents), std::move(remote_keys));
+    if (profile) {
+      LOG_DEBUG("Executed query %s: %s", query.ToString(),
+                profile->ToString());
+      result.set_profile(std::move(profile).value());
+    }
+    return result;
+  });
+}
+
+model::ObjectValue LocalStore::ExecuteAggregateQuery(
+    const Query& query, const std::vector<model::AggregateField>& aggregates) {
+  return persistence_->Run("ExecuteAggregateQuery", [&] {
+    absl::optional<TargetData> target_data = GetTargetData(query.ToTarget());
+    SnapshotVersion last_limbo_free_snapshot_version;
+    DocumentKeySet remote_keys;
+
+    if (target_data) {
+      last_limbo_free_snapshot_version =
+          target_data->last_limbo_free_snapshot_version();
+      remote_keys = target_cache_->GetMatchingKeys(target_data->target_id());
+    }
+
+    return query_engine_->ComputeAggregates(
+        query, aggregates, last_limbo_free_snapshot_version, remote_keys);
+  });
+}
+
+QueryResult LocalStore::ExecuteQueryReadOnly(const Query& query) {
+  std::shared_lock<std::shared_timed_mutex> lock(user_components_mutex_);
+
+  return persistence_->RunReadOnly("ExecuteQueryReadOnly", [&] {
+    // All reads below observe the same snapshot, so the result reflects
+    // exactly the remote events applied up to this version.
+    SnapshotVersion snapshot_version =
+        target_cache_->ReadLastRemoteSnapshotVersion();
+
+    // Use the persisted target data rather than `target_data_by_target_`,
+    // which is owned by the worker queue. The persisted limbo-free version may
+    // be older than the in-memory one, which only means that more documents
+    // are re-read below.
+    absl::optional<TargetData> target_data =
+        target_cache_->GetTarget(query.ToTarget());
+    SnapshotVersion last_limbo_free_snapshot_version;
+    DocumentKeySet remote_keys;
+
+    if (target_data) {
+      last_limbo_free_snapshot_version =
+          target_data->last_limbo_free_snapshot_version();
+      remote_keys = target_cache_->GetMatchingKeys(target_data->target_id());
+    }
+
+    model::DocumentMap documents =
+        query_engine_->GetDocumentsMatchingQueryWithoutIndexes(
+            query, last_limbo_free_snapshot_version, remote_keys);
+    return QueryResult(std::move(documents), std::move(remote_keys),
+                       std::move(snapshot_version));
   });
 }
 
@@ -585,12 +708,40 @@ LruResults LocalStore::CollectGarbage(LruGarbageCollector* garbage_collector) {
   });
 }
 
+LruCheckpoint LocalStore::StartGarbageCollection(
+    LruGarbageCollector* garbage_collector) {
+  return persistence_->Run("Start garbage collection", [&] {
+    return garbage_collector->StartCollection();
+  });
+}
+
+void LocalStore::CollectGarbageSlice(LruGarbageCollector* garbage_collector,
+                                     LruCheckpoint* checkpoint) {
+  persistence_->Run("Collect garbage slice", [&] {
+    garbage_collector->CollectSlice(target_data_by_target_, checkpoint);
+  });
+}
+
 int LocalStore::Backfill() const {
   return persistence_->Run("Backfill Indexes", [&] {
     return index_backfiller_->WriteIndexEntries(this);
   });
 }
 
+bool LocalStore::BackfillSlice(std::chrono::milliseconds target_duration) {
+  index_backfiller_->SetTargetDuration(target_duration);
+  size_t max_documents = index_backfiller_->max_documents_to_process();
+  auto start = std::chrono::steady_clock::now();
+  size_t documents_processed = persistence_->Run("Backfill Indexes", [&] {
+    return index_backfiller_->WriteIndexEntries(this);
+  });
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  index_backfiller_->RecordThroughput(documents_processed, elapsed);
+  return documents_processed >= max_documents;
+}
+
 bool LocalStore::HasNewerBundle(const bundle::BundleMetadata& metadata) {
   return persistence_->Run("Has newer bundle", [&] {
     absl::optional<bundle::BundleMetadata> cached_metadata =
@@ -601,41 +752,89 @@ bool LocalStore::HasNewerBundle(const bundle::BundleMetadata& metadata) {
 }
 
 void LocalStore::SaveBundle(const bundle::BundleMetadata& metadata) {
-  return persistence_->Run(
-      "Save bundle", [&] { bundle_cache_->SaveBundleMetadata(metadata); });
+  return persistence_->Run("Save bundle", [&] {
+    bundle_cache_->SaveBundleMetadata(metadata);
+    bundle_cache_->RemoveBundleLoad(metadata.bundle_id());
+  });
 }
 
-DocumentMap LocalStore::ApplyBundledDocuments(
-    const MutableDocumentMap& bundled_documents, const std::string& bundle_id) {
+uint32_t LocalStore::StartBundleLoad(const bundle::BundleMetadata& metadata) {
   // Allocates a target to hold all document keys from the bundle, such that
   // they will not get garbage collected right away.
-  TargetData umbrella_target = AllocateTarget(NewUmbrellaTarget(bundle_id));
-  return persistence_->Run("Apply bundle documents", [&] {
-    DocumentKeySet keys;
-    DocumentUpdateMap document_updates;
-    DocumentVersionMap versions;
+  TargetData umbrella_target =
+      AllocateTarget(NewUmbrellaTarget(metadata.bundle_id()));
+  return persistence_->Run("Start bundle load", [&] {
+    absl::optional<uint32_t> documents_staged =
+        bundle_cache_->GetBundleLoadProgress(metadata);
+    if (documents_staged) {
+      return *documents_staged;
+    }
+
+    // Drops what an unfinished load of an older bundle with the same id left.
+    bundle_cache_->RemoveBundleLoad(metadata.bundle_id());
+    target_cache_->RemoveMatchingKeysForTarget(umbrella_target.target_id());
+    return 0u;
+  });
+}
 
+void LocalStore::StageBundledDocuments(
+    const MutableDocumentMap& bundled_documents,
+    const bundle::BundleMetadata& metadata,
+    uint32_t documents_staged) {
+  persistence_->Run("Stage bundle documents", [&] {
     for (const auto& kv : bundled_documents) {
-      const DocumentKey& key = kv.first;
-      const auto& doc = kv.second;
-      if (doc.is_found_document()) {
-        keys = keys.insert(key);
-      }
-      document_updates.emplace(key, doc);
-      versions.emplace(key, doc.version());
+      bundle_cache_->StageBundledDocument(metadata.bundle_id(), kv.second);
     }
+    bundle_cache_->SaveBundleLoadProgress(metadata, documents_staged);
+  });
+}
 
-    target_cache_->RemoveMatchingKeysForTarget(umbrella_target.target_id());
-    target_cache_->AddMatchingKeys(keys, umbrella_target.target_id());
+absl::optional<DocumentMap> LocalStore::ApplyStagedDocuments(
+    const bundle::BundleMetadata& metadata, uint32_t max_documents) {
+  TargetData umbrella_target =
+      AllocateTarget(NewUmbrellaTarget(metadata.bundle_id()));
+  return persistence_->Run(
+      "Apply bundle documents", [&]() -> absl::optional<DocumentMap> {
+        MutableDocumentMap documents = bundle_cache_->TakeStagedDocuments(
+            metadata.bundle_id(), max_documents);
+        if (documents.empty()) {
+          return absl::nullopt;
+        }
+        return AddBundledDocuments(documents, umbrella_target.target_id());
+      });
+}
 
-    auto result = PopulateDocumentChanges(document_updates, versions,
-                                          SnapshotVersion::None());
-    return local_documents_->GetLocalViewOfDocuments(
-        std::move(result.changed_docs),
-        std::move(result.existence_changed_keys));
+void LocalStore::AbortBundleLoad(const bundle::BundleMetadata& metadata) {
+  persistence_->Run("Abort bundle load", [&] {
+    bundle_cache_->RemoveBundleLoad(metadata.bundle_id());
   });
 }
 
+DocumentMap LocalStore::AddBundledDocuments(
+    const MutableDocumentMap& bundled_documents, TargetId umbrella_id) {
+  DocumentKeySet keys;
+  DocumentUpdateMap document_updates;
+  DocumentVersionMap versions;
+
+  for (const auto& kv : bundled_documents) {
+    const DocumentKey& key = kv.first;
+    const auto& doc = kv.second;
+    if (doc.is_found_document()) {
+      keys = keys.insert(key);
+    }
+    document_updates.emplace(key, doc);
+    versions.emplace(key, doc.version());
+  }
+
+  target_cache_->AddMatchingKeys(keys, umbrella_id);
+
+  auto result = PopulateDocumentChanges(document_updates, versions,
+                                        SnapshotVersion::None());
+  return local_documents_->GetLocalViewOfDocuments(
+      std::move(result.changed_docs),
+      std::move(result.existence_changed_keys));
+}
+
 void LocalStore::SaveNamedQuery(const bundle::NamedQuery& query,
                                 const model::DocumentKeySet& keys) {
   // Allocate a target for the named query such that it can be resumed from
@@ -703,6 +902,32 @@ void LocalStore::SetIndexAutoCreationEnabled(bool is_enabled) const {
   query_engine_->SetIndexAutoCreationEnabled(is_enabled);
 }
 
+void LocalStore::SetQueryResultMaterializationEnabled(bool is_enabled) {
+  query_result_materialization_enabled_ = is_enabled;
+}
+
+void LocalStore::MaterializeQueryResults(
+    TargetId target_id,
+    const SnapshotVersion& snapshot_version,
+    const model::DocumentSet& documents) {
+  if (snapshot_version == SnapshotVersion::None()) return;
+
+  std::vector<MaterializedQueryResults::Entry> entries;
+  entries.reserve(documents.size());
+  for (const Document& document : documents) {
+    if (document->has_local_mutations()) {
+      // Documents with pending writes can't be validated against the remote
+      // document cache, so the query is executed as usual.
+      target_cache_->RemoveQueryResults(target_id);
+      return;
+    }
+    entries.emplace_back(document->key(), document->version());
+  }
+  target_cache_->SetQueryResults(
+      target_id,
+      MaterializedQueryResults(snapshot_version, std::move(entries)));
+}
+
 void LocalStore::DeleteAllFieldIndexes() const {
   // This step is not wrapped in `persistence_->Run()`.
   // The reason is `persistence_->Run()` always assume each operation is
@@ -754,7 +979,9 @@ LocalStore::DocumentChangeResult LocalStore::PopulateDocumentChanges(
     if (doc.is_no_document() && doc.version() == SnapshotVersion::None()) {
       // NoDocuments with SnapshotVersion::None are used in manufactured
       // events. We remove these documents from cache since we lost access.
-      remote_document_cache_->Remove(key);
+      if (existing_doc.is_valid_document()) {
+        remote_document_cache_->Remove(key);
+      }
       changed_docs = changed_docs.insert(key, doc);
     } else if (!existing_doc.is_valid_document() ||
                doc.version() > existing_doc.version() ||
@@ -763,6 +990,7 @@ LocalStore::DocumentChangeResult LocalStore::PopulateDocumentChanges(
       HARD_ASSERT(read_time != SnapshotVersion::None(),
                   "Cannot add a document when the remote version is zero");
       remote_document_cache_->Add(doc, read_time);
+      query_engine_->statistics()->RecordDocumentChange(existing_doc, doc);
       changed_docs = changed_docs.insert(key, doc);
     } else {
       LOG_DEBUG(
@@ -17,7 +17,9 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LOCAL_STORE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LOCAL_STORE_H_
 
+#include <chrono>  // NOLINT(build/c++11)
 #include <memory>
+#include <shared_mutex>  // NOLINT(build/c++14)
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -46,6 +48,7 @@ class Query;
 }  // namespace core
 
 namespace model {
+class AggregateField;
 class FieldIndex;
 }  // namespace model
 
@@ -57,6 +60,7 @@ class TargetChange;
 namespace local {
 
 class BundleCache;
+class CollectionStatistics;
 class IndexManager;
 class LocalDocumentsView;
 class LocalViewChanges;
@@ -70,6 +74,7 @@ class RemoteDocumentCache;
 class TargetCache;
 class IndexBackfiller;
 
+struct LruCheckpoint;
 struct LruResults;
 
 /**
@@ -123,6 +128,13 @@ class LocalStore : public bundle::BundleCallback {
   /** Performs any initial startup actions required by the local store. */
   void Start();
 
+  /**
+   * Migrates the overlays of users other than the current one, if required.
+   * Unlike `Start`, this does not need to complete before the local store
+   * serves reads.
+   */
+  void CompleteOverlayMigration();
+
   /**
    * Tells the LocalStore that the currently authenticated user has changed.
    *
@@ -219,11 +231,33 @@ class LocalStore : public bundle::BundleCallback {
    * potentially taking advantage of target data from previous executions (such
    * as the set of remote keys).
    *
+   * While debug logging is enabled, the query is profiled, and its profile is
+   * logged and attached to the result.
+   *
    * @param use_previous_results Whether results from previous executions can be
    *     used to optimize this query execution.
    */
   QueryResult ExecuteQuery(const core::Query& query, bool use_previous_results);
 
+  /**
+   * Computes the given aggregations over the documents that match the
+   * specified query in the local store, including local mutations.
+   */
+  model::ObjectValue ExecuteAggregateQuery(
+      const core::Query& query,
+      const std::vector<model::AggregateField>& aggregates);
+
+  /**
+   * Runs the specified query in a read-only transaction and returns the results
+   * together with the last remote snapshot version they reflect.
+   *
+   * Unlike `ExecuteQuery`, this only reads persisted state: it does not use
+   * client-side indexes or target data that has not been written yet. If the
+   * persistence layer supports concurrent read-only transactions, it may be
+   * called from any thread, concurrently with the worker queue.
+   */
+  QueryResult ExecuteQueryReadOnly(const core::Query& query);
+
   /**
    * Notify the local store of the changed views to locally pin / unpin
    * documents.
@@ -250,12 +284,33 @@ class LocalStore : public bundle::BundleCallback {
 
   LruResults CollectGarbage(LruGarbageCollector* garbage_collector);
 
+  /**
+   * Begins a time-sliced garbage collection in its own transaction. The
+   * collection is finished by calling `CollectGarbageSlice` until the returned
+   * checkpoint is complete.
+   */
+  LruCheckpoint StartGarbageCollection(LruGarbageCollector* garbage_collector);
+
+  /**
+   * Runs the next slice of a time-sliced garbage collection in its own
+   * transaction.
+   */
+  void CollectGarbageSlice(LruGarbageCollector* garbage_collector,
+                           LruCheckpoint* checkpoint);
+
   /**
    * Runs a single backfill operation and returns the number of documents
    * processed.
    */
   int Backfill() const;
 
+  /**
+   * Runs a single backfill operation sized, based on the throughput of earlier
+   * ones, to take about `target_duration`. Returns true if documents may be
+   * left to index.
+   */
+  bool BackfillSlice(std::chrono::milliseconds target_duration);
+
   /**
    * Returns whether the given bundle has already been loaded and its create
    * time is newer or equal to the currently loading bundle.
@@ -265,16 +320,16 @@ class LocalStore : public bundle::BundleCallback {
   /** Saves the given `BundleMetadata` to local persistence. */
   void SaveBundle(const bundle::BundleMetadata& metadata) override;
 
-  /**
-   * Applies the documents from a bundle to the "ground-state" (remote)
-   * documents.
-   *
-   * Local documents are re-calculated if there are remaining mutations in the
-   * queue.
-   */
-  model::DocumentMap ApplyBundledDocuments(
-      const model::MutableDocumentMap& documents,
-      const std::string& bundle_id) override;
+  uint32_t StartBundleLoad(const bundle::BundleMetadata& metadata) override;
+
+  void StageBundledDocuments(const model::MutableDocumentMap& documents,
+                             const bundle::BundleMetadata& metadata,
+                             uint32_t documents_staged) override;
+
+  absl::optional<model::DocumentMap> ApplyStagedDocuments(
+      const bundle::BundleMetadata& metadata, uint32_t max_documents) override;
+
+  void AbortBundleLoad(const bundle::BundleMetadata& metadata) override;
 
   /** Saves the given `NamedQuery` to local persistence. */
   void SaveNamedQuery(const bundle::NamedQuery& query,
@@ -290,6 +345,14 @@ class LocalStore : public bundle::BundleCallback {
 
   void SetIndexAutoCreationEnabled(bool is_enabled) const;
 
+  /**
+   * Enables materializing the results of each target when its view is in
+   * sync with the backend. `ExecuteQuery` then returns the materialized
+   * results of a target as long as none of its documents changed, which
+   * avoids filtering and sorting the collection after a restart.
+   */
+  void SetQueryResultMaterializationEnabled(bool is_enabled);
+
   void DeleteAllFieldIndexes() const;
 
  private:
@@ -306,6 +369,8 @@ class LocalStore : public bundle::BundleCallback {
     return local_documents_.get();
   }
 
+  CollectionStatistics* statistics() const;
+
   // For testing
   IndexBackfiller* index_backfiller() const {
     return index_backfiller_.get();
@@ -343,6 +408,14 @@ class LocalStore : public bundle::BundleCallback {
    */
   absl::optional<TargetData> GetTargetData(const core::Target& target);
 
+  /**
+   * Stores `documents`, which were in sync with the backend as of
+   * `snapshot_version`, as the materialized results of the given target.
+   */
+  void MaterializeQueryResults(model::TargetId target_id,
+                               const model::SnapshotVersion& snapshot_version,
+                               const model::DocumentSet& documents);
+
   /**
    * Creates a new target using the given bundle name, which will be used to
    * hold the keys of all documents from the bundle in query-document mappings.
@@ -351,6 +424,13 @@ class LocalStore : public bundle::BundleCallback {
    */
   static core::Target NewUmbrellaTarget(const std::string& bundle_id);
 
+  /**
+   * Adds the documents from a bundle to the remote documents and to the
+   * bundle's umbrella target. Must be called in a transaction.
+   */
+  model::DocumentMap AddBundledDocuments(
+      const model::MutableDocumentMap& documents, model::TargetId umbrella_id);
+
   /**
    * Populates the remote document cache with documents from backend or a
    * bundle. Returns the document changes resulting from applying those
@@ -406,6 +486,9 @@ class LocalStore : public bundle::BundleCallback {
    */
   QueryEngine* query_engine_ = nullptr;
 
+  /** Whether the results of targets are materialized in the TargetCache. */
+  bool query_result_materialization_enabled_ = false;
+
   /**
    * Manages indexes and support indexed queries.
    */
@@ -435,6 +518,12 @@ class LocalStore : public bundle::BundleCallback {
 
   /** Maps a target to its targetID. */
   std::unordered_map<core::Target, model::TargetId> target_id_by_target_;
+
+  /**
+   * Held exclusively while HandleUserChange swaps the user-specific components
+   * above, and shared by read-only queries that may run on other threads.
+   */
+  std::shared_timed_mutex user_components_mutex_;
 };
 
 }  // namespace local
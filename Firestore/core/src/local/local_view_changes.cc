@@ -49,7 +49,8 @@ LocalViewChanges LocalViewChanges::FromViewSnapshot(
   }
 
   return LocalViewChanges(target_id, snapshot.from_cache(),
-                          std::move(added_keys), std::move(removed_keys));
+                          std::move(added_keys), std::move(removed_keys),
+                          snapshot.documents());
 }
 
 }  // namespace local
@@ -21,7 +21,9 @@
 
 #include "Firestore/core/src/core/core_fwd.h"
 #include "Firestore/core/src/model/document_key_set.h"
+#include "Firestore/core/src/model/document_set.h"
 #include "Firestore/core/src/model/types.h"
+#include "absl/types/optional.h"
 
 namespace firebase {
 namespace firestore {
@@ -42,11 +44,13 @@ class LocalViewChanges {
   LocalViewChanges(model::TargetId target_id,
                    bool from_cache,
                    model::DocumentKeySet added_keys,
-                   model::DocumentKeySet removed_keys)
+                   model::DocumentKeySet removed_keys,
+                   absl::optional<model::DocumentSet> documents = absl::nullopt)
       : target_id_(target_id),
         from_cache_(from_cache),
         added_keys_(std::move(added_keys)),
-        removed_keys_(std::move(removed_keys)) {
+        removed_keys_(std::move(removed_keys)),
+        documents_(std::move(documents)) {
   }
 
   /** The batch ID of the local write. */
@@ -67,11 +71,20 @@ class LocalViewChanges {
     return removed_keys_;
   }
 
+  /**
+   * The documents in the view after the changes, sorted by the query, if
+   * known.
+   */
+  const absl::optional<model::DocumentSet>& documents() const {
+    return documents_;
+  }
+
  private:
   model::TargetId target_id_ = 0;
   bool from_cache_ = false;
   model::DocumentKeySet added_keys_;
   model::DocumentKeySet removed_keys_;
+  absl::optional<model::DocumentSet> documents_;
 };
 
 }  // namespace local
@@ -25,6 +25,7 @@
 #include "Firestore/core/src/api/settings.h"
 #include "Firestore/core/src/local/target_data.h"
 #include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/util/hard_assert.h"
 #include "Firestore/core/src/util/log.h"
 #include "Firestore/core/src/util/statusor.h"
 
@@ -114,10 +115,10 @@ StatusOr<int64_t> LruGarbageCollector::CalculateByteSize() const {
   return delegate_->CalculateByteSize();
 }
 
-LruResults LruGarbageCollector::Collect(const LiveQueryMap& live_targets) {
+bool LruGarbageCollector::ShouldCollect() {
   if (params_.min_bytes_threshold == Settings::CacheSizeUnlimited) {
     LOG_DEBUG("Garbage collection skipped; disabled");
-    return LruResults::DidNotRun();
+    return false;
   }
 
   StatusOr<int64_t> maybe_current_size = CalculateByteSize();
@@ -126,7 +127,7 @@ LruResults LruGarbageCollector::Collect(const LiveQueryMap& live_targets) {
         "Garbage collection skipped; failed to estimate the size of the "
         "cache: %s",
         maybe_current_size.status().ToString());
-    return LruResults::DidNotRun();
+    return false;
   }
 
   int64_t current_size = maybe_current_size.ValueOrDie();
@@ -135,13 +136,77 @@ LruResults LruGarbageCollector::Collect(const LiveQueryMap& live_targets) {
     LOG_DEBUG(
         "Garbage collection skipped; Cache size %s is lower than threshold %s",
         current_size, params_.min_bytes_threshold);
-    return LruResults::DidNotRun();
+    return false;
   }
 
   LOG_DEBUG("Running garbage collection on cache of size: %s", current_size);
+  return true;
+}
+
+LruResults LruGarbageCollector::Collect(const LiveQueryMap& live_targets) {
+  if (!ShouldCollect()) {
+    return LruResults::DidNotRun();
+  }
   return RunGarbageCollection(live_targets);
 }
 
+LruCheckpoint LruGarbageCollector::StartCollection() {
+  LruCheckpoint checkpoint;
+  if (!ShouldCollect()) {
+    checkpoint.complete = true;
+    return checkpoint;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  int sequence_numbers = QueryCountForPercentile(params_.percentile_to_collect);
+  if (sequence_numbers > params_.maximum_sequence_numbers_to_collect) {
+    sequence_numbers = params_.maximum_sequence_numbers_to_collect;
+  }
+
+  checkpoint.upper_bound = SequenceNumberForQueryCount(sequence_numbers);
+  // With no sequence numbers to collect, the upper bound is invalid and
+  // there are no targets or documents to remove.
+  checkpoint.complete = sequence_numbers == 0;
+  checkpoint.results = LruResults{/* did_run= */ true, sequence_numbers, 0, 0};
+  checkpoint.results.slice_durations.push_back(
+      std::chrono::duration_cast<Millis>(std::chrono::steady_clock::now() -
+                                         start));
+  return checkpoint;
+}
+
+void LruGarbageCollector::CollectSlice(const LiveQueryMap& live_targets,
+                                       LruCheckpoint* checkpoint) {
+  HARD_ASSERT(!checkpoint->complete, "Garbage collection already complete");
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + params_.slice_duration;
+  LruResults& results = checkpoint->results;
+  if (!checkpoint->targets_complete) {
+    // Targets are removed first so that the documents they referenced are
+    // orphaned by the time the documents are visited.
+    results.targets_removed += delegate_->RemoveTargets(
+        checkpoint, live_targets, params_.documents_per_slice, deadline);
+  } else {
+    results.documents_removed += delegate_->RemoveOrphanedDocuments(
+        checkpoint, params_.documents_per_slice, deadline);
+  }
+  results.slice_durations.push_back(std::chrono::duration_cast<Millis>(
+      std::chrono::steady_clock::now() - start));
+
+  if (checkpoint->complete) {
+    Millis total{0};
+    for (Millis duration : results.slice_durations) {
+      total += duration;
+    }
+    LOG_DEBUG(
+        "LRU Garbage Collection: removed %s targets and %s documents in %s "
+        "slices, %sms total",
+        results.targets_removed, results.documents_removed,
+        results.slice_durations.size(), total.count());
+  }
+}
+
 LruResults LruGarbageCollector::RunGarbageCollection(
     const LiveQueryMap& live_targets) {
   Timestamp start = Timestamp::Now();
@@ -180,8 +245,11 @@ LruResults LruGarbageCollector::RunGarbageCollection(
                   MillisecondsBetween(start, removed_documents), "ms");
   LOG_DEBUG(desc.c_str());
 
-  return LruResults{/* did_run= */ true, sequence_numbers, num_targets_removed,
-                    num_documents_removed};
+  return LruResults{/* did_run= */ true,
+                    sequence_numbers,
+                    num_targets_removed,
+                    num_documents_removed,
+                    {Millis(MillisecondsBetween(start, removed_documents))}};
 }
 
 int LruGarbageCollector::QueryCountForPercentile(int percentile) {
@@ -202,9 +270,17 @@ ListenSequenceNumber LruGarbageCollector::SequenceNumberForQueryCount(
         buffer.AddElement(sequence_number);
       });
 
-  delegate_->EnumerateOrphanedDocuments(
-      [&buffer](const DocumentKey&, ListenSequenceNumber sequence_number) {
+  // Orphaned documents are visited least recently used first, so once the
+  // buffer is full, no later document can displace any of its elements.
+  auto buffer_size = static_cast<size_t>(query_count);
+  delegate_->EnumerateOrphanedDocumentsInOrder(
+      [&](const DocumentKey&, ListenSequenceNumber sequence_number) {
+        if (buffer.size() == buffer_size &&
+            sequence_number >= buffer.max_value()) {
+          return false;
+        }
         buffer.AddElement(sequence_number);
+        return true;
       });
 
   return buffer.max_value();
@@ -17,13 +17,18 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_LRU_GARBAGE_COLLECTOR_H_
 #define FIRESTORE_CORE_SRC_LOCAL_LRU_GARBAGE_COLLECTOR_H_
 
+#include <chrono>  // NOLINT(build/c++11)
+#include <functional>
 #include <unordered_map>
+#include <vector>
 
 #include "Firestore/core/src/local/reference_delegate.h"
 #include "Firestore/core/src/local/target_cache.h"
 #include "Firestore/core/src/local/target_data.h"
+#include "Firestore/core/src/model/document_key.h"
 #include "Firestore/core/src/model/types.h"
 #include "Firestore/core/src/util/status_fwd.h"
+#include "absl/types/optional.h"
 
 namespace firebase {
 namespace firestore {
@@ -45,6 +50,19 @@ struct LruParams {
   int64_t min_bytes_threshold;
   int percentile_to_collect;
   int maximum_sequence_numbers_to_collect;
+
+  /**
+   * The maximum number of orphaned documents visited, or target document keys
+   * removed, by one slice of a time-sliced collection. See
+   * `LruGarbageCollector::CollectSlice`.
+   */
+  int documents_per_slice = 1000;
+
+  /**
+   * The time after which a slice of a time-sliced collection stops removing
+   * targets or visiting orphaned documents.
+   */
+  std::chrono::milliseconds slice_duration{20};
 };
 
 struct LruResults {
@@ -56,10 +74,54 @@ struct LruResults {
   int sequence_numbers_collected;
   int targets_removed;
   int documents_removed;
+
+  /**
+   * The duration of each transaction of the collection. A collection run by
+   * `Collect` has a single slice.
+   */
+  std::vector<std::chrono::milliseconds> slice_durations;
+};
+
+/**
+ * The progress of a time-sliced garbage collection, which removes targets and
+ * then orphaned documents across several transactions so that no single
+ * transaction blocks the worker queue for long.
+ */
+struct LruCheckpoint {
+  /** True once there is nothing left to collect. */
+  bool complete = false;
+
+  /** Targets and documents up to this sequence number are collected. */
+  model::ListenSequenceNumber upper_bound = 0;
+
+  /**
+   * True once every target up to `upper_bound` has been removed. Until then,
+   * slices remove targets in ascending order of target ID, resuming with
+   * `next_target_id`.
+   */
+  bool targets_complete = false;
+  model::TargetId next_target_id = 0;
+
+  /**
+   * The sequence number and key of the last orphaned document visited, if
+   * any. The next slice resumes with the document that follows it in order.
+   */
+  model::ListenSequenceNumber last_sequence_number = 0;
+  absl::optional<model::DocumentKey> last_document_key;
+
+  /** The results accumulated by the slices run so far. */
+  LruResults results = LruResults::DidNotRun();
 };
 
 using LiveQueryMap = std::unordered_map<model::TargetId, TargetData>;
 
+/**
+ * A callback for enumerating orphaned documents in order. Returns false to
+ * stop the enumeration.
+ */
+using OrderedOrphanedDocumentCallback =
+    std::function<bool(const model::DocumentKey&, model::ListenSequenceNumber)>;
+
 /**
  * Persistence layers intending to use LRU Garbage collection should implement
  * this interface. This interface defines the operations that the LRU garbage
@@ -90,6 +152,14 @@ class LruDelegate : public ReferenceDelegate {
   virtual void EnumerateOrphanedDocuments(
       const OrphanedDocumentCallback& callback) = 0;
 
+  /**
+   * Enumerates the same documents as `EnumerateOrphanedDocuments`, in
+   * ascending order of sequence number, stopping once `callback` returns
+   * false.
+   */
+  virtual void EnumerateOrphanedDocumentsInOrder(
+      const OrderedOrphanedDocumentCallback& callback) = 0;
+
   /**
    * Removes all unreferenced documents from the cache that have a sequence
    * number less than or equal to the given sequence number. Returns the number
@@ -98,6 +168,19 @@ class LruDelegate : public ReferenceDelegate {
   virtual int RemoveOrphanedDocuments(
       model::ListenSequenceNumber sequence_number) = 0;
 
+  /**
+   * Removes unreferenced documents as `RemoveOrphanedDocuments` does with
+   * `checkpoint->upper_bound`, in ascending order of sequence number, starting
+   * after the last document visited by the previous slice. Stops after
+   * visiting `max_documents` documents or once `deadline` has passed, and
+   * records its position in `checkpoint`, marking it complete once there is
+   * nothing left to visit. Returns the number of documents removed.
+   */
+  virtual int RemoveOrphanedDocuments(
+      LruCheckpoint* checkpoint,
+      int max_documents,
+      std::chrono::steady_clock::time_point deadline) = 0;
+
   /**
    * Removes all targets that are not currently being listened to and have a
    * sequence number less than or equal to the given sequence number. Returns
@@ -105,6 +188,18 @@ class LruDelegate : public ReferenceDelegate {
    */
   virtual int RemoveTargets(model::ListenSequenceNumber sequence_number,
                             const LiveQueryMap& live_queries) = 0;
+
+  /**
+   * Removes targets as `RemoveTargets` does with `checkpoint->upper_bound`,
+   * starting with `checkpoint->next_target_id`. Stops after removing
+   * `max_documents` document keys or once `deadline` has passed, and records
+   * its position in `checkpoint`, setting `targets_complete` once every target
+   * has been visited. Returns the number of targets removed.
+   */
+  virtual int RemoveTargets(LruCheckpoint* checkpoint,
+                            const LiveQueryMap& live_queries,
+                            int max_documents,
+                            std::chrono::steady_clock::time_point deadline) = 0;
 };
 
 /**
@@ -147,6 +242,22 @@ class LruGarbageCollector {
 
   local::LruResults Collect(const LiveQueryMap& live_targets);
 
+  /**
+   * Begins a time-sliced collection: determines whether to collect and the
+   * sequence number cutoff. The targets and then the orphaned documents are
+   * removed by calling `CollectSlice` until the returned checkpoint is
+   * complete, each call in its own transaction.
+   */
+  LruCheckpoint StartCollection();
+
+  /**
+   * Removes a bounded number of targets that are not in `live_targets` or, once
+   * there are none left, orphaned documents, as limited by
+   * `documents_per_slice` and `slice_duration`, and advances `checkpoint`.
+   */
+  void CollectSlice(const LiveQueryMap& live_targets,
+                    LruCheckpoint* checkpoint);
+
   /**
    * Visible for testing only!
    */
@@ -155,6 +266,9 @@ class LruGarbageCollector {
   }
 
  private:
+  /** Returns true if the cache is large enough to be collected. */
+  bool ShouldCollect();
+
   LruResults RunGarbageCollection(const LiveQueryMap& live_targets);
 
   // Delegate owns the LruGarbageCollector; this is a back pointer.
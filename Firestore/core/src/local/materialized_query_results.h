@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIRESTORE_CORE_SRC_LOCAL_MATERIALIZED_QUERY_RESULTS_H_
+#define FIRESTORE_CORE_SRC_LOCAL_MATERIALIZED_QUERY_RESULTS_H_
+
+#include <utility>
+#include <vector>
+
+#include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/model/snapshot_version.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+
+/**
+ * The results of a target's query as they were last shown to the user in a
+ * view that was in sync with the backend: the keys of the matching documents
+ * in query order, each with the version of the document that matched.
+ */
+class MaterializedQueryResults {
+ public:
+  using Entry = std::pair<model::DocumentKey, model::SnapshotVersion>;
+
+  MaterializedQueryResults() = default;
+
+  MaterializedQueryResults(model::SnapshotVersion snapshot_version,
+                           std::vector<Entry> documents)
+      : snapshot_version_{std::move(snapshot_version)},
+        documents_{std::move(documents)} {
+  }
+
+  /** The remote snapshot version that the results are consistent with. */
+  const model::SnapshotVersion& snapshot_version() const {
+    return snapshot_version_;
+  }
+
+  /** The matching documents, sorted by the query's comparator. */
+  const std::vector<Entry>& documents() const {
+    return documents_;
+  }
+
+  friend bool operator==(const MaterializedQueryResults& lhs,
+                         const MaterializedQueryResults& rhs) {
+    return lhs.snapshot_version_ == rhs.snapshot_version_ &&
+           lhs.documents_ == rhs.documents_;
+  }
+
+  friend bool operator!=(const MaterializedQueryResults& lhs,
+                         const MaterializedQueryResults& rhs) {
+    return !(lhs == rhs);
+  }
+
+ private:
+  model::SnapshotVersion snapshot_version_;
+  std::vector<Entry> documents_;
+};
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
+
+#endif  // FIRESTORE_CORE_SRC_LOCAL_MATERIALIZED_QUERY_RESULTS_H_
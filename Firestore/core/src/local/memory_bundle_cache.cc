@@ -24,6 +24,8 @@ namespace local {
 
 using bundle::BundleMetadata;
 using bundle::NamedQuery;
+using model::MutableDocument;
+using model::MutableDocumentMap;
 
 absl::optional<BundleMetadata> MemoryBundleCache::GetBundleMetadata(
     const std::string& bundle_id) const {
@@ -51,6 +53,53 @@ void MemoryBundleCache::SaveNamedQuery(const NamedQuery& query) {
   named_queries_[query.query_name()] = query;
 }
 
+absl::optional<uint32_t> MemoryBundleCache::GetBundleLoadProgress(
+    const BundleMetadata& metadata) const {
+  auto got = bundle_loads_.find(metadata.bundle_id());
+  if (got == bundle_loads_.end() ||
+      got->second.first != metadata.create_time()) {
+    return absl::nullopt;
+  }
+  return got->second.second;
+}
+
+void MemoryBundleCache::SaveBundleLoadProgress(const BundleMetadata& metadata,
+                                               uint32_t documents_staged) {
+  bundle_loads_[metadata.bundle_id()] = {metadata.create_time(),
+                                         documents_staged};
+}
+
+void MemoryBundleCache::StageBundledDocument(const std::string& bundle_id,
+                                             const MutableDocument& document) {
+  MutableDocumentMap& documents = staged_documents_[bundle_id];
+  documents = documents.insert(document.key(), document);
+}
+
+MutableDocumentMap MemoryBundleCache::TakeStagedDocuments(
+    const std::string& bundle_id, size_t count) {
+  MutableDocumentMap result;
+  auto got = staged_documents_.find(bundle_id);
+  if (got == staged_documents_.end()) {
+    return result;
+  }
+
+  MutableDocumentMap& documents = got->second;
+  while (result.size() < count && !documents.empty()) {
+    MutableDocument document = documents.begin()->second;
+    documents = documents.erase(document.key());
+    result = result.insert(document.key(), document);
+  }
+  if (documents.empty()) {
+    staged_documents_.erase(got);
+  }
+  return result;
+}
+
+void MemoryBundleCache::RemoveBundleLoad(const std::string& bundle_id) {
+  bundle_loads_.erase(bundle_id);
+  staged_documents_.erase(bundle_id);
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
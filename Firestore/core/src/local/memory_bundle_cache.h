@@ -17,12 +17,19 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_MEMORY_BUNDLE_CACHE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_MEMORY_BUNDLE_CACHE_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
 #include "Firestore/core/src/bundle/bundle_metadata.h"
 #include "Firestore/core/src/bundle/named_query.h"
+#include "Firestore/core/src/immutable/sorted_map.h"
 #include "Firestore/core/src/local/bundle_cache.h"
+#include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/model/model_fwd.h"
+#include "Firestore/core/src/model/mutable_document.h"
 #include "absl/types/optional.h"
 
 namespace firebase {
@@ -41,9 +48,28 @@ class MemoryBundleCache : public BundleCache {
 
   void SaveNamedQuery(const bundle::NamedQuery& query) override;
 
+  absl::optional<uint32_t> GetBundleLoadProgress(
+      const bundle::BundleMetadata& metadata) const override;
+
+  void SaveBundleLoadProgress(const bundle::BundleMetadata& metadata,
+                              uint32_t documents_staged) override;
+
+  void StageBundledDocument(const std::string& bundle_id,
+                            const model::MutableDocument& document) override;
+
+  model::MutableDocumentMap TakeStagedDocuments(const std::string& bundle_id,
+                                                size_t count) override;
+
+  void RemoveBundleLoad(const std::string& bundle_id) override;
+
  private:
   std::unordered_map<std::string, bundle::BundleMetadata> bundles_;
   std::unordered_map<std::string, bundle::NamedQuery> named_queries_;
+  // The create time and progress of unfinished loads, by bundle id.
+  std::unordered_map<std::string, std::pair<model::SnapshotVersion, uint32_t>>
+      bundle_loads_;
+  // The documents staged by unfinished loads, by bundle id.
+  std::unordered_map<std::string, model::MutableDocumentMap> staged_documents_;
 };
 
 }  // namespace local
@@ -113,6 +113,12 @@ MemoryIndexManager::GetDocumentsMatchingTarget(const core::Target&) {
   return absl::nullopt;
 }
 
+absl::optional<std::vector<model::DocumentKey>>
+MemoryIndexManager::GetDocumentsMatchingTarget(const core::Target&,
+                                               absl::optional<QueryContext>&) {
+  return absl::nullopt;
+}
+
 absl::optional<std::string> MemoryIndexManager::GetNextCollectionGroupToUpdate()
     const {
   return absl::nullopt;
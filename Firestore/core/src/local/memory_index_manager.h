@@ -80,6 +80,9 @@ class MemoryIndexManager : public IndexManager {
   absl::optional<std::vector<model::DocumentKey>> GetDocumentsMatchingTarget(
       const core::Target&) override;
 
+  absl::optional<std::vector<model::DocumentKey>> GetDocumentsMatchingTarget(
+      const core::Target&, absl::optional<QueryContext>&) override;
+
   absl::optional<std::string> GetNextCollectionGroupToUpdate() const override;
 
   void UpdateCollectionGroup(const std::string&, model::IndexOffset) override;
@@ -16,6 +16,8 @@
 
 #include "Firestore/core/src/local/memory_lru_reference_delegate.h"
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 #include "Firestore/core/src/local/listen_sequence.h"
@@ -104,6 +106,22 @@ void MemoryLruReferenceDelegate::EnumerateOrphanedDocuments(
   }
 }
 
+void MemoryLruReferenceDelegate::EnumerateOrphanedDocumentsInOrder(
+    const OrderedOrphanedDocumentCallback& callback) {
+  std::vector<std::pair<ListenSequenceNumber, DocumentKey>> orphaned;
+  EnumerateOrphanedDocuments(
+      [&](const DocumentKey& key, ListenSequenceNumber sequence_number) {
+        orphaned.emplace_back(sequence_number, key);
+      });
+  std::sort(orphaned.begin(), orphaned.end());
+
+  for (const auto& entry : orphaned) {
+    if (!callback(entry.second, entry.first)) {
+      break;
+    }
+  }
+}
+
 size_t MemoryLruReferenceDelegate::GetSequenceNumberCount() {
   size_t total_count = persistence_->target_cache()->size();
   EnumerateOrphanedDocuments(
@@ -120,6 +138,16 @@ int MemoryLruReferenceDelegate::RemoveTargets(
       sequence_number, live_queries));
 }
 
+int MemoryLruReferenceDelegate::RemoveTargets(
+    LruCheckpoint* checkpoint,
+    const LiveQueryMap& live_queries,
+    int /* max_documents */,
+    std::chrono::steady_clock::time_point /* deadline */) {
+  // As with documents, removing targets from memory is cheap.
+  checkpoint->targets_complete = true;
+  return RemoveTargets(checkpoint->upper_bound, live_queries);
+}
+
 int MemoryLruReferenceDelegate::RemoveOrphanedDocuments(
     model::ListenSequenceNumber upper_bound) {
   std::vector<DocumentKey> removed =
@@ -131,6 +159,16 @@ int MemoryLruReferenceDelegate::RemoveOrphanedDocuments(
   return static_cast<int>(removed.size());
 }
 
+int MemoryLruReferenceDelegate::RemoveOrphanedDocuments(
+    LruCheckpoint* checkpoint,
+    int /* max_documents */,
+    std::chrono::steady_clock::time_point /* deadline */) {
+  // Removing documents from memory is cheap, so there is no need to spread the
+  // work across several transactions.
+  checkpoint->complete = true;
+  return RemoveOrphanedDocuments(checkpoint->upper_bound);
+}
+
 void MemoryLruReferenceDelegate::AddReference(const DocumentKey& key) {
   sequence_numbers_[key] = current_sequence_number_;
 }
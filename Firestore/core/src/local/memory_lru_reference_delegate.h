@@ -17,6 +17,7 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_MEMORY_LRU_REFERENCE_DELEGATE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_MEMORY_LRU_REFERENCE_DELEGATE_H_
 
+#include <chrono>  // NOLINT(build/c++11)
 #include <memory>
 #include <unordered_map>
 #include <utility>
@@ -73,10 +74,23 @@ class MemoryLruReferenceDelegate : public LruDelegate {
   void EnumerateOrphanedDocuments(
       const OrphanedDocumentCallback& callback) override;
 
+  void EnumerateOrphanedDocumentsInOrder(
+      const OrderedOrphanedDocumentCallback& callback) override;
+
   int RemoveOrphanedDocuments(model::ListenSequenceNumber upper_bound) override;
+
+  int RemoveOrphanedDocuments(
+      LruCheckpoint* checkpoint,
+      int max_documents,
+      std::chrono::steady_clock::time_point deadline) override;
   int RemoveTargets(model::ListenSequenceNumber sequence_number,
                     const LiveQueryMap& live_queries) override;
 
+  int RemoveTargets(LruCheckpoint* checkpoint,
+                    const LiveQueryMap& live_queries,
+                    int max_documents,
+                    std::chrono::steady_clock::time_point deadline) override;
+
  private:
   bool MutationQueuesContainKey(const model::DocumentKey& key) const;
 
@@ -152,6 +152,18 @@ void MemoryPersistence::RunInternal(absl::string_view label,
   block();
 }
 
+bool MemoryPersistence::SupportsConcurrentReadOnlyTransactions() const {
+  // The in-memory caches are not safe for concurrent access.
+  return false;
+}
+
+void MemoryPersistence::RunReadOnlyInternal(absl::string_view,
+                                            std::function<void()> block) {
+  // Reads are never interleaved with writes because all transactions run on
+  // the same thread, so the current state is already a consistent snapshot.
+  block();
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
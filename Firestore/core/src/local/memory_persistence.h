@@ -107,10 +107,15 @@ class MemoryPersistence : public Persistence {
 
   void ReleaseOtherUserSpecificComponents(const std::string& uid) override;
 
+  bool SupportsConcurrentReadOnlyTransactions() const override;
+
  protected:
   void RunInternal(absl::string_view label,
                    std::function<void()> block) override;
 
+  void RunReadOnlyInternal(absl::string_view label,
+                           std::function<void()> block) override;
+
  private:
   MemoryPersistence();
 
@@ -17,6 +17,7 @@
 #include "Firestore/core/src/local/memory_remote_document_cache.h"
 
 #include "Firestore/core/src/core/query.h"
+#include "Firestore/core/src/local/collection_statistics.h"
 #include "Firestore/core/src/local/memory_lru_reference_delegate.h"
 #include "Firestore/core/src/local/memory_persistence.h"
 #include "Firestore/core/src/local/query_context.h"
@@ -36,6 +37,7 @@ using model::DocumentKeySet;
 using model::ListenSequenceNumber;
 using model::MutableDocument;
 using model::MutableDocumentMap;
+using model::ResourcePath;
 using model::SnapshotVersion;
 
 MemoryRemoteDocumentCache::MemoryRemoteDocumentCache(
@@ -54,6 +56,9 @@ void MemoryRemoteDocumentCache::Add(const MutableDocument& document,
 }
 
 void MemoryRemoteDocumentCache::Remove(const DocumentKey& key) {
+  if (statistics_ && docs_.get(key)) {
+    statistics_->RecordDocumentRemoved(key);
+  }
   docs_ = docs_.erase(key);
 }
 
@@ -76,6 +81,28 @@ MutableDocumentMap MemoryRemoteDocumentCache::GetAll(
   return results;
 }
 
+size_t MemoryRemoteDocumentCache::CountEntries(
+    const DocumentKeySet& keys) const {
+  size_t count = 0;
+  for (const DocumentKey& key : keys) {
+    if (docs_.get(key)) ++count;
+  }
+  return count;
+}
+
+size_t MemoryRemoteDocumentCache::CountDocuments(
+    const ResourcePath& collection_path) const {
+  size_t count = 0;
+  size_t immediate_children_path_length = collection_path.size() + 1;
+  for (auto it = docs_.lower_bound(DocumentKey{collection_path.Append("")});
+       it != docs_.end() && collection_path.IsPrefixOf(it->first.path());
+       ++it) {
+    // Exclude entries from subcollections.
+    if (it->first.path().size() == immediate_children_path_length) ++count;
+  }
+  return count;
+}
+
 // This method should only be called from the IndexBackfiller if LevelDB is
 // enabled.
 MutableDocumentMap MemoryRemoteDocumentCache::GetAll(const std::string&,
@@ -85,6 +112,32 @@ MutableDocumentMap MemoryRemoteDocumentCache::GetAll(const std::string&,
       "getAll(String, IndexOffset, int) is not supported.");
 }
 
+void MemoryRemoteDocumentCache::ForEachDocumentMatchingQuery(
+    const core::Query& query,
+    const model::OverlayByDocumentKeyMap& mutated_docs,
+    const std::function<void(MutableDocument&&)>& callback) const {
+  auto path = query.path();
+  DocumentKey prefix{path.Append("")};
+  size_t immediate_children_path_length = path.size() + 1;
+  for (auto it = docs_.lower_bound(prefix); it != docs_.end(); ++it) {
+    const DocumentKey& key = it->first;
+    if (!path.IsPrefixOf(key.path())) {
+      break;
+    }
+    if (key.path().size() > immediate_children_path_length) {
+      // Exclude entries from subcollections.
+      continue;
+    }
+
+    const MutableDocument& document = it->second;
+    if (mutated_docs.find(key) == mutated_docs.end() &&
+        !query.Matches(document)) {
+      continue;
+    }
+    callback(document.Clone());
+  }
+}
+
 MutableDocumentMap MemoryRemoteDocumentCache::GetDocumentsMatchingQuery(
     const core::Query& query,
     const model::IndexOffset& offset,
@@ -97,10 +150,11 @@ MutableDocumentMap MemoryRemoteDocumentCache::GetDocumentsMatchingQuery(
 MutableDocumentMap MemoryRemoteDocumentCache::GetDocumentsMatchingQuery(
     const core::Query& query,
     const model::IndexOffset& offset,
-    absl::optional<QueryContext>&,
+    absl::optional<QueryContext>& context,
     absl::optional<size_t>,
     const model::OverlayByDocumentKeyMap& mutated_docs) const {
   MutableDocumentMap results;
+  size_t documents_read = 0;
 
   // Documents are ordered by key, so we can use a prefix scan to narrow down
   // the documents we need to match the query against.
@@ -117,6 +171,7 @@ MutableDocumentMap MemoryRemoteDocumentCache::GetDocumentsMatchingQuery(
       // Exclude entries from subcollections.
       continue;
     }
+    ++documents_read;
 
     if (model::IndexOffset::FromDocument(document).CompareTo(offset) !=
         util::ComparisonResult::Descending) {
@@ -133,6 +188,10 @@ MutableDocumentMap MemoryRemoteDocumentCache::GetDocumentsMatchingQuery(
     // data.
     results = results.insert(key, document.Clone());
   }
+
+  if (context.has_value()) {
+    context.value().IncrementDocumentReadCount(documents_read);
+  }
   return results;
 }
 
@@ -146,6 +205,7 @@ std::vector<DocumentKey> MemoryRemoteDocumentCache::RemoveOrphanedDocuments(
     if (!reference_delegate->IsPinnedAtSequenceNumber(upper_bound, key)) {
       updated_docs = updated_docs.erase(key);
       removed.push_back(key);
+      if (statistics_) statistics_->RecordDocumentRemoved(key);
     }
   }
   docs_ = updated_docs;
@@ -165,6 +225,11 @@ void MemoryRemoteDocumentCache::SetIndexManager(IndexManager* manager) {
   index_manager_ = NOT_NULL(manager);
 }
 
+void MemoryRemoteDocumentCache::SetCollectionStatistics(
+    CollectionStatistics* statistics) {
+  statistics_ = NOT_NULL(statistics);
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
@@ -17,6 +17,7 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_MEMORY_REMOTE_DOCUMENT_CACHE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_MEMORY_REMOTE_DOCUMENT_CACHE_H_
 
+#include <functional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -50,6 +51,9 @@ class MemoryRemoteDocumentCache : public RemoteDocumentCache {
   model::MutableDocument Get(const model::DocumentKey& key) const override;
   model::MutableDocumentMap GetAll(
       const model::DocumentKeySet& keys) const override;
+  size_t CountEntries(const model::DocumentKeySet& keys) const override;
+  size_t CountDocuments(
+      const model::ResourcePath& collection_path) const override;
   model::MutableDocumentMap GetAll(const std::string&,
                                    const model::IndexOffset&,
                                    size_t) const override;
@@ -64,8 +68,14 @@ class MemoryRemoteDocumentCache : public RemoteDocumentCache {
       absl::optional<QueryContext>&,
       absl::optional<size_t> limit = absl::nullopt,
       const model::OverlayByDocumentKeyMap& mutated_docs = {}) const override;
+  void ForEachDocumentMatchingQuery(
+      const core::Query& query,
+      const model::OverlayByDocumentKeyMap& mutated_docs,
+      const std::function<void(model::MutableDocument&&)>& callback)
+      const override;
 
   void SetIndexManager(IndexManager* manager) override;
+  void SetCollectionStatistics(CollectionStatistics* statistics) override;
 
   std::vector<model::DocumentKey> RemoveOrphanedDocuments(
       MemoryLruReferenceDelegate* reference_delegate,
@@ -81,6 +91,8 @@ class MemoryRemoteDocumentCache : public RemoteDocumentCache {
   MemoryPersistence* persistence_;
   // This instance is also owned by MemoryPersistence.
   IndexManager* index_manager_ = nullptr;
+  // This instance is owned by the QueryEngine.
+  CollectionStatistics* statistics_ = nullptr;
 };
 
 }  // namespace local
@@ -61,6 +61,7 @@ void MemoryTargetCache::UpdateTarget(const TargetData& target_data) {
 void MemoryTargetCache::RemoveTarget(const TargetData& target_data) {
   targets_.erase(target_data.target());
   references_.RemoveReferences(target_data.target_id());
+  results_.erase(target_data.target_id());
 }
 
 absl::optional<TargetData> MemoryTargetCache::GetTarget(const Target& target) {
@@ -87,6 +88,7 @@ size_t MemoryTargetCache::RemoveTargets(
       if (live_targets.find(target_data.target_id()) == live_targets.end()) {
         to_remove.push_back(&target);
         references_.RemoveReferences(target_data.target_id());
+        results_.erase(target_data.target_id());
       }
     }
   }
@@ -121,6 +123,26 @@ bool MemoryTargetCache::Contains(const DocumentKey& key) {
   return references_.ContainsKey(key);
 }
 
+void MemoryTargetCache::SetQueryResults(
+    TargetId target_id, const MaterializedQueryResults& results) {
+  results_[target_id] = results;
+}
+
+absl::optional<MaterializedQueryResults> MemoryTargetCache::GetQueryResults(
+    TargetId target_id) {
+  auto iter = results_.find(target_id);
+  return iter == results_.end() ? absl::optional<MaterializedQueryResults>{}
+                                : iter->second;
+}
+
+bool MemoryTargetCache::HasQueryResults(TargetId target_id) {
+  return results_.find(target_id) != results_.end();
+}
+
+void MemoryTargetCache::RemoveQueryResults(TargetId target_id) {
+  results_.erase(target_id);
+}
+
 int64_t MemoryTargetCache::CalculateByteSize(const Sizer& sizer) {
   int64_t count = 0;
   for (const auto& kv : targets_) {
@@ -137,6 +159,10 @@ void MemoryTargetCache::SetLastRemoteSnapshotVersion(SnapshotVersion version) {
   last_remote_snapshot_version_ = std::move(version);
 }
 
+SnapshotVersion MemoryTargetCache::ReadLastRemoteSnapshotVersion() {
+  return last_remote_snapshot_version_;
+}
+
 void MemoryTargetCache::RemoveMatchingKeysForTarget(model::TargetId target_id) {
   references_.RemoveReferences(target_id);
 }
@@ -22,6 +22,7 @@
 #include <utility>
 
 #include "Firestore/core/src/core/target.h"
+#include "Firestore/core/src/local/materialized_query_results.h"
 #include "Firestore/core/src/local/reference_set.h"
 #include "Firestore/core/src/local/target_cache.h"
 #include "Firestore/core/src/local/target_data.h"
@@ -69,6 +70,17 @@ class MemoryTargetCache : public TargetCache {
 
   bool Contains(const model::DocumentKey& key) override;
 
+  // Materialized result methods
+  void SetQueryResults(model::TargetId target_id,
+                       const MaterializedQueryResults& results) override;
+
+  absl::optional<MaterializedQueryResults> GetQueryResults(
+      model::TargetId target_id) override;
+
+  bool HasQueryResults(model::TargetId target_id) override;
+
+  void RemoveQueryResults(model::TargetId target_id) override;
+
   // Other methods and accessors
   int64_t CalculateByteSize(const Sizer& sizer);
 
@@ -88,6 +100,8 @@ class MemoryTargetCache : public TargetCache {
 
   void SetLastRemoteSnapshotVersion(model::SnapshotVersion version) override;
 
+  model::SnapshotVersion ReadLastRemoteSnapshotVersion() override;
+
  private:
   // This instance is owned by MemoryPersistence.
   MemoryPersistence* persistence_;
@@ -102,6 +116,9 @@ class MemoryTargetCache : public TargetCache {
   /** Maps a target to the data about that query. */
   std::unordered_map<core::Target, TargetData> targets_;
 
+  /** Maps a target ID to the materialized results of its query. */
+  std::unordered_map<model::TargetId, MaterializedQueryResults> results_;
+
   /**
    * A ordered bidirectional mapping between documents and the remote target
    * IDs.
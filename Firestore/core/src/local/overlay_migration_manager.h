@@ -26,13 +26,26 @@ class OverlayMigrationManager {
  public:
   virtual ~OverlayMigrationManager() = default;
 
+  /**
+   * Migrates the overlays of the user the manager was created for, if
+   * required, so that the local store can serve that user's reads.
+   */
   virtual void Run() = 0;
+
+  /**
+   * Migrates the overlays of every other user that still requires it. This can
+   * run after the local store has started.
+   */
+  virtual void RunForOtherUsers() = 0;
 };
 
 class MemoryOverlayMigrationManager : public OverlayMigrationManager {
  public:
   void Run() override {
   }
+
+  void RunForOtherUsers() override {
+  }
 };
 
 }  // namespace local
@@ -196,10 +196,43 @@ class Persistence {
     return result;
   }
 
+  /**
+   * Returns true if `RunReadOnly` may be called from threads other than the
+   * one that calls `Run`, concurrently with read-write transactions.
+   */
+  virtual bool SupportsConcurrentReadOnlyTransactions() const = 0;
+
+  /**
+   * Accepts a function and runs it within a read-only transaction. The block
+   * observes a consistent snapshot of the persisted state taken when the
+   * transaction starts and does not see writes committed afterwards, including
+   * any writes made concurrently by `Run`. The block must not write.
+   *
+   * If `SupportsConcurrentReadOnlyTransactions()` returns false, this must be
+   * called from the same thread as `Run`.
+   *
+   * @param label A semi-unique name for the transaction, for logging.
+   * @param block A function to be executed within the transaction whose return
+   *     value will be the result of the transaction. The type of the return
+   *     value must be default constructible and copy- or move-assignable.
+   * @return The value returned from the invocation of `block`.
+   */
+  template <typename F>
+  auto RunReadOnly(absl::string_view label, F block) -> decltype(block()) {
+    decltype(block()) result;
+
+    RunReadOnlyInternal(label, [&]() mutable { result = block(); });
+
+    return result;
+  }
+
  private:
   virtual void RunInternal(absl::string_view label,
                            std::function<void()> block) = 0;
 
+  virtual void RunReadOnlyInternal(absl::string_view label,
+                                   std::function<void()> block) = 0;
+
   /**
    * Removes all persistent cache indexes. This feature is implemented in
    * `Persistence` instead of `IndexManager` like other SDKs. The reason for
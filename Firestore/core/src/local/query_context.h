@@ -17,6 +17,8 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_QUERY_CONTEXT_H_
 #define FIRESTORE_CORE_SRC_LOCAL_QUERY_CONTEXT_H_
 
+#include <cstddef>
+
 namespace firebase {
 namespace firestore {
 namespace local {
@@ -33,10 +35,51 @@ class QueryContext {
     document_read_count_ += num;
   }
 
+  size_t GetOverlayCount() const {
+    return overlay_count_;
+  }
+
+  void IncrementOverlayCount(size_t num) {
+    overlay_count_ += num;
+  }
+
+  size_t GetIndexRangeCount() const {
+    return index_range_count_;
+  }
+
+  void IncrementIndexRangeCount(size_t num) {
+    index_range_count_ += num;
+  }
+
+  size_t GetIndexEntryReadCount() const {
+    return index_entry_read_count_;
+  }
+
+  void IncrementIndexEntryReadCount(size_t num) {
+    index_entry_read_count_ += num;
+  }
+
+  /** Adds the counts recorded by `other` to this context. */
+  void Add(const QueryContext& other) {
+    document_read_count_ += other.document_read_count_;
+    overlay_count_ += other.overlay_count_;
+    index_range_count_ += other.index_range_count_;
+    index_entry_read_count_ += other.index_entry_read_count_;
+  }
+
  private:
   /** Counts the number of documents passed through during local query
    * execution. */
   size_t document_read_count_ = 0;
+
+  /** Counts the overlays that were read to compute local views. */
+  size_t overlay_count_ = 0;
+
+  /** Counts the index ranges that were scanned. */
+  size_t index_range_count_ = 0;
+
+  /** Counts the index entries that were read from those ranges. */
+  size_t index_entry_read_count_ = 0;
 };
 
 }  // namespace local
@@ -16,16 +16,30 @@
 
 #include "Firestore/core/src/local/query_engine.h"
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "Firestore/core/src/core/query.h"
 #include "Firestore/core/src/core/target.h"
+#include "Firestore/core/src/local/document_overlay_cache.h"
+#include "Firestore/core/src/local/local_aggregator.h"
 #include "Firestore/core/src/local/local_documents_view.h"
+#include "Firestore/core/src/local/local_write_result.h"
+#include "Firestore/core/src/local/materialized_query_results.h"
 #include "Firestore/core/src/local/query_context.h"
+#include "Firestore/core/src/local/query_profile.h"
+#include "Firestore/core/src/local/remote_document_cache.h"
+#include "Firestore/core/src/model/aggregate_field.h"
 #include "Firestore/core/src/model/document.h"
 #include "Firestore/core/src/model/document_set.h"
 #include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/src/model/object_value.h"
 #include "Firestore/core/src/model/snapshot_version.h"
+#include "Firestore/core/src/util/comparison.h"
 #include "Firestore/core/src/util/log.h"
 
 namespace firebase {
@@ -44,15 +58,80 @@ static const int kDefaultIndexAutoCreationMinCollectionSize = 100;
  */
 
 static const double KDefaultRelativeIndexReadCostPerDocument = 3.4;
+
+/**
+ * Collections with fewer documents than this are always queried as if nothing
+ * was known about them: their statistics are too noisy to pick a plan, and
+ * every plan is cheap.
+ */
+const size_t kMinDocumentsForCostEstimates = 100;
+
+/**
+ * The number of documents that are loaded at a time when an aggregation
+ * reads them by key.
+ */
+const size_t kAggregationBatchSize = 1000;
+
+/**
+ * The number of documents changed since an index's offset at which an
+ * aggregation stops using the index, since every changed document is read.
+ */
+const size_t kMaxChangedDocumentsForIndexAggregation = 1000;
+
+/**
+ * Loads the local view of documents a batch at a time, and passes those that
+ * match a query to a callback.
+ */
+class MatchingDocumentLoader {
+ public:
+  MatchingDocumentLoader(
+      LocalDocumentsView* local_documents_view,
+      const core::Query& query,
+      std::function<void(const model::Document&)> callback)
+      : local_documents_view_(local_documents_view),
+        query_(query),
+        callback_(std::move(callback)) {
+  }
+
+  /** Adds `key` to the current batch, which is loaded once it is full. */
+  void Add(const model::DocumentKey& key) {
+    batch_ = batch_.insert(key);
+    if (batch_.size() == kAggregationBatchSize) Flush();
+  }
+
+  /** Loads the documents of the current batch. */
+  void Flush() {
+    if (batch_.empty()) return;
+
+    model::DocumentMap documents = local_documents_view_->GetDocuments(batch_);
+    for (const auto& entry : documents) {
+      const model::Document& document = entry.second;
+      if (document->is_found_document() && query_.Matches(document)) {
+        callback_(document);
+      }
+    }
+    batch_ = model::DocumentKeySet{};
+  }
+
+ private:
+  LocalDocumentsView* local_documents_view_;
+  const core::Query& query_;
+  std::function<void(const model::Document&)> callback_;
+  model::DocumentKeySet batch_;
+};
+
 }  // namespace
 
 using core::LimitType;
 using core::Query;
+using model::AggregateField;
 using model::Document;
 using model::DocumentKeySet;
 using model::DocumentMap;
 using model::DocumentSet;
 using model::MutableDocument;
+using model::MutableDocumentMap;
+using model::ObjectValue;
 using model::SnapshotVersion;
 
 void QueryEngine::Initialize(LocalDocumentsView* local_documents) {
@@ -67,30 +146,197 @@ void QueryEngine::Initialize(LocalDocumentsView* local_documents) {
 const DocumentMap QueryEngine::GetDocumentsMatchingQuery(
     const Query& query,
     const SnapshotVersion& last_limbo_free_snapshot_version,
-    const DocumentKeySet& remote_keys) const {
+    const DocumentKeySet& remote_keys,
+    QueryProfile* profile) const {
   HARD_ASSERT(local_documents_view_ && index_manager_,
               "Initialize() not called");
 
+  // Reads are only tracked for the profile, except for full scans, whose
+  // reads decide whether to create an index.
+  absl::optional<QueryContext> context;
+  if (profile) {
+    context = QueryContext();
+  }
+  auto finish_profile = [&](QueryProfile::Plan plan,
+                            const DocumentMap& result) {
+    if (profile) {
+      profile->set_plan(plan);
+      profile->AddReads(context.value());
+      profile->set_matched_document_count(result.size());
+    }
+  };
+
   const absl::optional<DocumentMap> index_result =
-      PerformQueryUsingIndex(query);
+      PerformQueryUsingIndex(query, context, profile);
   if (index_result.has_value()) {
+    finish_profile(QueryProfile::Plan::Index, index_result.value());
     return index_result.value();
   }
 
-  const absl::optional<DocumentMap> key_result = PerformQueryUsingRemoteKeys(
-      query, remote_keys, last_limbo_free_snapshot_version);
+  const absl::optional<DocumentMap> key_result =
+      PerformQueryUsingRemoteKeys(query, remote_keys,
+                                  last_limbo_free_snapshot_version, context,
+                                  profile);
   if (key_result.has_value()) {
+    finish_profile(QueryProfile::Plan::RemoteKeys, key_result.value());
     return key_result.value();
   }
 
-  absl::optional<QueryContext> context = QueryContext();
-  auto full_scan_result = ExecuteFullCollectionScan(query, context);
+  absl::optional<QueryContext> scan_context = QueryContext();
+  auto full_scan_result =
+      ExecuteFullCollectionScan(query, scan_context, profile);
   if (index_auto_creation_enabled_) {
-    CreateCacheIndexes(query, context.value(), full_scan_result.size());
+    CreateCacheIndexes(query, scan_context.value(), full_scan_result.size());
+  }
+  if (context.has_value()) {
+    context.value().Add(scan_context.value());
   }
+  finish_profile(QueryProfile::Plan::FullScan, full_scan_result);
   return full_scan_result;
 }
 
+const DocumentMap QueryEngine::GetDocumentsMatchingQueryWithoutIndexes(
+    const Query& query,
+    const SnapshotVersion& last_limbo_free_snapshot_version,
+    const DocumentKeySet& remote_keys) const {
+  HARD_ASSERT(local_documents_view_, "Initialize() not called");
+
+  absl::optional<QueryContext> context;
+  const absl::optional<DocumentMap> key_result =
+      PerformQueryUsingRemoteKeys(query, remote_keys,
+                                  last_limbo_free_snapshot_version, context,
+                                  /* profile= */ nullptr);
+  if (key_result.has_value()) {
+    return key_result.value();
+  }
+
+  context = QueryContext();
+  return ExecuteFullCollectionScan(query, context, /* profile= */ nullptr);
+}
+
+absl::optional<DocumentMap> QueryEngine::GetDocumentsFromMaterializedResults(
+    const Query& query, const MaterializedQueryResults& results) const {
+  HARD_ASSERT(local_documents_view_ && index_manager_,
+              "Initialize() not called");
+
+  if (results.snapshot_version() == SnapshotVersion::None()) {
+    return absl::nullopt;
+  }
+
+  DocumentKeySet keys;
+  for (const auto& entry : results.documents()) {
+    keys = keys.insert(entry.first);
+  }
+
+  // A document that is unchanged since the results were materialized, and
+  // has no local mutations, still matches the query in the same position.
+  DocumentMap documents = local_documents_view_->GetDocuments(keys);
+  for (const auto& entry : results.documents()) {
+    absl::optional<Document> document = documents.get(entry.first);
+    if (!document || !(*document)->is_found_document() ||
+        (*document)->has_local_mutations() ||
+        (*document)->version() != entry.second) {
+      return absl::nullopt;
+    }
+  }
+
+  // Documents that were written since may have started to match.
+  DocumentMap updated_documents =
+      local_documents_view_->GetDocumentsMatchingQuery(
+          query,
+          model::IndexOffset::CreateSuccessor(results.snapshot_version()));
+  for (const auto& entry : updated_documents) {
+    if (!keys.contains(entry.first)) {
+      return absl::nullopt;
+    }
+  }
+
+  LOG_DEBUG("Using materialized results to execute query: %s",
+            query.ToString());
+  return documents;
+}
+
+ObjectValue QueryEngine::ComputeAggregates(
+    const Query& query,
+    const std::vector<AggregateField>& aggregates,
+    const SnapshotVersion& last_limbo_free_snapshot_version,
+    const DocumentKeySet& remote_keys) const {
+  HARD_ASSERT(local_documents_view_ && index_manager_,
+              "Initialize() not called");
+
+  LocalAggregator aggregator(aggregates);
+  if (!query.has_limit()) {
+    if (AggregateUsingIndex(query, &aggregator)) {
+      return aggregator.Result();
+    }
+
+    // Documents are folded into the aggregates as they are read instead of
+    // collected.
+    auto add = [&](const Document& document) { aggregator.Add(document); };
+    if (!AggregateUsingIndexScan(query, add) &&
+        !AggregateUsingRemoteKeys(query, remote_keys,
+                                  last_limbo_free_snapshot_version, add)) {
+      local_documents_view_->ForEachDocumentMatchingQuery(query, add);
+    }
+    return aggregator.Result();
+  }
+
+  // A limit applies to the documents in query order, but the aggregates don't
+  // depend on the order of the documents within it, so only the documents
+  // within the limit so far are kept, in a heap whose top is the first to
+  // leave the limit when a document that precedes it is read.
+  model::DocumentComparator comparator = query.Comparator();
+  util::ComparisonResult in_limit = query.limit_type() == LimitType::First
+                                        ? util::ComparisonResult::Ascending
+                                        : util::ComparisonResult::Descending;
+  auto precedes_in_limit = [&](const Document& lhs, const Document& rhs) {
+    return comparator.Compare(lhs, rhs) == in_limit;
+  };
+  size_t limit = static_cast<size_t>(query.limit());
+  std::vector<Document> within_limit;
+  auto keep = [&](const Document& document) {
+    if (within_limit.size() < limit) {
+      within_limit.push_back(document);
+      std::push_heap(within_limit.begin(), within_limit.end(),
+                     precedes_in_limit);
+    } else if (!within_limit.empty() &&
+               precedes_in_limit(document, within_limit.front())) {
+      std::pop_heap(within_limit.begin(), within_limit.end(),
+                    precedes_in_limit);
+      within_limit.back() = document;
+      std::push_heap(within_limit.begin(), within_limit.end(),
+                     precedes_in_limit);
+    }
+  };
+
+  // The remote keys of a limit query are the documents within its limit, so
+  // reusing them reads no more than the limit and the documents changed since.
+  absl::optional<QueryContext> context;
+  absl::optional<DocumentMap> documents = PerformQueryUsingRemoteKeys(
+      query, remote_keys, last_limbo_free_snapshot_version, context,
+      /* profile= */ nullptr);
+  if (documents) {
+    for (const auto& entry : *documents) {
+      const Document& document = entry.second;
+      if (document->is_found_document() && query.Matches(document)) {
+        keep(document);
+      }
+    }
+  } else {
+    // Otherwise every matching document is read to find those within the
+    // limit.
+    const Query without_limit = query.WithLimitToFirst(core::Target::kNoLimit);
+    if (!AggregateUsingIndexScan(without_limit, keep)) {
+      local_documents_view_->ForEachDocumentMatchingQuery(without_limit, keep);
+    }
+  }
+
+  for (const Document& document : within_limit) {
+    aggregator.Add(document);
+  }
+  return aggregator.Result();
+}
+
 void QueryEngine::CreateCacheIndexes(const core::Query& query,
                                      const QueryContext& context,
                                      size_t result_size) const {
@@ -109,8 +355,16 @@ void QueryEngine::CreateCacheIndexes(const core::Query& query,
       "results.",
       query.ToString(), context.GetDocumentReadCount(), result_size);
 
-  if (context.GetDocumentReadCount() >
-      relative_index_read_cost_per_document_ * result_size) {
+  // An index covers the whole collection group, so it may have to read more
+  // rows than this collection's results.
+  double index_cost = relative_index_read_cost_per_document_ * result_size;
+  absl::optional<double> estimated_index_cost =
+      EstimateIndexScanCost(query, query.has_limit());
+  if (estimated_index_cost) {
+    index_cost = std::max(index_cost, *estimated_index_cost);
+  }
+
+  if (context.GetDocumentReadCount() > index_cost) {
     index_manager_->CreateTargetIndexes(query.ToTarget());
     LOG_DEBUG(
         "The SDK decides to create cache indexes for query: %s, as using cache "
@@ -124,7 +378,9 @@ void QueryEngine::SetIndexAutoCreationEnabled(bool is_enabled) {
 }
 
 absl::optional<DocumentMap> QueryEngine::PerformQueryUsingIndex(
-    const Query& query) const {
+    const Query& query,
+    absl::optional<QueryContext>& context,
+    QueryProfile* profile) const {
   if (query.MatchesAllDocuments()) {
     // Don't use indexes for queries that can be executed by scanning the
     // collection.
@@ -140,6 +396,12 @@ absl::optional<DocumentMap> QueryEngine::PerformQueryUsingIndex(
     return absl::nullopt;
   }
 
+  bool applies_limit =
+      query.has_limit() && index_type == IndexManager::IndexType::FULL;
+  if (IndexScanCostsMore(query, applies_limit)) {
+    return absl::nullopt;
+  }
+
   if (query.has_limit() && index_type == IndexManager::IndexType::PARTIAL) {
     // We cannot apply a limit for targets that are served using a partial
     // index. If a partial index will be used to serve the target, the query may
@@ -150,40 +412,243 @@ absl::optional<DocumentMap> QueryEngine::PerformQueryUsingIndex(
     // in such cases.
     const Query query_with_limit =
         query.WithLimitToFirst(core::Target::kNoLimit);
-    return PerformQueryUsingIndex(query_with_limit);
+    return PerformQueryUsingIndex(query_with_limit, context, profile);
   }
 
-  auto keys = index_manager_->GetDocumentsMatchingTarget(target);
+  absl::optional<std::vector<model::DocumentKey>> keys;
+  {
+    QueryStageTimer timer(profile, "index scan");
+    keys = index_manager_->GetDocumentsMatchingTarget(target, context);
+  }
   HARD_ASSERT(
       keys.has_value(),
       "index manager must return results for partial and full indexes.");
+  if (!query.has_limit()) {
+    statistics_.RecordIndexScan(target, keys->size());
+  }
 
   DocumentKeySet remote_keys;
   for (auto key : keys.value()) {
     remote_keys = remote_keys.insert(key);
   }
 
-  DocumentMap indexedDocuments =
-      local_documents_view_->GetDocuments(remote_keys);
+  DocumentMap indexedDocuments = LookUpDocuments(remote_keys, context, profile);
   model::IndexOffset offset = index_manager_->GetMinOffset(target);
 
-  DocumentSet previous_results = ApplyQuery(query, indexedDocuments);
-  if (NeedsRefill(query, previous_results, remote_keys, offset.read_time())) {
-    // A limit query whose boundaries change due to local edits can be re-run
-    // against the cache by excluding the limit. This ensures that all documents
-    // that match the query's filters are included in the result set. The SDK
-    // can then apply the limit once all local edits are incorporated.
-    const Query query_with_limit =
-        query.WithLimitToFirst(core::Target::kNoLimit);
-    return PerformQueryUsingIndex(query_with_limit);
+  DocumentSet previous_results = ApplyQuery(query, indexedDocuments, profile);
+  if (!NeedsRefill(query, previous_results, remote_keys, offset.read_time())) {
+    // Retrieve all results for documents that were updated since the last
+    // remote snapshot that did not contain any Limbo documents.
+    return AppendRemainingResults(previous_results, query, offset, context,
+                                  profile);
   }
 
-  // Retrieve all results for documents that were updated since the last
-  // remote snapshot that did not contain any Limbo documents.
-  return AppendRemainingResults(previous_results, query, offset);
+  // A limit query whose boundaries change due to local edits can be re-run
+  // against the cache by excluding the limit. This ensures that all documents
+  // that match the query's filters are included in the result set. The SDK
+  // can then apply the limit once all local edits are incorporated.
+  const Query query_with_limit = query.WithLimitToFirst(core::Target::kNoLimit);
+  return PerformQueryUsingIndex(query_with_limit, context, profile);
 }
 
-absl::optional<DocumentMap> QueryEngine::PerformQueryUsingRemoteKeys(
+bool QueryEngine::AggregateUsingIndex(const Query& query,
+                                      LocalAggregator* aggregator) const {
+  if (query.MatchesAllDocuments()) {
+    return false;
+  }
+
+  const core::Target& target = query.ToTarget();
+  if (index_manager_->GetIndexType(target) != IndexManager::IndexType::FULL) {
+    // A partial index may contain documents that don't match the query.
+    return false;
+  }
+
+  // The index only reflects documents up to its offset. Documents that changed
+  // since then are aggregated from their local view instead of their entries.
+  // Each of them is read, so an index that lags far behind is not used.
+  model::IndexOffset offset = index_manager_->GetMinOffset(target);
+  std::string collection_group = target.collection_group() != nullptr
+                                     ? *target.collection_group()
+                                     : target.path().last_segment();
+  RemoteDocumentCache* remote_document_cache =
+      local_documents_view_->remote_document_cache();
+  MutableDocumentMap remote_changes = remote_document_cache->GetAll(
+      collection_group, offset, kMaxChangedDocumentsForIndexAggregation);
+  if (remote_changes.size() >= kMaxChangedDocumentsForIndexAggregation) {
+    LOG_DEBUG("Not aggregating query %s from its index, which is behind",
+              query.ToString());
+    return false;
+  }
+
+  // Index entries cover the whole collection group.
+  auto in_query_collection = [&](const model::DocumentKey& key) {
+    return query.IsCollectionGroupQuery() ||
+           key.path().PopLast() == query.path();
+  };
+
+  DocumentOverlayCache* overlay_cache =
+      local_documents_view_->document_overlay_cache();
+  model::OverlayByDocumentKeyMap overlays =
+      query.IsCollectionGroupQuery()
+          ? overlay_cache->GetOverlays(collection_group,
+                                       offset.largest_batch_id(),
+                                       std::numeric_limits<size_t>::max())
+          : overlay_cache->GetOverlays(query.path(), offset.largest_batch_id());
+
+  MutableDocumentMap changed_base_documents;
+  for (const auto& entry : remote_changes) {
+    if (in_query_collection(entry.first)) {
+      changed_base_documents =
+          changed_base_documents.insert(entry.first, entry.second);
+    }
+  }
+  DocumentKeySet overlay_only_keys;
+  for (const auto& entry : overlays) {
+    if (!changed_base_documents.contains(entry.first)) {
+      overlay_only_keys = overlay_only_keys.insert(entry.first);
+    }
+  }
+  for (const auto& entry : remote_document_cache->GetAll(overlay_only_keys)) {
+    changed_base_documents =
+        changed_base_documents.insert(entry.first, entry.second);
+  }
+  DocumentMap changed_documents =
+      local_documents_view_->GetLocalViewOfDocuments(changed_base_documents,
+                                                     DocumentKeySet{});
+
+  auto keys = index_manager_->GetDocumentsMatchingTarget(target);
+  HARD_ASSERT(keys.has_value(),
+              "index manager must return results for full indexes.");
+
+  // Entries may outlive their documents, which garbage collection removes
+  // without updating the index, so only keys that are still cached count.
+  // Counting them only probes the keys and reads no documents.
+  if (aggregator->needs_documents()) {
+    MatchingDocumentLoader loader(
+        local_documents_view_, query,
+        [aggregator](const Document& document) { aggregator->Add(document); });
+    for (const auto& key : *keys) {
+      if (!changed_documents.contains(key) && in_query_collection(key)) {
+        loader.Add(key);
+      }
+    }
+    loader.Flush();
+  } else {
+    DocumentKeySet batch;
+    auto flush_batch = [&] {
+      aggregator->AddCount(
+          static_cast<int64_t>(remote_document_cache->CountEntries(batch)));
+      batch = DocumentKeySet{};
+    };
+    for (const auto& key : *keys) {
+      if (changed_documents.contains(key) || !in_query_collection(key)) {
+        continue;
+      }
+
+      batch = batch.insert(key);
+      if (batch.size() == kAggregationBatchSize) flush_batch();
+    }
+    flush_batch();
+  }
+
+  for (const auto& entry : changed_documents) {
+    const Document& document = entry.second;
+    if (document->is_found_document() && query.Matches(document)) {
+      aggregator->Add(document);
+    }
+  }
+
+  LOG_DEBUG("Aggregated %s documents for query %s from %s index entries",
+            aggregator->count(), query.ToString(), keys->size());
+  return true;
+}
+
+bool QueryEngine::AggregateUsingIndexScan(
+    const Query& query, const DocumentCallback& callback) const {
+  if (query.MatchesAllDocuments()) {
+    return false;
+  }
+
+  const core::Target& target = query.ToTarget();
+  if (index_manager_->GetIndexType(target) == IndexManager::IndexType::NONE ||
+      IndexScanCostsMore(query, /* applies_limit= */ false)) {
+    return false;
+  }
+
+  auto keys = index_manager_->GetDocumentsMatchingTarget(target);
+  HARD_ASSERT(
+      keys.has_value(),
+      "index manager must return results for partial and full indexes.");
+  statistics_.RecordIndexScan(target, keys->size());
+
+  // Documents that changed since the index was last updated are read from
+  // their local view instead of through their entries.
+  DocumentMap changed_documents =
+      local_documents_view_->GetDocumentsMatchingQuery(
+          query, index_manager_->GetMinOffset(target));
+  MatchingDocumentLoader loader(local_documents_view_, query, callback);
+  for (const auto& key : *keys) {
+    if (!changed_documents.contains(key)) loader.Add(key);
+  }
+  loader.Flush();
+
+  for (const auto& entry : changed_documents) {
+    const Document& document = entry.second;
+    if (document->is_found_document() && query.Matches(document)) {
+      callback(document);
+    }
+  }
+  return true;
+}
+
+bool QueryEngine::AggregateUsingRemoteKeys(
+    const Query& query,
+    const DocumentKeySet& remote_keys,
+    const SnapshotVersion& last_limbo_free_snapshot_version,
+    const DocumentCallback& callback) const {
+  if (!CanUseRemoteKeys(query, remote_keys, last_limbo_free_snapshot_version)) {
+    return false;
+  }
+
+  // Documents that changed since the remote keys were last current are read
+  // from their local view instead.
+  model::IndexOffset offset =
+      model::IndexOffset::CreateSuccessor(last_limbo_free_snapshot_version);
+  DocumentMap changed_documents =
+      local_documents_view_->GetDocumentsMatchingQuery(query, offset);
+  MatchingDocumentLoader loader(local_documents_view_, query, callback);
+  for (const auto& key : remote_keys) {
+    if (!changed_documents.contains(key)) loader.Add(key);
+  }
+  loader.Flush();
+
+  for (const auto& entry : changed_documents) {
+    const Document& document = entry.second;
+    if (document->is_found_document() && query.Matches(document)) {
+      callback(document);
+    }
+  }
+  return true;
+}
+
+bool QueryEngine::IndexScanCostsMore(const Query& query,
+                                     bool applies_limit) const {
+  // The full scan is estimated first, since it may count the collection's
+  // documents, which the index scan estimate also uses.
+  absl::optional<double> scan_cost = EstimateFullScanCost(query);
+  absl::optional<double> index_cost =
+      EstimateIndexScanCost(query, applies_limit);
+  if (index_cost && scan_cost && *index_cost > *scan_cost) {
+    LOG_DEBUG(
+        "Not using an index for query: %s, since it is estimated to cost %s "
+        "documents and a full collection scan %s",
+        query.ToString(), *index_cost, *scan_cost);
+    return true;
+  }
+  return false;
+}
+
+bool QueryEngine::CanUseRemoteKeys(
     const Query& query,
     const DocumentKeySet& remote_keys,
     const SnapshotVersion& last_limbo_free_snapshot_version) const {
@@ -191,17 +656,42 @@ absl::optional<DocumentMap> QueryEngine::PerformQueryUsingRemoteKeys(
   // lookups. It is more efficient to scan all documents in a collection, rather
   // than to perform individual lookups.
   if (query.MatchesAllDocuments()) {
-    return absl::nullopt;
+    return false;
   }
 
   // Queries that have never seen a snapshot without limbo free documents should
   // also be run as a full collection scan.
   if (last_limbo_free_snapshot_version == SnapshotVersion::None()) {
+    return false;
+  }
+
+  // Like an index entry, each remote key leads to a lookup of its document.
+  absl::optional<double> scan_cost = EstimateFullScanCost(query);
+  double key_cost =
+      relative_index_read_cost_per_document_ * remote_keys.size();
+  if (scan_cost && key_cost > *scan_cost) {
+    LOG_DEBUG(
+        "Not re-using previous result for query: %s, since reading %s "
+        "documents by key is estimated to cost more than a full collection "
+        "scan",
+        query.ToString(), remote_keys.size());
+    return false;
+  }
+  return true;
+}
+
+absl::optional<DocumentMap> QueryEngine::PerformQueryUsingRemoteKeys(
+    const Query& query,
+    const DocumentKeySet& remote_keys,
+    const SnapshotVersion& last_limbo_free_snapshot_version,
+    absl::optional<QueryContext>& context,
+    QueryProfile* profile) const {
+  if (!CanUseRemoteKeys(query, remote_keys, last_limbo_free_snapshot_version)) {
     return absl::nullopt;
   }
 
-  DocumentMap documents = local_documents_view_->GetDocuments(remote_keys);
-  DocumentSet previous_results = ApplyQuery(query, documents);
+  DocumentMap documents = LookUpDocuments(remote_keys, context, profile);
+  DocumentSet previous_results = ApplyQuery(query, documents, profile);
 
   if ((query.has_limit_to_first() || query.has_limit_to_last()) &&
       NeedsRefill(query, previous_results, remote_keys,
@@ -216,11 +706,23 @@ absl::optional<DocumentMap> QueryEngine::PerformQueryUsingRemoteKeys(
   // remote snapshot that did not contain any Limbo documents.
   return AppendRemainingResults(
       previous_results, query,
-      model::IndexOffset::CreateSuccessor(last_limbo_free_snapshot_version));
+      model::IndexOffset::CreateSuccessor(last_limbo_free_snapshot_version),
+      context, profile);
+}
+
+DocumentMap QueryEngine::LookUpDocuments(
+    const DocumentKeySet& keys,
+    absl::optional<QueryContext>& context,
+    QueryProfile* profile) const {
+  QueryStageTimer timer(profile, "document lookup");
+  return local_documents_view_->GetDocuments(keys, context);
 }
 
 DocumentSet QueryEngine::ApplyQuery(const Query& query,
-                                    const DocumentMap& documents) const {
+                                    const DocumentMap& documents,
+                                    QueryProfile* profile) const {
+  QueryStageTimer timer(profile, "apply query");
+
   // Sort the documents and re-apply the query filter since previously matching
   // documents do not necessarily still match the query.
   DocumentSet query_results(query.Comparator());
@@ -272,21 +774,81 @@ bool QueryEngine::NeedsRefill(
          (*document_at_limit_edge)->version() > limbo_free_snapshot_version;
 }
 
+absl::optional<double> QueryEngine::EstimateFullScanCost(
+    const Query& query) const {
+  if (query.IsDocumentQuery()) return absl::nullopt;
+
+  absl::optional<size_t> document_count =
+      query.IsCollectionGroupQuery()
+          ? statistics_.GetCollectionGroupDocumentCount(
+                *query.collection_group())
+          : statistics_.GetDocumentCount(query.path());
+  if (!document_count && !query.IsCollectionGroupQuery()) {
+    // Counts are only kept in memory, so the first estimate for a collection
+    // since startup counts its documents in the cache without reading them.
+    document_count =
+        local_documents_view_->remote_document_cache()->CountDocuments(
+            query.path());
+    statistics_.RecordCollectionScan(query.path(), *document_count);
+  }
+  if (!document_count || *document_count < kMinDocumentsForCostEstimates) {
+    return absl::nullopt;
+  }
+  return static_cast<double>(*document_count);
+}
+
+absl::optional<double> QueryEngine::EstimateIndexScanCost(
+    const Query& query, bool applies_limit) const {
+  const core::Target& target = query.ToTarget();
+  std::string collection_group = target.collection_group() != nullptr
+                                     ? *target.collection_group()
+                                     : target.path().last_segment();
+  absl::optional<size_t> document_count =
+      statistics_.GetCollectionGroupDocumentCount(collection_group);
+  if (!document_count || *document_count < kMinDocumentsForCostEstimates) {
+    return absl::nullopt;
+  }
+  absl::optional<double> selectivity = statistics_.EstimateSelectivity(target);
+  if (!selectivity) return absl::nullopt;
+
+  double rows = *selectivity * static_cast<double>(*document_count);
+  if (applies_limit) {
+    rows = std::min(rows, static_cast<double>(query.limit()));
+  }
+  return relative_index_read_cost_per_document_ * rows;
+}
+
 const DocumentMap QueryEngine::ExecuteFullCollectionScan(
-    const Query& query, absl::optional<QueryContext>& context) const {
+    const Query& query,
+    absl::optional<QueryContext>& context,
+    QueryProfile* profile) const {
   LOG_DEBUG("Using full collection scan to execute query: %s",
             query.ToString());
-  return local_documents_view_->GetDocumentsMatchingQuery(
+  QueryStageTimer timer(profile, "full scan");
+  DocumentMap result = local_documents_view_->GetDocumentsMatchingQuery(
       query, model::IndexOffset::None(), context);
+  if (context && !query.IsDocumentQuery() &&
+      !query.IsCollectionGroupQuery()) {
+    statistics_.RecordCollectionScan(query.path(),
+                                     context->GetDocumentReadCount());
+  }
+  return result;
 }
 
 const DocumentMap QueryEngine::AppendRemainingResults(
     const DocumentSet& indexed_results,
     const Query& query,
-    const model::IndexOffset& offset) const {
+    const model::IndexOffset& offset,
+    absl::optional<QueryContext>& context,
+    QueryProfile* profile) const {
+  QueryStageTimer timer(profile, "remaining documents");
+
   // Retrieve all results for documents that were updated since the offset.
   DocumentMap remaining_results =
-      local_documents_view_->GetDocumentsMatchingQuery(query, offset);
+      context.has_value()
+          ? local_documents_view_->GetDocumentsMatchingQuery(query, offset,
+                                                             context)
+          : local_documents_view_->GetDocumentsMatchingQuery(query, offset);
 
   // We merge `previous_results` into `update_results`, since `update_results`
   // is already a DocumentMap. If a document is contained in both lists, then
@@ -17,11 +17,19 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_QUERY_ENGINE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_QUERY_ENGINE_H_
 
+#include <functional>
+#include <vector>
+
+#include "Firestore/core/src/local/collection_statistics.h"
 #include "Firestore/core/src/model/model_fwd.h"
 
 namespace firebase {
 namespace firestore {
 
+namespace model {
+class AggregateField;
+}  // namespace model
+
 namespace core {
 class Query;
 enum class LimitType;
@@ -29,9 +37,12 @@ enum class LimitType;
 
 namespace local {
 
+class LocalAggregator;
 class LocalDocumentsView;
 class IndexManager;
+class MaterializedQueryResults;
 class QueryContext;
+class QueryProfile;
 
 /**
  * Firestore queries can be executed in three modes. The Query Engine determines
@@ -61,6 +72,10 @@ class QueryContext;
  * specific optimization is not guaranteed to produce the same results as full
  * collection scans. So in these cases, query processing falls back to full
  * scans.
+ *
+ * Once CollectionStatistics know enough about a collection, the index and the
+ * target document mapping are only used if reading through them is estimated
+ * to cost less than a full collection scan.
  */
 class QueryEngine {
  public:
@@ -74,13 +89,68 @@ class QueryEngine {
    */
   virtual void Initialize(LocalDocumentsView* local_documents);
 
+  /**
+   * Returns the documents that match `query` in the local view, and possibly
+   * some documents that don't.
+   *
+   * @param profile If not null, records how the query was executed.
+   */
   const model::DocumentMap GetDocumentsMatchingQuery(
+      const core::Query& query,
+      const model::SnapshotVersion& last_limbo_free_snapshot_version,
+      const model::DocumentKeySet& remote_keys,
+      QueryProfile* profile = nullptr) const;
+
+  /**
+   * Like `GetDocumentsMatchingQuery`, but never reads or creates client-side
+   * indexes. The IndexManager caches index metadata in memory while planning
+   * queries, so only this variant may run in a read-only transaction that is
+   * concurrent with read-write transactions.
+   */
+  const model::DocumentMap GetDocumentsMatchingQueryWithoutIndexes(
       const core::Query& query,
       const model::SnapshotVersion& last_limbo_free_snapshot_version,
       const model::DocumentKeySet& remote_keys) const;
 
+  /**
+   * Returns the documents in `results` if they are still exactly the documents
+   * that match `query` in the local view, without filtering or sorting them.
+   * Returns nullopt if any of them changed, or another document may have
+   * started to match, since the results were materialized.
+   */
+  absl::optional<model::DocumentMap> GetDocumentsFromMaterializedResults(
+      const core::Query& query, const MaterializedQueryResults& results) const;
+
+  /**
+   * Computes `aggregates` over the documents that match `query` in the local
+   * view, including local mutations, and returns the results keyed by alias.
+   *
+   * If a full index covers a query without a limit, the documents are found
+   * through its index entries and loaded in batches. COUNT alone is computed
+   * from the index entries, and only documents changed since the index was
+   * last updated are read. Otherwise the documents are read with the plan
+   * `GetDocumentsMatchingQuery` picks, loading the documents found through an
+   * index or the target's remote keys in batches and folding each document
+   * into the aggregates as it is read. For a query with a limit, only the
+   * documents within the limit so far are kept.
+   */
+  model::ObjectValue ComputeAggregates(
+      const core::Query& query,
+      const std::vector<model::AggregateField>& aggregates,
+      const model::SnapshotVersion& last_limbo_free_snapshot_version,
+      const model::DocumentKeySet& remote_keys) const;
+
   void SetIndexAutoCreationEnabled(bool is_enabled);
 
+  /**
+   * Returns the statistics that query plans are chosen from. They are updated
+   * as queries run, and by the LocalStore as documents are written and
+   * indexed.
+   */
+  CollectionStatistics* statistics() const {
+    return &statistics_;
+  }
+
  private:
   friend class IndexManagerTest;
   friend class LocalStoreTestBase;
@@ -90,7 +160,56 @@ class QueryEngine {
    * persisted index values. Returns nullopt if an index is not available.
    */
   absl::optional<model::DocumentMap> PerformQueryUsingIndex(
-      const core::Query& query) const;
+      const core::Query& query,
+      absl::optional<QueryContext>& context,
+      QueryProfile* profile) const;
+
+  /**
+   * Adds the documents that match `query` to `aggregator`, using the entries of
+   * a full index. Returns false if no full index covers the query.
+   */
+  bool AggregateUsingIndex(const core::Query& query,
+                           LocalAggregator* aggregator) const;
+
+  /** Receives the documents that an aggregation reads. */
+  using DocumentCallback = std::function<void(const model::Document&)>;
+
+  /**
+   * Passes the documents that match `query`, which must not have a limit, to
+   * `callback`, loading the documents that an index scan returns in batches.
+   * Returns false if `PerformQueryUsingIndex` would not use an index.
+   */
+  bool AggregateUsingIndexScan(const core::Query& query,
+                               const DocumentCallback& callback) const;
+
+  /**
+   * Passes the documents that match `query`, which must not have a limit, to
+   * `callback`, loading the documents at `remote_keys` in batches. Returns
+   * false if `PerformQueryUsingRemoteKeys` would not use the remote keys.
+   */
+  bool AggregateUsingRemoteKeys(
+      const core::Query& query,
+      const model::DocumentKeySet& remote_keys,
+      const model::SnapshotVersion& last_limbo_free_snapshot_version,
+      const DocumentCallback& callback) const;
+
+  /**
+   * Returns true if reading the results of `query` through an index is
+   * estimated to cost more than a full collection scan.
+   *
+   * @param applies_limit Whether the index scan stops at the query's limit.
+   */
+  bool IndexScanCostsMore(const core::Query& query, bool applies_limit) const;
+
+  /**
+   * Returns true if `query` can be executed by reading the documents at
+   * `remote_keys` and those changed since `last_limbo_free_snapshot_version`,
+   * rather than every document of its collection.
+   */
+  bool CanUseRemoteKeys(
+      const core::Query& query,
+      const model::DocumentKeySet& remote_keys,
+      const model::SnapshotVersion& last_limbo_free_snapshot_version) const;
 
   /**
    * Performs a query based on the target's persisted query mapping. Returns
@@ -99,11 +218,19 @@ class QueryEngine {
   absl::optional<model::DocumentMap> PerformQueryUsingRemoteKeys(
       const core::Query& query,
       const model::DocumentKeySet& remote_keys,
-      const model::SnapshotVersion& last_limbo_free_snapshot_version) const;
+      const model::SnapshotVersion& last_limbo_free_snapshot_version,
+      absl::optional<QueryContext>& context,
+      QueryProfile* profile) const;
+
+  /** Reads the documents for `keys`, including local mutations. */
+  model::DocumentMap LookUpDocuments(const model::DocumentKeySet& keys,
+                                     absl::optional<QueryContext>& context,
+                                     QueryProfile* profile) const;
 
   /** Applies the query filter and sorting to the provided documents. */
   model::DocumentSet ApplyQuery(const core::Query& query,
-                                const model::DocumentMap& documents) const;
+                                const model::DocumentMap& documents,
+                                QueryProfile* profile = nullptr) const;
 
   /**
    * Determines if a limit query needs to be refilled from cache, making it
@@ -123,8 +250,27 @@ class QueryEngine {
       const model::DocumentKeySet& remote_keys,
       const model::SnapshotVersion& limbo_free_snapshot_version) const;
 
+  /**
+   * Returns the estimated cost of a full collection scan for `query`, in
+   * documents read, or nullopt if too little is known about the collection.
+   * Counts the documents of a collection whose size is not known yet.
+   */
+  absl::optional<double> EstimateFullScanCost(const core::Query& query) const;
+
+  /**
+   * Returns the estimated cost of reading the results of `query` through an
+   * index, in the unit of `EstimateFullScanCost`, or nullopt if too little is
+   * known about the collection group.
+   *
+   * @param applies_limit Whether the index scan stops at the query's limit.
+   */
+  absl::optional<double> EstimateIndexScanCost(const core::Query& query,
+                                               bool applies_limit) const;
+
   const model::DocumentMap ExecuteFullCollectionScan(
-      const core::Query& query, absl::optional<QueryContext>& context) const;
+      const core::Query& query,
+      absl::optional<QueryContext>& context,
+      QueryProfile* profile) const;
 
   /**
    * Combines the results from an indexed execution with the remaining documents
@@ -133,7 +279,9 @@ class QueryEngine {
   const model::DocumentMap AppendRemainingResults(
       const model::DocumentSet& indexedResults,
       const core::Query& query,
-      const model::IndexOffset& offset) const;
+      const model::IndexOffset& offset,
+      absl::optional<QueryContext>& context,
+      QueryProfile* profile) const;
 
   void CreateCacheIndexes(const core::Query& query,
                           const QueryContext& context,
@@ -151,6 +299,8 @@ class QueryEngine {
 
   double relative_index_read_cost_per_document_;
 
+  mutable CollectionStatistics statistics_;
+
   // For testing
   void SetIndexAutoCreationMinCollectionSize(size_t new_min) {
     index_auto_creation_min_collection_size_ = new_min;
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/query_profile.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+const char* PlanName(QueryProfile::Plan plan) {
+  switch (plan) {
+    case QueryProfile::Plan::Index:
+      return "index";
+    case QueryProfile::Plan::RemoteKeys:
+      return "remote keys";
+    case QueryProfile::Plan::FullScan:
+      return "full scan";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+void QueryProfile::AddStageTime(const std::string& name,
+                                std::chrono::microseconds duration) {
+  for (Stage& stage : stages_) {
+    if (stage.first == name) {
+      stage.second += duration;
+      return;
+    }
+  }
+  stages_.emplace_back(name, duration);
+}
+
+std::chrono::microseconds QueryProfile::total_time() const {
+  std::chrono::microseconds total{0};
+  for (const Stage& stage : stages_) {
+    total += stage.second;
+  }
+  return total;
+}
+
+std::string QueryProfile::ToString() const {
+  std::string result = absl::StrCat(
+      "plan: ", PlanName(plan_), ", index ranges: ",
+      reads_.GetIndexRangeCount(),
+      ", index entries: ", reads_.GetIndexEntryReadCount(),
+      ", documents read: ", reads_.GetDocumentReadCount(),
+      ", overlays: ", reads_.GetOverlayCount(),
+      ", matched: ", matched_document_count_,
+      ", total: ", total_time().count(), "us");
+  for (const Stage& stage : stages_) {
+    absl::StrAppend(&result, ", ", stage.first, ": ", stage.second.count(),
+                    "us");
+  }
+  return result;
+}
+
+QueryStageTimer::QueryStageTimer(QueryProfile* profile, const char* stage)
+    : profile_(profile), stage_(stage) {
+  if (profile_) {
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+QueryStageTimer::~QueryStageTimer() {
+  if (profile_) {
+    profile_->AddStageTime(
+        stage_, std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_));
+  }
+}
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIRESTORE_CORE_SRC_LOCAL_QUERY_PROFILE_H_
+#define FIRESTORE_CORE_SRC_LOCAL_QUERY_PROFILE_H_
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Firestore/core/src/local/query_context.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+
+/**
+ * Describes how the QueryEngine executed a single query against the local
+ * cache: the plan it chose, what it read and how long each stage took.
+ */
+class QueryProfile {
+ public:
+  /** The ways in which the QueryEngine can execute a query. */
+  enum class Plan {
+    /** The documents were found through a client-side index. */
+    Index,
+    /** The documents that matched the target before were read by key. */
+    RemoteKeys,
+    /** Every document in the collection was read. */
+    FullScan
+  };
+
+  using Stage = std::pair<std::string, std::chrono::microseconds>;
+
+  Plan plan() const {
+    return plan_;
+  }
+
+  void set_plan(Plan plan) {
+    plan_ = plan;
+  }
+
+  /**
+   * The index ranges, index entries, documents and overlays that were read,
+   * including those of plans that were tried and abandoned.
+   */
+  const QueryContext& reads() const {
+    return reads_;
+  }
+
+  void AddReads(const QueryContext& context) {
+    reads_.Add(context);
+  }
+
+  /** The number of documents that the query returned. */
+  size_t matched_document_count() const {
+    return matched_document_count_;
+  }
+
+  void set_matched_document_count(size_t count) {
+    matched_document_count_ = count;
+  }
+
+  /** The wall time spent in each stage, in the order they first ran. */
+  const std::vector<Stage>& stages() const {
+    return stages_;
+  }
+
+  /** Adds `duration` to the time spent in the stage called `name`. */
+  void AddStageTime(const std::string& name,
+                    std::chrono::microseconds duration);
+
+  /** Returns the sum of the time spent in all stages. */
+  std::chrono::microseconds total_time() const;
+
+  /** Returns a human-readable description of the execution. */
+  std::string ToString() const;
+
+ private:
+  Plan plan_ = Plan::FullScan;
+  QueryContext reads_;
+  size_t matched_document_count_ = 0;
+  std::vector<Stage> stages_;
+};
+
+/**
+ * Adds the wall time between its construction and destruction to a stage of
+ * a QueryProfile. Does nothing if the profile is null.
+ */
+class QueryStageTimer {
+ public:
+  QueryStageTimer(QueryProfile* profile, const char* stage);
+  ~QueryStageTimer();
+
+  QueryStageTimer(const QueryStageTimer&) = delete;
+  QueryStageTimer& operator=(const QueryStageTimer&) = delete;
+
+ private:
+  QueryProfile* profile_;
+  const char* stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
+
+#endif  // FIRESTORE_CORE_SRC_LOCAL_QUERY_PROFILE_H_
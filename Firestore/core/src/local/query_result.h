@@ -20,9 +20,12 @@
 #include <utility>
 #include <vector>
 
+#include "Firestore/core/src/local/query_profile.h"
 #include "Firestore/core/src/model/document.h"
 #include "Firestore/core/src/model/document_key_set.h"
 #include "Firestore/core/src/model/model_fwd.h"
+#include "Firestore/core/src/model/snapshot_version.h"
+#include "absl/types/optional.h"
 
 namespace firebase {
 namespace firestore {
@@ -38,6 +41,18 @@ class QueryResult {
       : documents_{std::move(documents)}, remote_keys_{std::move(remote_keys)} {
   }
 
+  /**
+   * Creates a new QueryResult that reflects all remote events up to and
+   * including `snapshot_version`.
+   */
+  QueryResult(model::DocumentMap documents,
+              model::DocumentKeySet remote_keys,
+              model::SnapshotVersion snapshot_version)
+      : documents_{std::move(documents)},
+        remote_keys_{std::move(remote_keys)},
+        snapshot_version_{std::move(snapshot_version)} {
+  }
+
   const model::DocumentMap& documents() const {
     return documents_;
   }
@@ -46,9 +61,32 @@ class QueryResult {
     return remote_keys_;
   }
 
+  /**
+   * The last remote snapshot version applied to the cache that the result was
+   * read from, or `SnapshotVersion::None()` if the query was not executed in a
+   * read-only transaction.
+   */
+  const model::SnapshotVersion& snapshot_version() const {
+    return snapshot_version_;
+  }
+
+  /**
+   * How the query was executed, if debug logging was enabled when the local
+   * store executed it.
+   */
+  const absl::optional<QueryProfile>& profile() const {
+    return profile_;
+  }
+
+  void set_profile(QueryProfile profile) {
+    profile_ = std::move(profile);
+  }
+
  private:
   model::DocumentMap documents_;
   model::DocumentKeySet remote_keys_;
+  model::SnapshotVersion snapshot_version_;
+  absl::optional<QueryProfile> profile_;
 };
 
 }  // namespace local
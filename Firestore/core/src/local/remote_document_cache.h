@@ -17,6 +17,7 @@
 #ifndef FIRESTORE_CORE_SRC_LOCAL_REMOTE_DOCUMENT_CACHE_H_
 #define FIRESTORE_CORE_SRC_LOCAL_REMOTE_DOCUMENT_CACHE_H_
 
+#include <functional>
 #include <string>
 
 #include "Firestore/core/src/model/document_key.h"
@@ -32,6 +33,7 @@ class Query;
 
 namespace local {
 
+class CollectionStatistics;
 class IndexManager;
 class QueryContext;
 
@@ -81,6 +83,20 @@ class RemoteDocumentCache {
   virtual model::MutableDocumentMap GetAll(
       const model::DocumentKeySet& keys) const = 0;
 
+  /**
+   * Returns how many of the given keys have a cached Document or NoDocument
+   * entry, without reading the entries.
+   */
+  virtual size_t CountEntries(const model::DocumentKeySet& keys) const = 0;
+
+  /**
+   * Returns the number of entries in the collection at `collection_path`, which
+   * is how many a full scan of the collection reads, without reading the
+   * entries.
+   */
+  virtual size_t CountDocuments(
+      const model::ResourcePath& collection_path) const = 0;
+
   /**
    * Looks up the next "limit" number of documents for a collection group based
    * on the provided offset. The ordering is based on the document's read time
@@ -144,12 +160,37 @@ class RemoteDocumentCache {
       absl::optional<size_t> limit = absl::nullopt,
       const model::OverlayByDocumentKeyMap& mutated_docs = {}) const = 0;
 
+  /**
+   * Calls `callback` with each document in the collection at the query's path
+   * that `GetDocumentsMatchingQuery` would return with no offset, without
+   * collecting them first. Documents are visited in an unspecified order, one
+   * at a time.
+   *
+   * @param query The query to match documents against.
+   * @param mutated_docs The documents with local mutations, which are visited
+   *     even if they don't match the query.
+   * @param callback Called with each document.
+   */
+  virtual void ForEachDocumentMatchingQuery(
+      const core::Query& query,
+      const model::OverlayByDocumentKeyMap& mutated_docs,
+      const std::function<void(model::MutableDocument&&)>& callback) const = 0;
+
   /**
    * Sets the index manager used by remote document cache.
    *
    * @param manager A pointer to an `IndexManager` owned by `Persistence`.
    */
   virtual void SetIndexManager(IndexManager* manager) = 0;
+
+  /**
+   * Sets the statistics that are told about every document this cache
+   * removes, including the ones removed by garbage collection.
+   *
+   * @param statistics A pointer to `CollectionStatistics` owned by the
+   *     `QueryEngine`.
+   */
+  virtual void SetCollectionStatistics(CollectionStatistics* statistics) = 0;
 };
 
 }  // namespace local
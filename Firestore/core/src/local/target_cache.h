@@ -32,6 +32,7 @@ class Target;
 }  // namespace core
 
 namespace local {
+class MaterializedQueryResults;
 class TargetData;
 
 using OrphanedDocumentCallback =
@@ -120,6 +121,30 @@ class TargetCache {
 
   virtual bool Contains(const model::DocumentKey& key) = 0;
 
+  // Materialized result methods
+
+  /**
+   * Stores `results` as the materialized results of the given target ID,
+   * replacing any previous ones. Results are removed along with their target.
+   */
+  virtual void SetQueryResults(model::TargetId target_id,
+                               const MaterializedQueryResults& results) = 0;
+
+  /**
+   * Returns the materialized results of the given target ID, or nullopt if
+   * none are stored.
+   */
+  virtual absl::optional<MaterializedQueryResults> GetQueryResults(
+      model::TargetId target_id) = 0;
+
+  /**
+   * Returns whether materialized results are stored for the given target,
+   * without reading them.
+   */
+  virtual bool HasQueryResults(model::TargetId target_id) = 0;
+
+  virtual void RemoveQueryResults(model::TargetId target_id) = 0;
+
   // Accessors
 
   /** Returns the number of targets cached. */
@@ -159,6 +184,16 @@ class TargetCache {
    * @param version The new snapshot version.
    */
   virtual void SetLastRemoteSnapshotVersion(model::SnapshotVersion version) = 0;
+
+  /**
+   * Reads the last remote snapshot version as seen by the current transaction.
+   *
+   * Unlike `GetLastRemoteSnapshotVersion()`, which returns the latest version
+   * known to the writer, this is consistent with the other reads made by a
+   * read-only transaction: every document the transaction reads reflects all
+   * remote events up to and including the returned version.
+   */
+  virtual model::SnapshotVersion ReadLastRemoteSnapshotVersion() = 0;
 };
 
 }  // namespace local
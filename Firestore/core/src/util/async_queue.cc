@@ -99,7 +99,7 @@ bool AsyncQueue::EnqueueEvenWhileRestricted(const Operation& operation) {
   std::lock_guard<std::mutex> lock(mutex_);
   if (mode_ == Mode::kDisposed) return false;
 
-  executor_->Execute(Wrap(operation));
+  executor_->Execute(WrapPending(operation));
   return true;
 }
 
@@ -112,10 +112,14 @@ bool AsyncQueue::EnqueueRelaxed(const Operation& operation) {
   std::lock_guard<std::mutex> lock(mutex_);
   if (mode_ != Mode::kRunning) return false;
 
-  executor_->Execute(Wrap(operation));
+  executor_->Execute(WrapPending(operation));
   return true;
 }
 
+bool AsyncQueue::HasPendingOperations() const {
+  return pending_operations_ > 0;
+}
+
 DelayedOperation AsyncQueue::EnqueueAfterDelay(Milliseconds delay,
                                                const TimerId timer_id,
                                                const Operation& operation) {
@@ -144,6 +148,14 @@ AsyncQueue::Operation AsyncQueue::Wrap(const Operation& operation) {
   return [this, operation] { this->ExecuteBlocking(operation); };
 }
 
+AsyncQueue::Operation AsyncQueue::WrapPending(const Operation& operation) {
+  ++pending_operations_;
+  return [this, operation] {
+    --pending_operations_;
+    this->ExecuteBlocking(operation);
+  };
+}
+
 void AsyncQueue::VerifySequentialOrder() const {
   // This is the inverse of `VerifyIsCurrentQueue`.
   HARD_ASSERT(!is_operation_in_progress_ || !executor_->IsCurrentExecutor(),
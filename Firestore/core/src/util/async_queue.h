@@ -73,7 +73,25 @@ enum class TimerId {
   /**
    * A timer used to periodically attempt Index Backfill
    */
-  IndexBackfillDelay
+  IndexBackfillDelay,
+
+  /**
+   * A timer used to compact the key ranges emptied by bulk deletes once no
+   * more bulk deletes have happened for a while.
+   */
+  CompactionDelay,
+
+  /**
+   * A timer used to migrate the overlays of users other than the current one
+   * once the client has started.
+   */
+  OverlayMigrationDelay,
+
+  /**
+   * A timer used to rewrite the next chunk of remote documents whose encoding
+   * does not match the field name dictionary setting.
+   */
+  RemoteDocumentRewriteDelay
 };
 
 // A serial queue that executes given operations asynchronously, one at a time.
@@ -169,6 +187,11 @@ class AsyncQueue : public std::enable_shared_from_this<AsyncQueue> {
   // restricted or disposed).
   bool is_running() const;
 
+  // Returns true if operations enqueued for immediate execution are waiting to
+  // run. Operations scheduled with `EnqueueAfterDelay` are not counted. Long
+  // running background work can use this to yield to other operations.
+  bool HasPendingOperations() const;
+
   // Puts the `operation` on the queue to be executed `delay` milliseconds from
   // now, and returns a handle that allows to cancel the operation (provided it
   // hasn't run already).
@@ -233,11 +256,15 @@ class AsyncQueue : public std::enable_shared_from_this<AsyncQueue> {
 
   Operation Wrap(const Operation& operation);
 
+  // Like `Wrap`, but counts the operation as pending until it starts running.
+  Operation WrapPending(const Operation& operation);
+
   // Asserts that the current invocation happens asynchronously on the queue.
   void VerifyIsCurrentExecutor() const;
   void VerifySequentialOrder() const;
 
   std::atomic<bool> is_operation_in_progress_;
+  std::atomic<int> pending_operations_{0};
   std::unique_ptr<Executor> executor_;
 
   mutable std::mutex mutex_;
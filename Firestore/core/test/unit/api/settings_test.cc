@@ -184,6 +184,60 @@ TEST(Settings, EqualityAndHash) {
     EXPECT_NE(settings1, settings2);
     EXPECT_NE(settings1.Hash(), settings2.Hash());
   }
+  {
+    Settings settings1;
+    settings1.set_local_cache_settings(PersistentCacheSettings{}.WithTuning(
+        PersistentCacheTuning::ForLargeCache()));
+
+    Settings settings2;
+    settings2.set_local_cache_settings(PersistentCacheSettings{}.WithTuning(
+        PersistentCacheTuning::ForLargeCache()));
+
+    EXPECT_EQ(settings1, settings2);
+    EXPECT_EQ(settings1.Hash(), settings2.Hash());
+
+    settings2.set_local_cache_settings(PersistentCacheSettings{}.WithTuning(
+        PersistentCacheTuning::ForLargeCache().WithBloomFilterBitsPerKey(0)));
+
+    EXPECT_NE(settings1, settings2);
+    EXPECT_NE(settings1.Hash(), settings2.Hash());
+  }
+}
+
+TEST(Settings, PersistentCacheTuning) {
+  Settings settings;
+  EXPECT_EQ(PersistentCacheTuning{}, settings.persistent_cache_tuning());
+
+  PersistentCacheTuning tuning = PersistentCacheTuning{}
+                                     .WithBloomFilterBitsPerKey(12)
+                                     .WithBlockCacheSizeBytes(1024)
+                                     .WithMaxOpenFiles(50);
+  EXPECT_EQ(12, tuning.bloom_filter_bits_per_key());
+  EXPECT_EQ(1024, tuning.block_cache_size_bytes());
+  EXPECT_EQ(0, tuning.block_size_bytes());
+  EXPECT_EQ(0, tuning.write_buffer_size_bytes());
+  EXPECT_EQ(50, tuning.max_open_files());
+
+  EXPECT_FALSE(tuning.field_name_dictionary_enabled());
+  PersistentCacheTuning dictionary = tuning.WithFieldNameDictionary(true);
+  EXPECT_TRUE(dictionary.field_name_dictionary_enabled());
+  EXPECT_NE(tuning, dictionary);
+  EXPECT_NE(tuning.Hash(), dictionary.Hash());
+
+  EXPECT_FALSE(tuning.query_result_materialization_enabled());
+  PersistentCacheTuning materialized =
+      tuning.WithQueryResultMaterialization(true);
+  EXPECT_TRUE(materialized.query_result_materialization_enabled());
+  EXPECT_NE(tuning, materialized);
+  EXPECT_NE(tuning.Hash(), materialized.Hash());
+
+  settings.set_local_cache_settings(
+      PersistentCacheSettings{}.WithSizeBytes(1000000).WithTuning(tuning));
+  EXPECT_EQ(tuning, settings.persistent_cache_tuning());
+  EXPECT_EQ(1000000, settings.cache_size_bytes());
+
+  settings.set_local_cache_settings(MemoryCacheSettings{});
+  EXPECT_EQ(PersistentCacheTuning{}, settings.persistent_cache_tuning());
 }
 
 }  // namespace
@@ -20,6 +20,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "Firestore/core/src/bundle/bundle_callback.h"
@@ -53,16 +54,44 @@ class BundleLoaderTest : public ::testing::Test {
     explicit TestBundleCallback(BundleLoaderTest& parant) : parent_(parant) {
     }
 
-    model::DocumentMap ApplyBundledDocuments(
-        const model::MutableDocumentMap& documents,
-        const std::string& bundle_id) override {
-      (void)bundle_id;
+    uint32_t StartBundleLoad(const BundleMetadata& metadata) override {
+      (void)metadata;
+      return parent_.documents_staged_;
+    }
+
+    void StageBundledDocuments(const model::MutableDocumentMap& documents,
+                               const BundleMetadata& metadata,
+                               uint32_t documents_staged) override {
+      (void)metadata;
       for (const auto& entry : documents) {
-        parent_.last_documents_ = parent_.last_documents_.insert(entry.first);
+        parent_.staged_documents_ =
+            parent_.staged_documents_.insert(entry.first);
+      }
+      parent_.chunk_sizes_.push_back(documents.size());
+      parent_.documents_staged_ = documents_staged;
+    }
+
+    absl::optional<model::DocumentMap> ApplyStagedDocuments(
+        const BundleMetadata& metadata, uint32_t max_documents) override {
+      (void)metadata;
+      if (parent_.staged_documents_.empty()) {
+        return absl::nullopt;
+      }
+      for (uint32_t i = 0;
+           i < max_documents && !parent_.staged_documents_.empty(); ++i) {
+        model::DocumentKey key = *parent_.staged_documents_.begin();
+        parent_.staged_documents_ = parent_.staged_documents_.erase(key);
+        parent_.last_documents_ = parent_.last_documents_.insert(key);
       }
       return DocumentMap{};
     }
 
+    void AbortBundleLoad(const BundleMetadata& metadata) override {
+      (void)metadata;
+      parent_.staged_documents_ = {};
+      parent_.documents_staged_ = 0;
+    }
+
     void SaveNamedQuery(const NamedQuery& query,
                         const model::DocumentKeySet& keys) override {
       parent_.last_queries_.insert({query.query_name(), keys});
@@ -70,6 +99,7 @@ class BundleLoaderTest : public ::testing::Test {
 
     void SaveBundle(const BundleMetadata& metadata) override {
       parent_.last_bundles_.insert({metadata.bundle_id(), metadata});
+      parent_.documents_staged_ = 0;
     }
 
    private:
@@ -99,17 +129,32 @@ class BundleLoaderTest : public ::testing::Test {
     return BundleMetadata("bundle-1", 1, create_time_, documents, 10);
   }
 
+  BundleLoader::ChunkAppliedCallback CountAppliedChunks() {
+    return [this](const DocumentMap&) { applied_chunks_++; };
+  }
+
+  std::unique_ptr<BundledDocumentMetadata> DeletedDocumentMetadata(
+      const std::string& path, std::vector<std::string> queries = {}) {
+    return absl::make_unique<BundledDocumentMetadata>(
+        testutil::Key(path), create_time_, /*exists=*/false,
+        std::move(queries));
+  }
+
  protected:
   std::unique_ptr<BundleCallback> callback_ = nullptr;
   DocumentKeySet last_documents_;
   std::unordered_map<std::string, DocumentKeySet> last_queries_;
   std::unordered_map<std::string, BundleMetadata> last_bundles_;
+  DocumentKeySet staged_documents_;
+  std::vector<size_t> chunk_sizes_;
+  uint32_t documents_staged_ = 0;
+  int applied_chunks_ = 0;
   model::SnapshotVersion create_time_ =
       model::SnapshotVersion(Timestamp::Now());
 };
 
 TEST_F(BundleLoaderTest, LoadsDocuments) {
-  BundleLoader loader(callback_.get(), CreateMetadata(2));
+  BundleLoader loader(callback_.get(), CreateMetadata(2), /*chunk_size=*/1);
 
   BundleLoader::AddElementResult result = loader.AddElement(
       absl::make_unique<BundledDocumentMetadata>(
@@ -144,7 +189,7 @@ TEST_F(BundleLoaderTest, LoadsDocuments) {
 }
 
 TEST_F(BundleLoaderTest, LoadsDeletedDocuments) {
-  BundleLoader loader(callback_.get(), CreateMetadata(1));
+  BundleLoader loader(callback_.get(), CreateMetadata(1), /*chunk_size=*/1);
 
   BundleLoader::AddElementResult result = loader.AddElement(
       absl::make_unique<BundledDocumentMetadata>(
@@ -158,6 +203,93 @@ TEST_F(BundleLoaderTest, LoadsDeletedDocuments) {
                  LoadBundleTaskState::kInProgress);
 }
 
+TEST_F(BundleLoaderTest, StagesDocumentsInChunks) {
+  BundleLoader loader(callback_.get(), CreateMetadata(3), /*chunk_size=*/2);
+
+  BundleLoader::AddElementResult result =
+      loader.AddElement(DeletedDocumentMetadata("coll/doc1"), 1);
+  EXPECT_OK(result);
+  AssertProgress(result.ValueOrDie(), /*documents_loaded=*/1,
+                 /*total_documents=*/3, /*bytes_loaded*/ 1, /*total_bytes*/ 10,
+                 LoadBundleTaskState::kInProgress);
+  EXPECT_TRUE(chunk_sizes_.empty());
+
+  result = loader.AddElement(DeletedDocumentMetadata("coll/doc2"), 1);
+  EXPECT_OK(result);
+  AssertProgress(result.ValueOrDie(), /*documents_loaded=*/2,
+                 /*total_documents=*/3, /*bytes_loaded*/ 2, /*total_bytes*/ 10,
+                 LoadBundleTaskState::kInProgress);
+  EXPECT_EQ(chunk_sizes_, std::vector<size_t>{2});
+  EXPECT_EQ(documents_staged_, 2u);
+  // Staged documents are not applied before the whole bundle is read.
+  EXPECT_TRUE(last_documents_.empty());
+
+  result = loader.AddElement(DeletedDocumentMetadata("coll/doc3"), 1);
+  EXPECT_OK(result);
+  AssertProgress(result.ValueOrDie(), /*documents_loaded=*/3,
+                 /*total_documents=*/3, /*bytes_loaded*/ 3, /*total_bytes*/ 10,
+                 LoadBundleTaskState::kInProgress);
+
+  EXPECT_OK(loader.ApplyChanges(CountAppliedChunks()));
+  EXPECT_EQ(chunk_sizes_, (std::vector<size_t>{2, 1}));
+  // The changes of each applied chunk are raised separately.
+  EXPECT_EQ(applied_chunks_, 2);
+  EXPECT_EQ(last_documents_.size(), 3u);
+  EXPECT_TRUE(staged_documents_.empty());
+  EXPECT_EQ(last_bundles_["bundle-1"], CreateMetadata(3));
+}
+
+TEST_F(BundleLoaderTest, ResumesInterruptedLoad) {
+  // An earlier load staged the first chunk before it was interrupted.
+  staged_documents_ = DocumentKeySet{testutil::Key("coll/doc1"),
+                                     testutil::Key("coll/doc2")};
+  documents_staged_ = 2;
+  BundleLoader loader(callback_.get(), CreateMetadata(3), /*chunk_size=*/2);
+
+  EXPECT_OK(loader.AddElement(
+      DeletedDocumentMetadata("coll/doc1", {"query-1"}), 1));
+  BundleLoader::AddElementResult result =
+      loader.AddElement(DeletedDocumentMetadata("coll/doc2"), 1);
+  EXPECT_OK(result);
+  AssertProgress(result.ValueOrDie(), /*documents_loaded=*/2,
+                 /*total_documents=*/3, /*bytes_loaded*/ 2, /*total_bytes*/ 10,
+                 LoadBundleTaskState::kInProgress);
+  EXPECT_OK(loader.AddElement(
+      DeletedDocumentMetadata("coll/doc3", {"query-1"}), 1));
+  EXPECT_OK(loader.AddElement(
+      absl::make_unique<NamedQuery>(
+          "query-1",
+          BundledQuery(testutil::Query("coll").ToTarget(), LimitType::First),
+          create_time_),
+      /*byte_size=*/7));
+  EXPECT_OK(loader.ApplyChanges(CountAppliedChunks()));
+
+  // Only the documents after the staged chunk are staged again, but all of
+  // them are applied and the named query still matches the skipped ones.
+  EXPECT_EQ(chunk_sizes_, std::vector<size_t>{1});
+  EXPECT_EQ(last_documents_.size(), 3u);
+  EXPECT_EQ(last_queries_["query-1"],
+            (DocumentKeySet{testutil::Key("coll/doc1"),
+                            testutil::Key("coll/doc3")}));
+  EXPECT_EQ(documents_staged_, 0u);
+}
+
+TEST_F(BundleLoaderTest, DiscardsStagedDocumentsOfInvalidBundle) {
+  BundleLoader loader(callback_.get(), CreateMetadata(3), /*chunk_size=*/1);
+
+  EXPECT_OK(loader.AddElement(DeletedDocumentMetadata("coll/doc1"), 1));
+  EXPECT_OK(loader.AddElement(DeletedDocumentMetadata("coll/doc2"), 1));
+  EXPECT_EQ(documents_staged_, 2u);
+
+  // BundleMetadata says there are 3 documents, but only 2 are found.
+  EXPECT_NOT_OK(loader.ApplyChanges(CountAppliedChunks()));
+  EXPECT_TRUE(staged_documents_.empty());
+  EXPECT_EQ(documents_staged_, 0u);
+  EXPECT_TRUE(last_documents_.empty());
+  EXPECT_TRUE(last_bundles_.empty());
+  EXPECT_EQ(applied_chunks_, 0);
+}
+
 TEST_F(BundleLoaderTest, AppliesDocumentChanges) {
   BundleLoader loader(callback_.get(), CreateMetadata(1));
 
@@ -169,7 +301,7 @@ TEST_F(BundleLoaderTest, AppliesDocumentChanges) {
   EXPECT_OK(loader.AddElement(
       absl::make_unique<BundleDocument>(testutil::Doc("coll/doc1", 1)),
       /*byte_size=*/9));
-  EXPECT_OK(loader.ApplyChanges());
+  EXPECT_OK(loader.ApplyChanges(CountAppliedChunks()));
 
   EXPECT_EQ(last_documents_, DocumentKeySet{testutil::Key("coll/doc1")});
   EXPECT_EQ(last_bundles_["bundle-1"], CreateMetadata(1));
@@ -200,7 +332,7 @@ TEST_F(BundleLoaderTest, AppliesNamedQueries) {
           BundledQuery(testutil::Query("foo").ToTarget(), LimitType::First),
           create_time_),
       /*byte_size=*/4));
-  (void)loader.ApplyChanges();
+  (void)loader.ApplyChanges(CountAppliedChunks());
 
   EXPECT_EQ(last_queries_["query-1"],
             DocumentKeySet{testutil::Key("coll/doc1")});
@@ -236,7 +368,7 @@ TEST_F(BundleLoaderTest, VerifiesDocumentFollowsMetadata) {
                                   /*exists=*/true, std::vector<std::string>{}),
                               /*byte_size=*/10));
   // Metadata says document exists, but document is missing.
-  EXPECT_NOT_OK(loader.ApplyChanges());
+  EXPECT_NOT_OK(loader.ApplyChanges(CountAppliedChunks()));
 }
 
 TEST_F(BundleLoaderTest, VerifiesDocumentCount) {
@@ -247,7 +379,7 @@ TEST_F(BundleLoaderTest, VerifiesDocumentCount) {
                                   /*exists=*/false, std::vector<std::string>{}),
                               /*byte_size=*/10));
   // BundleMetadata says there are 2 documents, but only 1 is found.
-  EXPECT_NOT_OK(loader.ApplyChanges());
+  EXPECT_NOT_OK(loader.ApplyChanges(CountAppliedChunks()));
 }
 
 }  //  namespace
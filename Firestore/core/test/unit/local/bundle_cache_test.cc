@@ -27,6 +27,7 @@
 #include "Firestore/core/src/core/target.h"
 #include "Firestore/core/src/local/bundle_cache.h"
 #include "Firestore/core/src/local/persistence.h"
+#include "Firestore/core/src/model/mutable_document.h"
 #include "Firestore/core/src/util/hard_assert.h"
 #include "Firestore/core/test/unit/testutil/testutil.h"
 #include "gtest/gtest.h"
@@ -48,6 +49,8 @@ namespace {
 using bundle::BundledQuery;
 using bundle::BundleMetadata;
 using bundle::NamedQuery;
+using model::MutableDocument;
+using model::MutableDocumentMap;
 using core::Query;
 using core::Target;
 using model::SnapshotVersion;
@@ -77,6 +80,51 @@ TEST_P(BundleCacheTest, ReturnsSavedBundle) {
   });
 }
 
+TEST_P(BundleCacheTest, SavesBundleLoadProgress) {
+  persistence_->Run("test_saves_bundle_load_progress", [&] {
+    auto bundle =
+        BundleMetadata("bundle-1", 1, SnapshotVersion(Timestamp(1, 2)));
+    EXPECT_EQ(cache_->GetBundleLoadProgress(bundle), absl::nullopt);
+
+    cache_->SaveBundleLoadProgress(bundle, 1000);
+    EXPECT_EQ(cache_->GetBundleLoadProgress(bundle), 1000u);
+
+    // A newer bundle with the same id starts from the beginning.
+    auto newer =
+        BundleMetadata("bundle-1", 1, SnapshotVersion(Timestamp(1, 3)));
+    EXPECT_EQ(cache_->GetBundleLoadProgress(newer), absl::nullopt);
+
+    cache_->RemoveBundleLoad("bundle-1");
+    EXPECT_EQ(cache_->GetBundleLoadProgress(bundle), absl::nullopt);
+  });
+}
+
+TEST_P(BundleCacheTest, StagesBundledDocuments) {
+  persistence_->Run("test_stages_bundled_documents", [&] {
+    MutableDocument doc1 = testutil::Doc("coll/doc1", 1, testutil::Map());
+    MutableDocument doc2 = testutil::DeletedDoc("coll/doc2", 1);
+    MutableDocument doc3 = testutil::Doc("coll/doc3", 1, testutil::Map());
+    cache_->StageBundledDocument("bundle-1", doc1);
+    cache_->StageBundledDocument("bundle-1", doc2);
+    cache_->StageBundledDocument("bundle-1", doc3);
+    cache_->StageBundledDocument("bundle-2", doc1);
+
+    MutableDocumentMap taken = cache_->TakeStagedDocuments("bundle-1", 2);
+    ASSERT_EQ(taken.size(), 2u);
+    EXPECT_EQ(taken.find(doc1.key())->second, doc1);
+    EXPECT_EQ(taken.find(doc2.key())->second, doc2);
+
+    taken = cache_->TakeStagedDocuments("bundle-1", 2);
+    ASSERT_EQ(taken.size(), 1u);
+    EXPECT_EQ(taken.find(doc3.key())->second, doc3);
+    EXPECT_TRUE(cache_->TakeStagedDocuments("bundle-1", 2).empty());
+
+    // Removing a load discards the documents it staged.
+    cache_->RemoveBundleLoad("bundle-2");
+    EXPECT_TRUE(cache_->TakeStagedDocuments("bundle-2", 2).empty());
+  });
+}
+
 TEST_P(BundleCacheTest, ReturnsNullOptWhenNamedQueryNotFound) {
   persistence_->Run("test_returns_nullopt_when_named_query_not_found", [&] {
     EXPECT_EQ(cache_->GetNamedQuery("query-1"), absl::nullopt);
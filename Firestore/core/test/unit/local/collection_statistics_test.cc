@@ -0,0 +1,202 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/collection_statistics.h"
+
+#include <string>
+
+#include "Firestore/core/src/core/query.h"
+#include "Firestore/core/src/core/target.h"
+#include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
+#include "gtest/gtest.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using model::MutableDocument;
+using testutil::Array;
+using testutil::DeletedDoc;
+using testutil::Doc;
+using testutil::Field;
+using testutil::Filter;
+using testutil::Map;
+using testutil::Query;
+using testutil::Resource;
+
+TEST(CollectionStatisticsTest, CountsDocumentsOnceScanned) {
+  CollectionStatistics statistics;
+  MutableDocument missing =
+      MutableDocument::InvalidDocument(testutil::Key("coll/new"));
+
+  // Writes to a collection that was never scanned are not counted.
+  statistics.RecordDocumentChange(missing, Doc("coll/new", 1, Map()));
+  EXPECT_EQ(statistics.GetDocumentCount(Resource("coll")), absl::nullopt);
+
+  statistics.RecordCollectionScan(Resource("coll"), 10);
+  statistics.RecordCollectionScan(Resource("doc/a/coll"), 5);
+  statistics.RecordDocumentChange(missing, Doc("coll/new", 1, Map()));
+  statistics.RecordDocumentChange(Doc("coll/a", 1, Map()),
+                                  Doc("coll/a", 2, Map("a", 1)));
+  // Deleted documents stay in the cache until they are removed.
+  statistics.RecordDocumentChange(Doc("coll/b", 1, Map()),
+                                  DeletedDoc("coll/b", 2));
+  statistics.RecordDocumentRemoved(testutil::Key("coll/b"));
+  statistics.RecordDocumentRemoved(testutil::Key("coll/c"));
+
+  EXPECT_EQ(statistics.GetDocumentCount(Resource("coll")), 9u);
+  EXPECT_EQ(statistics.GetDocumentCount(Resource("doc/a/coll")), 5u);
+  EXPECT_EQ(statistics.GetCollectionGroupDocumentCount("coll"), 14u);
+  EXPECT_EQ(statistics.GetCollectionGroupDocumentCount("other"),
+            absl::nullopt);
+}
+
+TEST(CollectionStatisticsTest, CapsTrackedCollections) {
+  CollectionStatistics statistics;
+  for (int i = 0; i < 1000; ++i) {
+    statistics.RecordCollectionScan(
+        Resource("doc/" + std::to_string(i) + "/coll"), 1);
+  }
+
+  // Older collections are evicted, but the latest scan is always kept.
+  EXPECT_EQ(statistics.GetDocumentCount(Resource("doc/999/coll")), 1u);
+  EXPECT_EQ(statistics.GetCollectionGroupDocumentCount("coll"), 256u);
+}
+
+TEST(CollectionStatisticsTest, CapsTrackedCollectionGroups) {
+  CollectionStatistics statistics;
+  for (int i = 0; i < 1000; ++i) {
+    statistics.RecordCollectionScan(Resource("coll" + std::to_string(i)), 1);
+  }
+
+  size_t tracked = 0;
+  for (int i = 0; i < 1000; ++i) {
+    if (statistics.GetDocumentCount(Resource("coll" + std::to_string(i)))) {
+      ++tracked;
+    }
+  }
+  EXPECT_EQ(tracked, 256u);
+  EXPECT_EQ(statistics.GetDocumentCount(Resource("coll999")), 1u);
+}
+
+TEST(CollectionStatisticsTest, EvictsLeastRecentlyUsedEntries) {
+  CollectionStatistics statistics;
+  for (int i = 0; i < 256; ++i) {
+    statistics.RecordCollectionScan(
+        Resource("doc/" + std::to_string(i) + "/coll"), 1);
+  }
+  // Reading a count keeps it from being evicted next.
+  EXPECT_EQ(statistics.GetDocumentCount(Resource("doc/0/coll")), 1u);
+  statistics.RecordCollectionScan(Resource("doc/256/coll"), 1);
+  EXPECT_EQ(statistics.GetDocumentCount(Resource("doc/0/coll")), 1u);
+  EXPECT_EQ(statistics.GetDocumentCount(Resource("doc/1/coll")),
+            absl::nullopt);
+
+  CollectionStatistics groups;
+  for (int i = 0; i < 256; ++i) {
+    groups.RecordCollectionScan(Resource("coll" + std::to_string(i)), 1);
+  }
+  EXPECT_EQ(groups.GetCollectionGroupDocumentCount("coll0"), 1u);
+  groups.RecordCollectionScan(Resource("coll256"), 1);
+  EXPECT_EQ(groups.GetCollectionGroupDocumentCount("coll0"), 1u);
+  EXPECT_EQ(groups.GetCollectionGroupDocumentCount("coll1"), absl::nullopt);
+}
+
+TEST(CollectionStatisticsTest, EstimatesDistinctValues) {
+  CollectionStatistics statistics;
+  for (int i = 0; i < 10000; ++i) {
+    statistics.RecordDocumentValues(Doc("coll/" + std::to_string(i), 1,
+                                        Map("id", i, "parity", i % 2)));
+  }
+
+  EXPECT_EQ(statistics.EstimateDistinctValues("coll", Field("parity")), 2);
+  absl::optional<double> ids =
+      statistics.EstimateDistinctValues("coll", Field("id"));
+  ASSERT_TRUE(ids.has_value());
+  EXPECT_GT(*ids, 5000);
+  EXPECT_LT(*ids, 20000);
+  EXPECT_EQ(statistics.EstimateDistinctValues("coll", Field("other")),
+            absl::nullopt);
+}
+
+TEST(CollectionStatisticsTest, DoesNotTrackArrayOrMapValues) {
+  CollectionStatistics statistics;
+  statistics.RecordDocumentValues(
+      Doc("coll/a", 1,
+          Map("array", Array(1, 2), "map", Map("a", 1), "string", "a")));
+
+  EXPECT_EQ(statistics.EstimateDistinctValues("coll", Field("array")),
+            absl::nullopt);
+  EXPECT_EQ(statistics.EstimateDistinctValues("coll", Field("map")),
+            absl::nullopt);
+  EXPECT_EQ(statistics.EstimateDistinctValues("coll", Field("string")), 1);
+}
+
+TEST(CollectionStatisticsTest, EstimatesSelectivityFromDistinctValues) {
+  CollectionStatistics statistics;
+  for (int i = 0; i < 4; ++i) {
+    statistics.RecordDocumentValues(
+        Doc("coll/" + std::to_string(i), 1, Map("a", i, "b", i % 2)));
+  }
+
+  auto selectivity = [&](const core::Query& query) {
+    return statistics.EstimateSelectivity(query.ToTarget());
+  };
+  EXPECT_EQ(selectivity(Query("coll").AddingFilter(Filter("a", "==", 1))),
+            0.25);
+  EXPECT_EQ(
+      selectivity(Query("coll").AddingFilter(Filter("a", "in", Array(1, 2)))),
+      0.5);
+  EXPECT_EQ(selectivity(Query("coll").AddingFilter(Filter("a", "!=", 1))),
+            0.75);
+  EXPECT_EQ(selectivity(Query("coll")
+                            .AddingFilter(Filter("a", "==", 1))
+                            .AddingFilter(Filter("b", "==", 1))),
+            0.125);
+  EXPECT_EQ(selectivity(Query("coll").AddingFilter(Filter("a", ">", 1))),
+            absl::nullopt);
+}
+
+TEST(CollectionStatisticsTest, EstimatesSelectivityFromIndexScans) {
+  CollectionStatistics statistics;
+  core::Target target =
+      Query("coll").AddingFilter(Filter("a", ">", 1)).ToTarget();
+
+  // Scans are only recorded once the size of the collection group is known.
+  statistics.RecordIndexScan(target, 10);
+  EXPECT_EQ(statistics.EstimateSelectivity(target), absl::nullopt);
+
+  statistics.RecordCollectionScan(Resource("coll"), 1000);
+  statistics.RecordIndexScan(target, 10);
+  statistics.RecordIndexScan(target, 12);
+  statistics.RecordIndexScan(target, 900);
+
+  absl::optional<double> selectivity = statistics.EstimateSelectivity(target);
+  ASSERT_TRUE(selectivity.has_value());
+  EXPECT_GT(*selectivity, 1.0 / 128);
+  EXPECT_LT(*selectivity, 1.0 / 64);
+
+  core::Target other_field =
+      Query("coll").AddingFilter(Filter("b", ">", 1)).ToTarget();
+  EXPECT_EQ(statistics.EstimateSelectivity(other_field), absl::nullopt);
+}
+
+}  // namespace
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -16,6 +16,8 @@
 
 #include "Firestore/core/test/unit/local/counting_query_engine.h"
 
+#include <utility>
+
 #include "Firestore/core/src/local/local_documents_view.h"
 #include "Firestore/core/src/model/model_fwd.h"
 #include "Firestore/core/src/model/mutable_document.h"
@@ -176,6 +178,18 @@ model::MutableDocumentMap WrappedRemoteDocumentCache::GetAll(
   return result;
 }
 
+size_t WrappedRemoteDocumentCache::CountEntries(
+    const model::DocumentKeySet& keys) const {
+  // Only the keys are read, so no documents are counted as read.
+  return subject_->CountEntries(keys);
+}
+
+size_t WrappedRemoteDocumentCache::CountDocuments(
+    const model::ResourcePath& collection_path) const {
+  // Only the keys are read, so no documents are counted as read.
+  return subject_->CountDocuments(collection_path);
+}
+
 model::MutableDocumentMap WrappedRemoteDocumentCache::GetAll(
     const std::string& collection_group,
     const model::IndexOffset& offset,
@@ -185,6 +199,17 @@ model::MutableDocumentMap WrappedRemoteDocumentCache::GetAll(
   return result;
 }
 
+void WrappedRemoteDocumentCache::ForEachDocumentMatchingQuery(
+    const core::Query& query,
+    const model::OverlayByDocumentKeyMap& mutated_docs,
+    const std::function<void(model::MutableDocument&&)>& callback) const {
+  subject_->ForEachDocumentMatchingQuery(
+      query, mutated_docs, [&](model::MutableDocument&& document) {
+        ++query_engine_->documents_read_by_query_;
+        callback(std::move(document));
+      });
+}
+
 model::MutableDocumentMap WrappedRemoteDocumentCache::GetDocumentsMatchingQuery(
     const core::Query& query,
     const model::IndexOffset& offset,
@@ -17,6 +17,7 @@
 #ifndef FIRESTORE_CORE_TEST_UNIT_LOCAL_COUNTING_QUERY_ENGINE_H_
 #define FIRESTORE_CORE_TEST_UNIT_LOCAL_COUNTING_QUERY_ENGINE_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -191,6 +192,9 @@ class WrappedRemoteDocumentCache : public RemoteDocumentCache {
 
   model::MutableDocumentMap GetAll(
       const model::DocumentKeySet& keys) const override;
+  size_t CountEntries(const model::DocumentKeySet& keys) const override;
+  size_t CountDocuments(
+      const model::ResourcePath& collection_path) const override;
 
   model::MutableDocumentMap GetAll(const std::string& collection_group,
                                    const model::IndexOffset& offset,
@@ -209,10 +213,20 @@ class WrappedRemoteDocumentCache : public RemoteDocumentCache {
       absl::optional<size_t> limit,
       const model::OverlayByDocumentKeyMap& mutated_docs) const override;
 
+  void ForEachDocumentMatchingQuery(
+      const core::Query& query,
+      const model::OverlayByDocumentKeyMap& mutated_docs,
+      const std::function<void(model::MutableDocument&&)>& callback)
+      const override;
+
   void SetIndexManager(IndexManager* manager) override {
     index_manager_ = NOT_NULL(manager);
   }
 
+  void SetCollectionStatistics(CollectionStatistics* statistics) override {
+    subject_->SetCollectionStatistics(statistics);
+  }
+
  private:
   RemoteDocumentCache* subject_ = nullptr;
   IndexManager* index_manager_ = nullptr;
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/decoded_document_cache.h"
+
+#include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
+#include "gtest/gtest.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using model::MutableDocument;
+using testutil::Doc;
+using testutil::Key;
+using testutil::Map;
+using testutil::Version;
+
+MutableDocument DocAtReadTime(absl::string_view key, int64_t read_time) {
+  return Doc(key, 1, Map("value", "a")).WithReadTime(Version(read_time));
+}
+
+}  // namespace
+
+TEST(DecodedDocumentCacheTest, ReturnsDocumentAtMatchingReadTime) {
+  DecodedDocumentCache cache;
+  MutableDocument doc = DocAtReadTime("coll/a", 10);
+  cache.Insert(doc, 100);
+
+  EXPECT_EQ(cache.Lookup(Key("coll/a"), Version(10)), doc);
+  EXPECT_EQ(cache.Lookup(Key("coll/a"), Version(11)), absl::nullopt);
+  EXPECT_EQ(cache.Lookup(Key("coll/b"), Version(10)), absl::nullopt);
+  EXPECT_EQ(cache.hit_count(), 1);
+  EXPECT_EQ(cache.miss_count(), 2);
+}
+
+TEST(DecodedDocumentCacheTest, ReturnsIndependentCopies) {
+  DecodedDocumentCache cache;
+  cache.Insert(DocAtReadTime("coll/a", 10), 100);
+
+  MutableDocument copy = *cache.Lookup(Key("coll/a"), Version(10));
+  copy.data().Set(testutil::Field("value"), testutil::Value("b"));
+
+  EXPECT_EQ(cache.Lookup(Key("coll/a"), Version(10)),
+            DocAtReadTime("coll/a", 10));
+}
+
+TEST(DecodedDocumentCacheTest, InsertReplacesOtherReadTimes) {
+  DecodedDocumentCache cache;
+  cache.Insert(DocAtReadTime("coll/a", 10), 100);
+  cache.Insert(DocAtReadTime("coll/a", 20), 50);
+
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_EQ(cache.size_bytes(), 50);
+  EXPECT_EQ(cache.Lookup(Key("coll/a"), Version(10)), absl::nullopt);
+  EXPECT_NE(cache.Lookup(Key("coll/a"), Version(20)), absl::nullopt);
+}
+
+TEST(DecodedDocumentCacheTest, Invalidate) {
+  DecodedDocumentCache cache;
+  cache.Insert(DocAtReadTime("coll/a", 10), 100);
+  cache.Insert(DocAtReadTime("coll/b", 10), 100);
+
+  cache.Invalidate(Key("coll/a"));
+
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_EQ(cache.size_bytes(), 100);
+  EXPECT_EQ(cache.Lookup(Key("coll/a"), Version(10)), absl::nullopt);
+  EXPECT_NE(cache.Lookup(Key("coll/b"), Version(10)), absl::nullopt);
+}
+
+TEST(DecodedDocumentCacheTest, EvictsLeastRecentlyUsed) {
+  DecodedDocumentCache cache(250);
+  cache.Insert(DocAtReadTime("coll/a", 10), 100);
+  cache.Insert(DocAtReadTime("coll/b", 10), 100);
+
+  // Touch "a" so that "b" is the least recently used.
+  EXPECT_NE(cache.Lookup(Key("coll/a"), Version(10)), absl::nullopt);
+  cache.Insert(DocAtReadTime("coll/c", 10), 100);
+
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_EQ(cache.size_bytes(), 200);
+  EXPECT_NE(cache.Lookup(Key("coll/a"), Version(10)), absl::nullopt);
+  EXPECT_EQ(cache.Lookup(Key("coll/b"), Version(10)), absl::nullopt);
+  EXPECT_NE(cache.Lookup(Key("coll/c"), Version(10)), absl::nullopt);
+
+  cache.SetMaxSizeBytes(100);
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_NE(cache.Lookup(Key("coll/c"), Version(10)), absl::nullopt);
+}
+
+TEST(DecodedDocumentCacheTest, DoesNotCacheDocumentsLargerThanBudget) {
+  DecodedDocumentCache cache(100);
+  cache.Insert(DocAtReadTime("coll/a", 10), 101);
+  EXPECT_EQ(cache.size(), 0u);
+
+  DecodedDocumentCache disabled(0);
+  disabled.Insert(DocAtReadTime("coll/a", 10), 1);
+  EXPECT_EQ(disabled.size(), 0u);
+}
+
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "Firestore/core/src/local/index_backfiller.h"
+
+#include <chrono>  // NOLINT(build/c++11)
+
 #include "Firestore/core/src/core/filter.h"
 #include "Firestore/core/src/core/target.h"
 #include "Firestore/core/src/credentials/user.h"
@@ -554,6 +557,82 @@ TEST_F(IndexBackfillerTest, ReindexesDocumentsWhenNewIndexIsAdded) {
   VerifyQueryResults(query_b, {"coll/doc2"});
 }
 
+TEST_F(IndexBackfillerTest, ReportsProgressPerCollectionGroup) {
+  SetMaxDocumentsToProcess(3);
+
+  AddFieldIndex("coll1", "foo");
+  AddFieldIndex("coll2", "foo");
+  AddDoc("coll1/docA", Version(10), "foo", 1);
+  AddDoc("coll1/docB", Version(20), "foo", 1);
+  AddDoc("coll2/docA", Version(30), "foo", 1);
+  AddDoc("coll2/docB", Version(40), "foo", 1);
+
+  local_store_.Backfill();
+  const auto& progress = index_backfiller_->progress();
+  ASSERT_EQ(2u, progress.at("coll1").documents_processed);
+  ASSERT_TRUE(progress.at("coll1").up_to_date);
+  ASSERT_EQ(1u, progress.at("coll2").documents_processed);
+  ASSERT_FALSE(progress.at("coll2").up_to_date);
+
+  local_store_.Backfill();
+  ASSERT_EQ(2u, progress.at("coll2").documents_processed);
+  ASSERT_TRUE(progress.at("coll2").up_to_date);
+}
+
+TEST_F(IndexBackfillerTest, AdjustsCapToThroughput) {
+  SetMaxDocumentsToProcess(100);
+
+  // The cap stays put until a run has been measured.
+  index_backfiller_->SetTargetDuration(std::chrono::milliseconds(50));
+  ASSERT_EQ(100u, index_backfiller_->max_documents_to_process());
+
+  // Growth is limited to twice the largest measured run.
+  index_backfiller_->RecordThroughput(100, std::chrono::milliseconds(1));
+  index_backfiller_->SetTargetDuration(std::chrono::milliseconds(50));
+  ASSERT_EQ(200u, index_backfiller_->max_documents_to_process());
+
+  index_backfiller_->RecordThroughput(200, std::chrono::milliseconds(40));
+  index_backfiller_->SetTargetDuration(std::chrono::milliseconds(50));
+  ASSERT_EQ(250u, index_backfiller_->max_documents_to_process());
+
+  index_backfiller_->RecordThroughput(250, std::chrono::milliseconds(100));
+  index_backfiller_->SetTargetDuration(std::chrono::milliseconds(20));
+  ASSERT_EQ(50u, index_backfiller_->max_documents_to_process());
+
+  // Runs that stop short of the cap are ignored.
+  index_backfiller_->RecordThroughput(10, std::chrono::milliseconds(100));
+  index_backfiller_->SetTargetDuration(std::chrono::milliseconds(20));
+  ASSERT_EQ(50u, index_backfiller_->max_documents_to_process());
+}
+
+TEST_F(IndexBackfillerTest, SizesEachRunForItsTargetDuration) {
+  SetMaxDocumentsToProcess(400);
+  index_backfiller_->RecordThroughput(400, std::chrono::milliseconds(40));
+
+  // Switching between a busy and an idle target takes effect on the next run,
+  // not only after it has been measured.
+  index_backfiller_->SetTargetDuration(std::chrono::milliseconds(10));
+  ASSERT_EQ(100u, index_backfiller_->max_documents_to_process());
+  index_backfiller_->SetTargetDuration(std::chrono::milliseconds(50));
+  ASSERT_EQ(500u, index_backfiller_->max_documents_to_process());
+  index_backfiller_->SetTargetDuration(std::chrono::milliseconds(10));
+  ASSERT_EQ(100u, index_backfiller_->max_documents_to_process());
+}
+
+TEST_F(IndexBackfillerTest, BackfillSliceReportsRemainingDocuments) {
+  SetMaxDocumentsToProcess(2);
+
+  AddFieldIndex("coll", "foo");
+  AddDoc("coll/docA", Version(10), "foo", 1);
+  AddDoc("coll/docB", Version(20), "foo", 1);
+  AddDoc("coll/docC", Version(30), "foo", 1);
+
+  ASSERT_TRUE(local_store_.BackfillSlice(std::chrono::milliseconds(50)));
+  while (local_store_.BackfillSlice(std::chrono::milliseconds(50))) {
+  }
+  VerifyQueryResults("coll", {"coll/docA", "coll/docB", "coll/docC"});
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/leveldb_compactor.h"
+
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "Firestore/core/src/credentials/user.h"
+#include "Firestore/core/src/local/leveldb_key.h"
+#include "Firestore/core/src/local/leveldb_lru_reference_delegate.h"
+#include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_remote_document_cache.h"
+#include "Firestore/core/src/local/local_store.h"
+#include "Firestore/core/src/local/query_engine.h"
+#include "Firestore/core/src/local/reference_set.h"
+#include "Firestore/core/test/unit/local/persistence_testing.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "leveldb/db.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+class LevelDbCompactorTest : public ::testing::Test {
+ protected:
+  LevelDbCompactorTest()
+      : persistence_(LevelDbPersistenceForTesting()),
+        compactor_(persistence_->compactor()) {
+  }
+
+  ~LevelDbCompactorTest() override {
+    persistence_->Shutdown();
+  }
+
+  std::unique_ptr<LevelDbPersistence> persistence_;
+  LevelDbCompactor* compactor_;
+};
+
+TEST_F(LevelDbCompactorTest, CompactsOnceEnoughKeysAreDeleted) {
+  ASSERT_FALSE(compactor_->ShouldCompact());
+
+  compactor_->AddRange("a", "b",
+                       LevelDbCompactor::kMinDeletedKeysToCompact - 1);
+  ASSERT_FALSE(compactor_->ShouldCompact());
+
+  compactor_->AddPrefix("c", 1);
+  ASSERT_TRUE(compactor_->ShouldCompact());
+
+  compactor_->CompactPendingRanges();
+  ASSERT_FALSE(compactor_->ShouldCompact());
+
+  LevelDbCompactionStats stats = compactor_->stats();
+  ASSERT_EQ(2, stats.ranges_recorded);
+  ASSERT_EQ(2, stats.ranges_compacted);
+}
+
+TEST_F(LevelDbCompactorTest, MergesOverlappingRanges) {
+  compactor_->AddRange("a", "c", 1);
+  compactor_->AddRange("x", "y", 1);
+  compactor_->AddRange("b", "d", 1);
+  compactor_->AddRange("d", "e", 1);
+
+  compactor_->CompactPendingRanges();
+
+  LevelDbCompactionStats stats = compactor_->stats();
+  ASSERT_EQ(4, stats.ranges_recorded);
+  ASSERT_EQ(2, stats.ranges_compacted);
+
+  // Nothing is left to compact.
+  compactor_->CompactPendingRanges();
+  ASSERT_EQ(2, compactor_->stats().ranges_compacted);
+}
+
+TEST_F(LevelDbCompactorTest, RecordsRangesDeletedByDeleteAllFieldIndexes) {
+  std::string prefix = LevelDbIndexEntryKey::KeyPrefix();
+  persistence_->Run("write index entries", [&] {
+    for (int i = 0; i < 10; ++i) {
+      persistence_->current_transaction()->Put(absl::StrCat(prefix, i), "");
+    }
+  });
+
+  QueryEngine query_engine;
+  LocalStore local_store(persistence_.get(), &query_engine,
+                         credentials::User::Unauthenticated());
+  local_store.DeleteAllFieldIndexes();
+  ASSERT_EQ(1, compactor_->stats().ranges_recorded);
+
+  compactor_->CompactPendingRanges();
+  ASSERT_EQ(1, compactor_->stats().ranges_compacted);
+
+  std::unique_ptr<leveldb::Iterator> it(
+      persistence_->ptr()->NewIterator(leveldb::ReadOptions()));
+  it->Seek(prefix);
+  ASSERT_TRUE(!it->Valid() || !it->key().starts_with(prefix));
+}
+
+TEST_F(LevelDbCompactorTest, RecordsRangePerCollectionOfCollectedDocuments) {
+  LevelDbRemoteDocumentCache* cache = persistence_->remote_document_cache();
+  cache->SetIndexManager(
+      persistence_->GetIndexManager(credentials::User::Unauthenticated()));
+  ReferenceSet pins;
+  LevelDbLruReferenceDelegate* delegate = persistence_->reference_delegate();
+  delegate->AddInMemoryPins(&pins);
+  persistence_->Run("add orphaned documents", [&] {
+    for (const char* path : {"a/1", "b/1", "a/2", "b/2"}) {
+      cache->Add(testutil::Doc(path, 1, testutil::Map("v", 1)),
+                 testutil::Version(1));
+      delegate->RemoveMutationReference(testutil::Key(path));
+    }
+  });
+
+  int removed = persistence_->Run("collect garbage", [&] {
+    return delegate->RemoveOrphanedDocuments(
+        std::numeric_limits<model::ListenSequenceNumber>::max());
+  });
+  ASSERT_EQ(4, removed);
+
+  // One range per collection, plus the removed prefix of the orphaned
+  // documents index.
+  ASSERT_EQ(3, compactor_->stats().ranges_recorded);
+}
+
+}  // namespace
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -887,6 +887,26 @@ TEST_F(LevelDbIndexManagerTest, LimitAppliesOrdering) {
   });
 }
 
+TEST_F(LevelDbIndexManagerTest, LimitMergesArrayRangesInOrder) {
+  persistence_->Run("TestLimitMergesArrayRangesInOrder", [&]() {
+    index_manager_->Start();
+    index_manager_->AddFieldIndex(
+        MakeFieldIndex("coll", "tags", model::Segment::kContains, "value",
+                       model::Segment::kAscending));
+    AddDoc("coll/doc1", Map("tags", Array("a"), "value", 4));
+    AddDoc("coll/doc2", Map("tags", Array("b"), "value", 1));
+    AddDoc("coll/doc3", Map("tags", Array("a", "b"), "value", 2));
+    AddDoc("coll/doc4", Map("tags", Array("a"), "value", 3));
+    AddDoc("coll/doc5", Map("tags", Array("b"), "value", 5));
+    auto query =
+        Query("coll")
+            .AddingFilter(Filter("tags", "array-contains-any", Array("a", "b")))
+            .AddingOrderBy(OrderBy("value"))
+            .WithLimitToFirst(3);
+    VerifyResults(query, {"coll/doc2", "coll/doc3", "coll/doc4"});
+  });
+}
+
 TEST_F(LevelDbIndexManagerTest, IndexEntriesAreUpdated) {
   persistence_->Run("TestIndexEntriesAreUpdated", [&]() {
     index_manager_->Start();
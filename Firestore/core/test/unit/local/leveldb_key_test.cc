@@ -226,6 +226,62 @@ TEST(LevelDbDocumentMutationKeyTest, Description) {
       "[document_mutation: user_id=user1 path=foo/bar batch_id=42]", key);
 }
 
+TEST(LevelDbCollectionMutationKeyTest, EncodeDecodeCycle) {
+  LevelDbCollectionMutationKey key;
+  std::string user("foo");
+
+  std::vector<DocumentKey> document_keys{testutil::Key("a/b"),
+                                         testutil::Key("a/b/c/d")};
+
+  std::vector<BatchId> batch_ids{0, 1, 100, INT_MAX - 1, INT_MAX};
+
+  for (BatchId batch_id : batch_ids) {
+    for (auto&& document_key : document_keys) {
+      auto encoded =
+          LevelDbCollectionMutationKey::Key(user, document_key, batch_id);
+
+      bool ok = key.Decode(encoded);
+      ASSERT_TRUE(ok);
+      ASSERT_EQ(user, key.user_id());
+      ASSERT_EQ(document_key.path().PopLast(), key.collection());
+      ASSERT_EQ(document_key, key.document_key());
+      ASSERT_EQ(batch_id, key.batch_id());
+    }
+  }
+}
+
+TEST(LevelDbCollectionMutationKeyTest, Ordering) {
+  auto key = [](absl::string_view path, BatchId batch_id) {
+    return LevelDbCollectionMutationKey::Key("1", testutil::Key(path),
+                                             batch_id);
+  };
+
+  ASSERT_LT(key("foo/bar", 0), key("foo/bar", 1));
+  ASSERT_LT(key("foo/bar", 1), key("foo/baz", 0));
+
+  // Immediate children of a collection sort before documents in any of its
+  // subcollections.
+  ASSERT_LT(key("foo/baz", 0), key("foo/bar/suffix/key", 0));
+  ASSERT_LT(key("foo/zzz", 0), key("foo/aaa/suffix/key", 0));
+
+  auto prefix = LevelDbCollectionMutationKey::KeyPrefix(
+      "1", testutil::Resource("foo"));
+  ASSERT_TRUE(absl::StartsWith(key("foo/bar", 0), prefix));
+  ASSERT_FALSE(absl::StartsWith(key("food/bar", 0), prefix));
+}
+
+TEST(LevelDbCollectionMutationKeyTest, Description) {
+  AssertExpectedKeyDescription("[collection_mutation: incomplete key]",
+                               LevelDbCollectionMutationKey::KeyPrefix());
+
+  auto key =
+      LevelDbCollectionMutationKey::Key("user1", testutil::Key("foo/bar"), 42);
+  AssertExpectedKeyDescription(
+      "[collection_mutation: user_id=user1 path=foo document_id=bar "
+      "batch_id=42]",
+      key);
+}
+
 TEST(LevelDbTargetGlobalKeyTest, EncodeDecodeCycle) {
   LevelDbTargetGlobalKey key;
 
@@ -254,6 +310,21 @@ TEST(LevelDbTargetKeyTest, Description) {
                                LevelDbTargetKey::Key(42));
 }
 
+TEST(LevelDbQueryResultsKeyTest, EncodeDecodeCycle) {
+  LevelDbQueryResultsKey key;
+  TargetId target_id = 42;
+
+  auto encoded = LevelDbQueryResultsKey::Key(42);
+  bool ok = key.Decode(encoded);
+  ASSERT_TRUE(ok);
+  ASSERT_EQ(target_id, key.target_id());
+}
+
+TEST(LevelDbQueryResultsKeyTest, Description) {
+  AssertExpectedKeyDescription("[query_results: target_id=42]",
+                               LevelDbQueryResultsKey::Key(42));
+}
+
 TEST(LevelDbQueryTargetKeyTest, EncodeDecodeCycle) {
   LevelDbQueryTargetKey key;
   std::string canonical_id("foo");
@@ -460,6 +531,51 @@ TEST(BundleKeyTest, Description) {
                                LevelDbBundleKey::Key("foo-bar?baz!quux"));
 }
 
+TEST(BundleLoadKeyTest, EncodeDecodeCycle) {
+  LevelDbBundleLoadKey key;
+
+  std::vector<std::string> ids{"foo", "bar", "foo-bar?baz!quux"};
+  for (auto&& id : ids) {
+    auto encoded = LevelDbBundleLoadKey::Key(id);
+    bool ok = key.Decode(encoded);
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(id, key.bundle_id());
+  }
+  ASSERT_FALSE(key.Decode(LevelDbBundleKey::Key("foo")));
+}
+
+TEST(BundleLoadKeyTest, Description) {
+  AssertExpectedKeyDescription("[bundle_loads: bundle_id=foo-bar]",
+                               LevelDbBundleLoadKey::Key("foo-bar"));
+}
+
+TEST(BundleDocumentKeyTest, Prefixing) {
+  auto bundle_prefix = LevelDbBundleDocumentKey::KeyPrefix("foo");
+  ASSERT_TRUE(absl::StartsWith(
+      LevelDbBundleDocumentKey::Key("foo", testutil::Key("coll/doc")),
+      bundle_prefix));
+  ASSERT_FALSE(absl::StartsWith(
+      LevelDbBundleDocumentKey::Key("foo-bar", testutil::Key("coll/doc")),
+      bundle_prefix));
+}
+
+TEST(BundleDocumentKeyTest, EncodeDecodeCycle) {
+  LevelDbBundleDocumentKey key;
+
+  auto encoded =
+      LevelDbBundleDocumentKey::Key("foo-bar", testutil::Key("coll/doc"));
+  ASSERT_TRUE(key.Decode(encoded));
+  ASSERT_EQ("foo-bar", key.bundle_id());
+  ASSERT_EQ(testutil::Key("coll/doc"), key.document_key());
+  ASSERT_FALSE(key.Decode(LevelDbBundleLoadKey::Key("foo-bar")));
+}
+
+TEST(BundleDocumentKeyTest, Description) {
+  AssertExpectedKeyDescription(
+      "[bundle_documents: bundle_id=foo path=coll/doc]",
+      LevelDbBundleDocumentKey::Key("foo", testutil::Key("coll/doc")));
+}
+
 TEST(NamedQueryKeyTest, Prefixing) {
   auto table_key = LevelDbNamedQueryKey::KeyPrefix();
 
@@ -1196,6 +1312,102 @@ TEST(LevelDbDataMigrationKeyTest, Encode) {
   EXPECT_EQ(decoded_key.migration_name(), "animal_migration");
 }
 
+TEST(LevelDbDataMigrationKeyTest, IsOverlayMigration) {
+  LevelDbDataMigrationKey key;
+  ASSERT_TRUE(key.Decode(LevelDbDataMigrationKey::OverlayMigrationKey()));
+  EXPECT_TRUE(key.IsOverlayMigration());
+
+  ASSERT_TRUE(
+      key.Decode(LevelDbDataMigrationKey::UserOverlayMigrationKey("user")));
+  EXPECT_TRUE(key.IsOverlayMigration());
+  EXPECT_EQ(key.migration_name(), "overlay_migration/user");
+
+  ASSERT_TRUE(key.Decode(LevelDbDataMigrationKey::Key("overlay_migrations")));
+  EXPECT_FALSE(key.IsOverlayMigration());
+}
+
+TEST(LevelDbOrphanedDocumentKeyTest, OrderedBySequenceNumber) {
+  ASSERT_LT(LevelDbOrphanedDocumentKey::Key(2, testutil::Key("foo/bar")),
+            LevelDbOrphanedDocumentKey::Key(10, testutil::Key("foo/a")));
+  ASSERT_LT(LevelDbOrphanedDocumentKey::Key(10, testutil::Key("foo/a")),
+            LevelDbOrphanedDocumentKey::Key(10, testutil::Key("foo/bar")));
+}
+
+TEST(LevelDbOrphanedDocumentKeyTest, EncodeDecodeCycle) {
+  LevelDbOrphanedDocumentKey key;
+  auto encoded = LevelDbOrphanedDocumentKey::Key(42, testutil::Key("foo/bar"));
+  ASSERT_TRUE(key.Decode(encoded));
+  ASSERT_EQ(key.sequence_number(), 42);
+  ASSERT_EQ(key.document_key(), testutil::Key("foo/bar"));
+}
+
+TEST(LevelDbOrphanedDocumentKeyTest, Description) {
+  AssertExpectedKeyDescription(
+      "[orphaned_document: sequence_number=42 path=foo/bar]",
+      LevelDbOrphanedDocumentKey::Key(42, testutil::Key("foo/bar")));
+}
+
+TEST(LevelDbFieldNameKeyTest, EncodeDecodeCycle) {
+  LevelDbFieldNameKey key;
+
+  for (int32_t field_id : {0, 1, 100, INT_MAX}) {
+    auto encoded = LevelDbFieldNameKey::Key("posts", field_id);
+    bool ok = key.Decode(encoded);
+    ASSERT_TRUE(ok);
+    ASSERT_EQ("posts", key.collection_id());
+    ASSERT_EQ(field_id, key.field_id());
+  }
+}
+
+TEST(LevelDbFieldNameKeyTest, Ordering) {
+  ASSERT_LT(LevelDbFieldNameKey::Key("posts", 2),
+            LevelDbFieldNameKey::Key("posts", 10));
+
+  auto prefix = LevelDbFieldNameKey::KeyPrefix("posts");
+  ASSERT_TRUE(absl::StartsWith(LevelDbFieldNameKey::Key("posts", 0), prefix));
+  ASSERT_FALSE(
+      absl::StartsWith(LevelDbFieldNameKey::Key("postsa", 0), prefix));
+}
+
+TEST(LevelDbFieldNameKeyTest, Description) {
+  AssertExpectedKeyDescription("[field_name: incomplete key]",
+                               LevelDbFieldNameKey::KeyPrefix());
+  AssertExpectedKeyDescription("[field_name: collection_id=posts field_id=7]",
+                               LevelDbFieldNameKey::Key("posts", 7));
+}
+
+TEST(LevelDbStoreForKeyTest, ClassifiesKeysByTable) {
+  EXPECT_EQ(LevelDbStoreForKey(RemoteDocKey("foo/bar")),
+            LevelDbStore::kDocuments);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbCollectionParentKey::Key(
+                "foo", testutil::Resource("bar/baz"))),
+            LevelDbStore::kDocuments);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbFieldNameKey::Key("foo", 1)),
+            LevelDbStore::kDocuments);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbTargetGlobalKey::Key()),
+            LevelDbStore::kTargets);
+  EXPECT_EQ(LevelDbStoreForKey(DocTargetKey("foo/bar", 42)),
+            LevelDbStore::kTargets);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbQueryResultsKey::Key(42)),
+            LevelDbStore::kTargets);
+  EXPECT_EQ(LevelDbStoreForKey(DocMutationKey("user", "foo/bar", 42)),
+            LevelDbStore::kMutations);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbCollectionMutationKey::Key(
+                "user", testutil::Key("foo/bar"), 42)),
+            LevelDbStore::kMutations);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbMutationQueueKey::Key("user")),
+            LevelDbStore::kMutations);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbIndexConfigurationKey::Key(1, "coll")),
+            LevelDbStore::kIndexes);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbVersionKey::Key()),
+            LevelDbStore::kOther);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbGlobalKey::Key("foo")),
+            LevelDbStore::kOther);
+  EXPECT_EQ(LevelDbStoreForKey(LevelDbBundleLoadKey::Key("foo")),
+            LevelDbStore::kOther);
+  EXPECT_EQ(LevelDbStoreForKey(""), LevelDbStore::kOther);
+}
+
 #undef AssertExpectedKeyDescription
 
 }  // namespace local
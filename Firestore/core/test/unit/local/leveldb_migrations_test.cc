@@ -25,6 +25,7 @@
 #include "Firestore/core/src/core/field_filter.h"
 #include "Firestore/core/src/core/query.h"
 #include "Firestore/core/src/local/leveldb_key.h"
+#include "Firestore/core/src/local/leveldb_size_tracker.h"
 #include "Firestore/core/src/local/leveldb_target_cache.h"
 #include "Firestore/core/src/local/target_data.h"
 #include "Firestore/core/src/nanopb/message.h"
@@ -114,7 +115,25 @@ TEST_F(LevelDbMigrationsTest, SetsVersionNumber) {
   LevelDbMigrations::RunMigrations(db_.get(), *serializer_);
 
   SchemaVersion actual = LevelDbMigrations::ReadSchemaVersion(db_.get());
-  ASSERT_GT(actual, 0) << "Expected to migrate to a schema version > 0";
+  ASSERT_EQ(kSchemaVersion, actual);
+}
+
+TEST_F(LevelDbMigrationsTest, KeepsByteSizesWhenUpToDate) {
+  LevelDbMigrations::RunMigrations(db_.get(), *serializer_);
+  {
+    LevelDbTransaction transaction(db_.get(), "Save byte sizes");
+    transaction.Put(LevelDbSizeTracker::Key(), "sizes");
+    transaction.Commit();
+  }
+
+  LevelDbMigrations::RunMigrations(db_.get(), *serializer_);
+
+  std::string sizes;
+  ASSERT_TRUE(db_->Get(leveldb::ReadOptions(), LevelDbSizeTracker::Key(),
+                       &sizes)
+                  .ok())
+      << "Byte sizes should only be discarded when a migration runs";
+  ASSERT_EQ("sizes", sizes);
 }
 
 MATCHER_P(IsFound, transaction, "") {
@@ -272,6 +291,65 @@ TEST_F(LevelDbMigrationsTest, AddsSentinelRows) {
   }
 }
 
+TEST_F(LevelDbMigrationsTest, ResumesInterruptedMigration) {
+  LevelDbMigrations::RunMigrations(db_.get(), 3, *serializer_);
+  auto doc_key = [](int i) {
+    return DocumentKey::FromSegments({"docs", std::to_string(i)});
+  };
+  {
+    std::string empty_buffer;
+    LevelDbTransaction transaction(db_.get(), "Setup");
+    for (int i = 0; i < 10; i++) {
+      transaction.Put(LevelDbRemoteDocumentKey::Key(doc_key(i)), empty_buffer);
+    }
+
+    // Pretend that an earlier attempt committed the rows before docs/5.
+    LevelDbMigrations::Cursor cursor;
+    cursor.version = 4;
+    cursor.next_key = LevelDbRemoteDocumentKey::Key(doc_key(5));
+    LevelDbMigrations::SaveMigrationCursor(cursor, &transaction);
+    transaction.Commit();
+  }
+
+  LevelDbMigrations::RunMigrations(db_.get(), 4, *serializer_);
+  ASSERT_EQ(4, LevelDbMigrations::ReadSchemaVersion(db_.get()));
+  ASSERT_FALSE(LevelDbMigrations::ReadMigrationCursor(db_.get()));
+  {
+    std::string buffer;
+    LevelDbTransaction transaction(db_.get(), "Verify");
+    for (int i = 0; i < 10; i++) {
+      std::string sentinel_key =
+          LevelDbDocumentTargetKey::SentinelKey(doc_key(i));
+      ASSERT_EQ(i >= 5, transaction.Get(sentinel_key, &buffer).ok()) << i;
+    }
+  }
+}
+
+TEST_F(LevelDbMigrationsTest, IgnoresCursorOfAnotherMigration) {
+  LevelDbMigrations::RunMigrations(db_.get(), 3, *serializer_);
+  DocumentKey key = DocumentKey::FromPathString("docs/a");
+  {
+    std::string empty_buffer;
+    LevelDbTransaction transaction(db_.get(), "Setup");
+    transaction.Put(LevelDbRemoteDocumentKey::Key(key), empty_buffer);
+
+    LevelDbMigrations::Cursor cursor;
+    cursor.version = 12;
+    cursor.pass = 1;
+    LevelDbMigrations::SaveMigrationCursor(cursor, &transaction);
+    transaction.Commit();
+  }
+
+  LevelDbMigrations::RunMigrations(db_.get(), 4, *serializer_);
+  {
+    std::string buffer;
+    LevelDbTransaction transaction(db_.get(), "Verify");
+    ASSERT_TRUE(
+        transaction.Get(LevelDbDocumentTargetKey::SentinelKey(key), &buffer)
+            .ok());
+  }
+}
+
 TEST_F(LevelDbMigrationsTest, RemovesMutationBatches) {
   std::string empty_buffer;
   DocumentKey test_write_foo = DocumentKey::FromPathString("docs/foo");
@@ -548,6 +626,149 @@ TEST_F(LevelDbMigrationsTest, SetsOverlayMigrationFlag) {
   ASSERT_TRUE(status.ok());
 }
 
+TEST_F(LevelDbMigrationsTest, CreatesOrphanedDocumentsIndex) {
+  LevelDbMigrations::RunMigrations(db_.get(), 9, *serializer_);
+
+  DocumentKey orphaned = DocumentKey::FromPathString("docs/orphaned");
+  DocumentKey targeted = DocumentKey::FromPathString("docs/targeted");
+  DocumentKey stale = DocumentKey::FromPathString("docs/stale");
+  {
+    std::string empty_buffer;
+    LevelDbTransaction transaction(db_.get(), "Setup");
+    transaction.Put(LevelDbDocumentTargetKey::SentinelKey(orphaned),
+                    LevelDbDocumentTargetKey::EncodeSentinelValue(10));
+    transaction.Put(LevelDbDocumentTargetKey::SentinelKey(targeted),
+                    LevelDbDocumentTargetKey::EncodeSentinelValue(5));
+    transaction.Put(LevelDbDocumentTargetKey::Key(targeted, 1), empty_buffer);
+    // An index entry left behind by a newer version before a downgrade.
+    transaction.Put(LevelDbOrphanedDocumentKey::Key(1, stale), empty_buffer);
+    transaction.Commit();
+  }
+
+  LevelDbMigrations::RunMigrations(db_.get(), 10, *serializer_);
+  {
+    LevelDbTransaction transaction(db_.get(), "Verify");
+    auto it = transaction.NewIterator();
+    std::string index_prefix = LevelDbOrphanedDocumentKey::KeyPrefix();
+    it->Seek(index_prefix);
+
+    LevelDbOrphanedDocumentKey index_key;
+    ASSERT_TRUE(it->Valid() && absl::StartsWith(it->key(), index_prefix));
+    ASSERT_TRUE(index_key.Decode(it->key()));
+    ASSERT_EQ(index_key.document_key(), orphaned);
+    ASSERT_EQ(index_key.sequence_number(), 10);
+
+    it->Next();
+    ASSERT_FALSE(it->Valid() && absl::StartsWith(it->key(), index_prefix));
+  }
+}
+
+TEST_F(LevelDbMigrationsTest, CreatesOrphanedDocumentsIndexInChunks) {
+  LevelDbMigrations::RunMigrations(db_.get(), 9, *serializer_);
+
+  DocumentKey first = DocumentKey::FromPathString("docs/a");
+  DocumentKey targeted = DocumentKey::FromPathString("docs/b");
+  DocumentKey last = DocumentKey::FromPathString("docs/c");
+  {
+    std::string empty_buffer;
+    LevelDbTransaction transaction(db_.get(), "Setup");
+    transaction.Put(LevelDbDocumentTargetKey::SentinelKey(first),
+                    LevelDbDocumentTargetKey::EncodeSentinelValue(1));
+    transaction.Put(LevelDbDocumentTargetKey::SentinelKey(targeted),
+                    LevelDbDocumentTargetKey::EncodeSentinelValue(2));
+    transaction.Put(LevelDbDocumentTargetKey::Key(targeted, 1), empty_buffer);
+    transaction.Put(LevelDbDocumentTargetKey::Key(targeted, 2), empty_buffer);
+    transaction.Put(LevelDbDocumentTargetKey::SentinelKey(last),
+                    LevelDbDocumentTargetKey::EncodeSentinelValue(3));
+    transaction.Commit();
+  }
+
+  // Every document is committed in its own transaction, with all its rows.
+  LevelDbMigrations::RunMigrations(db_.get(), 10, *serializer_, 1);
+  {
+    LevelDbTransaction transaction(db_.get(), "Verify");
+    auto it = transaction.NewIterator();
+    std::string index_prefix = LevelDbOrphanedDocumentKey::KeyPrefix();
+    it->Seek(index_prefix);
+
+    std::vector<DocumentKey> orphaned;
+    LevelDbOrphanedDocumentKey index_key;
+    for (; it->Valid() && absl::StartsWith(it->key(), index_prefix);
+         it->Next()) {
+      ASSERT_TRUE(index_key.Decode(it->key()));
+      orphaned.push_back(index_key.document_key());
+    }
+    ASSERT_EQ(orphaned, (std::vector<DocumentKey>{first, last}));
+  }
+  ASSERT_FALSE(LevelDbMigrations::ReadMigrationCursor(db_.get()));
+}
+
+TEST_F(LevelDbMigrationsTest, CopiesOverlaysIntoCollectionIndex) {
+  LevelDbMigrations::RunMigrations(db_.get(), 10, *serializer_);
+
+  LevelDbDocumentOverlayKey overlay_key(
+      "user", DocumentKey::FromPathString("coll/doc"), 42);
+  std::string index_key =
+      LevelDbDocumentOverlayCollectionIndexKey::Key(overlay_key);
+  {
+    // Before schema 11, the collection index stored no value.
+    LevelDbTransaction transaction(db_.get(), "Setup");
+    transaction.Put(overlay_key.Encode(), "mutation bytes");
+    transaction.Put(index_key, "");
+    transaction.Commit();
+  }
+
+  LevelDbMigrations::RunMigrations(db_.get(), 11, *serializer_);
+  {
+    std::string value;
+    LevelDbTransaction transaction(db_.get(), "Verify");
+    ASSERT_TRUE(transaction.Get(index_key, &value).ok());
+    ASSERT_EQ(value, "mutation bytes");
+  }
+}
+
+TEST_F(LevelDbMigrationsTest, CreatesCollectionMutationsIndex) {
+  LevelDbMigrations::RunMigrations(db_.get(), 11, *serializer_);
+
+  DocumentKey user = DocumentKey::FromPathString("users/a");
+  DocumentKey event = DocumentKey::FromPathString("users/a/events/b");
+  {
+    std::string empty_buffer;
+    LevelDbTransaction transaction(db_.get(), "Setup");
+    transaction.Put(LevelDbDocumentMutationKey::Key("foo", user, 1),
+                    empty_buffer);
+    transaction.Put(LevelDbDocumentMutationKey::Key("foo", event, 2),
+                    empty_buffer);
+    // An index entry left behind by a newer version before a downgrade.
+    transaction.Put(LevelDbCollectionMutationKey::Key("foo", user, 3),
+                    empty_buffer);
+    transaction.Commit();
+  }
+
+  LevelDbMigrations::RunMigrations(db_.get(), 12, *serializer_);
+  {
+    LevelDbTransaction transaction(db_.get(), "Verify");
+    auto it = transaction.NewIterator();
+    std::string index_prefix = LevelDbCollectionMutationKey::KeyPrefix();
+    it->Seek(index_prefix);
+
+    LevelDbCollectionMutationKey index_key;
+    ASSERT_TRUE(it->Valid() && absl::StartsWith(it->key(), index_prefix));
+    ASSERT_TRUE(index_key.Decode(it->key()));
+    ASSERT_EQ(index_key.document_key(), user);
+    ASSERT_EQ(index_key.batch_id(), 1);
+
+    it->Next();
+    ASSERT_TRUE(it->Valid() && absl::StartsWith(it->key(), index_prefix));
+    ASSERT_TRUE(index_key.Decode(it->key()));
+    ASSERT_EQ(index_key.document_key(), event);
+    ASSERT_EQ(index_key.batch_id(), 2);
+
+    it->Next();
+    ASSERT_FALSE(it->Valid() && absl::StartsWith(it->key(), index_prefix));
+  }
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
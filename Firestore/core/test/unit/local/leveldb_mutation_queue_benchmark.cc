@@ -0,0 +1,106 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Firestore/core/include/firebase/firestore/timestamp.h"
+#include "Firestore/core/src/core/query.h"
+#include "Firestore/core/src/credentials/user.h"
+#include "Firestore/core/src/local/leveldb_mutation_queue.h"
+#include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/model/mutation_batch.h"
+#include "Firestore/core/src/model/set_mutation.h"
+#include "Firestore/core/src/util/hard_assert.h"
+#include "Firestore/core/test/unit/local/persistence_testing.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
+#include "benchmark/benchmark.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using credentials::User;
+using model::MutationBatch;
+using testutil::Map;
+
+/**
+ * Queues one pending write for each of `user_count` documents in the "users"
+ * collection and one for each of `events_per_user` documents in every user's
+ * "events" subcollection.
+ */
+void WriteDeepHierarchy(LevelDbPersistence* persistence,
+                        LevelDbMutationQueue* queue,
+                        int64_t user_count,
+                        int64_t events_per_user) {
+  for (int64_t user = 0; user < user_count; ++user) {
+    persistence->Run("WriteDeepHierarchy", [&] {
+      std::string user_path = "users/user" + std::to_string(user);
+      queue->AddMutationBatch(
+          Timestamp::Now(), {},
+          {testutil::SetMutation(user_path, Map("name", "user"))});
+      for (int64_t event = 0; event < events_per_user; ++event) {
+        std::string event_path =
+            user_path + "/events/event" + std::to_string(event);
+        queue->AddMutationBatch(
+            Timestamp::Now(), {},
+            {testutil::SetMutation(event_path, Map("type", "click"))});
+      }
+    });
+  }
+}
+
+/**
+ * Measures a collection query over "users" as the number of pending writes in
+ * nested "events" subcollections grows. Only the writes to the users
+ * themselves should contribute to the cost of the scan.
+ */
+void BM_AllMutationBatchesAffectingQuery(benchmark::State& state) {
+  int64_t user_count = state.range(0);
+  int64_t events_per_user = state.range(1);
+
+  auto persistence = LevelDbPersistenceForTesting();
+  User user("user");
+  LevelDbMutationQueue* queue =
+      persistence->GetMutationQueue(user, persistence->GetIndexManager(user));
+  persistence->Run("Start", [&] { queue->Start(); });
+  WriteDeepHierarchy(persistence.get(), queue, user_count, events_per_user);
+
+  core::Query query = testutil::Query("users");
+  for (auto _ : state) {
+    std::vector<MutationBatch> batches =
+        persistence->Run("BM_AllMutationBatchesAffectingQuery", [&] {
+          return queue->AllMutationBatchesAffectingQuery(query);
+        });
+    HARD_ASSERT(static_cast<int64_t>(batches.size()) == user_count,
+                "Expected %s batches but read %s", user_count, batches.size());
+  }
+  state.SetItemsProcessed(state.iterations() * user_count);
+}
+BENCHMARK(BM_AllMutationBatchesAffectingQuery)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"users", "events_per_user"})
+    ->Args({100, 0})
+    ->Args({100, 10})
+    ->Args({100, 100})
+    ->Args({1000, 10});
+
+}  // namespace
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -310,33 +310,109 @@ TEST_F(LevelDbOverlayMigrationManagerTest, CreateOverlaysForDifferentUsers) {
                                     credentials::User::Unauthenticated());
   local_store_->Start();
 
+  // Only the current user is migrated during startup.
   persistence_->Run("Verify mutation", [&] {
-    {
-      auto overlay =
-          persistence_
-              ->GetDocumentOverlayCache(credentials::User::Unauthenticated())
-              ->GetOverlay(Key("foo/bar"));
-      EXPECT_EQ(SetMutation("foo/bar", Map("foo", "set-by-unauthenticated")),
-                overlay.value().mutation());
-    }
-    {
-      auto overlay =
-          persistence_
-              ->GetDocumentOverlayCache(credentials::User("another_user"))
-              ->GetOverlay(Key("foo/bar"));
-      EXPECT_EQ(SetMutation("foo/bar", Map("foo", "set-by-another_user")),
-                overlay.value().mutation());
-    }
+    auto overlay =
+        persistence_
+            ->GetDocumentOverlayCache(credentials::User::Unauthenticated())
+            ->GetOverlay(Key("foo/bar"));
+    EXPECT_EQ(SetMutation("foo/bar", Map("foo", "set-by-unauthenticated")),
+              overlay.value().mutation());
   });
-
   EXPECT_EQ(Doc("foo/bar", 2, Map("foo", "set-by-unauthenticated"))
                 .SetHasLocalMutations(),
             local_store_->ReadDocument(Key("foo/bar")));
+  persistence_->Run("Verify flag",
+                    [&] { EXPECT_TRUE(has_pending_overlay_migration()); });
+
+  local_store_->CompleteOverlayMigration();
+
+  persistence_->Run("Verify mutation", [&] {
+    auto overlay =
+        persistence_->GetDocumentOverlayCache(credentials::User("another_user"))
+            ->GetOverlay(Key("foo/bar"));
+    EXPECT_EQ(SetMutation("foo/bar", Map("foo", "set-by-another_user")),
+              overlay.value().mutation());
+  });
 
   persistence_->Run("Verify flag",
                     [&] { EXPECT_FALSE(has_pending_overlay_migration()); });
 }
 
+TEST_F(LevelDbOverlayMigrationManagerTest, MigratesUserOnUserChange) {
+  WriteRemoteDocument(Doc("foo/bar", 2, Map("it", "original")));
+  WriteMutation(SetMutation("foo/bar", Map("foo", "set-by-unauthenticated")));
+
+  local_store_ =
+      absl::make_unique<LocalStore>(persistence_.get(), query_engine_.get(),
+                                    credentials::User("another_user"));
+  local_store_->Start();
+  WriteMutation(SetMutation("foo/bar", Map("foo", "set-by-another_user")));
+
+  persistence_->Shutdown();
+  persistence_ =
+      LevelDbPersistence::Create(dir_, *serializer_, LruParams::Default())
+          .ValueOrDie();
+  local_store_ =
+      absl::make_unique<LocalStore>(persistence_.get(), query_engine_.get(),
+                                    credentials::User::Unauthenticated());
+  local_store_->Start();
+
+  // Switching users migrates the new user before reading its documents.
+  local_store_->HandleUserChange(credentials::User("another_user"));
+  EXPECT_EQ(
+      Doc("foo/bar", 2, Map("foo", "set-by-another_user"))
+          .SetHasLocalMutations(),
+      local_store_->ReadDocument(Key("foo/bar")));
+
+  persistence_->Run("Verify flag",
+                    [&] { EXPECT_FALSE(has_pending_overlay_migration()); });
+}
+
+TEST_F(LevelDbOverlayMigrationManagerTest, CreateOverlaysForManyDocuments) {
+  // Enough documents for overlays to be calculated by several tasks, with
+  // some documents mutated by more than one batch.
+  const int document_count = 250;
+  std::vector<Mutation> sets;
+  std::vector<Mutation> patches;
+  for (int i = 0; i < document_count; ++i) {
+    std::string path = "coll/doc" + std::to_string(i);
+    WriteRemoteDocument(Doc(path, 2, Map("it", "original")));
+    sets.push_back(SetMutation(path, Map("it", "set")));
+    if (i % 2 == 0) {
+      patches.push_back(PatchMutation(path, Map("patched", true)));
+    }
+  }
+  WriteMutations(std::move(sets));
+  WriteMutations(std::move(patches));
+
+  persistence_->Shutdown();
+  persistence_ =
+      LevelDbPersistence::Create(dir_, *serializer_, LruParams::Default())
+          .ValueOrDie();
+  local_store_ =
+      absl::make_unique<LocalStore>(persistence_.get(), query_engine_.get(),
+                                    credentials::User::Unauthenticated());
+  local_store_->Start();
+
+  persistence_->Run("Verify mutation", [&] {
+    for (int i = 0; i < document_count; ++i) {
+      std::string path = "coll/doc" + std::to_string(i);
+      auto overlay = document_overlay_cache()->GetOverlay(Key(path));
+      ASSERT_TRUE(overlay.has_value()) << path;
+      if (i % 2 == 0) {
+        EXPECT_EQ(2, overlay.value().largest_batch_id()) << path;
+        EXPECT_EQ(SetMutation(path, Map("it", "set", "patched", true)),
+                  overlay.value().mutation());
+      } else {
+        EXPECT_EQ(1, overlay.value().largest_batch_id()) << path;
+        EXPECT_EQ(SetMutation(path, Map("it", "set")),
+                  overlay.value().mutation());
+      }
+    }
+  });
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
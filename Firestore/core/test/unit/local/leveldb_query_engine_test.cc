@@ -14,14 +14,20 @@
  * limitations under the License.
  */
 
+#include <string>
 #include <vector>
 
 #include "Firestore/core/src/core/query.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
 #include "Firestore/core/src/local/query_engine.h"
+#include "Firestore/core/src/local/query_profile.h"
+#include "Firestore/core/src/model/aggregate_alias.h"
+#include "Firestore/core/src/model/aggregate_field.h"
+#include "Firestore/core/src/model/document_key_set.h"
 #include "Firestore/core/src/model/document_set.h"
 #include "Firestore/core/src/model/field_index.h"
 #include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/src/model/object_value.h"
 #include "Firestore/core/src/model/patch_mutation.h"
 #include "Firestore/core/src/model/set_mutation.h"
 #include "Firestore/core/test/unit/local/persistence_testing.h"
@@ -34,12 +40,15 @@ namespace firestore {
 namespace local {
 namespace {
 
+using model::AggregateField;
+using model::DocumentKeySet;
 using model::DocumentSet;
 using model::SnapshotVersion;
 using testutil::AndFilters;
 using testutil::Array;
 using testutil::Doc;
 using testutil::DocSet;
+using testutil::Field;
 using testutil::Filter;
 using testutil::MakeFieldIndex;
 using testutil::Map;
@@ -48,6 +57,7 @@ using testutil::OrFilters;
 using testutil::PatchMutation;
 using testutil::Query;
 using testutil::SetMutation;
+using testutil::Value;
 using testutil::Version;
 
 std::unique_ptr<Persistence> PersistenceFactory() {
@@ -104,6 +114,218 @@ TEST_F(LevelDbQueryEngineTest, CombinesIndexedWithNonIndexedResults) {
   });
 }
 
+TEST_F(LevelDbQueryEngineTest, AggregatesUsingFullIndex) {
+  persistence_->Run("AggregatesUsingFullIndex", [&] {
+    mutation_queue_->Start();
+    index_manager_->Start();
+
+    auto doc1 = Doc("coll/a", 1, Map("foo", true, "n", 1));
+    auto doc2 = Doc("coll/b", 2, Map("foo", true, "n", 2));
+    auto doc3 = Doc("coll/c", 2, Map("foo", false, "n", 4));
+    auto doc4 = Doc("coll/d", 3, Map("foo", true, "n", 8));
+
+    index_manager_->AddFieldIndex(
+        MakeFieldIndex("coll", "foo", model::Segment::kAscending));
+
+    AddDocuments({doc1, doc2, doc3});
+    index_manager_->UpdateIndexEntries(DocumentMap({doc1, doc2, doc3}));
+    index_manager_->UpdateCollectionGroup(
+        "coll", model::IndexOffset::FromDocument(doc3));
+
+    // Documents changed since the index offset are aggregated from their local
+    // view.
+    AddDocuments({doc4});
+    AddMutation(PatchMutation("coll/a", Map("foo", false)));
+    AddMutation(SetMutation("coll/e", Map("foo", true, "n", 16)));
+
+    std::vector<AggregateField> aggregates = {
+        AggregateField(AggregateField::OpKind::Count,
+                       model::AggregateAlias("count")),
+        AggregateField(AggregateField::OpKind::Sum,
+                       model::AggregateAlias("sum"), Field("n"))};
+    core::Query query = Query("coll").AddingFilter(Filter("foo", "==", true));
+
+    model::ObjectValue result = query_engine_.ComputeAggregates(
+        query, {aggregates[0]}, SnapshotVersion::None(), DocumentKeySet{});
+    EXPECT_EQ(*result.Get("count"), *Value(3));
+
+    result = query_engine_.ComputeAggregates(
+        query, aggregates, SnapshotVersion::None(), DocumentKeySet{});
+    EXPECT_EQ(*result.Get("count"), *Value(3));
+    EXPECT_EQ(*result.Get("sum"), *Value(26));
+
+    result = query_engine_.ComputeAggregates(
+        query.AddingOrderBy(OrderBy("n")).WithLimitToLast(2), aggregates,
+        SnapshotVersion::None(), DocumentKeySet{});
+    EXPECT_EQ(*result.Get("count"), *Value(2));
+    EXPECT_EQ(*result.Get("sum"), *Value(24));
+  });
+}
+
+TEST_F(LevelDbQueryEngineTest,
+       AggregatesOnlyCachedDocumentsOfCollectionUsingFullIndex) {
+  persistence_->Run(
+      "AggregatesOnlyCachedDocumentsOfCollectionUsingFullIndex", [&] {
+        mutation_queue_->Start();
+        index_manager_->Start();
+
+        auto doc1 = Doc("rooms/a/messages/1", 1, Map("foo", true, "n", 1));
+        auto doc2 = Doc("rooms/a/messages/2", 1, Map("foo", true, "n", 2));
+        auto doc3 = Doc("rooms/b/messages/3", 1, Map("foo", true, "n", 4));
+
+        index_manager_->AddFieldIndex(
+            MakeFieldIndex("messages", "foo", model::Segment::kAscending));
+
+        AddDocuments({doc1, doc2, doc3});
+        index_manager_->UpdateIndexEntries(DocumentMap({doc1, doc2, doc3}));
+        index_manager_->UpdateCollectionGroup(
+            "messages", model::IndexOffset::FromDocument(doc3));
+
+        // Garbage collection removes documents but keeps their index entries.
+        remote_document_cache_->Remove(doc2.key());
+
+        std::vector<AggregateField> aggregates = {
+            AggregateField(AggregateField::OpKind::Count,
+                           model::AggregateAlias("count")),
+            AggregateField(AggregateField::OpKind::Sum,
+                           model::AggregateAlias("sum"), Field("n"))};
+        core::Query query = Query("rooms/a/messages")
+                                .AddingFilter(Filter("foo", "==", true));
+
+        model::ObjectValue result = query_engine_.ComputeAggregates(
+            query, {aggregates[0]}, SnapshotVersion::None(), DocumentKeySet{});
+        EXPECT_EQ(*result.Get("count"), *Value(1));
+
+        result = query_engine_.ComputeAggregates(
+            query, aggregates, SnapshotVersion::None(), DocumentKeySet{});
+        EXPECT_EQ(*result.Get("count"), *Value(1));
+        EXPECT_EQ(*result.Get("sum"), *Value(1));
+
+        core::Query group_query = testutil::CollectionGroupQuery("messages")
+                                      .AddingFilter(Filter("foo", "==", true));
+        result = query_engine_.ComputeAggregates(group_query, {aggregates[0]},
+                                                 SnapshotVersion::None(),
+                                                 DocumentKeySet{});
+        EXPECT_EQ(*result.Get("count"), *Value(2));
+      });
+}
+
+TEST_F(LevelDbQueryEngineTest, ChoosesPlansFromCollectionStatistics) {
+  persistence_->Run("ChoosesPlansFromCollectionStatistics", [&] {
+    mutation_queue_->Start();
+    index_manager_->Start();
+
+    std::vector<model::MutableDocument> docs;
+    for (int i = 100; i < 300; ++i) {
+      docs.push_back(
+          Doc("coll/" + std::to_string(i), 1, Map("id", i, "matches", true)));
+    }
+    AddDocuments(docs);
+    index_manager_->AddFieldIndex(
+        MakeFieldIndex("coll", "id", model::Segment::kAscending));
+    index_manager_->AddFieldIndex(
+        MakeFieldIndex("coll", "matches", model::Segment::kAscending));
+    index_manager_->UpdateIndexEntries(DocumentMap(docs));
+    index_manager_->UpdateCollectionGroup(
+        "coll", model::IndexOffset::FromDocument(docs.back()));
+    for (const auto& doc : docs) {
+      query_engine_.statistics()->RecordDocumentValues(doc);
+    }
+
+    // A full collection scan records the size of the collection.
+    local_documents_view_.ExpectFullCollectionScan(true);
+    RunQuery(Query("coll"), SnapshotVersion::None());
+
+    // Every document matches, so reading them through the index is estimated
+    // to cost more than a full collection scan.
+    core::Query all_match =
+        Query("coll").AddingFilter(Filter("matches", "==", true));
+    local_documents_view_.ExpectFullCollectionScan(true);
+    DocumentSet result = RunQuery(all_match, SnapshotVersion::None());
+    EXPECT_EQ(result.size(), docs.size());
+
+    core::Query one_match = Query("coll").AddingFilter(Filter("id", "==", 150));
+    result = ExpectOptimizedCollectionScan(
+        [&] { return RunQuery(one_match, SnapshotVersion::None()); });
+    EXPECT_EQ(result, DocSet(one_match.Comparator(), {docs[50]}));
+  });
+}
+
+TEST_F(LevelDbQueryEngineTest, CountsCollectionWithoutPreviousScan) {
+  persistence_->Run("CountsCollectionWithoutPreviousScan", [&] {
+    mutation_queue_->Start();
+    index_manager_->Start();
+
+    std::vector<model::MutableDocument> docs;
+    for (int i = 100; i < 300; ++i) {
+      docs.push_back(Doc("coll/" + std::to_string(i), 1, Map("matches", true)));
+    }
+    AddDocuments(docs);
+    index_manager_->AddFieldIndex(
+        MakeFieldIndex("coll", "matches", model::Segment::kAscending));
+    index_manager_->UpdateIndexEntries(DocumentMap(docs));
+    index_manager_->UpdateCollectionGroup(
+        "coll", model::IndexOffset::FromDocument(docs.back()));
+    for (const auto& doc : docs) {
+      query_engine_.statistics()->RecordDocumentValues(doc);
+    }
+
+    // The collection was never scanned, so its documents are counted in the
+    // cache to find that reading them through the index costs more.
+    core::Query all_match =
+        Query("coll").AddingFilter(Filter("matches", "==", true));
+    local_documents_view_.ExpectFullCollectionScan(true);
+    DocumentSet result = RunQuery(all_match, SnapshotVersion::None());
+    EXPECT_EQ(result.size(), docs.size());
+    EXPECT_EQ(query_engine_.statistics()->GetDocumentCount(
+                  testutil::Resource("coll")),
+              docs.size());
+  });
+}
+
+TEST_F(LevelDbQueryEngineTest, ProfilesQueryExecution) {
+  persistence_->Run("ProfilesQueryExecution", [&] {
+    mutation_queue_->Start();
+    index_manager_->Start();
+
+    auto doc1 = Doc("coll/1", 1, Map("a", 1));
+    auto doc2 = Doc("coll/2", 1, Map("a", 2));
+    auto doc3 = Doc("coll/3", 1, Map("a", 2));
+    AddDocuments({doc1, doc2, doc3});
+    AddMutation(PatchMutation("coll/3", Map("b", 1)));
+
+    core::Query query = Query("coll").AddingFilter(Filter("a", "==", 2));
+    local_documents_view_.ExpectFullCollectionScan(true);
+    QueryProfile scan_profile;
+    model::DocumentMap result = query_engine_.GetDocumentsMatchingQuery(
+        query, SnapshotVersion::None(), DocumentKeySet{}, &scan_profile);
+    EXPECT_EQ(scan_profile.plan(), QueryProfile::Plan::FullScan);
+    EXPECT_EQ(scan_profile.reads().GetDocumentReadCount(), 3u);
+    EXPECT_EQ(scan_profile.reads().GetOverlayCount(), 1u);
+    EXPECT_EQ(scan_profile.reads().GetIndexRangeCount(), 0u);
+    EXPECT_EQ(scan_profile.matched_document_count(), result.size());
+    ASSERT_EQ(scan_profile.stages().size(), 1u);
+    EXPECT_EQ(scan_profile.stages()[0].first, "full scan");
+
+    index_manager_->AddFieldIndex(
+        MakeFieldIndex("coll", "a", model::Segment::kAscending));
+    index_manager_->UpdateIndexEntries(DocumentMap({doc1, doc2, doc3}));
+    index_manager_->UpdateCollectionGroup(
+        "coll", model::IndexOffset::FromDocument(doc3));
+
+    QueryProfile index_profile;
+    result = query_engine_.GetDocumentsMatchingQuery(
+        query, SnapshotVersion::None(), DocumentKeySet{}, &index_profile);
+    EXPECT_EQ(index_profile.plan(), QueryProfile::Plan::Index);
+    EXPECT_EQ(index_profile.reads().GetIndexRangeCount(), 1u);
+    EXPECT_EQ(index_profile.reads().GetIndexEntryReadCount(), 2u);
+    EXPECT_GE(index_profile.reads().GetOverlayCount(), 1u);
+    EXPECT_EQ(index_profile.matched_document_count(), 2u);
+    ASSERT_FALSE(index_profile.stages().empty());
+    EXPECT_EQ(index_profile.stages()[0].first, "index scan");
+  });
+}
+
 TEST_F(LevelDbQueryEngineTest, UsesPartialIndexForLimitQueries) {
   persistence_->Run("UsesPartialIndexForLimitQueries", [&] {
     mutation_queue_->Start();
@@ -159,6 +381,72 @@ TEST_F(LevelDbQueryEngineTest, RefillsIndexedLimitQueries) {
   });
 }
 
+TEST_F(LevelDbQueryEngineTest, RefillsIndexedLimitQueriesForRemovedDocuments) {
+  persistence_->Run("RefillsIndexedLimitQueriesForRemovedDocuments", [&] {
+    mutation_queue_->Start();
+    index_manager_->Start();
+
+    auto doc1 = Doc("coll/1", 1, Map("a", 1));
+    auto doc2 = Doc("coll/2", 1, Map("a", 2));
+    auto doc3 = Doc("coll/3", 1, Map("a", 3));
+    auto doc4 = Doc("coll/4", 1, Map("a", 4));
+    auto doc5 = Doc("coll/5", 1, Map("a", 5));
+    AddDocuments({doc1, doc2, doc3, doc4, doc5});
+
+    index_manager_->AddFieldIndex(
+        MakeFieldIndex("coll", "a", model::Segment::kAscending));
+    index_manager_->UpdateIndexEntries(
+        DocumentMap({doc1, doc2, doc3, doc4, doc5}));
+    index_manager_->UpdateCollectionGroup(
+        "coll", model::IndexOffset::FromDocument(doc5));
+
+    AddMutation(PatchMutation("coll/1", Map("a", 0)));
+    AddMutation(PatchMutation("coll/2", Map("a", 0)));
+
+    core::Query query = Query("coll")
+                            .AddingFilter(Filter("a", ">", 0))
+                            .AddingOrderBy(OrderBy("a"))
+                            .WithLimitToFirst(2);
+    DocumentSet docs = ExpectOptimizedCollectionScan(
+        [&] { return RunQuery(query, SnapshotVersion::None()); });
+    EXPECT_EQ(docs, DocSet(query.Comparator(), {doc3, doc4}));
+  });
+}
+
+TEST_F(LevelDbQueryEngineTest, RefillsIndexedInQueriesWithLimit) {
+  persistence_->Run("RefillsIndexedInQueriesWithLimit", [&] {
+    mutation_queue_->Start();
+    index_manager_->Start();
+
+    auto doc1 = Doc("coll/1", 1, Map("a", 1));
+    auto doc2 = Doc("coll/2", 1, Map("a", 1));
+    auto doc3 = Doc("coll/3", 1, Map("a", 2));
+    auto doc4 = Doc("coll/4", 1, Map("a", 2));
+    auto doc5 = Doc("coll/5", 1, Map("a", 1));
+    AddDocuments({doc1, doc2, doc3, doc4, doc5});
+
+    index_manager_->AddFieldIndex(
+        MakeFieldIndex("coll", "a", model::Segment::kAscending));
+    index_manager_->UpdateIndexEntries(
+        DocumentMap({doc1, doc2, doc3, doc4, doc5}));
+    index_manager_->UpdateCollectionGroup(
+        "coll", model::IndexOffset::FromDocument(doc5));
+
+    // Each `in` value is scanned up to the limit. coll/5 is only found if the
+    // query is refilled after coll/1 stops matching, even though the scan of
+    // "a == 2" alone fills the limit.
+    AddMutation(PatchMutation("coll/1", Map("a", 3)));
+
+    core::Query query = Query("coll")
+                            .AddingFilter(Filter("a", "in", Array(1, 2)))
+                            .AddingOrderBy(OrderBy("a"))
+                            .WithLimitToFirst(2);
+    DocumentSet docs = ExpectOptimizedCollectionScan(
+        [&] { return RunQuery(query, SnapshotVersion::None()); });
+    EXPECT_EQ(docs, DocSet(query.Comparator(), {doc2, doc5}));
+  });
+}
+
 TEST_F(LevelDbQueryEngineTest, CanPerformOrQueriesUsingIndexes1) {
   persistence_->Run("CanPerformOrQueriesUsingIndexes", [&] {
     mutation_queue_->Start();
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include "Firestore/core/src/core/query.h"
+#include "Firestore/core/src/credentials/user.h"
+#include "Firestore/core/src/api/settings.h"
+#include "Firestore/core/src/local/decoded_document_cache.h"
+#include "Firestore/core/src/local/leveldb_key.h"
+#include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_remote_document_cache.h"
+#include "Firestore/core/src/model/field_path.h"
+#include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/src/model/object_value.h"
+#include "Firestore/core/src/util/autoid.h"
+#include "Firestore/core/src/util/hard_assert.h"
+#include "Firestore/core/test/unit/local/persistence_testing.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "leveldb/db.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using credentials::User;
+using model::IndexOffset;
+using model::MutableDocumentMap;
+using testutil::Doc;
+using testutil::Map;
+using testutil::Version;
+using util::CreateAutoId;
+
+using ReadMode = LevelDbRemoteDocumentCache::ReadMode;
+
+const int64_t kDocumentsPerTransaction = 1000;
+
+/**
+ * Writes `count` documents with random IDs to the "docs" collection. Each
+ * document gets its own read time, so the order in which the read time index
+ * returns the documents is unrelated to their order in the remote documents
+ * table.
+ */
+void WriteDocuments(LevelDbPersistence* persistence, int64_t count) {
+  LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+  std::string value(100, 'a');
+  for (int64_t written = 0; written < count;) {
+    persistence->Run("WriteDocuments", [&] {
+      for (int64_t i = 0; i < kDocumentsPerTransaction && written < count;
+           ++i, ++written) {
+        cache->Add(Doc("docs/" + CreateAutoId(), 1, Map("value", value)),
+                   Version(written + 1));
+      }
+    });
+  }
+}
+
+void BM_GetDocumentsMatchingQuery(benchmark::State& state) {
+  auto read_mode = static_cast<ReadMode>(state.range(0));
+  int64_t document_count = state.range(1);
+
+  auto persistence = LevelDbPersistenceForTesting();
+  LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+  cache->SetIndexManager(
+      persistence->GetIndexManager(User::Unauthenticated()));
+  cache->set_read_mode(read_mode);
+  WriteDocuments(persistence.get(), document_count);
+
+  core::Query query = testutil::Query("docs");
+  for (auto _ : state) {
+    MutableDocumentMap documents =
+        persistence->Run("BM_GetDocumentsMatchingQuery", [&] {
+          return cache->GetDocumentsMatchingQuery(query, IndexOffset::None());
+        });
+    HARD_ASSERT(static_cast<int64_t>(documents.size()) == document_count,
+                "Expected %s documents but read %s", document_count,
+                documents.size());
+  }
+  state.SetItemsProcessed(state.iterations() * document_count);
+}
+BENCHMARK(BM_GetDocumentsMatchingQuery)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"read_mode", "documents"})
+    ->Args({static_cast<int64_t>(ReadMode::kPointLookup), 1000})
+    ->Args({static_cast<int64_t>(ReadMode::kOrderedScan), 1000})
+    ->Args({static_cast<int64_t>(ReadMode::kPointLookup), 10000})
+    ->Args({static_cast<int64_t>(ReadMode::kOrderedScan), 10000})
+    ->Args({static_cast<int64_t>(ReadMode::kPointLookup), 100000})
+    ->Args({static_cast<int64_t>(ReadMode::kOrderedScan), 100000});
+
+/**
+ * Measures repeated scans of the same collection with the decoded document
+ * cache disabled (a budget of zero) and with budgets large enough to hold part
+ * or all of the collection.
+ */
+void BM_RepeatedScanWithDecodedDocumentCache(benchmark::State& state) {
+  int64_t budget = state.range(0);
+  int64_t document_count = state.range(1);
+
+  auto persistence = LevelDbPersistenceForTesting();
+  LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+  cache->SetIndexManager(
+      persistence->GetIndexManager(User::Unauthenticated()));
+  cache->decoded_document_cache().SetMaxSizeBytes(budget);
+  WriteDocuments(persistence.get(), document_count);
+
+  core::Query query = testutil::Query("docs");
+  for (auto _ : state) {
+    MutableDocumentMap documents =
+        persistence->Run("BM_RepeatedScanWithDecodedDocumentCache", [&] {
+          return cache->GetDocumentsMatchingQuery(query, IndexOffset::None());
+        });
+    HARD_ASSERT(static_cast<int64_t>(documents.size()) == document_count,
+                "Expected %s documents but read %s", document_count,
+                documents.size());
+  }
+  state.SetItemsProcessed(state.iterations() * document_count);
+  state.counters["hits"] =
+      static_cast<double>(cache->decoded_document_cache().hit_count());
+  state.counters["misses"] =
+      static_cast<double>(cache->decoded_document_cache().miss_count());
+}
+BENCHMARK(BM_RepeatedScanWithDecodedDocumentCache)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"budget", "documents"})
+    ->Args({0, 10000})
+    ->Args({1 << 20, 10000})
+    ->Args({DecodedDocumentCache::DefaultMaxSizeBytes, 10000})
+    ->Args({0, 100000})
+    ->Args({DecodedDocumentCache::DefaultMaxSizeBytes, 100000})
+    ->Args({64 << 20, 100000});
+
+/**
+ * Writes `count` documents to the "docs" collection, each with `field_count`
+ * fields whose names are 24 characters long.
+ */
+void WriteWideDocuments(LevelDbPersistence* persistence,
+                        int64_t count,
+                        int64_t field_count) {
+  model::ObjectValue value;
+  for (int64_t i = 0; i < field_count; ++i) {
+    std::string name = absl::StrCat("a_rather_long_field_", 1000 + i);
+    value.Set(model::FieldPath::FromDotSeparatedString(name),
+              testutil::Value(i));
+  }
+
+  LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+  for (int64_t written = 0; written < count;) {
+    persistence->Run("WriteWideDocuments", [&] {
+      for (int64_t i = 0; i < kDocumentsPerTransaction && written < count;
+           ++i, ++written) {
+        cache->Add(model::MutableDocument::FoundDocument(
+                       testutil::Key("docs/" + CreateAutoId()), Version(1),
+                       model::ObjectValue(value)),
+                   Version(written + 1));
+      }
+    });
+  }
+}
+
+/** Returns the total size of the rows in the remote documents table. */
+int64_t RemoteDocumentBytes(LevelDbPersistence* persistence) {
+  std::string prefix = LevelDbRemoteDocumentKey::KeyPrefix();
+  std::unique_ptr<leveldb::Iterator> it(
+      persistence->ptr()->NewIterator(leveldb::ReadOptions()));
+  int64_t bytes = 0;
+  for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix);
+       it->Next()) {
+    bytes += static_cast<int64_t>(it->value().size());
+  }
+  return bytes;
+}
+
+/**
+ * Measures scans of documents with many fields, stored with their field names
+ * spelled out (0) or replaced by dictionary IDs (1). The decoded document
+ * cache is disabled so that every scan decodes every document.
+ */
+void BM_ScanWithFieldNameDictionary(benchmark::State& state) {
+  bool dictionary = state.range(0) != 0;
+  int64_t field_count = state.range(1);
+  const int64_t document_count = 10000;
+
+  auto persistence = LevelDbPersistenceForTesting(
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(dictionary));
+  LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+  cache->SetIndexManager(
+      persistence->GetIndexManager(User::Unauthenticated()));
+  cache->decoded_document_cache().SetMaxSizeBytes(0);
+  WriteWideDocuments(persistence.get(), document_count, field_count);
+
+  core::Query query = testutil::Query("docs");
+  for (auto _ : state) {
+    MutableDocumentMap documents =
+        persistence->Run("BM_ScanWithFieldNameDictionary", [&] {
+          return cache->GetDocumentsMatchingQuery(query, IndexOffset::None());
+        });
+    HARD_ASSERT(static_cast<int64_t>(documents.size()) == document_count,
+                "Expected %s documents but read %s", document_count,
+                documents.size());
+  }
+  state.SetItemsProcessed(state.iterations() * document_count);
+  state.counters["bytes_per_document"] = static_cast<double>(
+      RemoteDocumentBytes(persistence.get()) / document_count);
+}
+BENCHMARK(BM_ScanWithFieldNameDictionary)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"dictionary", "fields"})
+    ->Args({0, 10})
+    ->Args({1, 10})
+    ->Args({0, 40})
+    ->Args({1, 40});
+
+}  // namespace
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -17,12 +17,22 @@
 #include <initializer_list>
 #include <memory>
 #include <string>
+#include <utility>
 
+#include "Firestore/core/src/api/settings.h"
+#include "Firestore/core/src/credentials/user.h"
+#include "Firestore/core/src/local/collection_statistics.h"
+#include "Firestore/core/src/local/leveldb_field_name_dictionary.h"
+#include "Firestore/core/src/local/leveldb_migrations.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_remote_document_cache.h"
+#include "Firestore/core/src/local/leveldb_transaction.h"
+#include "Firestore/core/src/local/lru_garbage_collector.h"
 #include "Firestore/core/src/local/remote_document_cache.h"
 #include "Firestore/core/src/util/ordered_code.h"
 #include "Firestore/core/test/unit/local/persistence_testing.h"
 #include "Firestore/core/test/unit/local/remote_document_cache_test.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
 #include "absl/memory/memory.h"
 #include "leveldb/db.h"
 
@@ -32,7 +42,9 @@ namespace local {
 namespace {
 
 using leveldb::WriteOptions;
+using model::MutableDocument;
 using util::OrderedCode;
+using util::Path;
 
 // A dummy document value, useful for testing code that's known to examine only
 // document keys.
@@ -62,8 +74,13 @@ void WriteDummyRow(LevelDbPersistence* db,
   db->ptr()->Put(WriteOptions(), key, kDummy);
 }
 
-std::unique_ptr<Persistence> PersistenceFactory() {
-  auto persistence = LevelDbPersistenceForTesting();
+using ReadMode = LevelDbRemoteDocumentCache::ReadMode;
+
+std::unique_ptr<LevelDbPersistence> MakePersistence(
+    ReadMode read_mode,
+    const api::PersistentCacheTuning& tuning = api::PersistentCacheTuning{}) {
+  auto persistence = LevelDbPersistenceForTesting(tuning);
+  persistence->remote_document_cache()->set_read_mode(read_mode);
 
   // Write rows that go before and after remote document cache keys to ensure
   // that LevelDbRemoteDocumentCache doesn't accidentally read rows outside the
@@ -78,11 +95,388 @@ std::unique_ptr<Persistence> PersistenceFactory() {
   return persistence;
 }
 
+std::unique_ptr<Persistence> OrderedScanPersistenceFactory() {
+  return MakePersistence(ReadMode::kOrderedScan);
+}
+
+std::unique_ptr<Persistence> PointLookupPersistenceFactory() {
+  return MakePersistence(ReadMode::kPointLookup);
+}
+
+std::unique_ptr<Persistence> LargeCachePersistenceFactory() {
+  return MakePersistence(ReadMode::kOrderedScan,
+                         api::PersistentCacheTuning::ForLargeCache());
+}
+
+std::unique_ptr<Persistence> DictionaryEncodingPersistenceFactory() {
+  return MakePersistence(
+      ReadMode::kOrderedScan,
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(true));
+}
+
+/** Returns the raw contents of the remote documents row for `path`. */
+std::string ReadRawDocument(LevelDbPersistence* persistence,
+                            absl::string_view path) {
+  std::string value;
+  leveldb::Status status = persistence->ptr()->Get(
+      leveldb::ReadOptions(),
+      LevelDbRemoteDocumentKey::Key(testutil::Key(path)), &value);
+  EXPECT_TRUE(status.ok());
+  return value;
+}
+
+/** Rewrites the remote documents left to rewrite when `persistence` opened. */
+void FinishRemoteDocumentRewrite(LevelDbPersistence* persistence) {
+  while (persistence->RewriteRemoteDocumentsSlice()) {
+  }
+  EXPECT_FALSE(persistence->has_pending_remote_document_rewrite());
+}
+
 }  // namespace
 
 INSTANTIATE_TEST_SUITE_P(LevelDbRemoteDocumentCacheTest,
                          RemoteDocumentCacheTest,
-                         testing::Values(PersistenceFactory));
+                         testing::Values(OrderedScanPersistenceFactory,
+                                         PointLookupPersistenceFactory,
+                                         LargeCachePersistenceFactory,
+                                         DictionaryEncodingPersistenceFactory));
+
+TEST(LevelDbRemoteDocumentCacheTest, CachesDecodedDocumentsForScans) {
+  for (ReadMode read_mode : {ReadMode::kOrderedScan, ReadMode::kPointLookup}) {
+    auto persistence = MakePersistence(read_mode);
+    LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+    cache->SetIndexManager(
+        persistence->GetIndexManager(credentials::User::Unauthenticated()));
+    DecodedDocumentCache& decoded = cache->decoded_document_cache();
+    core::Query query = testutil::Query("coll");
+
+    auto scan = [&] {
+      return persistence->Run("scan", [&] {
+        return cache->GetDocumentsMatchingQuery(query,
+                                                model::IndexOffset::None());
+      });
+    };
+
+    persistence->Run("add", [&] {
+      cache->Add(testutil::Doc("coll/a", 1, testutil::Map("v", 1)),
+                 testutil::Version(1));
+      cache->Add(testutil::Doc("coll/b", 1, testutil::Map("v", 1)),
+                 testutil::Version(1));
+    });
+
+    EXPECT_EQ(scan().size(), 2u);
+    EXPECT_EQ(decoded.hit_count(), 0);
+    EXPECT_EQ(decoded.miss_count(), 2);
+
+    EXPECT_EQ(scan().size(), 2u);
+    EXPECT_EQ(decoded.hit_count(), 2);
+
+    // Rewriting a document at the same read time must not serve the stale
+    // copy.
+    persistence->Run("update", [&] {
+      cache->Add(testutil::Doc("coll/a", 2, testutil::Map("v", 2)),
+                 testutil::Version(1));
+    });
+    model::MutableDocumentMap result = scan();
+    EXPECT_EQ(result.get(testutil::Key("coll/a"))->version(),
+              testutil::Version(2));
+    EXPECT_EQ(decoded.hit_count(), 3);
+    EXPECT_EQ(decoded.miss_count(), 3);
+
+    // Removed documents are not returned even though their read time index
+    // entries remain.
+    persistence->Run("remove",
+                     [&] { cache->Remove(testutil::Key("coll/b")); });
+    EXPECT_EQ(scan().size(), 1u);
+  }
+}
+
+TEST(LevelDbRemoteDocumentCacheTest, ScansInReadOnlyTransactions) {
+  for (ReadMode read_mode : {ReadMode::kOrderedScan, ReadMode::kPointLookup}) {
+    auto persistence = MakePersistence(read_mode);
+    LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+    cache->SetIndexManager(
+        persistence->GetIndexManager(credentials::User::Unauthenticated()));
+
+    persistence->Run("add", [&] {
+      for (int i = 0; i < 10; ++i) {
+        cache->Add(testutil::Doc("coll/" + std::to_string(i), 1,
+                                 testutil::Map("v", i)),
+                   testutil::Version(1));
+      }
+    });
+
+    // Documents are fetched on query executor threads, which must not look up
+    // the read-only transaction of the calling thread themselves.
+    model::MutableDocumentMap result = persistence->RunReadOnly("scan", [&] {
+      return cache->GetDocumentsMatchingQuery(testutil::Query("coll"),
+                                              model::IndexOffset::None());
+    });
+    EXPECT_EQ(result.size(), 10u);
+  }
+}
+
+TEST(LevelDbRemoteDocumentCacheTest, RemoveAllSubtractsRemovedDocuments) {
+  auto persistence = MakePersistence(ReadMode::kOrderedScan);
+  LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+  cache->SetIndexManager(
+      persistence->GetIndexManager(credentials::User::Unauthenticated()));
+  CollectionStatistics statistics;
+  cache->SetCollectionStatistics(&statistics);
+  statistics.RecordCollectionScan(testutil::Resource("coll"), 2);
+
+  persistence->Run("add", [&] {
+    cache->Add(testutil::Doc("coll/a", 1, testutil::Map("v", 1)),
+               testutil::Version(1));
+    cache->Add(testutil::Doc("coll/b", 1, testutil::Map("v", 1)),
+               testutil::Version(1));
+  });
+  int64_t size_before = persistence->CalculateByteSize().ValueOrDie();
+
+  // Removing a document that is not in the cache leaves the count alone.
+  persistence->Run("remove", [&] {
+    cache->RemoveAll({testutil::Key("coll/missing"), testutil::Key("coll/a")});
+  });
+
+  persistence->Run("get", [&] {
+    EXPECT_FALSE(cache->Get(testutil::Key("coll/a")).is_valid_document());
+    EXPECT_TRUE(cache->Get(testutil::Key("coll/b")).is_valid_document());
+  });
+  EXPECT_EQ(statistics.GetDocumentCount(testutil::Resource("coll")), 1u);
+  EXPECT_LT(persistence->CalculateByteSize().ValueOrDie(), size_before);
+}
+
+TEST(LevelDbRemoteDocumentCacheTest, EncodesFieldNamesWithDictionary) {
+  Path dir = LevelDbDir();
+  api::PersistentCacheTuning tuning =
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(true);
+  auto persistence =
+      LevelDbPersistenceForTesting(dir, LruParams::Default(), tuning);
+  LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+  cache->SetIndexManager(
+      persistence->GetIndexManager(credentials::User::Unauthenticated()));
+
+  std::string long_name(64, 'f');
+  MutableDocument doc1 = testutil::Doc(
+      "users/a/posts/1", 1,
+      testutil::Map(long_name, 1, "nested", testutil::Map(long_name, "x"),
+                    "array", testutil::Array(testutil::Map(long_name, 2))));
+  // Collections with the same ID share a dictionary.
+  MutableDocument doc2 =
+      testutil::Doc("users/b/posts/2", 1, testutil::Map(long_name, 3));
+  MutableDocument missing = testutil::DeletedDoc("users/a/posts/3", 1);
+  persistence->Run("add", [&] {
+    cache->Add(doc1, testutil::Version(1));
+    cache->Add(doc2, testutil::Version(1));
+    cache->Add(missing, testutil::Version(1));
+  });
+
+  auto get = [&](const MutableDocument& doc) {
+    return persistence->Run("get", [&] {
+      return persistence->remote_document_cache()->Get(doc.key());
+    });
+  };
+  ASSERT_EQ(doc1, get(doc1));
+  ASSERT_EQ(doc2, get(doc2));
+  ASSERT_EQ(missing, get(missing));
+
+  std::string raw = ReadRawDocument(persistence.get(), "users/b/posts/2");
+  ASSERT_TRUE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(raw));
+  ASSERT_EQ(raw.find(long_name), std::string::npos);
+
+  // Names of nested fields are user data and are stored as they are.
+  raw = ReadRawDocument(persistence.get(), "users/a/posts/1");
+  ASSERT_NE(raw.find(long_name), std::string::npos);
+
+  // The dictionary is loaded from disk after a restart.
+  persistence->Shutdown();
+  persistence = LevelDbPersistenceForTesting(dir, LruParams::Default(), tuning);
+  ASSERT_EQ(doc1, get(doc1));
+  ASSERT_EQ(doc2, get(doc2));
+  persistence->Shutdown();
+}
+
+TEST(LevelDbRemoteDocumentCacheTest, ReencodesDocumentsWhenSettingChanges) {
+  Path dir = LevelDbDir();
+  auto persistence = LevelDbPersistenceForTesting(dir);
+  MutableDocument doc = testutil::Doc(
+      "coll/a", 1, testutil::Map("field", testutil::Map("nested", 1)));
+  persistence->Run("add", [&] {
+    persistence->remote_document_cache()->Add(doc, testutil::Version(1));
+  });
+  ASSERT_FALSE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/a")));
+  persistence->Shutdown();
+  persistence.reset();
+
+  auto get = [&] {
+    return persistence->Run("get", [&] {
+      return persistence->remote_document_cache()->Get(doc.key());
+    });
+  };
+
+  persistence = LevelDbPersistenceForTesting(
+      dir, LruParams::Default(),
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(true));
+  // Documents are rewritten after the database is open, and can be read in
+  // either encoding until then.
+  ASSERT_TRUE(persistence->has_pending_remote_document_rewrite());
+  ASSERT_FALSE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/a")));
+  ASSERT_EQ(doc, get());
+  FinishRemoteDocumentRewrite(persistence.get());
+  ASSERT_TRUE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/a")));
+  ASSERT_EQ(doc, get());
+  persistence->Shutdown();
+  persistence.reset();
+
+  persistence = LevelDbPersistenceForTesting(
+      dir, LruParams::Default(),
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(true));
+  ASSERT_FALSE(persistence->has_pending_remote_document_rewrite());
+  persistence->Shutdown();
+  persistence.reset();
+
+  persistence = LevelDbPersistenceForTesting(dir);
+  FinishRemoteDocumentRewrite(persistence.get());
+  ASSERT_FALSE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/a")));
+  ASSERT_EQ(doc, get());
+  persistence->Shutdown();
+}
+
+TEST(LevelDbRemoteDocumentCacheTest, ResumesReencodingFromMigrationCursor) {
+  Path dir = LevelDbDir();
+  auto persistence = LevelDbPersistenceForTesting(dir);
+  MutableDocument doc_a = testutil::Doc("coll/a", 1, testutil::Map("f", 1));
+  MutableDocument doc_b = testutil::Doc("coll/b", 1, testutil::Map("f", 2));
+  persistence->Run("add", [&] {
+    persistence->remote_document_cache()->Add(doc_a, testutil::Version(1));
+    persistence->remote_document_cache()->Add(doc_b, testutil::Version(1));
+  });
+
+  // Simulate a rewrite that committed the chunk holding "coll/a".
+  {
+    LevelDbTransaction transaction(persistence->ptr(), "Save cursor");
+    LevelDbMigrations::Cursor cursor;
+    cursor.version = kFieldNameDictionarySchemaVersion;
+    cursor.next_key = LevelDbRemoteDocumentKey::Key(doc_b.key());
+    LevelDbMigrations::SaveMigrationCursor(cursor, &transaction);
+    transaction.Commit();
+  }
+  persistence->Shutdown();
+  persistence.reset();
+
+  persistence = LevelDbPersistenceForTesting(
+      dir, LruParams::Default(),
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(true));
+  FinishRemoteDocumentRewrite(persistence.get());
+  EXPECT_FALSE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/a")));
+  EXPECT_TRUE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/b")));
+  EXPECT_FALSE(
+      LevelDbMigrations::ReadMigrationCursor(persistence->ptr()).has_value());
+  persistence->Shutdown();
+}
+
+TEST(LevelDbRemoteDocumentCacheTest, RewritesInterruptedRewriteWhenReverted) {
+  Path dir = LevelDbDir();
+  auto persistence = LevelDbPersistenceForTesting(
+      dir, LruParams::Default(),
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(true));
+  MutableDocument doc = testutil::Doc("coll/a", 1, testutil::Map("f", 1));
+  persistence->Run("add", [&] {
+    persistence->remote_document_cache()->Add(doc, testutil::Version(1));
+  });
+  ASSERT_TRUE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/a")));
+  persistence->Shutdown();
+  persistence.reset();
+
+  // The database never recorded that its documents are dictionary encoded,
+  // but the rewrite left its cursor behind.
+  persistence = LevelDbPersistenceForTesting(dir);
+  ASSERT_TRUE(persistence->has_pending_remote_document_rewrite());
+  FinishRemoteDocumentRewrite(persistence.get());
+  EXPECT_FALSE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/a")));
+  EXPECT_EQ(0,
+            LevelDbMigrations::ReadMinimumSchemaVersion(persistence->ptr()));
+  persistence->Shutdown();
+}
+
+TEST(LevelDbRemoteDocumentCacheTest, LimitsFieldNameDictionarySize) {
+  auto persistence = LevelDbPersistenceForTesting(
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(true));
+  LevelDbRemoteDocumentCache* cache = persistence->remote_document_cache();
+  cache->SetIndexManager(
+      persistence->GetIndexManager(credentials::User::Unauthenticated()));
+
+  auto doc_with_fields = [](absl::string_view path, size_t first,
+                            size_t count) {
+    model::ObjectValue value;
+    for (size_t i = first; i < first + count; ++i) {
+      value.Set(testutil::Field("f" + std::to_string(i)),
+                testutil::Value(static_cast<int64_t>(i)));
+    }
+    return MutableDocument::FoundDocument(testutil::Key(path),
+                                          testutil::Version(1),
+                                          std::move(value));
+  };
+
+  // The first document fills the dictionary; the second would grow it beyond
+  // its limit, so it is stored without the dictionary.
+  size_t max_names = LevelDbFieldNameDictionary::kMaxFieldNames;
+  MutableDocument full = doc_with_fields("coll/full", 0, max_names);
+  MutableDocument overflow = doc_with_fields("coll/overflow", max_names, 1);
+  persistence->Run("add", [&] {
+    cache->Add(full, testutil::Version(1));
+    cache->Add(overflow, testutil::Version(1));
+  });
+
+  EXPECT_TRUE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/full")));
+  EXPECT_FALSE(LevelDbRemoteDocumentCache::IsDictionaryEncoded(
+      ReadRawDocument(persistence.get(), "coll/overflow")));
+  persistence->Run("get", [&] {
+    EXPECT_EQ(full, cache->Get(full.key()));
+    EXPECT_EQ(overflow, cache->Get(overflow.key()));
+  });
+}
+
+TEST(LevelDbRemoteDocumentCacheTest,
+     RefusesDatabasesRequiringNewerSchemaVersion) {
+  Path dir = LevelDbDir();
+  auto persistence = LevelDbPersistenceForTesting(
+      dir, LruParams::Default(),
+      api::PersistentCacheTuning{}.WithFieldNameDictionary(true));
+  EXPECT_EQ(kFieldNameDictionarySchemaVersion,
+            LevelDbMigrations::ReadMinimumSchemaVersion(persistence->ptr()));
+  persistence->Shutdown();
+  persistence.reset();
+
+  // Rewriting every document as plain lifts the restriction.
+  persistence = LevelDbPersistenceForTesting(dir);
+  FinishRemoteDocumentRewrite(persistence.get());
+  EXPECT_EQ(0,
+            LevelDbMigrations::ReadMinimumSchemaVersion(persistence->ptr()));
+
+  {
+    LevelDbTransaction transaction(persistence->ptr(), "Require newer SDK");
+    LevelDbMigrations::SaveMinimumSchemaVersion(kSchemaVersion + 1,
+                                                &transaction);
+    transaction.Commit();
+  }
+  persistence->Shutdown();
+  persistence.reset();
+
+  auto created = LevelDbPersistence::Create(dir, MakeLocalSerializer(),
+                                            LruParams::Default());
+  ASSERT_FALSE(created.ok());
+  EXPECT_EQ(Error::kErrorFailedPrecondition, created.status().code());
+}
 
 }  // namespace local
 }  // namespace firestore
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_target_cache.h"
+#include "Firestore/core/src/model/document_key_set.h"
+#include "Firestore/core/src/util/hard_assert.h"
+#include "Firestore/core/test/unit/local/persistence_testing.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
+#include "benchmark/benchmark.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using model::DocumentKeySet;
+using model::TargetId;
+
+/**
+ * Measures adding the matching keys of a target and removing them again, as
+ * listening to a query and stopping do. For every key, the target cache reads
+ * the document's sentinel row, checks whether any other target contains the
+ * document, and updates the orphaned documents index and its count.
+ */
+void BM_AddAndRemoveMatchingKeys(benchmark::State& state) {
+  int64_t key_count = state.range(0);
+
+  auto persistence = LevelDbPersistenceForTesting();
+  LevelDbTargetCache* cache = persistence->target_cache();
+
+  DocumentKeySet keys;
+  for (int64_t i = 0; i < key_count; ++i) {
+    keys = keys.insert(testutil::Key("docs/doc" + std::to_string(i)));
+  }
+
+  TargetId target_id = 1;
+  for (auto _ : state) {
+    persistence->Run("BM_AddMatchingKeys",
+                     [&] { cache->AddMatchingKeys(keys, target_id); });
+    persistence->Run("BM_RemoveMatchingKeys",
+                     [&] { cache->RemoveMatchingKeys(keys, target_id); });
+  }
+
+  HARD_ASSERT(cache->CountOrphanedDocuments() ==
+                  static_cast<size_t>(key_count),
+              "Expected %s orphaned documents but counted %s", key_count,
+              cache->CountOrphanedDocuments());
+  state.SetItemsProcessed(state.iterations() * key_count * 2);
+}
+BENCHMARK(BM_AddAndRemoveMatchingKeys)
+    ->Unit(benchmark::kMicrosecond)
+    ->Arg(10)
+    ->Arg(100)
+    ->Arg(1000);
+
+}  // namespace
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -16,9 +16,13 @@
 
 #include "Firestore/core/src/local/leveldb_target_cache.h"
 
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
 #include "Firestore/core/include/firebase/firestore/timestamp.h"
 #include "Firestore/core/src/local/leveldb_key.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_transaction.h"
 #include "Firestore/core/src/local/persistence.h"
 #include "Firestore/core/src/local/target_data.h"
 #include "Firestore/core/src/model/document_key.h"
@@ -35,12 +39,16 @@ namespace local {
 namespace {
 
 using core::Query;
+using core::Target;
 using model::DocumentKey;
 using model::ListenSequenceNumber;
 using model::SnapshotVersion;
 using model::TargetId;
 using util::Path;
 
+constexpr LevelDbTargetCache::MembershipChange kUnchanged =
+    LevelDbTargetCache::MembershipChange::kUnchanged;
+
 std::unique_ptr<Persistence> PersistenceFactory() {
   return LevelDbPersistenceForTesting();
 }
@@ -151,6 +159,165 @@ TEST_F(LevelDbTargetCacheTest, SurvivesMissingTargetData) {
   });
 }
 
+TEST_F(LevelDbTargetCacheTest, InMemoryLookupsTrackTargetChanges) {
+  persistence_->Run("test_in_memory_lookups", [&]() {
+    Target rooms = query_rooms_.ToTarget();
+    TargetData target_data = MakeTargetData(query_rooms_);
+    cache_->AddTarget(target_data);
+    ASSERT_EQ(cache_->GetTarget(rooms), target_data);
+
+    TargetData updated =
+        target_data
+            .WithResumeToken(testutil::ResumeToken(2), testutil::Version(2))
+            .WithExpectedCount(5);
+    cache_->UpdateTarget(updated);
+    absl::optional<TargetData> result = cache_->GetTarget(rooms);
+    ASSERT_TRUE(result.has_value());
+    ASSERT_EQ(result->resume_token(), updated.resume_token());
+    // The expected count is not persisted.
+    ASSERT_EQ(result->expected_count(), absl::nullopt);
+
+    cache_->RemoveTarget(updated);
+    ASSERT_EQ(cache_->GetTarget(rooms), absl::nullopt);
+
+    TargetData halls = MakeTargetData(testutil::Query("halls"));
+    cache_->AddTarget(halls);
+    ASSERT_EQ(cache_->GetTarget(halls.target()), halls);
+    cache_->RemoveTargets(halls.sequence_number(), {});
+    ASSERT_EQ(cache_->GetTarget(halls.target()), absl::nullopt);
+  });
+}
+
+TEST_F(LevelDbTargetCacheTest, InMemoryLookupsLoadAfterRestart) {
+  persistence_->Shutdown();
+  persistence_.reset();
+
+  Path dir = LevelDbDir();
+  TargetData target_data = MakeTargetData(query_rooms_);
+
+  auto db1 = LevelDbPersistenceForTesting(dir);
+  db1->Run("add target data",
+           [&] { db1->target_cache()->AddTarget(target_data); });
+  db1->Shutdown();
+  db1.reset();
+
+  auto db2 = LevelDbPersistenceForTesting(dir);
+  absl::optional<TargetData> result = db2->Run("get target data", [&] {
+    return db2->target_cache()->GetTarget(query_rooms_.ToTarget());
+  });
+  ASSERT_EQ(result, target_data);
+
+  db2->Shutdown();
+  db2.reset();
+}
+
+TEST_F(LevelDbTargetCacheTest, IndexesOrphanedDocumentsBySequenceNumber) {
+  persistence_->Run("test_orphaned_documents_index", [&]() {
+    DocumentKey key1 = testutil::Key("foo/bar");
+    DocumentKey key2 = testutil::Key("foo/baz");
+    LevelDbTargetCache* cache = leveldb_cache();
+
+    auto orphaned_keys = [&] {
+      std::vector<DocumentKey> result;
+      cache->EnumerateOrphanedDocuments(
+          [&](const DocumentKey& key, ListenSequenceNumber) {
+            result.push_back(key);
+            return true;
+          });
+      return result;
+    };
+
+    cache->WriteSentinel(key1, 20, kUnchanged);
+    cache->WriteSentinel(key2, 10, kUnchanged);
+    ASSERT_EQ(orphaned_keys(), (std::vector<DocumentKey>{key2, key1}));
+    ASSERT_EQ(cache->CountOrphanedDocuments(), 2u);
+
+    // Rewriting a sentinel moves the document within the index.
+    cache->WriteSentinel(key2, 30, kUnchanged);
+    ASSERT_EQ(orphaned_keys(), (std::vector<DocumentKey>{key1, key2}));
+
+    AddMatchingKey(key1, 1);
+    ASSERT_EQ(orphaned_keys(), std::vector<DocumentKey>{key2});
+    ASSERT_EQ(cache->CountOrphanedDocuments(), 1u);
+
+    cache->RemoveMatchingKeysForTarget(1);
+    ASSERT_EQ(cache->CountOrphanedDocuments(), 2u);
+
+    cache->RemoveSentinel(key2, 30);
+    ASSERT_EQ(orphaned_keys(), std::vector<DocumentKey>{key1});
+    ASSERT_EQ(cache->CountOrphanedDocuments(), 1u);
+  });
+}
+
+TEST_F(LevelDbTargetCacheTest, OrphanedDocumentCountPersistedAcrossRestarts) {
+  persistence_->Shutdown();
+  persistence_.reset();
+
+  Path dir = LevelDbDir();
+
+  auto db1 = LevelDbPersistenceForTesting(dir);
+  db1->Run("write sentinels", [&] {
+    db1->target_cache()->WriteSentinel(testutil::Key("foo/bar"), 10,
+                                        kUnchanged);
+    db1->target_cache()->WriteSentinel(testutil::Key("foo/baz"), 20,
+                                        kUnchanged);
+  });
+  // Index entries written without going through the target cache are not
+  // counted until the count is recomputed.
+  db1->Run("write index entry", [&] {
+    db1->current_transaction()->Put(
+        LevelDbOrphanedDocumentKey::Key(30, testutil::Key("foo/qux")), "");
+  });
+  db1->Shutdown();
+  db1.reset();
+
+  auto db2 = LevelDbPersistenceForTesting(dir);
+  ASSERT_EQ(db2->target_cache()->CountOrphanedDocuments(), 2u);
+  db2->Run("discard count", [&] {
+    LevelDbTargetCache::DiscardOrphanedDocumentCount(
+        db2->current_transaction());
+  });
+  db2->Shutdown();
+  db2.reset();
+
+  auto db3 = LevelDbPersistenceForTesting(dir);
+  ASSERT_EQ(db3->target_cache()->CountOrphanedDocuments(), 3u);
+  db3->Shutdown();
+  db3.reset();
+}
+
+TEST_F(LevelDbTargetCacheTest, ReadOnlyTransactionReadsFromSnapshot) {
+  SnapshotVersion first_version = testutil::Version(100);
+  SnapshotVersion second_version = testutil::Version(200);
+  persistence_->Run("set first version", [&] {
+    cache_->SetLastRemoteSnapshotVersion(first_version);
+  });
+
+  absl::optional<TargetData> target;
+  SnapshotVersion version = persistence_->RunReadOnly("read", [&] {
+    // Commit a write from another thread while the read-only transaction is
+    // open. The transaction must not observe it.
+    std::thread writer([&] {
+      persistence_->Run("write", [&] {
+        cache_->AddTarget(MakeTargetData(query_rooms_));
+        cache_->SetLastRemoteSnapshotVersion(second_version);
+      });
+    });
+    writer.join();
+
+    target = cache_->GetTarget(query_rooms_.ToTarget());
+    return cache_->ReadLastRemoteSnapshotVersion();
+  });
+
+  ASSERT_EQ(first_version, version);
+  ASSERT_EQ(absl::nullopt, target);
+  ASSERT_EQ(second_version, cache_->GetLastRemoteSnapshotVersion());
+
+  version = persistence_->RunReadOnly(
+      "read again", [&] { return cache_->ReadLastRemoteSnapshotVersion(); });
+  ASSERT_EQ(second_version, version);
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
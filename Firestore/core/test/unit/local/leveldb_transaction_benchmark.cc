@@ -0,0 +1,210 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Firestore/core/src/local/leveldb_key.h"
+#include "Firestore/core/src/local/leveldb_size_tracker.h"
+#include "Firestore/core/src/local/leveldb_transaction.h"
+#include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/model/snapshot_version.h"
+#include "Firestore/core/src/util/hard_assert.h"
+#include "Firestore/core/src/util/path.h"
+#include "Firestore/core/test/unit/local/persistence_testing.h"
+#include "benchmark/benchmark.h"
+#include "leveldb/db.h"
+#include "leveldb/write_batch.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using leveldb::DB;
+using leveldb::Options;
+using leveldb::Status;
+using leveldb::WriteBatch;
+using model::DocumentKey;
+using model::SnapshotVersion;
+
+std::string RowKey(int64_t i) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "row_%010lld",
+                static_cast<long long>(i));  // NOLINT(runtime/int)
+  return buffer;
+}
+
+std::unique_ptr<DB> OpenDbWithRows(int64_t row_count) {
+  Options options;
+  options.error_if_exists = true;
+  options.create_if_missing = true;
+
+  DB* db = nullptr;
+  Status status = DB::Open(options, LevelDbDir().ToUtf8String(), &db);
+  HARD_ASSERT(status.ok(), "Failed to create db: %s", status.ToString());
+
+  WriteBatch batch;
+  std::string value(100, 'a');
+  for (int64_t i = 0; i < row_count; ++i) {
+    batch.Put(RowKey(i), value);
+  }
+  status = db->Write(LevelDbTransaction::DefaultWriteOptions(), &batch);
+  HARD_ASSERT(status.ok(), "Failed to write rows: %s", status.ToString());
+  return std::unique_ptr<DB>(db);
+}
+
+/**
+ * Measures a full scan of a transaction that has deleted every other row of
+ * the table, as happens during garbage collection.
+ */
+void BM_IterateWithPendingDeletes(benchmark::State& state) {
+  int64_t deletes = state.range(0);
+  int64_t row_count = deletes * 2;
+  std::unique_ptr<DB> db = OpenDbWithRows(row_count);
+
+  LevelDbTransaction transaction(db.get(), "BM_IterateWithPendingDeletes");
+  for (int64_t i = 0; i < row_count; i += 2) {
+    transaction.Delete(RowKey(i));
+  }
+
+  for (auto _ : state) {
+    int64_t visited = 0;
+    auto it = transaction.NewIterator();
+    for (it->Seek(RowKey(0)); it->Valid(); it->Next()) {
+      ++visited;
+    }
+    HARD_ASSERT(visited == row_count - deletes, "Expected %s rows but read %s",
+                row_count - deletes, visited);
+  }
+  state.SetItemsProcessed(state.iterations() * row_count);
+}
+BENCHMARK(BM_IterateWithPendingDeletes)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"deletes"})
+    ->Arg(1000)
+    ->Arg(10000);
+
+/**
+ * Measures point reads through a transaction with pending deletes, half of
+ * which hit a deleted row.
+ */
+void BM_GetWithPendingDeletes(benchmark::State& state) {
+  int64_t deletes = state.range(0);
+  int64_t row_count = deletes * 2;
+  std::unique_ptr<DB> db = OpenDbWithRows(row_count);
+
+  LevelDbTransaction transaction(db.get(), "BM_GetWithPendingDeletes");
+  for (int64_t i = 0; i < row_count; i += 2) {
+    transaction.Delete(RowKey(i));
+  }
+
+  std::vector<std::string> keys;
+  for (int64_t i = 0; i < row_count; ++i) {
+    keys.push_back(RowKey(i));
+  }
+
+  std::string value;
+  for (auto _ : state) {
+    for (const std::string& key : keys) {
+      benchmark::DoNotOptimize(transaction.Get(key, &value));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * row_count);
+}
+BENCHMARK(BM_GetWithPendingDeletes)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"deletes"})
+    ->Arg(10000);
+
+DocumentKey BenchmarkDocumentKey(int64_t i) {
+  return DocumentKey::FromPathString("docs/" + RowKey(i));
+}
+
+/**
+ * Measures the commits of transactions that write rows the way
+ * LocalStore::ApplyRemoteEvent does, with `range(0)` documents per event, and
+ * with (`range(1)` == 1) or without a size tracker attached. Each document is
+ * read with a seek, rewritten, and gets new read time and target rows and a
+ * rewritten LRU sentinel.
+ */
+void BM_ApplyRemoteEventWrites(benchmark::State& state) {
+  int64_t documents_per_event = state.range(0);
+  bool tracked = state.range(1) != 0;
+  const int64_t document_count = 10000;
+
+  std::unique_ptr<DB> db = OpenDbWithRows(0);
+  {
+    WriteBatch batch;
+    std::string value(1000, 'a');
+    for (int64_t i = 0; i < document_count; ++i) {
+      DocumentKey key = BenchmarkDocumentKey(i);
+      batch.Put(LevelDbRemoteDocumentKey::Key(key), value);
+      batch.Put(LevelDbDocumentTargetKey::SentinelKey(key), "sequence");
+    }
+    Status status =
+        db->Write(LevelDbTransaction::DefaultWriteOptions(), &batch);
+    HARD_ASSERT(status.ok(), "Failed to write rows: %s", status.ToString());
+  }
+  LevelDbSizeTracker tracker(db.get());
+
+  std::string value(1000, 'b');
+  int64_t next = 0;
+  int64_t version = 1;
+  for (auto _ : state) {
+    LevelDbTransaction transaction(db.get(), "BM_ApplyRemoteEventWrites");
+    if (tracked) {
+      transaction.set_size_tracker(&tracker);
+    }
+
+    auto it = transaction.NewIterator();
+    for (int64_t i = 0; i < documents_per_event; ++i) {
+      DocumentKey key = BenchmarkDocumentKey(next++ % document_count);
+      std::string document_key = LevelDbRemoteDocumentKey::Key(key);
+      it->Seek(document_key);
+      HARD_ASSERT(it->Valid() && it->key() == document_key,
+                  "Document %s not found", key.ToString());
+
+      transaction.Put(std::move(document_key), value);
+      transaction.Put(
+          LevelDbRemoteDocumentReadTimeKey::Key(
+              key.path().PopLast(), SnapshotVersion(Timestamp(version, 0)),
+              key.path().last_segment()),
+          "");
+      transaction.Put(LevelDbTargetDocumentKey::Key(2, key), "");
+      transaction.Put(LevelDbDocumentTargetKey::SentinelKey(key), "sequence");
+    }
+    transaction.Put(LevelDbTargetKey::Key(2), "target");
+    ++version;
+
+    transaction.Commit();
+  }
+  state.SetItemsProcessed(state.iterations() * documents_per_event);
+}
+BENCHMARK(BM_ApplyRemoteEventWrites)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"documents", "tracked"})
+    ->Args({10, 0})
+    ->Args({10, 1})
+    ->Args({500, 0})
+    ->Args({500, 1});
+
+}  // namespace
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
@@ -18,10 +18,12 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "Firestore/Protos/nanopb/firestore/local/mutation.nanopb.h"
 #include "Firestore/Protos/nanopb/firestore/local/target.nanopb.h"
 #include "Firestore/core/src/local/leveldb_key.h"
+#include "Firestore/core/src/local/leveldb_size_tracker.h"
 #include "Firestore/core/src/nanopb/byte_string.h"
 #include "Firestore/core/src/nanopb/message.h"
 #include "Firestore/core/src/nanopb/reader.h"
@@ -290,6 +292,101 @@ TEST_F(LevelDbTransactionTest, DeletingAheadOfAnIterator) {
   ASSERT_FALSE(it->Valid());
 }
 
+TEST_F(LevelDbTransactionTest, CurrentMutationSurvivesChanges) {
+  // Iterate over pending mutations only, then delete and overwrite the entry
+  // the iterator points at. Verify the current entry is still readable and
+  // that iteration continues past it.
+  LevelDbTransaction transaction(db_.get(), "CurrentMutationSurvivesChanges");
+  transaction.Put("key_0", "value_0");
+  transaction.Put("key_1", "value_1");
+
+  auto it = transaction.NewIterator();
+  it->Seek("key_0");
+  ASSERT_TRUE(it->Valid());
+  ASSERT_EQ("key_0", it->key());
+
+  transaction.Delete("key_0");
+  ASSERT_EQ("key_0", it->key());
+  ASSERT_EQ("value_0", it->value());
+
+  transaction.Put("key_0", std::string(100, 'x'));
+  ASSERT_EQ("key_0", it->key());
+  ASSERT_EQ("value_0", it->value());
+
+  it->Next();
+  ASSERT_TRUE(it->Valid());
+  ASSERT_EQ("key_1", it->key());
+  ASSERT_EQ("value_1", it->value());
+  it->Next();
+  ASSERT_FALSE(it->Valid());
+}
+
+TEST_F(LevelDbTransactionTest, CanDeleteCurrentKeyWhileIterating) {
+  LevelDbTransaction transaction(db_.get(),
+                                 "CanDeleteCurrentKeyWhileIterating");
+  for (int i = 0; i < 4; ++i) {
+    transaction.Put("key_" + std::to_string(i), "value_" + std::to_string(i));
+  }
+
+  int deleted = 0;
+  auto it = transaction.NewIterator();
+  for (it->Seek("key_0"); it->Valid(); it->Next()) {
+    transaction.Delete(it->key());
+    ++deleted;
+  }
+  ASSERT_EQ(4, deleted);
+
+  it->Seek("key_0");
+  ASSERT_FALSE(it->Valid());
+}
+
+TEST_F(LevelDbTransactionTest, SkipsInterleavedDeletions) {
+  for (int i = 0; i < 8; ++i) {
+    Status status =
+        db_->Put(LevelDbTransaction::DefaultWriteOptions(),
+                 "key_" + std::to_string(i), "value_" + std::to_string(i));
+    ASSERT_TRUE(status.ok());
+  }
+
+  LevelDbTransaction transaction(db_.get(), "SkipsInterleavedDeletions");
+  for (int i = 1; i < 8; i += 2) {
+    transaction.Delete("key_" + std::to_string(i));
+  }
+  // Deletions of keys that are not in leveldb must not hide other rows.
+  transaction.Delete("key_0a");
+  transaction.Delete("key_9");
+
+  std::vector<std::string> keys;
+  auto it = transaction.NewIterator();
+  for (it->Seek("key_0"); it->Valid(); it->Next()) {
+    keys.emplace_back(it->key());
+  }
+  ASSERT_EQ((std::vector<std::string>{"key_0", "key_2", "key_4", "key_6"}),
+            keys);
+
+  // Seeking backwards restarts the scan of pending deletions.
+  it->Seek("key_3");
+  ASSERT_TRUE(it->Valid());
+  ASSERT_EQ("key_4", it->key());
+
+  // Restoring a deleted row ahead of the iterator makes it visible again.
+  transaction.Put("key_5", "restored");
+  it->Next();
+  ASSERT_TRUE(it->Valid());
+  ASSERT_EQ("key_5", it->key());
+  ASSERT_EQ("restored", it->value());
+  it->Next();
+  ASSERT_TRUE(it->Valid());
+  ASSERT_EQ("key_6", it->key());
+  it->Next();
+  ASSERT_FALSE(it->Valid());
+
+  std::string value;
+  ASSERT_TRUE(transaction.Get(absl::string_view("key_3"), &value).IsNotFound());
+  ASSERT_TRUE(transaction.Get(absl::string_view("key_4"), &value).ok());
+  ASSERT_EQ("value_4", value);
+}
+
 TEST_F(LevelDbTransactionTest, ToString) {
   std::string key = LevelDbMutationKey::Key("user1", 42);
   Message<firestore_client_WriteBatch> message;
@@ -314,6 +411,166 @@ TEST_F(LevelDbTransactionTest, ToString) {
             "  - Put [mutation: user_id=user1 batch_id=42] (2 bytes)>");
 }
 
+TEST_F(LevelDbTransactionTest, TracksByteSizesOfCommittedChanges) {
+  LevelDbSizeTracker tracker(db_.get());
+  ASSERT_EQ(tracker.total_byte_size(), 0);
+
+  std::string target_key = LevelDbTargetKey::Key(1);
+  std::string mutation_key = LevelDbMutationKey::Key("user1", 42);
+  {
+    LevelDbTransaction transaction(db_.get(), "Put");
+    transaction.set_size_tracker(&tracker);
+    transaction.Put(target_key, "0123456789");
+    transaction.Put(mutation_key, "01234");
+    transaction.Commit();
+  }
+
+  auto target_size = static_cast<int64_t>(target_key.size() + 10);
+  auto mutation_size = static_cast<int64_t>(mutation_key.size() + 5);
+  ASSERT_EQ(tracker.byte_size(LevelDbStore::kTargets), target_size);
+  ASSERT_EQ(tracker.byte_size(LevelDbStore::kMutations), mutation_size);
+  ASSERT_EQ(tracker.total_byte_size(), target_size + mutation_size);
+
+  {
+    // Overwriting a row of known size only accounts for the difference, and
+    // deleting a row that does not exist does not change anything.
+    LevelDbTransaction transaction(db_.get(), "Overwrite and delete");
+    transaction.set_size_tracker(&tracker);
+    transaction.RecordPreviousSize(target_key, 10);
+    transaction.Put(target_key, "01234");
+    transaction.RecordPreviousSize(mutation_key, 5);
+    transaction.Delete(mutation_key);
+    transaction.Delete(LevelDbMutationKey::Key("user1", 43));
+    transaction.Commit();
+  }
+
+  ASSERT_EQ(tracker.byte_size(LevelDbStore::kTargets), target_size - 5);
+  ASSERT_EQ(tracker.byte_size(LevelDbStore::kMutations), 0);
+}
+
+TEST_F(LevelDbTransactionTest, TracksByteSizesOfRowsWrittenBeforeTracker) {
+  std::string read_key = LevelDbTargetKey::Key(1);
+  std::string scanned_key = LevelDbTargetKey::Key(2);
+  std::string recorded_key = LevelDbTargetKey::Key(3);
+  std::string blind_key = LevelDbTargetKey::Key(4);
+  {
+    LevelDbTransaction transaction(db_.get(), "Put");
+    transaction.Put(read_key, "0123456789");
+    transaction.Put(scanned_key, "0123456789");
+    transaction.Put(recorded_key, "0123456789");
+    transaction.Put(blind_key, "0123456789");
+    transaction.Commit();
+  }
+  auto row_size = static_cast<int64_t>(read_key.size() + 10);
+
+  LevelDbSizeTracker tracker(db_.get());
+  ASSERT_EQ(tracker.total_byte_size(), 4 * row_size);
+  {
+    LevelDbTransaction transaction(db_.get(), "Change");
+    transaction.set_size_tracker(&tracker);
+
+    std::string value;
+    ASSERT_TRUE(transaction.Get(read_key, &value).ok());
+    transaction.Put(read_key, "01234");
+
+    auto it = transaction.NewIterator();
+    it->Seek(scanned_key);
+    ASSERT_TRUE(it->Valid());
+    transaction.Delete(it->key());
+
+    transaction.RecordPreviousSize(recorded_key, 10);
+    transaction.Delete(recorded_key);
+
+    // A row of unknown size is assumed not to exist, so rewriting it counts
+    // it twice.
+    transaction.Put(blind_key, "0123456789");
+    transaction.Commit();
+  }
+  ASSERT_EQ(tracker.total_byte_size(), 3 * row_size - 5);
+
+  // A full scan of the database finds the actual size.
+  LevelDbTransaction discard(db_.get(), "Discard");
+  LevelDbSizeTracker::Discard(&discard);
+  discard.Commit();
+  LevelDbSizeTracker recomputed(db_.get());
+  ASSERT_EQ(recomputed.total_byte_size(), 2 * row_size - 5);
+}
+
+TEST_F(LevelDbTransactionTest, RecomputesByteSizesAfterEstimatedChanges) {
+  std::string rewritten_key = LevelDbTargetKey::Key(1);
+  std::string deleted_key = LevelDbTargetKey::Key(2);
+  {
+    LevelDbTransaction transaction(db_.get(), "Put");
+    transaction.Put(rewritten_key, "0123456789");
+    transaction.Put(deleted_key, "0123456789");
+    transaction.Commit();
+  }
+  auto row_size = static_cast<int64_t>(rewritten_key.size() + 10);
+
+  {
+    LevelDbSizeTracker tracker(db_.get(), /* max_estimated_changes= */ 2);
+    ASSERT_EQ(tracker.total_byte_size(), 2 * row_size);
+
+    // A blind rewrite is counted as a new row.
+    LevelDbTransaction transaction(db_.get(), "Rewrite");
+    transaction.set_size_tracker(&tracker);
+    transaction.Put(rewritten_key, "0123456789");
+    transaction.Commit();
+    ASSERT_EQ(tracker.total_byte_size(), 3 * row_size);
+  }
+
+  // The number of estimated changes is persisted with the totals.
+  LevelDbSizeTracker tracker(db_.get(), /* max_estimated_changes= */ 2);
+  ASSERT_EQ(tracker.total_byte_size(), 3 * row_size);
+
+  {
+    // A blind delete is not subtracted.
+    LevelDbTransaction transaction(db_.get(), "Delete");
+    transaction.set_size_tracker(&tracker);
+    transaction.Delete(deleted_key);
+    transaction.Commit();
+  }
+  ASSERT_EQ(tracker.total_byte_size(), 3 * row_size);
+
+  // Having reached the limit of estimated changes, the totals are recomputed
+  // when next checked.
+  tracker.ResyncIfNeeded();
+  ASSERT_EQ(tracker.total_byte_size(), row_size);
+
+  LevelDbSizeTracker reloaded(db_.get(), /* max_estimated_changes= */ 2);
+  ASSERT_EQ(reloaded.total_byte_size(), row_size);
+}
+
+TEST_F(LevelDbTransactionTest, PersistsByteSizes) {
+  std::string key = LevelDbTargetKey::Key(1);
+  int64_t expected = 0;
+  {
+    LevelDbSizeTracker tracker(db_.get());
+    LevelDbTransaction transaction(db_.get(), "Put");
+    transaction.set_size_tracker(&tracker);
+    transaction.Put(key, "value");
+    transaction.Commit();
+    expected = tracker.total_byte_size();
+  }
+
+  // Writes made without a tracker are not accounted for until the totals are
+  // discarded and recomputed.
+  LevelDbTransaction untracked(db_.get(), "Untracked put");
+  untracked.Put(LevelDbTargetKey::Key(2), "value");
+  untracked.Commit();
+
+  LevelDbSizeTracker reloaded(db_.get());
+  ASSERT_EQ(reloaded.total_byte_size(), expected);
+
+  LevelDbTransaction discard(db_.get(), "Discard");
+  LevelDbSizeTracker::Discard(&discard);
+  discard.Commit();
+
+  LevelDbSizeTracker recomputed(db_.get());
+  ASSERT_EQ(recomputed.total_byte_size(), 2 * expected);
+  ASSERT_EQ(recomputed.byte_size(LevelDbStore::kTargets), 2 * expected);
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Firestore/core/src/api/settings.h"
+#include "Firestore/core/src/core/query.h"
+#include "Firestore/core/src/credentials/user.h"
+#include "Firestore/core/src/local/leveldb_persistence.h"
+#include "Firestore/core/src/local/leveldb_remote_document_cache.h"
+#include "Firestore/core/src/local/lru_garbage_collector.h"
+#include "Firestore/core/src/model/document_key.h"
+#include "Firestore/core/src/model/mutable_document.h"
+#include "Firestore/core/src/util/autoid.h"
+#include "Firestore/core/src/util/hard_assert.h"
+#include "Firestore/core/src/util/path.h"
+#include "Firestore/core/src/util/secure_random.h"
+#include "Firestore/core/test/unit/local/persistence_testing.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
+#include "benchmark/benchmark.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using api::PersistentCacheTuning;
+using credentials::User;
+using model::DocumentKey;
+using model::IndexOffset;
+using model::MutableDocument;
+using model::MutableDocumentMap;
+using testutil::Doc;
+using testutil::Map;
+using testutil::Version;
+using util::CreateAutoId;
+using util::Path;
+using util::SecureRandom;
+
+const int64_t kDocumentsPerTransaction = 1000;
+
+/** The tuning profiles compared by these benchmarks, indexed by `range(0)`. */
+PersistentCacheTuning Profile(int64_t index) {
+  switch (index) {
+    case 0:
+      return PersistentCacheTuning{};
+    case 1:
+      return PersistentCacheTuning{}.WithBloomFilterBitsPerKey(
+          PersistentCacheTuning::LargeCacheBloomFilterBitsPerKey);
+    case 2:
+      return PersistentCacheTuning::ForLargeCache();
+  }
+  UNREACHABLE();
+}
+
+/**
+ * A LevelDbPersistence populated with `count` documents in the "docs"
+ * collection. The database is reopened after writing so that the documents are
+ * read from table files rather than from the memtable.
+ */
+class PopulatedCache {
+ public:
+  PopulatedCache(const PersistentCacheTuning& tuning, int64_t count) {
+    Path dir = LevelDbDir();
+    persistence_ = Open(dir, PersistentCacheTuning{});
+    LevelDbRemoteDocumentCache* cache = persistence_->remote_document_cache();
+
+    std::string value(100, 'a');
+    for (int64_t written = 0; written < count;) {
+      persistence_->Run("PopulatedCache", [&] {
+        for (int64_t i = 0; i < kDocumentsPerTransaction && written < count;
+             ++i, ++written) {
+          MutableDocument doc =
+              Doc("docs/" + CreateAutoId(), 1, Map("value", value));
+          keys_.push_back(doc.key());
+          cache->Add(doc, Version(written + 1));
+        }
+      });
+    }
+
+    persistence_->Shutdown();
+    persistence_ = Open(dir, tuning);
+  }
+
+  LevelDbPersistence* persistence() {
+    return persistence_.get();
+  }
+
+  const std::vector<DocumentKey>& keys() const {
+    return keys_;
+  }
+
+ private:
+  static std::unique_ptr<LevelDbPersistence> Open(
+      const Path& dir, const PersistentCacheTuning& tuning) {
+    auto created = LevelDbPersistence::Create(dir, MakeLocalSerializer(),
+                                              LruParams::Default(), tuning);
+    HARD_ASSERT(created.ok(), "Failed to open leveldb: %s",
+                created.status().ToString());
+    auto persistence = std::move(created).ValueOrDie();
+    persistence->remote_document_cache()->SetIndexManager(
+        persistence->GetIndexManager(User::Unauthenticated()));
+    return persistence;
+  }
+
+  std::unique_ptr<LevelDbPersistence> persistence_;
+  std::vector<DocumentKey> keys_;
+};
+
+void BM_PointLookup(benchmark::State& state) {
+  PopulatedCache populated(Profile(state.range(0)), state.range(1));
+  LevelDbPersistence* persistence = populated.persistence();
+  const std::vector<DocumentKey>& keys = populated.keys();
+
+  SecureRandom rnd;
+  for (auto _ : state) {
+    const DocumentKey& key =
+        keys[rnd.Uniform(static_cast<uint32_t>(keys.size()))];
+    bool found = persistence->Run("BM_PointLookup", [&] {
+      return persistence->remote_document_cache()->Get(key).is_found_document();
+    });
+    HARD_ASSERT(found, "Document %s not found", key.ToString());
+  }
+}
+BENCHMARK(BM_PointLookup)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"profile", "documents"})
+    ->Args({0, 10000})
+    ->Args({1, 10000})
+    ->Args({2, 10000})
+    ->Args({0, 100000})
+    ->Args({1, 100000})
+    ->Args({2, 100000});
+
+void BM_PointLookupMissing(benchmark::State& state) {
+  PopulatedCache populated(Profile(state.range(0)), state.range(1));
+  LevelDbPersistence* persistence = populated.persistence();
+
+  for (auto _ : state) {
+    DocumentKey key = testutil::Key("docs/" + CreateAutoId());
+    bool found = persistence->Run("BM_PointLookupMissing", [&] {
+      return persistence->remote_document_cache()->Get(key).is_found_document();
+    });
+    HARD_ASSERT(!found, "Document %s unexpectedly found", key.ToString());
+  }
+}
+BENCHMARK(BM_PointLookupMissing)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"profile", "documents"})
+    ->Args({0, 10000})
+    ->Args({1, 10000})
+    ->Args({2, 10000})
+    ->Args({0, 100000})
+    ->Args({1, 100000})
+    ->Args({2, 100000});
+
+void BM_CollectionScan(benchmark::State& state) {
+  int64_t document_count = state.range(1);
+  PopulatedCache populated(Profile(state.range(0)), document_count);
+  LevelDbPersistence* persistence = populated.persistence();
+
+  core::Query query = testutil::Query("docs");
+  for (auto _ : state) {
+    MutableDocumentMap documents = persistence->Run("BM_CollectionScan", [&] {
+      return persistence->remote_document_cache()->GetDocumentsMatchingQuery(
+          query, IndexOffset::None());
+    });
+    HARD_ASSERT(static_cast<int64_t>(documents.size()) == document_count,
+                "Expected %s documents but read %s", document_count,
+                documents.size());
+  }
+  state.SetItemsProcessed(state.iterations() * document_count);
+}
+BENCHMARK(BM_CollectionScan)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"profile", "documents"})
+    ->Args({0, 10000})
+    ->Args({1, 10000})
+    ->Args({2, 10000})
+    ->Args({0, 100000})
+    ->Args({1, 100000})
+    ->Args({2, 100000});
+
+}  // namespace
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
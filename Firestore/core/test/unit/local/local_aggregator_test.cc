@@ -0,0 +1,125 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Firestore/core/src/local/local_aggregator.h"
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "Firestore/core/src/model/aggregate_alias.h"
+#include "Firestore/core/src/model/aggregate_field.h"
+#include "Firestore/core/src/model/document.h"
+#include "Firestore/core/src/model/field_path.h"
+#include "Firestore/core/src/model/value_util.h"
+#include "Firestore/core/test/unit/testutil/testutil.h"
+#include "gtest/gtest.h"
+
+namespace firebase {
+namespace firestore {
+namespace local {
+namespace {
+
+using model::AggregateAlias;
+using model::AggregateField;
+using model::Document;
+using model::FieldPath;
+using model::ObjectValue;
+using testutil::Doc;
+using testutil::Map;
+using testutil::Value;
+
+AggregateField Count() {
+  return AggregateField(AggregateField::OpKind::Count,
+                        AggregateAlias("count"));
+}
+
+AggregateField Sum(const std::string& field) {
+  return AggregateField(AggregateField::OpKind::Sum,
+                        AggregateAlias("sum_" + field),
+                        FieldPath::FromDotSeparatedString(field));
+}
+
+AggregateField Avg(const std::string& field) {
+  return AggregateField(AggregateField::OpKind::Avg,
+                        AggregateAlias("avg_" + field),
+                        FieldPath::FromDotSeparatedString(field));
+}
+
+google_firestore_v1_Value Get(const ObjectValue& result,
+                              const std::string& alias) {
+  absl::optional<google_firestore_v1_Value> value = result.Get(alias);
+  EXPECT_TRUE(value.has_value()) << "Missing aggregation " << alias;
+  return value.value_or(model::NullValue());
+}
+
+TEST(LocalAggregatorTest, ComputesCountSumAndAverage) {
+  LocalAggregator aggregator({Count(), Sum("n"), Avg("n")});
+  ASSERT_TRUE(aggregator.needs_documents());
+
+  aggregator.Add(Document(Doc("coll/a", 1, Map("n", 1))));
+  aggregator.Add(Document(Doc("coll/b", 1, Map("n", 2))));
+  aggregator.Add(Document(Doc("coll/c", 1, Map("n", "three"))));
+  aggregator.Add(Document(Doc("coll/d", 1, Map())));
+
+  ObjectValue result = aggregator.Result();
+  EXPECT_EQ(Get(result, "count"), *Value(4));
+  EXPECT_EQ(Get(result, "sum_n"), *Value(3));
+  EXPECT_EQ(Get(result, "avg_n"), *Value(1.5));
+}
+
+TEST(LocalAggregatorTest, SumsDoublesAsDouble) {
+  LocalAggregator aggregator({Sum("n")});
+  aggregator.Add(Document(Doc("coll/a", 1, Map("n", 1))));
+  aggregator.Add(Document(Doc("coll/b", 1, Map("n", 0.5))));
+
+  EXPECT_EQ(Get(aggregator.Result(), "sum_n"), *Value(1.5));
+}
+
+TEST(LocalAggregatorTest, SumsOverflowingIntegersAsDouble) {
+  int64_t max = std::numeric_limits<int64_t>::max();
+  LocalAggregator aggregator({Sum("n")});
+  aggregator.Add(Document(Doc("coll/a", 1, Map("n", max))));
+  aggregator.Add(Document(Doc("coll/b", 1, Map("n", max))));
+
+  EXPECT_EQ(Get(aggregator.Result(), "sum_n"),
+            *Value(static_cast<double>(max) * 2));
+}
+
+TEST(LocalAggregatorTest, AveragesNothingAsNull) {
+  LocalAggregator aggregator({Sum("n"), Avg("n")});
+  aggregator.Add(Document(Doc("coll/a", 1, Map("n", "one"))));
+
+  ObjectValue result = aggregator.Result();
+  EXPECT_EQ(Get(result, "sum_n"), *Value(0));
+  EXPECT_EQ(Get(result, "avg_n"), *Value(nullptr));
+}
+
+TEST(LocalAggregatorTest, CountsWithoutDocuments) {
+  LocalAggregator aggregator({Count()});
+  ASSERT_FALSE(aggregator.needs_documents());
+
+  aggregator.AddCount(100000);
+  aggregator.Add(Document(Doc("coll/a", 1, Map())));
+
+  EXPECT_EQ(aggregator.count(), 100001);
+  EXPECT_EQ(Get(aggregator.Result(), "count"), *Value(100001));
+}
+
+}  // namespace
+}  // namespace local
+}  // namespace firestore
+}  // namespace firebase
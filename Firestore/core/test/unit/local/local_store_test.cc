@@ -29,9 +29,12 @@
 #include "Firestore/core/src/local/index_backfiller.h"
 #include "Firestore/core/src/local/local_view_changes.h"
 #include "Firestore/core/src/local/local_write_result.h"
+#include "Firestore/core/src/local/materialized_query_results.h"
 #include "Firestore/core/src/local/persistence.h"
 #include "Firestore/core/src/local/query_result.h"
+#include "Firestore/core/src/local/target_cache.h"
 #include "Firestore/core/src/local/target_data.h"
+#include "Firestore/core/src/model/aggregate_field.h"
 #include "Firestore/core/src/model/delete_mutation.h"
 #include "Firestore/core/src/model/document.h"
 #include "Firestore/core/src/model/document_key.h"
@@ -42,6 +45,7 @@
 #include "Firestore/core/src/model/mutable_document.h"
 #include "Firestore/core/src/model/mutation.h"
 #include "Firestore/core/src/model/mutation_batch_result.h"
+#include "Firestore/core/src/model/object_value.h"
 #include "Firestore/core/src/model/patch_mutation.h"
 #include "Firestore/core/src/model/server_timestamp_util.h"
 #include "Firestore/core/src/model/set_mutation.h"
@@ -63,6 +67,8 @@ using bundle::BundleMetadata;
 using bundle::NamedQuery;
 using credentials::User;
 using local::QueryResult;
+using model::AggregateAlias;
+using model::AggregateField;
 using model::Document;
 using model::DocumentKey;
 using model::DocumentKeySet;
@@ -75,6 +81,7 @@ using model::MutationBatch;
 using model::MutationBatchResult;
 using model::MutationResult;
 using model::NumericIncrementTransform;
+using model::ObjectValue;
 using model::ResourcePath;
 using model::SnapshotVersion;
 using model::TargetId;
@@ -298,8 +305,16 @@ void LocalStoreTestBase::SetRelativeIndexReadCostPerDocument(double new_cost) {
 
 void LocalStoreTestBase::ApplyBundledDocuments(
     const std::vector<MutableDocument>& documents) {
-  last_changes_ =
-      local_store_.ApplyBundledDocuments(DocVectorToMap(documents), "");
+  // Loads the documents as a whole bundle, in a single chunk.
+  BundleMetadata metadata("", 1, testutil::Version(1));
+  local_store_.StartBundleLoad(metadata);
+  local_store_.StageBundledDocuments(DocVectorToMap(documents), metadata,
+                                     static_cast<uint32_t>(documents.size()));
+  last_changes_ = local_store_
+                      .ApplyStagedDocuments(
+                          metadata, static_cast<uint32_t>(documents.size()))
+                      .value_or(DocumentMap{});
+  local_store_.SaveBundle(metadata);
 }
 
 void LocalStoreTestBase::ResetPersistenceStats() {
@@ -924,6 +939,61 @@ TEST_P(LocalStoreTest, CanExecuteMixedCollectionQueries) {
           Document{Doc("foo/bonk", 0, Map("a", "b")).SetHasLocalMutations()}));
 }
 
+TEST_P(LocalStoreTest, CanExecuteReadOnlyQueries) {
+  core::Query query = Query("foo");
+  AllocateQuery(query);
+  FSTAssertTargetID(2);
+
+  ApplyRemoteEvent(
+      UpdateRemoteEvent(Doc("foo/baz", 10, Map("a", "b")), {2}, {}));
+  ApplyRemoteEvent(
+      UpdateRemoteEvent(Doc("foo/bar", 20, Map("a", "b")), {2}, {}));
+
+  local_store_.WriteLocally({testutil::SetMutation("foo/bonk", Map("a", "b"))});
+
+  QueryResult query_result = local_store_.ExecuteQueryReadOnly(query);
+  ASSERT_EQ(
+      DocMapToVector(query_result.documents()),
+      Vector(
+          Document{Doc("foo/bar", 20, Map("a", "b"))},
+          Document{Doc("foo/baz", 10, Map("a", "b"))},
+          Document{Doc("foo/bonk", 0, Map("a", "b")).SetHasLocalMutations()}));
+  ASSERT_EQ(query_result.snapshot_version(),
+            local_store_.GetLastRemoteSnapshotVersion());
+}
+
+TEST_P(LocalStoreTest, ExecutesAggregateQueriesWithPendingMutations) {
+  core::Query query = Query("foo");
+  AllocateQuery(query);
+  FSTAssertTargetID(2);
+
+  ApplyRemoteEvent(
+      UpdateRemoteEvent(Doc("foo/bar", 10, Map("n", 1)), {2}, {}));
+  ApplyRemoteEvent(
+      UpdateRemoteEvent(Doc("foo/baz", 20, Map("n", 2)), {2}, {}));
+  ApplyRemoteEvent(
+      UpdateRemoteEvent(Doc("foo/qux", 30, Map("n", 4)), {2}, {}));
+
+  local_store_.WriteLocally(
+      {testutil::PatchMutation("foo/bar", Map("n", 8)),
+       testutil::DeleteMutation("foo/baz"),
+       testutil::SetMutation("foo/bonk", Map("n", 16))});
+
+  std::vector<AggregateField> aggregates = {
+      AggregateField(AggregateField::OpKind::Count, AggregateAlias("count")),
+      AggregateField(AggregateField::OpKind::Sum, AggregateAlias("sum"),
+                     testutil::Field("n"))};
+  ObjectValue result = local_store_.ExecuteAggregateQuery(query, aggregates);
+  EXPECT_EQ(*result.Get("count"), *Value(3));
+  EXPECT_EQ(*result.Get("sum"), *Value(28));
+
+  result = local_store_.ExecuteAggregateQuery(
+      query.AddingOrderBy(testutil::OrderBy("n")).WithLimitToFirst(2),
+      aggregates);
+  EXPECT_EQ(*result.Get("count"), *Value(2));
+  EXPECT_EQ(*result.Get("sum"), *Value(12));
+}
+
 TEST_P(LocalStoreTest, ReadsAllDocumentsForInitialCollectionQueries) {
   core::Query query = Query("foo");
   local_store_.AllocateTarget(query.ToTarget());
@@ -1186,6 +1256,50 @@ TEST_P(LocalStoreTest, QueriesIncludeLocallyModifiedDocuments) {
   FSTAssertQueryReturned("foo/a", "foo/b");
 }
 
+TEST_P(LocalStoreTest, UsesMaterializedQueryResults) {
+  local_store_.SetQueryResultMaterializationEnabled(true);
+
+  core::Query query =
+      Query("foo").AddingFilter(testutil::Filter("matches", "==", true));
+  TargetId target_id = AllocateQuery(query);
+
+  MutableDocument doc_a = Doc("foo/a", 10, Map("matches", true));
+  ApplyRemoteEvent(AddedRemoteEvent(
+      {doc_a, Doc("foo/b", 10, Map("matches", false))}, {target_id}));
+  ApplyRemoteEvent(NoChangeEvent(target_id, 10));
+  NotifyLocalViewChanges(LocalViewChanges(
+      target_id, /* from_cache= */ false, {}, {},
+      testutil::DocSet(query.Comparator(), {Document(doc_a)})));
+  auto read_stored_results = [&] {
+    return persistence_->Run("GetQueryResults", [&] {
+      return persistence_->target_cache()->GetQueryResults(target_id);
+    });
+  };
+  absl::optional<MaterializedQueryResults> stored = read_stored_results();
+  ASSERT_TRUE(stored.has_value());
+  ASSERT_EQ(stored->documents().size(), 1u);
+
+  // Only the materialized document is read, not every document in the target
+  // mapping.
+  ExecuteQuery(query);
+  FSTAssertRemoteDocumentsRead(/* by_key= */ 1, /* by_query= */ 0);
+  FSTAssertQueryReturned("foo/a");
+
+  // Snapshots that don't change the target's keys don't rewrite the results.
+  NotifyLocalViewChanges(
+      LocalViewChanges(target_id, /* from_cache= */ false, {}, {},
+                       testutil::DocSet(query.Comparator(), {})));
+  EXPECT_EQ(read_stored_results(), stored);
+  ExecuteQuery(query);
+  FSTAssertRemoteDocumentsRead(/* by_key= */ 1, /* by_query= */ 0);
+  FSTAssertQueryReturned("foo/a");
+
+  // A newly matching document makes the results stale.
+  WriteMutation(testutil::SetMutation("foo/c", Map("matches", true)));
+  ExecuteQuery(query);
+  FSTAssertQueryReturned("foo/a", "foo/c");
+}
+
 TEST_P(LocalStoreTest, QueriesIncludeDocumentsFromOtherQueries) {
   if (IsGcEager()) return;
 
@@ -1398,6 +1512,44 @@ TEST_P(LocalStoreTest, HandlesSavingBundledDocuments) {
   FSTAssertQueryDocumentMapping(2, expected_keys);
 }
 
+TEST_P(LocalStoreTest, ResumesInterruptedBundleLoad) {
+  BundleMetadata metadata("bundle", 1, testutil::Version(1));
+  ASSERT_EQ(local_store_.StartBundleLoad(metadata), 0u);
+  local_store_.StageBundledDocuments(DocVectorToMap({Doc("foo/a", 1, Map())}),
+                                     metadata, 1);
+  FSTAssertNotContains("foo/a");
+
+  // Loading the bundle again skips the staged document but still applies it.
+  ASSERT_EQ(local_store_.StartBundleLoad(metadata), 1u);
+  local_store_.StageBundledDocuments(DocVectorToMap({Doc("foo/b", 1, Map())}),
+                                     metadata, 2);
+  last_changes_ = local_store_.ApplyStagedDocuments(metadata, 1).value();
+  FSTAssertQueryDocumentMapping(2, DocumentKeySet({Key("foo/a")}));
+  last_changes_ = local_store_.ApplyStagedDocuments(metadata, 1).value();
+  FSTAssertQueryDocumentMapping(
+      2, DocumentKeySet({Key("foo/a"), Key("foo/b")}));
+  ASSERT_FALSE(local_store_.ApplyStagedDocuments(metadata, 1).has_value());
+  FSTAssertContains(Doc("foo/a", 1, Map()));
+  FSTAssertContains(Doc("foo/b", 1, Map()));
+
+  // Saving the bundle ends the load, so the next one starts over.
+  local_store_.SaveBundle(metadata);
+  ASSERT_EQ(local_store_.StartBundleLoad(metadata), 0u);
+  FSTAssertQueryDocumentMapping(2, DocumentKeySet{});
+}
+
+TEST_P(LocalStoreTest, DiscardsStagedDocumentsOfAbortedBundleLoad) {
+  BundleMetadata metadata("bundle", 1, testutil::Version(1));
+  ASSERT_EQ(local_store_.StartBundleLoad(metadata), 0u);
+  local_store_.StageBundledDocuments(DocVectorToMap({Doc("foo/a", 1, Map())}),
+                                     metadata, 1);
+
+  local_store_.AbortBundleLoad(metadata);
+  ASSERT_EQ(local_store_.StartBundleLoad(metadata), 0u);
+  ASSERT_FALSE(local_store_.ApplyStagedDocuments(metadata, 1).has_value());
+  FSTAssertNotContains("foo/a");
+}
+
 TEST_P(LocalStoreTest, HandlesSavingBundledDocumentsWithNewerExistingVersion) {
   core::Query query = Query("foo");
   AllocateQuery(query);
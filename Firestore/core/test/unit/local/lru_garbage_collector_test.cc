@@ -16,6 +16,7 @@
 
 #include "Firestore/core/test/unit/local/lru_garbage_collector_test.h"
 
+#include <chrono>  // NOLINT(build/c++11)
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -37,6 +38,7 @@
 #include "Firestore/core/src/model/mutation_batch.h"
 #include "Firestore/core/src/model/precondition.h"
 #include "Firestore/core/src/model/set_mutation.h"
+#include "Firestore/core/src/model/snapshot_version.h"
 #include "Firestore/core/src/model/types.h"
 #include "Firestore/core/src/util/statusor.h"
 #include "Firestore/core/test/unit/testutil/status_testing.h"
@@ -58,11 +60,13 @@ using model::Mutation;
 using model::ObjectValue;
 using model::Precondition;
 using model::SetMutation;
+using model::SnapshotVersion;
 using model::TargetId;
 using util::StatusOr;
 
 using testutil::Key;
 using testutil::Query;
+using testutil::ResumeToken;
 using testutil::Version;
 using testutil::WrapObject;
 
@@ -766,6 +770,108 @@ TEST_P(LruGarbageCollectorTest, GCRan) {
   ASSERT_EQ(100, results.documents_removed);
 }
 
+TEST_P(LruGarbageCollectorTest, GCRunsInSlices) {
+  LruParams params = LruParams::Default();
+  params.min_bytes_threshold = 100;
+  params.documents_per_slice = 30;
+  // Only the document budget should limit the slices.
+  params.slice_duration = std::chrono::minutes(1);
+  NewTestResources(params);
+
+  for (int i = 0; i < 100; i++) {
+    persistence_->Run("Add a target and some documents", [&] {
+      TargetData target_data = AddNextQueryInTransaction();
+      for (int j = 0; j < 10; j++) {
+        MutableDocument doc = CacheADocumentInTransaction();
+        AddDocument(doc.key(), target_data.target_id());
+      }
+    });
+  }
+
+  LruCheckpoint checkpoint = persistence_->Run(
+      "Start GC", [&] { return gc_->StartCollection(); });
+  int slices = 0;
+  while (!checkpoint.complete) {
+    persistence_->Run("GC slice", [&] { gc_->CollectSlice({}, &checkpoint); });
+    slices++;
+    ASSERT_LE(slices, 100) << "Garbage collection made no progress";
+  }
+
+  // The results match a collection in a single transaction, plus one timing
+  // for starting the collection and one for each slice.
+  const LruResults& results = checkpoint.results;
+  ASSERT_TRUE(results.did_run);
+  ASSERT_EQ(10, results.targets_removed);
+  ASSERT_EQ(100, results.documents_removed);
+  ASSERT_EQ(results.slice_durations.size(), static_cast<size_t>(slices + 1));
+}
+
+TEST_P(LruGarbageCollectorTest, SlicedGCRemovesLargeTargetsAcrossSlices) {
+  LruParams params = LruParams::Default();
+  params.min_bytes_threshold = 100;
+  params.documents_per_slice = 30;
+  params.slice_duration = std::chrono::minutes(1);
+  NewTestResources(params);
+
+  // Of ten targets, only the oldest is collected.
+  TargetData large_target = persistence_->Run("Add a large target", [&] {
+    TargetData target_data =
+        NextTestQuery().WithResumeToken(ResumeToken(1000), Version(1000));
+    target_cache_->AddTarget(target_data);
+    for (int i = 0; i < 100; i++) {
+      MutableDocument doc = CacheADocumentInTransaction();
+      AddDocument(doc.key(), target_data.target_id());
+    }
+    return target_data;
+  });
+  for (int i = 0; i < 9; i++) {
+    AddNextQuery();
+  }
+
+  LruCheckpoint checkpoint = persistence_->Run(
+      "Start GC", [&] { return gc_->StartCollection(); });
+  ASSERT_FALSE(checkpoint.complete);
+  ASSERT_EQ(0, checkpoint.results.targets_removed);
+
+  persistence_->Run("GC slice", [&] { gc_->CollectSlice({}, &checkpoint); });
+  persistence_->Run("Check the target", [&] {
+    absl::optional<TargetData> cached =
+        target_cache_->GetTarget(large_target.target());
+    if (checkpoint.targets_complete) {
+      ASSERT_FALSE(cached.has_value());
+    } else {
+      // The target is only partially removed, so it cannot be resumed.
+      ASSERT_TRUE(cached.has_value());
+      ASSERT_TRUE(cached->resume_token().empty());
+      ASSERT_EQ(cached->snapshot_version(), SnapshotVersion::None());
+    }
+  });
+
+  int slices = 1;
+  while (!checkpoint.complete) {
+    persistence_->Run("GC slice", [&] { gc_->CollectSlice({}, &checkpoint); });
+    slices++;
+    ASSERT_LE(slices, 100) << "Garbage collection made no progress";
+  }
+
+  const LruResults& results = checkpoint.results;
+  ASSERT_EQ(1, results.targets_removed);
+  ASSERT_EQ(100, results.documents_removed);
+  persistence_->Run("Check the target", [&] {
+    ASSERT_FALSE(target_cache_->GetTarget(large_target.target()).has_value());
+  });
+}
+
+TEST_P(LruGarbageCollectorTest, SlicedGCSkippedWhenCacheTooSmall) {
+  // The default threshold is much larger than the empty cache.
+  NewTestResources();
+
+  LruCheckpoint checkpoint = persistence_->Run(
+      "Start GC", [&] { return gc_->StartCollection(); });
+  ASSERT_TRUE(checkpoint.complete);
+  ASSERT_FALSE(checkpoint.results.did_run);
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
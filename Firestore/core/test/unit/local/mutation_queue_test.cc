@@ -230,6 +230,7 @@ TEST_P(MutationQueueTest, AllMutationBatchesAffectingDocumentKey) {
         testutil::SetMutation("foo/bar/suffix/key", Map("a", 1)),
         testutil::SetMutation("foo/baz", Map("a", 1)),
         testutil::SetMutation("food/bar", Map("a", 1)),
+        testutil::SetMutation("foo/bar/foo/baz", Map("a", 1)),
     };
 
     // Store all the mutations.
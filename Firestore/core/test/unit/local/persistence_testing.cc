@@ -18,6 +18,7 @@
 
 #include <utility>
 
+#include "Firestore/core/src/api/settings.h"
 #include "Firestore/core/src/local/leveldb_persistence.h"
 #include "Firestore/core/src/local/local_serializer.h"
 #include "Firestore/core/src/local/lru_garbage_collector.h"
@@ -64,9 +65,9 @@ Path LevelDbDir() {
 }
 
 std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
-    Path dir, LruParams lru_params) {
-  auto created =
-      LevelDbPersistence::Create(dir, MakeLocalSerializer(), lru_params);
+    Path dir, LruParams lru_params, const api::PersistentCacheTuning& tuning) {
+  auto created = LevelDbPersistence::Create(dir, MakeLocalSerializer(),
+                                            lru_params, tuning);
   if (!created.ok()) {
     util::ThrowIllegalState("Failed to open leveldb in dir %s: %s",
                             dir.ToUtf8String(), created.status().ToString());
@@ -74,6 +75,12 @@ std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
   return std::move(created).ValueOrDie();
 }
 
+std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
+    Path dir, LruParams lru_params) {
+  return LevelDbPersistenceForTesting(std::move(dir), lru_params,
+                                      api::PersistentCacheTuning{});
+}
+
 std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(Path dir) {
   return LevelDbPersistenceForTesting(std::move(dir), LruParams::Default());
 }
@@ -83,6 +90,12 @@ std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
   return LevelDbPersistenceForTesting(LevelDbDir(), lru_params);
 }
 
+std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
+    const api::PersistentCacheTuning& tuning) {
+  return LevelDbPersistenceForTesting(LevelDbDir(), LruParams::Default(),
+                                      tuning);
+}
+
 std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting() {
   return LevelDbPersistenceForTesting(LevelDbDir());
 }
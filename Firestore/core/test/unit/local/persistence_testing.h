@@ -23,6 +23,12 @@
 
 namespace firebase {
 namespace firestore {
+namespace api {
+
+class PersistentCacheTuning;
+
+}  // namespace api
+
 namespace util {
 
 class Path;
@@ -75,6 +81,25 @@ std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
 std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
     LruParams lru_params);
 
+/**
+ * Creates and starts a new LevelDbPersistence instance for testing, destroying
+ * any previous contents if they existed.
+ *
+ * Opens the database with the provided storage engine tuning.
+ */
+std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
+    const api::PersistentCacheTuning& tuning);
+
+/**
+ * Creates and starts a new LevelDbPersistence instance for testing with the
+ * provided LRU params and storage engine tuning. Does not delete any data
+ * present in the given directory.
+ */
+std::unique_ptr<LevelDbPersistence> LevelDbPersistenceForTesting(
+    util::Path dir,
+    LruParams lru_params,
+    const api::PersistentCacheTuning& tuning);
+
 /** Creates and starts a new MemoryPersistence instance for testing. */
 std::unique_ptr<MemoryPersistence> MemoryPersistenceWithEagerGcForTesting();
 
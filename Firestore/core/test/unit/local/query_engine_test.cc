@@ -29,6 +29,8 @@
 #include "Firestore/core/src/local/persistence.h"
 #include "Firestore/core/src/local/remote_document_cache.h"
 #include "Firestore/core/src/local/target_cache.h"
+#include "Firestore/core/src/model/aggregate_alias.h"
+#include "Firestore/core/src/model/aggregate_field.h"
 #include "Firestore/core/src/model/delete_mutation.h"
 #include "Firestore/core/src/model/document_key_set.h"
 #include "Firestore/core/src/model/model_fwd.h"
@@ -54,6 +56,7 @@ using local::Persistence;
 using local::QueryEngine;
 using local::RemoteDocumentCache;
 using local::TargetCache;
+using model::AggregateField;
 using model::BatchId;
 using model::DeleteMutation;
 using model::DocumentKey;
@@ -977,6 +980,35 @@ TEST_P(QueryEngineTest, InAndNotInFiltersWithObjectValues) {
   });
 }
 
+TEST_P(QueryEngineTest, AggregatesLocalViewByFullCollectionScan) {
+  persistence_->Run("AggregatesLocalViewByFullCollectionScan", [&] {
+    mutation_queue_->Start();
+    index_manager_->Start();
+
+    AddDocuments({Doc("coll/a", 1, Map("matches", true, "n", 1)),
+                  Doc("coll/b", 1, Map("matches", false, "n", 2)),
+                  Doc("coll/c", 1, Map("matches", true, "n", 4)),
+                  Doc("coll/a/sub/d", 1, Map("matches", true, "n", 8))});
+    // Overlays apply to scanned documents and add documents of their own.
+    AddMutation(testutil::PatchMutation("coll/b", Map("matches", true)));
+    AddMutation(testutil::DeleteMutation("coll/c"));
+    AddMutation(testutil::SetMutation("coll/e", Map("matches", true, "n", 16)));
+
+    std::vector<AggregateField> aggregates = {
+        AggregateField(AggregateField::OpKind::Count,
+                       model::AggregateAlias("count")),
+        AggregateField(AggregateField::OpKind::Sum,
+                       model::AggregateAlias("sum"), testutil::Field("n"))};
+    core::Query query =
+        Query("coll").AddingFilter(Filter("matches", "==", true));
+
+    ObjectValue result = query_engine_.ComputeAggregates(
+        query, aggregates, kMissingLastLimboFreeSnapshot, DocumentKeySet{});
+    EXPECT_EQ(*result.Get("count"), *testutil::Value(3));
+    EXPECT_EQ(*result.Get("sum"), *testutil::Value(19));
+  });
+}
+
 }  // namespace local
 }  // namespace firestore
 }  // namespace firebase
@@ -17,10 +17,12 @@
 #include "Firestore/core/test/unit/local/remote_document_cache_test.h"
 
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "Firestore/core/src/core/query.h"
 #include "Firestore/core/src/credentials/user.h"
+#include "Firestore/core/src/local/collection_statistics.h"
 #include "Firestore/core/src/local/memory_remote_document_cache.h"
 #include "Firestore/core/src/local/persistence.h"
 #include "Firestore/core/src/local/remote_document_cache.h"
@@ -32,6 +34,7 @@
 #include "Firestore/core/src/nanopb/message.h"
 #include "Firestore/core/src/util/string_apple.h"
 #include "Firestore/core/test/unit/testutil/testutil.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "gmock/gmock.h"
@@ -153,6 +156,37 @@ TEST_P(RemoteDocumentCacheTest,
       });
 }
 
+TEST_P(RemoteDocumentCacheTest, CountsEntriesWithoutReadingThem) {
+  persistence_->Run("test_counts_entries_without_reading_them", [&] {
+    SetTestDocument(kDocPath);
+    MutableDocument deleted_doc = DeletedDoc(kLongDocPath, kVersion);
+    cache_->Add(deleted_doc, deleted_doc.version());
+
+    EXPECT_EQ(cache_->CountEntries(DocumentKeySet{}), 0u);
+    EXPECT_EQ(cache_->CountEntries(DocumentKeySet{
+                  Key(kDocPath), Key(kLongDocPath), Key("foo/nonexistent")}),
+              2u);
+
+    cache_->Remove(Key(kDocPath));
+    EXPECT_EQ(cache_->CountEntries(DocumentKeySet{Key(kDocPath)}), 0u);
+  });
+}
+
+TEST_P(RemoteDocumentCacheTest, CountsDocumentsInCollection) {
+  persistence_->Run("test_counts_documents_in_collection", [&] {
+    SetTestDocument("a/1");
+    SetTestDocument("b/1");
+    SetTestDocument("b/1/z/1");
+    MutableDocument deleted_doc = DeletedDoc("b/2", kVersion);
+    cache_->Add(deleted_doc, deleted_doc.version());
+
+    // Deleted documents count, but documents in subcollections do not.
+    EXPECT_EQ(cache_->CountDocuments(testutil::Resource("b")), 2u);
+    EXPECT_EQ(cache_->CountDocuments(testutil::Resource("b/1/z")), 1u);
+    EXPECT_EQ(cache_->CountDocuments(testutil::Resource("c")), 0u);
+  });
+}
+
 TEST_P(RemoteDocumentCacheTest, SetAndReadADocumentAtDeepPath) {
   SetAndReadTestDocument(kLongDocPath);
 }
@@ -193,6 +227,19 @@ TEST_P(RemoteDocumentCacheTest, RemoveNonExistentDocument) {
   });
 }
 
+TEST_P(RemoteDocumentCacheTest, RemoveDocumentUpdatesCollectionStatistics) {
+  CollectionStatistics statistics;
+  cache_->SetCollectionStatistics(&statistics);
+  statistics.RecordCollectionScan(testutil::Resource("a"), 2);
+
+  persistence_->Run("test_remove_document_updates_collection_statistics", [&] {
+    SetTestDocument(kDocPath);
+    cache_->Remove(Key(kDocPath));
+  });
+
+  EXPECT_EQ(statistics.GetDocumentCount(testutil::Resource("a")), 1u);
+}
+
 // TODO(mikelehen): Write more elaborate tests once we have more elaborate
 // implementations.
 TEST_P(RemoteDocumentCacheTest, DocumentsMatchingQuery) {
@@ -216,6 +263,27 @@ TEST_P(RemoteDocumentCacheTest, DocumentsMatchingQuery) {
   });
 }
 
+TEST_P(RemoteDocumentCacheTest, DocumentsMatchingQuerySkipsRemovedDocuments) {
+  persistence_->Run("test_documents_matching_query_skips_removed", [&] {
+    // Removing runs of documents leaves gaps of varying length between the
+    // documents that remain.
+    std::vector<MutableDocument> docs;
+    for (int i = 0; i < 100; ++i) {
+      std::string path = absl::StrCat("b/", 1000 + i);
+      SetTestDocument(path);
+      if (i % 20 < 12 && i % 3 != 0) {
+        cache_->Remove(Key(path));
+      } else {
+        docs.push_back(Doc(path, kVersion, Map("a", 1, "b", 2)));
+      }
+    }
+
+    MutableDocumentMap results = cache_->GetDocumentsMatchingQuery(
+        Query("b"), model::IndexOffset::None());
+    EXPECT_THAT(results, HasExactlyDocs(docs));
+  });
+}
+
 TEST_P(RemoteDocumentCacheTest, DocumentsMatchingQuerySinceReadTime) {
   persistence_->Run("test_documents_matching_query_since_read_time", [&] {
     SetTestDocument("b/old", /* updateTime= */ 1, /* readTime= */ 11);
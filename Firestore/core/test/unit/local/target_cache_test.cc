@@ -23,6 +23,7 @@
 
 #include "Firestore/core/src/core/field_filter.h"
 #include "Firestore/core/src/immutable/sorted_set.h"
+#include "Firestore/core/src/local/materialized_query_results.h"
 #include "Firestore/core/src/local/persistence.h"
 #include "Firestore/core/src/local/target_cache.h"
 #include "Firestore/core/src/local/target_data.h"
@@ -265,6 +266,48 @@ TEST_P(TargetCacheTest, RemoveTargetsRemovesMatchingKeysToo) {
   });
 }
 
+TEST_P(TargetCacheTest, SetAndReadQueryResults) {
+  persistence_->Run("test_set_and_read_query_results", [&] {
+    TargetData rooms = MakeTargetData(query_rooms_);
+    cache_->AddTarget(rooms);
+    ASSERT_EQ(cache_->GetQueryResults(rooms.target_id()), absl::nullopt);
+
+    MaterializedQueryResults results(
+        Version(10), {{Key("rooms/foo"), Version(3)},
+                      {Key("rooms/bar/messages/baz"), Version(7)},
+                      {Key("rooms/abc"), Version(5)}});
+    cache_->SetQueryResults(rooms.target_id(), results);
+    EXPECT_EQ(cache_->GetQueryResults(rooms.target_id()), results);
+
+    MaterializedQueryResults empty(Version(11), {});
+    cache_->SetQueryResults(rooms.target_id(), empty);
+    EXPECT_EQ(cache_->GetQueryResults(rooms.target_id()), empty);
+
+    cache_->RemoveQueryResults(rooms.target_id());
+    EXPECT_EQ(cache_->GetQueryResults(rooms.target_id()), absl::nullopt);
+  });
+}
+
+TEST_P(TargetCacheTest, RemoveTargetsRemovesQueryResultsToo) {
+  persistence_->Run("test_remove_targets_removes_query_results_too", [&] {
+    TargetData rooms = MakeTargetData(query_rooms_);
+    cache_->AddTarget(rooms);
+    TargetData halls = MakeTargetData(testutil::Query("halls"));
+    cache_->AddTarget(halls);
+
+    MaterializedQueryResults results(Version(10),
+                                     {{Key("rooms/foo"), Version(3)}});
+    cache_->SetQueryResults(rooms.target_id(), results);
+    cache_->SetQueryResults(halls.target_id(), results);
+
+    cache_->RemoveTarget(rooms);
+    EXPECT_EQ(cache_->GetQueryResults(rooms.target_id()), absl::nullopt);
+
+    cache_->RemoveTargets(halls.sequence_number(), {});
+    EXPECT_EQ(cache_->GetQueryResults(halls.target_id()), absl::nullopt);
+  });
+}
+
 TEST_P(TargetCacheTest, AddOrRemoveMatchingKeys) {
   persistence_->Run("test_add_or_remove_matching_keys", [&] {
     DocumentKey key = Key("foo/bar");
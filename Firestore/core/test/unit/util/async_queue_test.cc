@@ -67,6 +67,22 @@ TEST_P(AsyncQueueTest, EnqueueRelaxedWorksFromWithinEnqueue) {
   Await(ran);
 }
 
+TEST_P(AsyncQueueTest, CountsPendingOperations) {
+  Expectation ran;
+  // clang-format off
+  queue->Enqueue([&] {
+    EXPECT_FALSE(queue->HasPendingOperations());
+    queue->EnqueueRelaxed([&] {
+      EXPECT_FALSE(queue->HasPendingOperations());
+      ran.Fulfill();
+    });
+    EXPECT_TRUE(queue->HasPendingOperations());
+  });
+  // clang-format on
+
+  Await(ran);
+}
+
 TEST_P(AsyncQueueTest, EnqueueBlocking) {
   bool finished = false;
   queue->EnqueueBlocking([&] { finished = true; });